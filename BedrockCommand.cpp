@@ -45,6 +45,8 @@ BedrockCommand::BedrockCommand(SQLiteCommand&& from, int dontCount) :
     peekedBy(nullptr),
     processedBy(nullptr),
     repeek(false),
+    holdID(0),
+    holdUntil(0),
     onlyProcessOnSyncThread(false),
     crashIdentifyingValues(*this),
     peekData(nullptr),
@@ -68,6 +70,8 @@ BedrockCommand::BedrockCommand(BedrockCommand&& from) :
     peekedBy(from.peekedBy),
     processedBy(from.processedBy),
     repeek(from.repeek),
+    holdID(from.holdID),
+    holdUntil(from.holdUntil),
     timingInfo(from.timingInfo),
     onlyProcessOnSyncThread(from.onlyProcessOnSyncThread),
     crashIdentifyingValues(*this, move(from.crashIdentifyingValues)),
@@ -94,6 +98,8 @@ BedrockCommand::BedrockCommand(SData&& _request) :
     peekedBy(nullptr),
     processedBy(nullptr),
     repeek(false),
+    holdID(0),
+    holdUntil(0),
     onlyProcessOnSyncThread(false),
     crashIdentifyingValues(*this),
     peekData(nullptr),
@@ -114,6 +120,8 @@ BedrockCommand::BedrockCommand(SData _request) :
     peekedBy(nullptr),
     processedBy(nullptr),
     repeek(false),
+    holdID(0),
+    holdUntil(0),
     onlyProcessOnSyncThread(false),
     crashIdentifyingValues(*this),
     peekData(nullptr),
@@ -150,6 +158,8 @@ BedrockCommand& BedrockCommand::operator=(BedrockCommand&& from) {
         peekedBy = from.peekedBy;
         processedBy = from.processedBy;
         repeek = from.repeek;
+        holdID = from.holdID;
+        holdUntil = from.holdUntil;
         priority = from.priority;
         timingInfo = from.timingInfo;
         onlyProcessOnSyncThread = from.onlyProcessOnSyncThread;
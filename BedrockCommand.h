@@ -81,6 +81,13 @@ class BedrockCommand : public SQLiteCommand {
     // all HTTPS requests are complete. It will be automatically cleared if the command throws an exception.
     bool repeek;
 
+    // A plugin can set `holdID` in `peek` (to an ID from `BedrockServer::getHoldID`) to have the server hold this
+    // command, rather than respond to it, until the plugin passes the same ID to `BedrockServer::wakeCommand`, at which
+    // point it's peeked again. If `holdUntil` is set, the command is also woken at that time. If the command times out
+    // while it's held, it gets whatever response `peek` gave it.
+    uint64_t holdID;
+    uint64_t holdUntil;
+
     // A list of timing sets, with an info type, start, and end.
     list<tuple<TIMING_INFO, uint64_t, uint64_t>> timingInfo;
 
@@ -9,15 +9,17 @@ void BedrockCommandQueue::stopTiming(BedrockCommand& command) {
 }
 
 BedrockCommandQueue::BedrockCommandQueue() :
-  SScheduledPriorityQueue<BedrockCommand>(function<void(BedrockCommand&)>(startTiming), function<void(BedrockCommand&)>(stopTiming))
+  SShardedScheduledPriorityQueue<BedrockCommand>(function<void(BedrockCommand&)>(startTiming), function<void(BedrockCommand&)>(stopTiming))
 { }
 
 list<string> BedrockCommandQueue::getRequestMethodLines() {
     list<string> returnVal;
-    SAUTOLOCK(_queueMutex);
-    for (auto& queue : _queue) {
-        for (auto& entry : queue.second) {
-            returnVal.push_back(entry.second.item.request.methodLine);
+    for (auto& shard : _shards) {
+        lock_guard<decltype(shard->queueMutex)> lock(shard->queueMutex);
+        for (auto& queue : shard->queue) {
+            for (auto& entry : queue.second) {
+                returnVal.push_back(entry.second.item.request.methodLine);
+            }
         }
     }
     return returnVal;
@@ -27,40 +29,38 @@ void BedrockCommandQueue::abandonFutureCommands(int msInFuture) {
     // We're going to delete every command scehduled after this timestamp.
     uint64_t timeLimit = STimeNow() + msInFuture * 1000;
 
-    // Lock around changes to the queue.
-    unique_lock<mutex> queueLock(_queueMutex);
+    // Each shard is handled independently, under its own lock.
+    size_t numberErased = 0;
+    for (auto& shard : _shards) {
+        lock_guard<decltype(shard->queueMutex)> lock(shard->queueMutex);
 
-    // We're going to look at each queue by priority. It's possible we'll end up removing *everything* from multiple
-    // queues. In that case, we need to remove the queues themselves, so we keep a list of queues to delete when we're
-    // done operating on each of them (so that we don't delete them while iterating over them).
-    list<typename decltype(_queue)::iterator> toDelete;
-    for (typename decltype(_queue)::iterator queueMapIt = _queue.begin(); queueMapIt != _queue.end(); ++queueMapIt) {
-        // Starting from the first item, skip any items that have a valid scheduled time.
-        auto commandMapIt = queueMapIt->second.begin();
-        while (commandMapIt != queueMapIt->second.end() && commandMapIt->first < timeLimit) {
-            commandMapIt++;
-        }
-
-        // Whatever's left in the queue is scheduled in the future and can be erased.
-        size_t numberToErase = distance(commandMapIt, queueMapIt->second.end());
-        if (numberToErase) {
-            queueMapIt->second.erase(commandMapIt, queueMapIt->second.end());
-        }
+        // We're going to look at each queue by priority. It's possible we'll end up removing *everything* from
+        // multiple queues, in which case we remove the queues themselves as well.
+        for (auto queueMapIt = shard->queue.begin(); queueMapIt != shard->queue.end();) {
+            // Starting from the first item, skip any items that have a valid scheduled time.
+            auto commandMapIt = queueMapIt->second.lower_bound(timeLimit);
 
-        // If the whole queue is empty, save it for deletion.
-        if (queueMapIt->second.empty()) {
-            toDelete.push_back(queueMapIt);
-        }
+            // Whatever's left in the queue is scheduled in the future and can be erased, along with its timeout.
+            while (commandMapIt != queueMapIt->second.end()) {
+                shard->timeouts.cancel(commandMapIt->second.timerID);
+                commandMapIt = queueMapIt->second.erase(commandMapIt);
+                numberErased++;
+                _size--;
+            }
 
-        // If we deleted any commands, log that.
-        if (numberToErase) {
-            SINFO("Erased " << numberToErase << " commands scheduled more than " << msInFuture << "ms in the future.");
+            // If the whole queue is empty, delete it.
+            if (queueMapIt->second.empty()) {
+                queueMapIt = shard->queue.erase(queueMapIt);
+            } else {
+                ++queueMapIt;
+            }
         }
+        _updateHints(*shard);
     }
 
-    // Delete any empty queues.
-    for (auto& it : toDelete) {
-        _queue.erase(it);
+    // If we deleted any commands, log that.
+    if (numberErased) {
+        SINFO("Erased " << numberErased << " commands scheduled more than " << msInFuture << "ms in the future.");
     }
 }
 
@@ -68,5 +68,5 @@ void BedrockCommandQueue::push(BedrockCommand&& command) {
     BedrockCommand::Priority priority = command.priority;
     uint64_t executionTime = command.request.calcU64("commandExecuteTime");
     uint64_t timeout = command.timeout();
-    SScheduledPriorityQueue<BedrockCommand>::push(move(command), priority, executionTime, timeout);
+    SShardedScheduledPriorityQueue<BedrockCommand>::push(move(command), priority, executionTime, timeout);
 }
@@ -1,9 +1,9 @@
 #pragma once
 #include <libstuff/libstuff.h>
-#include <libstuff/SScheduledPriorityQueue.h>
+#include <libstuff/SShardedScheduledPriorityQueue.h>
 #include "BedrockCommand.h"
 
-class BedrockCommandQueue : public SScheduledPriorityQueue<BedrockCommand> {
+class BedrockCommandQueue : public SShardedScheduledPriorityQueue<BedrockCommand> {
   public:
     BedrockCommandQueue();
 
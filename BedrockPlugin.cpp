@@ -76,3 +76,7 @@ void BedrockPlugin::upgradeDatabase(SQLite& db) {}
 void BedrockPlugin::handleFailedReply(const BedrockCommand& command) {
     // Default implementation does nothing.
 }
+
+void BedrockPlugin::holdReleased(uint64_t holdID) {
+    // Default implementation does nothing.
+}
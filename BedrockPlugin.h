@@ -79,6 +79,10 @@ class BedrockPlugin {
     // Note that it gets no reference to the DB, this happens after the transaction is already complete.
     virtual void handleFailedReply(const BedrockCommand& command);
 
+    // Called when a command held with this hold ID (see `BedrockCommand::holdID`) stops being held, because it's been
+    // woken, timed out, or released, so the plugin can forget anything it kept to wake it.
+    virtual void holdReleased(uint64_t holdID);
+
     // Map of plugin names to functions that will return a new plugin of the given type.
     static map<string, function<BedrockPlugin*(BedrockServer&)>> g_registeredPluginList;
 
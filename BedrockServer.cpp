@@ -166,7 +166,9 @@ void BedrockServer::sync(const SData& args,
     // Initialize the shared pointer to our sync node object.
     server._syncNode = make_shared<SQLiteNode>(server, db, args["-nodeName"], args["-nodeHost"],
                                                args["-peerList"], args.calc("-priority"), firstTimeout,
-                                               server._version);
+                                               server._version, args.isSet("-compressReplication"),
+                                               args.calcU64("-synchronizeBatchBytes"),
+                                               !args.isSet("-unbatchedReplication"));
 
     // This should be empty anyway, but let's make sure.
     if (server._completedCommands.size()) {
@@ -196,11 +198,31 @@ void BedrockServer::sync(const SData& args,
     BedrockCommand command(move(SQLiteCommand(SData())), BedrockCommand::DONT_COUNT);
     bool committingCommand = false;
 
+    // While leading, up to `quorumWindow` QUORUM commands can be committed at once: each is committed without waiting
+    // for approval, and held here, with the commit count it needs a quorum of followers to reach, until they have. With
+    // the default window of 1, QUORUM commands wait for approval before they're committed, as they always have.
+    // If we stop leading first, they're moved to `unresolvedCommands`, where they wait until we've caught up with
+    // the rest of the cluster, at which point their commits are either in our database or have been discarded.
+    size_t quorumWindow = max(args.calc("-quorumWindow"), 1);
+    bool pipeliningCommand = false;
+    struct PipelinedCommand {
+        uint64_t commitCount;
+        string hash;
+        BedrockCommand command;
+    };
+    list<PipelinedCommand> pipelinedCommands;
+    list<PipelinedCommand> unresolvedCommands;
+
     // We hold a lock here around all operations on `syncNode`, because `SQLiteNode` isn't thread-safe, but we need
     // `BedrockServer` to be able to introspect it in `Status` requests. We hold this lock at all times until exiting
     // our main loop, aside from when we're waiting on `poll`. Strictly, we could hold this lock less often, but there
     // are not that many status commands coming in, and they can wait for a fraction of a second, which lets us keep
     // the logic of this loop simpler.
+    // The fd_map contains a list of all file descriptors (eg, sockets, Unix pipes) that poll will wait on for activity.
+    // Once any of them has activity (or the timeout ends), poll will return. It's kept for the life of the loop, so
+    // file descriptors are only registered with it once.
+    fd_map fdm;
+
     server._syncMutex.lock();
     do {
         // Make sure the existing command prefix is still valid since they're reset when SAUTOPREFIX goes out of scope.
@@ -216,37 +238,19 @@ void BedrockServer::sync(const SData& args,
             SAUTOLOCK(server._futureCommitCommandMutex);
 
             // First, see if anything has timed out, and move that back to the main queue.
-            if (server._futureCommitCommandTimeouts.size()) {
-                uint64_t now = STimeNow();
-                auto it =  server._futureCommitCommandTimeouts.begin();
-                while (it != server._futureCommitCommandTimeouts.end() && it->first < now) {
-                    // Find commands depending on this commit.
-                    auto itPair =  server._futureCommitCommands.equal_range(it->second);
-                    for (auto cmdIt = itPair.first; cmdIt != itPair.second; cmdIt++) {
-                        // Check for one with this timeout.
-                        if (cmdIt->second.timeout() == it->first) {
-                            // This command has the right commit count *and* timeout, return it.
-                            SINFO("Returning command (" << cmdIt->second.request.methodLine << ") waiting on commit " << cmdIt->first
-                                  << " to queue, timed out at: " << now << ", timeout was: " << it->first << ".");
-
-                            // Remove the commit count requirement so this can get timed out.
-                            cmdIt->second.request.erase("commitCount");
-                            server._commandQueue.push(move(cmdIt->second));
-
-                            // And delete it, it's gone.
-                             server._futureCommitCommands.erase(cmdIt);
-
-                            // Done.
-                            break;
-                        }
-                    }
-                    it++;
-                }
-
-                // And remove everything we just iterated through.
-                if (it != server._futureCommitCommandTimeouts.begin()) {
-                    server._futureCommitCommandTimeouts.erase(server._futureCommitCommandTimeouts.begin(), it);
-                }
+            uint64_t now = STimeNow();
+            multimap<uint64_t, BedrockCommand>::iterator cmdIt;
+            while (server._futureCommitCommandTimeouts.popExpired(now, cmdIt)) {
+                SINFO("Returning command (" << cmdIt->second.request.methodLine << ") waiting on commit " << cmdIt->first
+                      << " to queue, timed out at: " << now << ", timeout was: " << cmdIt->second.timeout() << ".");
+
+                // Remove the commit count requirement so this can get timed out.
+                cmdIt->second.request.erase("commitCount");
+                server._futureCommitCommandTimerIDs.erase(&cmdIt->second);
+                server._commandQueue.push(move(cmdIt->second));
+
+                // And delete it, it's gone.
+                server._futureCommitCommands.erase(cmdIt);
             }
 
             // Anything that hasn't timed out might be ready to return because the commit count is up-to-date.
@@ -256,16 +260,14 @@ void BedrockServer::sync(const SData& args,
                 while (it != server._futureCommitCommands.end() && (it->first <= commitCount || server._shutdownState.load() != RUNNING)) {
                     SINFO("Returning command (" << it->second.request.methodLine << ") waiting on commit " << it->first
                           << " to queue, now have commit " << commitCount);
-                    server._commandQueue.push(move(it->second));
 
-                    // Remove it from the timed out list as well.
-                    auto itPair = server._futureCommitCommandTimeouts.equal_range(it->second.timeout());
-                    for (auto timeoutIt = itPair.first; timeoutIt != itPair.second; timeoutIt++) {
-                        if (timeoutIt->second == it->first) {
-                             server._futureCommitCommandTimeouts.erase(timeoutIt);
-                            break;
-                        }
+                    // Cancel its timeout, as well.
+                    auto timerIt = server._futureCommitCommandTimerIDs.find(&it->second);
+                    if (timerIt != server._futureCommitCommandTimerIDs.end()) {
+                        server._futureCommitCommandTimeouts.cancel(timerIt->second);
+                        server._futureCommitCommandTimerIDs.erase(timerIt);
                     }
+                    server._commandQueue.push(move(it->second));
                     it++;
                 }
                 if (it != server._futureCommitCommands.begin()) {
@@ -287,10 +289,6 @@ void BedrockServer::sync(const SData& args,
             server._syncNode->beginShutdown(max(timeAllowed, (int64_t)1));
         }
 
-        // The fd_map contains a list of all file descriptors (eg, sockets, Unix pipes) that poll will wait on for
-        // activity. Once any of them has activity (or the timeout ends), poll will return.
-        fd_map fdm;
-
         // Prepare our plugins for `poll` (for instance, in case they're making HTTP requests).
         server._prePollPlugins(fdm);
 
@@ -334,6 +332,57 @@ void BedrockServer::sync(const SData& args,
         replicationState.store(nodeState);
         leaderVersion.store(server._syncNode->getLeaderVersion());
 
+        // Respond to any pipelined commands that a quorum of followers have now committed, in the order they were
+        // committed. If we've stopped leading, we can't tell yet whether the rest made it.
+        uint64_t quorumCommitCount = server._syncNode->getQuorumCommitCount();
+        if (nodeState != SQLiteNode::LEADING && nodeState != SQLiteNode::STANDINGDOWN) {
+            unresolvedCommands.splice(unresolvedCommands.end(), pipelinedCommands);
+        }
+        while (pipelinedCommands.size() && pipelinedCommands.front().commitCount <= quorumCommitCount) {
+            BedrockCommand& pipelinedCommand = pipelinedCommands.front().command;
+            SAUTOPREFIX(pipelinedCommand.request);
+            pipelinedCommand.complete = true;
+            if (pipelinedCommand.initiatingPeerID) {
+                server._finishPeerCommand(pipelinedCommand);
+            } else {
+                server._reply(pipelinedCommand);
+            }
+            pipelinedCommands.pop_front();
+        }
+
+        // Once we're following the new leader (or leading again), our database has the cluster's history, which only
+        // has the commits of these commands if it has the same hash at the same commit count. Any that weren't kept,
+        // or that we've given up on, are `500 Abandoned`, as nothing they did was committed.
+        bool caughtUp = nodeState == SQLiteNode::FOLLOWING || nodeState == SQLiteNode::LEADING;
+        while (unresolvedCommands.size()) {
+            PipelinedCommand& unresolved = unresolvedCommands.front();
+            SAUTOPREFIX(unresolved.command.request);
+            if (caughtUp) {
+                string query, hash;
+                if (!db.getCommit(unresolved.commitCount, query, hash) || hash != unresolved.hash) {
+                    SWARN("Commit #" << unresolved.commitCount << " for '" << unresolved.command.request.methodLine
+                          << "' was discarded after we stopped leading, abandoning.");
+                    unresolved.command.response.methodLine = "500 Abandoned";
+                } else {
+                    SINFO("Commit #" << unresolved.commitCount << " for '" << unresolved.command.request.methodLine
+                          << "' was kept after we stopped leading.");
+                }
+            } else if (server._shutdownState.load() != RUNNING || unresolved.command.timeout() <= STimeNow()) {
+                SWARN("Couldn't find out whether commit #" << unresolved.commitCount << " for '"
+                      << unresolved.command.request.methodLine << "' was kept after we stopped leading, abandoning.");
+                unresolved.command.response.methodLine = "500 Abandoned";
+            } else {
+                break;
+            }
+            unresolved.command.complete = true;
+            if (unresolved.command.initiatingPeerID) {
+                server._finishPeerCommand(unresolved.command);
+            } else {
+                server._reply(unresolved.command);
+            }
+            unresolvedCommands.pop_front();
+        }
+
         // If anything was in the stand down queue, move it back to the main queue.
         if (nodeState != SQLiteNode::STANDINGDOWN) {
             while (server._standDownQueue.size()) {
@@ -348,6 +397,11 @@ void BedrockServer::sync(const SData& args,
             server._commandQueue.abandonFutureCommands(5000);
         }
 
+        // Commands held by plugins are only woken by commits on leader, so if we're not leading (or are shutting down),
+        // we respond to them all now, rather than let them wait out their timeouts.
+        nextActivity = min(nextActivity, server._processHeldCommands(nodeState != SQLiteNode::LEADING ||
+                                                                     server._shutdownState.load() != RUNNING));
+
         // If we're not leading, we turn off multi-write until we've finished upgrading the DB. This persists until
         // after we're leading again.
         if (nodeState != SQLiteNode::LEADING) {
@@ -428,13 +482,21 @@ void BedrockServer::sync(const SData& args,
 
                 // Otherwise, save the commit count, mark this command as complete, and reply.
                 command.response["commitCount"] = to_string(db.getCommitCount());
-                command.complete = true;
-                if (command.initiatingPeerID) {
-                    // This is a command that came from a peer. Have the sync node send the response back to the peer.
-                    server._finishPeerCommand(command);
+
+                if (pipeliningCommand) {
+                    // Unless it was pipelined, in which case it waits for a quorum of followers to acknowledge it.
+                    pipelinedCommands.push_back({db.getCommitCount(), db.getCommittedHash(), move(command)});
+                    nextActivity = STimeNow();
                 } else {
-                    // The only other option is this came from a client, so respond via the server.
-                    server._reply(command);
+                    command.complete = true;
+                    if (command.initiatingPeerID) {
+                        // This is a command that came from a peer. Have the sync node send the response back to the
+                        // peer.
+                        server._finishPeerCommand(command);
+                    } else {
+                        // The only other option is this came from a client, so respond via the server.
+                        server._reply(command);
+                    }
                 }
             } else {
                 // This should only happen if the cluster becomes largely disconnected while we were in the process of
@@ -448,6 +510,7 @@ void BedrockServer::sync(const SData& args,
                       << " queued commands.");
                 syncNodeQueuedCommands.push(move(command));
             }
+            pipeliningCommand = false;
 
             // Prevent the requestID from a finished command from being used.
             command.request.clear();
@@ -471,8 +534,9 @@ void BedrockServer::sync(const SData& args,
                 // when _completedCommands.pop() throws for running out of commands, we fall out of the loop.
             }
 
-            // We don't start processing a new command until we've completed any existing ones.
-            if (committingCommand) {
+            // We don't start processing a new command until we've completed any existing ones, or while we're
+            // waiting on a full window of pipelined commands.
+            if (committingCommand || pipelinedCommands.size() >= quorumWindow) {
                 continue;
             }
 
@@ -531,7 +595,9 @@ void BedrockServer::sync(const SData& args,
                         // This command completed in peek, respond to it appropriately, either directly or by sending it
                         // back to the sync thread.
                         SASSERT(command.complete);
-                        if (command.initiatingPeerID) {
+                        if (command.holdID) {
+                            server._holdCommand(move(command));
+                        } else if (command.initiatingPeerID) {
                             server._finishPeerCommand(command);
                         } else {
                             server._reply(command);
@@ -556,7 +622,9 @@ void BedrockServer::sync(const SData& args,
                     SINFO("[performance] Sync thread beginning committing command " << command.request.methodLine);
                     // START TIMING.
                     command.startTiming(BedrockCommand::COMMIT_SYNC);
-                    server._syncNode->startCommit(command.writeConsistency);
+                    pipeliningCommand = quorumWindow > 1 && nodeState == SQLiteNode::LEADING &&
+                                        command.writeConsistency == SQLiteNode::QUORUM;
+                    server._syncNode->startCommit(command.writeConsistency, pipeliningCommand);
 
                     // And we'll start the next main loop.
                     // NOTE: This will cause us to read from the network again. This, in theory, is fine, but we saw
@@ -780,8 +848,9 @@ void BedrockServer::worker(const SData& args,
                 auto newQueueSize = server._futureCommitCommands.size() + 1;
                 SINFO("Command (" << command.request.methodLine << ") depends on future commit (" << commandCommitCount
                       << "), Currently at: " << commitCount << ", storing for later. Queue size: " << newQueueSize);
-                server._futureCommitCommandTimeouts.insert(make_pair(command.timeout(), commandCommitCount));
-                server._futureCommitCommands.insert(make_pair(commandCommitCount, move(command)));
+                auto cmdIt = server._futureCommitCommands.insert(make_pair(commandCommitCount, move(command)));
+                server._futureCommitCommandTimerIDs[&cmdIt->second] =
+                    server._futureCommitCommandTimeouts.insert(cmdIt->second.timeout(), cmdIt);
 
                 // Don't count this as `in progress`, it's just sitting there.
                 if (newQueueSize > 100) {
@@ -1017,7 +1086,10 @@ void BedrockServer::worker(const SData& args,
                 // If the command was completed above, then we'll go ahead and respond. Otherwise there must have been
                 // a conflict, and we'll retry.
                 if (command.complete) {
-                    if (command.initiatingPeerID) {
+                    if (command.holdID) {
+                        // A plugin wants to hold this until something it's waiting for happens.
+                        server._holdCommand(move(command));
+                    } else if (command.initiatingPeerID) {
                         // Escalated command. Send it back to the peer.
                         server._finishPeerCommand(command);
                     } else {
@@ -1222,6 +1294,18 @@ BedrockServer::BedrockServer(const SData& args_)
     // Set the quorum checkpoint, or default if not specified.
     _quorumCheckpointSeconds = args.isSet("-quorumCheckpointSeconds") ? args.calc("-quorumCheckpointSeconds") : 60;
 
+    // Start the reactor threads, if we're using them for the command port.
+    int ioThreads = max(args.calc("-ioThreads"), 0);
+    for (int i = 0; i < ioThreads; i++) {
+        _reactors.emplace_back(new Reactor());
+    }
+    for (int i = 0; i < ioThreads; i++) {
+        _reactors[i]->reactorThread = thread(&BedrockServer::_reactorLoop, this, ref(*_reactors[i]), i);
+    }
+    if (ioThreads) {
+        SINFO("Started " << ioThreads << " I/O threads for the command port.");
+    }
+
     // Start the sync thread, which will start the worker threads.
     SINFO("Launching sync thread '" << _syncThreadName << "'");
     _syncThread = thread(syncWrapper,
@@ -1247,6 +1331,16 @@ BedrockServer::~BedrockServer() {
         SWARN("Still have " << _socketIDMap.size() << " entries in _socketIDMap.");
     }
 
+    // Stop the reactors, which close their own sockets.
+    for (auto& reactor : _reactors) {
+        reactor->exit = true;
+        reactor->socketsToRevisit.push(0);
+    }
+    for (auto& reactor : _reactors) {
+        reactor->reactorThread.join();
+    }
+    _reactors.clear();
+
     if (socketList.size()) {
         SWARN("Still have " << socketList.size() << " entries in socketList.");
         for (list<Socket*>::iterator socketIt = socketList.begin(); socketIt != socketList.end();) {
@@ -1315,6 +1409,7 @@ bool BedrockServer::shutdownComplete() {
 }
 
 void BedrockServer::prePoll(fd_map& fdm) {
+    _mainThreadCommands.prePoll(fdm);
     SAUTOLOCK(_socketIDMutex);
     STCPServer::prePoll(fdm);
 }
@@ -1417,52 +1512,157 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
     // over it, we'll keep a list of sockets that need closing.
     list<STCPManager::Socket*> socketsToClose;
 
-    // This is a timestamp, after which we'll start giving up on any sockets that don't seem to be giving us any data.
-    // The case for this is that once we start shutting down, we'll close any sockets when we respond to a command on
-    // them, and we'll stop accepting any new sockets, but if existing sockets just sit around giving us nothing, we
-    // need to figure out some way to handle them. We'll wait 5 seconds and then start killing them.
-    static uint64_t lastChance = 0;
-    for (auto s : socketList) {
-        switch (s->state.load()) {
-            case STCPManager::Socket::CLOSED:
-            {
-                // TODO: Cancel any outstanding commands initiated by this socket. This isn't critical, and is an
-                // optimization. Otherwise, they'll continue to get processed to completion, and will just never be
-                // able to have their responses returned.
+    // `_lastChance` is a timestamp, after which we'll start giving up on any sockets that don't seem to be giving us
+    // any data. The case for this is that once we start shutting down, we'll close any sockets when we respond to a
+    // command on them, and we'll stop accepting any new sockets, but if existing sockets just sit around giving us
+    // nothing, we need to figure out some way to handle them. We'll wait 5 seconds and then start killing them.
+
+    // Work out which sockets to check. Normally, that's the ones the base class saw activity on, and any we've been
+    // asked to revisit, but if we're shutting down, we check them all so we can close idle ones.
+    list<Socket*> socketsToCheck;
+    {
+        SAUTOLOCK(_socketIDMutex);
+        if (_shutdownState.load() != RUNNING || !fdm.edgeTriggered()) {
+            socketsToCheck = socketList;
+        } else {
+            socketsToCheck = activeSockets;
+            for (Socket* s : _socketsToRevisit) {
+                if (find(activeSockets.begin(), activeSockets.end(), s) == activeSockets.end()) {
+                    socketsToCheck.push_back(s);
+                }
+            }
+        }
+        _socketsToRevisit.clear();
+    }
+    for (auto s : socketsToCheck) {
+        if (_handleSocket(s, socketsToClose, deserializationAttempts, deserializedRequests)) {
+            SAUTOLOCK(_socketIDMutex);
+            _socketsToRevisit.insert(s);
+        }
+    }
+
+    // Handle any status or control commands read here or by the reactors.
+    _mainThreadCommands.postPoll(fdm, 1000);
+    while (!_mainThreadCommands.empty()) {
+        BedrockCommand command = _mainThreadCommands.pop();
+        SAUTOPREFIX(command.request);
+        _handleIfStatusOrControlCommand(command);
+    }
+
+    // Log the timing of this loop.
+    uint64_t readElapsedMS = (STimeNow() - acceptEndTime) / 1000;
+    SINFO("[performance] Read from " << socketList.size() << " sockets, attempted to deserialize " << deserializationAttempts
+          << " commands, " << deserializedRequests << " were complete and deserialized in " << readElapsedMS << "ms.");
+
+    // Now we can close any sockets that we need to.
+    for (auto s: socketsToClose) {
+        {
+            SAUTOLOCK(_socketIDMutex);
+            _socketsToRevisit.erase(s);
+        }
+        closeSocket(s);
+    }
+
+    // If there's anything to revisit, don't wait for activity before doing so.
+    {
+        SAUTOLOCK(_socketIDMutex);
+        if (!_socketsToRevisit.empty()) {
+            nextActivity = STimeNow();
+        }
+    }
+
+    // If any plugin timers are firing, let the plugins know.
+    for (auto plugin : plugins) {
+        for (SStopwatch* timer : plugin.second->timers) {
+            if (timer->ding()) {
+                plugin.second->timerFired(timer);
+            }
+        }
+    }
+
+    // If we've been told to start shutting down, we'll set the lastChance timer.
+    if (_shutdownState.load() == START_SHUTDOWN) {
+        if (!_lastChance) {
+            _lastChance = STimeNow() + 5 * 1'000'000; // 5 seconds from now.
+        }
+        // Count the sockets our reactors still have open.
+        size_t reactorSocketCount = 0;
+        for (auto& reactor : _reactors) {
+            reactorSocketCount += reactor->socketCount;
+        }
+
+        // If we've run out of sockets or hit our timeout, we'll increment _shutdownState.
+        if ((socketList.empty() && !reactorSocketCount) || _gracefulShutdownTimeout.ringing()) {
+            _lastChance = 0;
+
+            // We empty the socket list here, we will no longer allow new requests to come in, as the sync node can
+            // shutdown any time after here, and we'll have no way to handle new requests.
+            if (socketList.size()) {
                 SAUTOLOCK(_socketIDMutex);
-                _socketIDMap.erase(s->id);
-                socketsToClose.push_back(s);
+                SINFO("Killing " << socketList.size() << " remaining sockets at graceful shutdown timeout.");
+                while(socketList.size()) {
+                    auto s = socketList.front();
+                    _socketIDMap.erase(s->id);
+                    _socketsToRevisit.erase(s);
+                    closeSocket(s);
+                }
             }
-            break;
-            case STCPManager::Socket::CONNECTED:
+            if (reactorSocketCount) {
+                SINFO("Telling reactors to kill " << reactorSocketCount << " remaining sockets at graceful shutdown timeout.");
+                for (auto& reactor : _reactors) {
+                    reactor->closeAll = true;
+                    reactor->socketsToRevisit.push(0);
+                }
+            }
+            _shutdownState.store(CLIENTS_RESPONDED);
+        }
+    }
+}
+
+bool BedrockServer::_handleSocket(Socket* s, list<Socket*>& socketsToClose, int& deserializationAttempts,
+                                  int& deserializedRequests) {
+    bool revisit = false;
+    switch (s->state.load()) {
+        case STCPManager::Socket::CLOSED:
+        {
+            // TODO: Cancel any outstanding commands initiated by this socket. This isn't critical, and is an
+            // optimization. Otherwise, they'll continue to get processed to completion, and will just never be
+            // able to have their responses returned.
+            SAUTOLOCK(_socketIDMutex);
+            _socketIDMap.erase(s->id);
+            socketsToClose.push_back(s);
+        }
+        break;
+        case STCPManager::Socket::CONNECTED:
+        {
             {
-                {
-                    SAUTOLOCK(_socketIDMutex);
-                    if (s->recvBuffer.empty()) {
-                        // If nothing's been received, break early.
-                        if (_shutdownState.load() != RUNNING && lastChance && lastChance < STimeNow() && _socketIDMap.find(s->id) == _socketIDMap.end()) {
-                            // If we're shutting down and past our lastChance timeout, we start killing these.
-                            SINFO("Closing socket " << s->id << " with no data and no pending command: shutting down.");
-                            socketsToClose.push_back(s);
-                        }
+                SAUTOLOCK(_socketIDMutex);
+                auto clientIt = _socketIDMap.find(s->id);
+                if (s->recvBuffer.empty()) {
+                    // If nothing's been received, break early.
+                    if (_shutdownState.load() != RUNNING && _lastChance && _lastChance < STimeNow() && clientIt == _socketIDMap.end()) {
+                        // If we're shutting down and past our lastChance timeout, we start killing these.
+                        SINFO("Closing socket " << s->id << " with no data and no pending command: shutting down.");
+                        socketsToClose.push_back(s);
+                    }
+                    break;
+                } else if (clientIt != _socketIDMap.end()) {
+                    // Clients can pipeline requests, but plugins parse their own requests, so we only take one at a time
+                    // from their sockets. We also stop reading from any client with too many requests in progress.
+                    // We'll come back to these when we send a response.
+                    if (s->data || clientIt->second.inProgress >= _maxPipelinedRequests) {
                         break;
-                    } else {
-                        // Otherwise, we'll see if there's any activity on this socket. Currently, we don't handle clients
-                        // pipelining requests well. We process commands in no particular order, so we can't dequeue two
-                        // requests off the same socket at one time, or we don't guarantee their return order, thus we just
-                        // wait and will try again later.
-                        auto socketIt = _socketIDMap.find(s->id);
-                        if (socketIt != _socketIDMap.end()) {
-                            break;
-                        }
                     }
                 }
+            }
 
-                // If there's a request, we'll dequeue it (but only the first one).
+            // Dequeue every complete request in the buffer (but only the first one for plugins).
+            BedrockPlugin* plugin = static_cast<BedrockPlugin*>(s->data);
+            bool dequeuedRequest = false;
+            while (true) {
                 SData request;
 
                 // If the socket is owned by a plugin, we let the plugin populate our request.
-                BedrockPlugin* plugin = static_cast<BedrockPlugin*>(s->data);
                 if (plugin) {
                     // Call the plugin's handler.
                     plugin->onPortRecv(s, request);
@@ -1477,141 +1677,142 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
                     deserializationAttempts++;
                 }
 
-                // If we have a populated request, from either a plugin or our default handling, we'll queue up the
-                // command.
-                if (!request.empty()) {
-                    // If there's no ID for this request, let's add one.
-                    _addRequestID(request);
-                    SAUTOPREFIX(request);
-                    deserializedRequests++;
-                    // Either shut down the socket or store it so we can eventually sync out the response.
-                    if (SIEquals(request["Connection"], "forget") ||
-                        (uint64_t)request.calc64("commandExecuteTime") > STimeNow()) {
-                        // Respond immediately to make it clear we successfully queued it, but don't add to the socket
-                        // map as we don't care about the answer.
-                        SINFO("Firing and forgetting '" << request.methodLine << "'");
-                        SData response("202 Successfully queued");
-                        if (_shutdownState.load() != RUNNING) {
-                            response["Connection"] = "close";
+                // If we don't have a complete request, we're done with this socket for now.
+                if (request.empty()) {
+                    break;
+                }
+                dequeuedRequest = true;
+
+                // If there's no ID for this request, let's add one.
+                _addRequestID(request);
+                SAUTOPREFIX(request);
+                deserializedRequests++;
+
+                // Either respond immediately, or reserve this request's place in the order of responses on this socket,
+                // so we can eventually sync out the response.
+                uint64_t sequence = 0;
+                bool stopReading = plugin || SIEquals(request["Connection"], "close");
+                if (SIEquals(request["Connection"], "forget") ||
+                    (uint64_t)request.calc64("commandExecuteTime") > STimeNow()) {
+                    // Respond immediately to make it clear we successfully queued it, but don't wait for the response,
+                    // as we don't care about the answer. If there are earlier requests in progress on this socket,
+                    // this goes after their responses.
+                    SINFO("Firing and forgetting '" << request.methodLine << "'");
+                    SData response("202 Successfully queued");
+                    if (_shutdownState.load() != RUNNING) {
+                        response["Connection"] = "close";
+                    }
+                    {
+                        SAUTOLOCK(_socketIDMutex);
+                        auto clientIt = _socketIDMap.find(s->id);
+                        if (clientIt == _socketIDMap.end()) {
+                            s->send(response.serializeBuffers());
+                        } else {
+                            ClientSocket& client = clientIt->second;
+                            client.inProgress++;
+                            client.completedResponses.emplace(client.nextRequestSequence++,
+                                                              make_pair(response.serializeBuffers(), false));
+                            _sendResponses(clientIt);
                         }
-                        s->send(response.serialize());
+                    }
 
-                        // If we're shutting down, discard this command, we won't wait for the future.
-                        if (_shutdownState.load() != RUNNING) {
-                            SINFO("Not queuing future command '" << request.methodLine << "' while shutting down.");
+                    // If we're shutting down, discard this command, we won't wait for the future.
+                    if (_shutdownState.load() != RUNNING) {
+                        SINFO("Not queuing future command '" << request.methodLine << "' while shutting down.");
+                        if (stopReading) {
                             break;
                         }
+                        continue;
+                    }
+                } else {
+                    SINFO("Waiting for '" << request.methodLine << "' to complete.");
+                    SAUTOLOCK(_socketIDMutex);
+                    ClientSocket& client = _socketIDMap.emplace(s->id, ClientSocket(s)).first->second;
+                    client.inProgress++;
+                    if (!plugin && request.test("outOfOrderResponse")) {
+                        sequence = SQLiteCommand::UNORDERED_CLIENT_SEQUENCE;
                     } else {
-                        SINFO("Waiting for '" << request.methodLine << "' to complete.");
-                        SAUTOLOCK(_socketIDMutex);
-                        _socketIDMap[s->id] = s;
+                        sequence = client.nextRequestSequence++;
                     }
+                    stopReading = stopReading || client.inProgress >= _maxPipelinedRequests;
+                }
 
-                    // Create a command.
-                    BedrockCommand command(request);
+                // Create a command.
+                BedrockCommand command(request);
 
-                    // Get the source ip of the command.
-                    char *ip = inet_ntoa(s->addr.sin_addr);
-                    if (ip != "127.0.0.1"s) {
-                        // We only add this if it's not localhost because existing code expects commands that come from
-                        // localhost to have it blank.
-                        command.request["_source"] = ip;
-                    }
+                // Get the source ip of the command. We use `inet_ntop` as this can run on several threads at once.
+                char ip[INET_ADDRSTRLEN] = {};
+                inet_ntop(AF_INET, &s->addr.sin_addr, ip, sizeof(ip));
+                if (ip != "127.0.0.1"s) {
+                    // We only add this if it's not localhost because existing code expects commands that come from
+                    // localhost to have it blank.
+                    command.request["_source"] = ip;
+                }
 
-                    if (command.writeConsistency != SQLiteNode::QUORUM
-                        && _syncCommands.find(command.request.methodLine) != _syncCommands.end()) {
+                if (command.writeConsistency != SQLiteNode::QUORUM
+                    && _syncCommands.find(command.request.methodLine) != _syncCommands.end()) {
 
-                        command.writeConsistency = SQLiteNode::QUORUM;
-                        _lastQuorumCommandTime = STimeNow();
-                        SINFO("Forcing QUORUM consistency for command " << command.request.methodLine);
-                    }
+                    command.writeConsistency = SQLiteNode::QUORUM;
+                    _lastQuorumCommandTime = STimeNow();
+                    SINFO("Forcing QUORUM consistency for command " << command.request.methodLine);
+                }
 
-                    // This is important! All commands passed through the entire cluster must have unique IDs, or they
-                    // won't get routed properly from follower to leader and back.
-                    command.id = args["-nodeName"] + "#" + to_string(_requestCount++);
+                // This is important! All commands passed through the entire cluster must have unique IDs, or they
+                // won't get routed properly from follower to leader and back.
+                command.id = args["-nodeName"] + "#" + to_string(_requestCount++);
 
-                    // And we and keep track of the client that initiated this command, so we can respond later, except
-                    // if we received connection:forget in which case we don't respond later
-                    command.initiatingClientID = SIEquals(request["Connection"], "forget") ? -1 : s->id;
+                // And we and keep track of the client that initiated this command, so we can respond later, except
+                // if we received connection:forget in which case we don't respond later
+                command.initiatingClientID = SIEquals(request["Connection"], "forget") ? -1 : s->id;
+                command.initiatingClientSequence = sequence;
 
-                    // If it's a status or control command, we handle it specially there. If not, we'll queue it for
-                    // later processing.
-                    if (!_handleIfStatusOrControlCommand(command)) {
-                        auto _syncNodeCopy = _syncNode;
-                        if (_syncNodeCopy && _syncNodeCopy->getState() == SQLiteNode::STANDINGDOWN) {
-                            _standDownQueue.push(move(command));
-                        } else {
-                            SINFO("Queued new '" << command.request.methodLine << "' command from local client, with "
-                                  << _commandQueue.size() << " commands already queued.");
-                            _commandQueue.push(move(command));
-                        }
-                    }
+                // Status and control commands are handled by the main thread in postPoll, as this may be a reactor.
+                // Anything else we queue for later processing.
+                if (_isStatusCommand(command) || _isControlCommand(command)) {
+                    _mainThreadCommands.push(move(command));
                 } else {
-                    SAUTOLOCK(_socketIDMutex);
-                    // If we weren't able to deserialize a complete request, and we're shutting down, give up.
-                    if (_shutdownState.load() != RUNNING && lastChance && lastChance < STimeNow() && _socketIDMap.find(s->id) == _socketIDMap.end()) {
-                        SINFO("Closing socket " << s->id << " with incomplete data and no pending command: shutting down.");
-                        socketsToClose.push_back(s);
+                    auto _syncNodeCopy = _syncNode;
+                    if (_syncNodeCopy && _syncNodeCopy->getState() == SQLiteNode::STANDINGDOWN) {
+                        _standDownQueue.push(move(command));
+                    } else {
+                        SINFO("Queued new '" << command.request.methodLine << "' command from local client, with "
+                              << _commandQueue.size() << " commands already queued.");
+                        _commandQueue.push(move(command));
                     }
                 }
-            }
-            break;
-            case STCPManager::Socket::SHUTTINGDOWN:
-            {
-                // We do nothing in this state, we just wait until the next iteration of poll and let the CLOSED
-                // case run. This block just prevents default warning from firing.
-            }
-            break;
-            default:
-            {
-                SWARN("Socket in unhandled state: " << s->state);
-            }
-            break;
-        }
-    }
-
-    // Log the timing of this loop.
-    uint64_t readElapsedMS = (STimeNow() - acceptEndTime) / 1000;
-    SINFO("[performance] Read from " << socketList.size() << " sockets, attempted to deserialize " << deserializationAttempts
-          << " commands, " << deserializedRequests << " were complete and deserialized in " << readElapsedMS << "ms.");
 
-    // Now we can close any sockets that we need to.
-    for (auto s: socketsToClose) {
-        closeSocket(s);
-    }
+                // If we've taken all we can from this socket for now, stop.
+                if (stopReading) {
+                    break;
+                }
+            }
 
-    // If any plugin timers are firing, let the plugins know.
-    for (auto plugin : plugins) {
-        for (SStopwatch* timer : plugin.second->timers) {
-            if (timer->ding()) {
-                plugin.second->timerFired(timer);
+            SAUTOLOCK(_socketIDMutex);
+            bool inProgress = _socketIDMap.find(s->id) != _socketIDMap.end();
+            if (dequeuedRequest) {
+                // If the client sent more after these requests and we aren't waiting on a response, there'll be no
+                // new activity to tell us to read it, so come back to it.
+                revisit = !s->recvBuffer.empty() && !inProgress;
+            } else if (_shutdownState.load() != RUNNING && _lastChance && _lastChance < STimeNow() && !inProgress) {
+                // If we weren't able to deserialize a complete request, and we're shutting down, give up.
+                SINFO("Closing socket " << s->id << " with incomplete data and no pending command: shutting down.");
+                socketsToClose.push_back(s);
             }
         }
-    }
-
-    // If we've been told to start shutting down, we'll set the lastChance timer.
-    if (_shutdownState.load() == START_SHUTDOWN) {
-        if (!lastChance) {
-            lastChance = STimeNow() + 5 * 1'000'000; // 5 seconds from now.
+        break;
+        case STCPManager::Socket::SHUTTINGDOWN:
+        {
+            // We do nothing in this state, we just wait until the next iteration of poll and let the CLOSED
+            // case run. This block just prevents default warning from firing.
         }
-        // If we've run out of sockets or hit our timeout, we'll increment _shutdownState.
-        if (socketList.empty() || _gracefulShutdownTimeout.ringing()) {
-            lastChance = 0;
-
-            // We empty the socket list here, we will no longer allow new requests to come in, as the sync node can
-            // shutdown any time after here, and we'll have no way to handle new requests.
-            if (socketList.size()) {
-                SAUTOLOCK(_socketIDMutex);
-                SINFO("Killing " << socketList.size() << " remaining sockets at graceful shutdown timeout.");
-                while(socketList.size()) {
-                    auto s = socketList.front();
-                    _socketIDMap.erase(s->id);
-                    closeSocket(s);
-                }
-            }
-            _shutdownState.store(CLIENTS_RESPONDED);
+        break;
+        default:
+        {
+            SWARN("Socket in unhandled state: " << s->state);
         }
+        break;
     }
+    return revisit;
 }
 
 void BedrockServer::_reply(BedrockCommand& command) {
@@ -1625,9 +1826,11 @@ void BedrockServer::_reply(BedrockCommand& command) {
         return;
     }
 
-    // Do we have a socket for this command?
+    // Do we have a socket for this command? If the client wasn't waiting for a response (i.e., this was scheduled for
+    // the future), we don't.
     auto socketIt = _socketIDMap.find(command.initiatingClientID);
-    if (socketIt != _socketIDMap.end()) {
+    if (socketIt != _socketIDMap.end() && command.initiatingClientSequence) {
+        ClientSocket& client = socketIt->second;
         command.response["nodeName"] = args["-nodeName"];
 
         // Is a plugin handling this command? If so, it gets to send the response.
@@ -1638,28 +1841,36 @@ void BedrockServer::_reply(BedrockCommand& command) {
             command.response["Connection"] = "close";
         }
 
+        // If `Connection: close` was set, shut down the socket after the response, in case the caller ignores us.
+        bool shutdown = SIEquals(command.request["Connection"], "close");
+
         if (!pluginName.empty()) {
-            // Let the plugin handle it
+            // Let the plugin handle it. We only take one request at a time from plugin sockets, so this is always the
+            // next response.
             SINFO("Plugin '" << pluginName << "' handling response '" << command.response.methodLine
                   << "' to request '" << command.request.methodLine << "'");
             auto it = plugins.find(pluginName);
             if (it != plugins.end()) {
-                it->second->onPortRequestComplete(command, socketIt->second);
+                it->second->onPortRequestComplete(command, client.socket);
             } else {
                 SERROR("Couldn't find plugin '" << pluginName << ".");
             }
+            client.completedResponses.emplace(command.initiatingClientSequence,
+                                              make_pair(vector<shared_ptr<const string>>(), shutdown));
+        } else if (command.initiatingClientSequence == SQLiteCommand::UNORDERED_CLIENT_SEQUENCE) {
+            // The client said it doesn't care about the order, so send this now, tagged with its request ID.
+            command.response["requestID"] = command.request["requestID"];
+            client.socket->send(command.response.serializeBuffers());
+            client.inProgress--;
+            if (shutdown) {
+                _shutdownClientSocket(client.socket);
+            }
         } else {
-            // Otherwise we send the standard response.
-            socketIt->second->send(command.response.serialize());
+            // Otherwise we send the standard response, once the responses before it have been sent.
+            client.completedResponses.emplace(command.initiatingClientSequence,
+                                              make_pair(command.response.serializeBuffers(), shutdown));
         }
-
-        // If `Connection: close` was set, shut down the socket, in case the caller ignores us.
-        if (SIEquals(command.request["Connection"], "close") || _shutdownState.load() != RUNNING) {
-            shutdownSocket(socketIt->second, SHUT_RDWR);
-        }
-
-        // We only keep track of sockets with pending commands.
-        _socketIDMap.erase(socketIt);
+        _sendResponses(socketIt);
     } else {
         if (!SIEquals(command.request["Connection"], "forget")) {
             SINFO("No socket to reply for: '" << command.request.methodLine << "' #" << command.initiatingClientID);
@@ -1672,6 +1883,61 @@ void BedrockServer::_reply(BedrockCommand& command) {
     }
 }
 
+void BedrockServer::_sendResponses(map<uint64_t, ClientSocket>::iterator clientIt) {
+    ClientSocket& client = clientIt->second;
+    bool sentAny = false;
+    auto responseIt = client.completedResponses.begin();
+    while (responseIt != client.completedResponses.end() && responseIt->first == client.nextResponseSequence) {
+        // Plugins send their own responses, so these may be empty.
+        if (!responseIt->second.first.empty()) {
+            client.socket->send(responseIt->second.first);
+        }
+        bool shutdown = responseIt->second.second;
+        responseIt = client.completedResponses.erase(responseIt);
+        client.nextResponseSequence++;
+        client.inProgress--;
+        sentAny = true;
+        if (shutdown) {
+            _shutdownClientSocket(client.socket);
+        }
+    }
+
+    // We only keep track of sockets with pending commands. If we're shutting down, we close the socket once it has no
+    // more responses to send.
+    Socket* s = client.socket;
+    if (!client.inProgress) {
+        _socketIDMap.erase(clientIt);
+        if (_shutdownState.load() != RUNNING) {
+            _shutdownClientSocket(s);
+        }
+    }
+
+    // The client may have already sent its next request, or we may have stopped reading requests from it when it had
+    // too many in progress, so make sure whichever thread reads this socket looks at it again.
+    if (sentAny) {
+        _revisitClientSocket(s);
+    }
+}
+
+void BedrockServer::_shutdownClientSocket(Socket* s) {
+    auto reactorIt = _reactorSocketIDs.find(s->id);
+    if (reactorIt != _reactorSocketIDs.end()) {
+        lock_guard<recursive_mutex> lock(reactorIt->second->socketMutex);
+        reactorIt->second->shutdownSocket(s, SHUT_RDWR);
+    } else {
+        shutdownSocket(s, SHUT_RDWR);
+    }
+}
+
+void BedrockServer::_revisitClientSocket(Socket* s) {
+    auto reactorIt = _reactorSocketIDs.find(s->id);
+    if (reactorIt != _reactorSocketIDs.end()) {
+        reactorIt->second->socketsToRevisit.push(uint64_t(s->id));
+    } else {
+        _socketsToRevisit.insert(s);
+    }
+}
+
 void BedrockServer::suppressCommandPort(const string& reason, bool suppress, bool manualOverride) {
     // If we've set the manual override flag, then we'll only actually make this change if we've specified it again.
     if (_suppressCommandPortManualOverride && !manualOverride) {
@@ -1725,6 +1991,9 @@ bool BedrockServer::getPeerInfo(list<STable>& peerData) {
                 peerData.back()["host"] = peer->host;
                 peerData.back()["name"] = peer->name;
                 peerData.back()["State"] = SQLiteNode::stateName(peer->state);
+                for (auto& it : _syncNodeCopy->getCompressionInfo(peer)) {
+                    peerData.back()[it.first] = it.second;
+                }
             }
         }
     } else {
@@ -1806,6 +2075,10 @@ void BedrockServer::_status(BedrockCommand& command) {
         content["version"]  = _version;
         content["host"]     = args["-nodeHost"];
 
+        // Prepared statement cache effectiveness, summed over every DB handle on this server.
+        content["statementCacheHits"]   = to_string(SQLite::statementCacheHits.load());
+        content["statementCacheMisses"] = to_string(SQLite::statementCacheMisses.load());
+
         {
             // Make it known if anything is known to cause crashes.
             shared_lock<decltype(_crashCommandMutex)> lock(_crashCommandMutex);
@@ -2006,13 +2279,15 @@ void BedrockServer::_postPollPlugins(fd_map& fdm, uint64_t nextActivity) {
     map<SHTTPSManager::Transaction*, uint64_t> transactionTimeouts;
     {
         lock_guard<mutex> lock(_httpsCommandMutex);
-        auto timeoutIt = _outstandingHTTPSCommands.begin();
-        while (timeoutIt != _outstandingHTTPSCommands.end() && (*timeoutIt)->timeout() < now) {
+        BedrockCommand* timedOutCommand;
+        while (_outstandingHTTPSCommandTimeouts.popExpired(now, timedOutCommand)) {
+            _timedOutHTTPSCommands.insert(timedOutCommand);
+        }
+        for (auto command : _timedOutHTTPSCommands) {
             // Add all the transactions for this command, even if some are already complete, they'll just get ignored.
-            for (auto transaction : (*timeoutIt)->httpsRequests) {
-                transactionTimeouts[transaction] = (*timeoutIt)->timeout();
+            for (auto transaction : command->httpsRequests) {
+                transactionTimeouts[transaction] = command->timeout();
             }
-            timeoutIt++;
         }
     }
 
@@ -2138,10 +2413,121 @@ void BedrockServer::_acceptSockets() {
             // Remember that this socket is owned by this plugin.
             SASSERT(!s->data);
             s->data = plugin;
+        } else if (acceptPort == _commandPort && !_reactors.empty()) {
+            // Hand command port sockets to the reactors, round-robin. They'll check for a request immediately.
+            Reactor* reactor = _reactors[s->id % _reactors.size()].get();
+            releaseSocket(s);
+            {
+                SAUTOLOCK(_socketIDMutex);
+                _reactorSocketIDs[s->id] = reactor;
+            }
+            reactor->newSockets.push(move(s));
+            continue;
         }
+
+        // We may have read a request while accepting it, and there won't be any new activity to tell us.
+        SAUTOLOCK(_socketIDMutex);
+        _socketsToRevisit.insert(s);
     }
 }
 
+void BedrockServer::_reactorLoop(Reactor& reactor, int reactorID) {
+    SInitialize("reactor" + to_string(reactorID));
+
+    // The sockets this reactor owns, by ID, and the IDs of those to check without waiting for activity.
+    map<uint64_t, Socket*> sockets;
+    set<uint64_t> socketIDsToRevisit;
+
+    // The fd_map is kept for the life of the thread, as with the main thread.
+    fd_map fdm;
+    while (!reactor.exit) {
+        reactor.newSockets.prePoll(fdm);
+        reactor.socketsToRevisit.prePoll(fdm);
+        {
+            lock_guard<recursive_mutex> lock(reactor.socketMutex);
+            reactor.prePoll(fdm);
+        }
+
+        // If there's anything to revisit, don't wait. Otherwise, wait up to a second, so we notice shutting down.
+        S_poll(fdm, socketIDsToRevisit.empty() ? STIME_US_PER_S : 0);
+
+        // Read all of the bytes from the queues' pipes, as we empty the queues each time.
+        reactor.newSockets.postPoll(fdm, 1000);
+        reactor.socketsToRevisit.postPoll(fdm, 1000);
+        while (!reactor.newSockets.empty()) {
+            Socket* s = reactor.newSockets.pop();
+            lock_guard<recursive_mutex> lock(reactor.socketMutex);
+            reactor.adoptSocket(s);
+            sockets[s->id] = s;
+            socketIDsToRevisit.insert(s->id);
+        }
+        while (!reactor.socketsToRevisit.empty()) {
+            socketIDsToRevisit.insert(reactor.socketsToRevisit.pop());
+        }
+
+        // Do the socket I/O, and work out which sockets to check for requests, as in postPoll.
+        list<Socket*> socketsToCheck;
+        list<Socket*> socketsToClose;
+        {
+            lock_guard<recursive_mutex> lock(reactor.socketMutex);
+            reactor.postPoll(fdm);
+            if (reactor.closeAll) {
+                socketsToClose = reactor.socketList;
+                reactor.closeAll = false;
+            } else if (_shutdownState.load() != RUNNING || !fdm.edgeTriggered()) {
+                socketsToCheck = reactor.socketList;
+            } else {
+                socketsToCheck = reactor.activeSockets;
+                for (uint64_t id : socketIDsToRevisit) {
+                    auto socketIt = sockets.find(id);
+                    if (socketIt != sockets.end() &&
+                        find(socketsToCheck.begin(), socketsToCheck.end(), socketIt->second) == socketsToCheck.end()) {
+                        socketsToCheck.push_back(socketIt->second);
+                    }
+                }
+            }
+        }
+        socketIDsToRevisit.clear();
+
+        int deserializationAttempts = 0;
+        int deserializedRequests = 0;
+        for (Socket* s : socketsToCheck) {
+            if (_handleSocket(s, socketsToClose, deserializationAttempts, deserializedRequests)) {
+                socketIDsToRevisit.insert(s->id);
+            }
+        }
+        if (deserializationAttempts) {
+            SINFO("[performance] Read from " << socketsToCheck.size() << " sockets, attempted to deserialize "
+                  << deserializationAttempts << " commands, " << deserializedRequests << " were complete.");
+        }
+
+        // Close any sockets we're done with. Once they're out of `_socketIDMap`, `_reply` can't find them.
+        for (Socket* s : socketsToClose) {
+            {
+                SAUTOLOCK(_socketIDMutex);
+                _socketIDMap.erase(s->id);
+                _reactorSocketIDs.erase(s->id);
+            }
+            sockets.erase(s->id);
+            socketIDsToRevisit.erase(s->id);
+            lock_guard<recursive_mutex> lock(reactor.socketMutex);
+            reactor.closeSocket(s);
+        }
+        reactor.socketCount = sockets.size();
+    }
+
+    // Close anything left when we exit.
+    SAUTOLOCK(_socketIDMutex);
+    lock_guard<recursive_mutex> lock(reactor.socketMutex);
+    while (reactor.socketList.size()) {
+        Socket* s = reactor.socketList.front();
+        _socketIDMap.erase(s->id);
+        _reactorSocketIDs.erase(s->id);
+        reactor.closeSocket(s);
+    }
+    reactor.socketCount = 0;
+}
+
 void BedrockServer::waitForHTTPS(BedrockCommand&& command) {
     lock_guard<mutex> lock(_httpsCommandMutex);
 
@@ -2149,7 +2535,7 @@ void BedrockServer::waitForHTTPS(BedrockCommand&& command) {
     BedrockCommand* commandPtr = new BedrockCommand(move(command));
 
     // And we keep it in a set of all commands with outstanding HTTPS requests.
-    _outstandingHTTPSCommands.insert(commandPtr);
+    _outstandingHTTPSCommands[commandPtr] = _outstandingHTTPSCommandTimeouts.insert(commandPtr->timeout(), commandPtr);
 
     // Insert each request pointing at the given object.
     for (auto request : commandPtr->httpsRequests) {
@@ -2179,6 +2565,8 @@ int BedrockServer::finishWaitingForHTTPS(list<SHTTPSManager::Transaction*>& comp
             // I guess it's still here! Is it done?
             if (commandPtr->areHttpsRequestsComplete()) {
                 // If so, add it back to the main queue, erase its entry in _outstandingHTTPSCommands, and delete it.
+                _outstandingHTTPSCommandTimeouts.cancel(commandPtrIt->second);
+                _timedOutHTTPSCommands.erase(commandPtr);
                 _commandQueue.push(move(*commandPtr));
                 _outstandingHTTPSCommands.erase(commandPtrIt);
                 delete commandPtr;
@@ -2192,6 +2580,163 @@ int BedrockServer::finishWaitingForHTTPS(list<SHTTPSManager::Transaction*>& comp
     return commandsCompleted;
 }
 
+void BedrockServer::_holdCommand(BedrockCommand&& command) {
+    uint64_t holdID = command.holdID;
+    if (_replicationState.load() != SQLiteNode::LEADING || _shutdownState.load() != RUNNING) {
+        // Nobody will wake this command, so we respond to it now.
+        SINFO("Not holding " << command.request.methodLine << " while not leading, responding "
+              << command.response.methodLine << ".");
+        {
+            lock_guard<mutex> lock(_heldCommandMutex);
+            _earlyWakeups.erase(holdID);
+            _releasedHoldIDs.insert(holdID);
+        }
+        command.holdID = 0;
+        if (command.initiatingPeerID) {
+            _finishPeerCommand(command);
+        } else {
+            _reply(command);
+        }
+        _releaseHolds({holdID});
+        return;
+    }
+
+    lock_guard<mutex> lock(_heldCommandMutex);
+    auto wakeupIt = _earlyWakeups.find(holdID);
+    if (wakeupIt != _earlyWakeups.end()) {
+        // It's already been woken.
+        uint64_t when = wakeupIt->second.first;
+        if (when) {
+            command.holdUntil = command.holdUntil ? min(command.holdUntil, when) : when;
+        } else {
+            command.holdUntil = 1;
+        }
+        _earlyWakeups.erase(wakeupIt);
+    }
+    uint64_t expiration = command.holdUntil ? min(command.holdUntil, command.timeout()) : command.timeout();
+    SINFO("Holding " << command.request.methodLine << " with hold ID " << holdID << " for up to "
+          << (expiration - min(expiration, STimeNow())) / 1000 << "ms.");
+    auto it = _heldCommands.emplace(piecewise_construct, forward_as_tuple(holdID),
+                                    forward_as_tuple(move(command), 0)).first;
+    it->second.second = _heldCommandTimeouts.insert(expiration, holdID);
+}
+
+bool BedrockServer::wakeCommand(uint64_t holdID, uint64_t when, uint64_t timeout) {
+    lock_guard<mutex> lock(_heldCommandMutex);
+    auto it = _heldCommands.find(holdID);
+    if (it == _heldCommands.end()) {
+        if (_releasedHoldIDs.count(holdID)) {
+            // It's gone, and whoever's waking it hasn't been told yet.
+            return false;
+        }
+
+        // We don't have it yet, so remember to wake it when we do, until it would have timed out anyway.
+        auto wakeupIt = _earlyWakeups.find(holdID);
+        if (wakeupIt == _earlyWakeups.end()) {
+            uint64_t expiration = timeout ? timeout : STimeNow() + BedrockCommand::DEFAULT_TIMEOUT * 1000;
+            _earlyWakeups.emplace(holdID, make_pair(when, expiration));
+        } else if (wakeupIt->second.first) {
+            wakeupIt->second.first = when ? min(wakeupIt->second.first, when) : 0;
+        }
+        return true;
+    }
+
+    // Whoever woke it has already forgotten about it, so it's not released to the plugins.
+    if (!when || when <= STimeNow()) {
+        _unholdCommand(it);
+        return true;
+    }
+
+    // Otherwise, reschedule it if this is sooner than it was going to wake up anyway.
+    BedrockCommand& command = it->second.first;
+    command.holdUntil = command.holdUntil ? min(command.holdUntil, when) : when;
+    _heldCommandTimeouts.cancel(it->second.second);
+    it->second.second = _heldCommandTimeouts.insert(min(command.holdUntil, command.timeout()), holdID);
+    return true;
+}
+
+void BedrockServer::_unholdCommand(map<uint64_t, pair<BedrockCommand, uint64_t>>::iterator it) {
+    BedrockCommand& command = it->second.first;
+    SINFO("Waking held command " << command.request.methodLine << " with hold ID " << it->first << ".");
+    _heldCommandTimeouts.cancel(it->second.second);
+    command.holdID = 0;
+    command.holdUntil = 0;
+    command.complete = false;
+    command.response.clear();
+    _commandQueue.push(move(command));
+    _heldCommands.erase(it);
+}
+
+void BedrockServer::_releaseHolds(const list<uint64_t>& holdIDs) {
+    if (holdIDs.empty()) {
+        return;
+    }
+    for (auto& plugin : plugins) {
+        for (uint64_t holdID : holdIDs) {
+            plugin.second->holdReleased(holdID);
+        }
+    }
+    lock_guard<mutex> lock(_heldCommandMutex);
+    for (uint64_t holdID : holdIDs) {
+        _releasedHoldIDs.erase(holdID);
+    }
+}
+
+uint64_t BedrockServer::_processHeldCommands(bool releaseAll) {
+    list<BedrockCommand> timedOutCommands;
+    list<uint64_t> releasedHoldIDs;
+    uint64_t nextExpiration;
+    {
+        lock_guard<mutex> lock(_heldCommandMutex);
+        if (releaseAll) {
+            for (auto& held : _heldCommands) {
+                releasedHoldIDs.push_back(held.first);
+                timedOutCommands.push_back(move(held.second.first));
+            }
+            _heldCommands.clear();
+            _heldCommandTimeouts.clear();
+            _earlyWakeups.clear();
+        }
+        uint64_t now = STimeNow();
+        uint64_t holdID;
+        while (_heldCommandTimeouts.popExpired(now, holdID)) {
+            auto it = _heldCommands.find(holdID);
+            releasedHoldIDs.push_back(holdID);
+            if (it->second.first.timeout() <= now) {
+                // We're done waiting, it gets the response it was held with.
+                timedOutCommands.push_back(move(it->second.first));
+                _heldCommands.erase(it);
+            } else {
+                // Its `holdUntil` time has come. Its timer has already gone, so there's nothing to cancel.
+                it->second.second = 0;
+                _unholdCommand(it);
+            }
+        }
+        for (auto wakeupIt = _earlyWakeups.begin(); wakeupIt != _earlyWakeups.end();) {
+            if (wakeupIt->second.second <= now) {
+                wakeupIt = _earlyWakeups.erase(wakeupIt);
+            } else {
+                ++wakeupIt;
+            }
+        }
+        _releasedHoldIDs.insert(releasedHoldIDs.begin(), releasedHoldIDs.end());
+        nextExpiration = _heldCommandTimeouts.nextExpiration();
+    }
+    _releaseHolds(releasedHoldIDs);
+
+    for (auto& command : timedOutCommands) {
+        SINFO("Held command " << command.request.methodLine << " timed out, responding " << command.response.methodLine
+              << ".");
+        command.holdID = 0;
+        if (command.initiatingPeerID) {
+            _finishPeerCommand(command);
+        } else {
+            _reply(command);
+        }
+    }
+    return nextExpiration;
+}
+
 void BedrockServer::_addRequestID(SData& request) {
     if (!request.isSet("requestID")) {
         string chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
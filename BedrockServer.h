@@ -1,5 +1,6 @@
 #pragma once
 #include <libstuff/libstuff.h>
+#include <libstuff/STimerWheel.h>
 #include <sqlitecluster/SQLiteNode.h>
 #include <sqlitecluster/SQLiteServer.h>
 #include "BedrockPlugin.h"
@@ -179,6 +180,15 @@ class BedrockServer : public SQLiteServer {
     // Returns true when everything's ready to shutdown.
     bool shutdownComplete();
 
+    // Returns a new ID that a plugin can use to hold a command (see `BedrockCommand::holdID`).
+    uint64_t getHoldID() { return ++_lastHoldID; }
+
+    // Wakes the command held with this ID, sending it back to the main queue to be peeked again. If `when` is set, the
+    // command is woken at that time instead, unless it's woken sooner. A command can be woken before the server has
+    // actually taken it to hold, in which case it's woken as soon as it's held, unless it hasn't been by `timeout`.
+    // Returns false if the command has already stopped being held, so the caller can wake somebody else instead.
+    bool wakeCommand(uint64_t holdID, uint64_t when = 0, uint64_t timeout = 0);
+
     // Exposes the replication state to plugins.
     atomic<SQLiteNode::State>& getState() { return _replicationState; }
 
@@ -230,16 +240,50 @@ class BedrockServer : public SQLiteServer {
     BedrockCommandQueue _blockingCommandQueue;
 
     // Each time we read a new request from a client, we give it a unique ID.
-    uint64_t _requestCount;
+    atomic<uint64_t> _requestCount;
+
+    // A client socket with commands in progress. Clients can send several requests on one socket without waiting for
+    // the responses (pipelining). These are all executed in parallel, and their responses are sent in the order the
+    // requests arrived, unless the request sets `outOfOrderResponse: true`, in which case its response is sent as soon
+    // as it's ready, and includes the request's `requestID` so the client can match them up.
+    struct ClientSocket {
+        ClientSocket(Socket* s) : socket(s) { }
+        Socket* socket;
+
+        // The sequence number to give the next ordered request read from the socket, and of the next response to send.
+        uint64_t nextRequestSequence = 1;
+        uint64_t nextResponseSequence = 1;
+
+        // Responses that are ready, but are waiting for earlier ones, by sequence number, with whether to shut the
+        // socket down after sending each. Each is kept as the buffers `SData::serializeBuffers` returns, so the
+        // content isn't copied again on the way to the socket.
+        map<uint64_t, pair<vector<shared_ptr<const string>>, bool>> completedResponses;
+
+        // The number of requests we still owe a response for, ordered or not.
+        size_t inProgress = 0;
+    };
 
     // Each time we read a command off a socket, we put the socket in this map, so that we can respond to it when the
-    // command completes. We remove the socket from the map when we reply to the command, even if the socket is still
-    // open. It will be re-inserted in this set when another command is read from it.
-    map <uint64_t, Socket*> _socketIDMap;
+    // command completes. We remove the socket from the map once we've replied to every command read from it, even if
+    // the socket is still open. It will be re-inserted in this map when another command is read from it.
+    map<uint64_t, ClientSocket> _socketIDMap;
+
+    // The most requests we'll have in progress from a single socket. Once we reach this, we stop reading from the
+    // socket until some responses have been sent.
+    static constexpr size_t _maxPipelinedRequests = 100;
+
+    // Sends whatever responses are ready for a client, in order. Once nothing is left in progress, the client is
+    // removed from `_socketIDMap`. Must be called with `_socketIDMutex` held.
+    void _sendResponses(map<uint64_t, ClientSocket>::iterator clientIt);
+
+    // Shuts down a client socket, or tells the main thread or reactor that owns it to look at it again. Must be called
+    // with `_socketIDMutex` held.
+    void _shutdownClientSocket(Socket* s);
+    void _revisitClientSocket(Socket* s);
 
     // The above _socketIDMap is modified by multiple threads, so we lock this mutex around operations that access it.
     // We don't need to lock around access to the base class's `socketList` because we carefully control access to it
-    // to the main thread.
+    // to the main thread (sockets owned by reactors are in the reactor's own `socketList` instead).
     // The only functions that access `socketList` are prePoll, postPoll, openSocket, and closeSocket, in STCPManager,
     // and acceptSocket in STCPServer.
     // prePoll and postPoll are only ever called by the main thread.
@@ -247,6 +291,57 @@ class BedrockServer : public SQLiteServer {
     // closeSocket and acceptSocket are only called inside postPoll.
     recursive_mutex _socketIDMutex;
 
+    // Sockets that postPoll should check for requests even if they had no new activity, because a command on them
+    // finished (so we can read the next request that was already buffered), or they were just accepted. Only sockets
+    // with activity are otherwise checked. Protected by _socketIDMutex.
+    set<Socket*> _socketsToRevisit;
+
+    // Reads requests from, and writes responses to, a share of the sockets accepted on the command port, on its own
+    // thread, so reading and parsing requests isn't limited to what the main thread can do. The main thread accepts
+    // sockets and hands them to reactors round-robin. Sockets on the control port and plugin ports stay on the main
+    // thread. See `-ioThreads`.
+    class Reactor : public STCPManager {
+      public:
+        // Sockets handed to this reactor by the main thread.
+        SSynchronizedQueue<Socket*> newSockets;
+
+        // IDs of this reactor's sockets to check for requests without waiting for activity (see `_socketsToRevisit`).
+        SSynchronizedQueue<uint64_t> socketsToRevisit;
+
+        // Locked around changes to this reactor's sockets, as `_reply` can shut them down from other threads.
+        recursive_mutex socketMutex;
+
+        // The number of sockets this reactor has, so the main thread can tell when they're all closed at shutdown.
+        atomic<size_t> socketCount {0};
+
+        // When set, the reactor closes all of its sockets, and when `exit` is set, its thread returns.
+        atomic<bool> closeAll {false};
+        atomic<bool> exit {false};
+
+        thread reactorThread;
+    };
+    vector<unique_ptr<Reactor>> _reactors;
+
+    // The reactor that owns each socket that's been handed to one, by socket ID. Protected by _socketIDMutex.
+    map<uint64_t, Reactor*> _reactorSocketIDs;
+
+    // The main loop for each reactor thread.
+    void _reactorLoop(Reactor& reactor, int reactorID);
+
+    // Handles a client socket for postPoll or a reactor. A closed socket is removed from `_socketIDMap` and added to
+    // `socketsToClose`, otherwise, if there's no command in progress for this socket, the next request is read from it
+    // and queued. Returns true if the socket should be checked again without waiting for new activity.
+    bool _handleSocket(Socket* s, list<Socket*>& socketsToClose, int& deserializationAttempts,
+                       int& deserializedRequests);
+
+    // Status and control commands read from client sockets. These touch state owned by the main thread (the port
+    // list, plugins, shutdown), so `_handleSocket` leaves them here for postPoll to handle rather than running them on
+    // whichever thread read them.
+    SSynchronizedQueue<BedrockCommand> _mainThreadCommands;
+
+    // Once we start shutting down, this is when we'll start closing sockets that aren't giving us any data.
+    atomic<uint64_t> _lastChance {0};
+
     // This is the replication state of the sync node. It's updated after every SQLiteNode::update() iteration. A
     // reference to this object is passed to the sync thread to allow this update.
     atomic<SQLiteNode::State> _replicationState;
@@ -358,8 +453,10 @@ class BedrockServer : public SQLiteServer {
     // we catch up, and then move them back to the regular command queue.
     multimap<uint64_t, BedrockCommand> _futureCommitCommands;
 
-    // Map of command timeouts to the indexes into _futureCommitCommands where those commands live.
-    multimap<uint64_t, uint64_t> _futureCommitCommandTimeouts;
+    // Timeouts of the commands in _futureCommitCommands, pointing at where those commands live, and the timer ID of
+    // each of those commands, so its timeout can be cancelled when it's returned to the main queue.
+    STimerWheel<multimap<uint64_t, BedrockCommand>::iterator> _futureCommitCommandTimeouts;
+    unordered_map<const BedrockCommand*, uint64_t> _futureCommitCommandTimerIDs;
     recursive_mutex _futureCommitCommandMutex;
 
     // This is a shared mutex. It can be locked by many readers at once, but if the writer (the sync thread) locks it,
@@ -404,17 +501,15 @@ class BedrockServer : public SQLiteServer {
     map<SHTTPSManager::Transaction*, BedrockCommand*> _outstandingHTTPSRequests;
     mutex _httpsCommandMutex;
 
-    // Comparison class to sort command pointers based on their timeout rather than pointer address. This lets us keep
-    // commands ordered such that the first ones to time out are at the front.
-    struct compareCommandByTimeout {
-        bool operator() (BedrockCommand* a, BedrockCommand* b) const {
-            return a->timeout() < b->timeout();
-        }
-    };
-
     // This contains all of the command that _outstandingHTTPSRequests` points at. This allows us to keep only a single
-    // copy of each command, even if it has multiple requests. Sorted with the above `compareCommandByTimeout`.
-    set<BedrockCommand*, compareCommandByTimeout> _outstandingHTTPSCommands;
+    // copy of each command, even if it has multiple requests. Each is mapped to the ID of its timer in
+    // `_outstandingHTTPSCommandTimeouts`.
+    unordered_map<BedrockCommand*, uint64_t> _outstandingHTTPSCommands;
+
+    // The timeouts of the commands in `_outstandingHTTPSCommands`, and the set of those that have timed out, whose
+    // transactions get timed out by their HTTPS managers.
+    STimerWheel<BedrockCommand*> _outstandingHTTPSCommandTimeouts;
+    set<BedrockCommand*> _timedOutHTTPSCommands;
 
     // Takes a command that has an outstanding HTTPS request and saves it in _outstandingHTTPSCommands until its HTTPS
     // requests are complete.
@@ -424,6 +519,34 @@ class BedrockServer : public SQLiteServer {
     // have any other incomplete requests).
     int finishWaitingForHTTPS(list<SHTTPSManager::Transaction*>& completedHTTPSRequests);
 
+    // Commands that plugins have asked us to hold, by hold ID, each with the ID of its timer in `_heldCommandTimeouts`,
+    // which fires at the command's `holdUntil` time or its timeout, whichever is first. `_earlyWakeups` has the IDs
+    // that were woken before we got their commands, with when they should be woken, and when to forget them.
+    // `_releasedHoldIDs` has the IDs of commands that have stopped being held that the plugins haven't been told about
+    // yet (see `_releaseHolds`).
+    map<uint64_t, pair<BedrockCommand, uint64_t>> _heldCommands;
+    STimerWheel<uint64_t> _heldCommandTimeouts;
+    map<uint64_t, pair<uint64_t, uint64_t>> _earlyWakeups;
+    set<uint64_t> _releasedHoldIDs;
+    mutex _heldCommandMutex;
+    atomic<uint64_t> _lastHoldID{0};
+
+    // Takes a command that a plugin has asked us to hold, and keeps it in `_heldCommands` until it's woken or times
+    // out.
+    // Commands are only held while we're leading, otherwise they're responded to immediately.
+    void _holdCommand(BedrockCommand&& command);
+
+    // Returns held commands whose time has come to the main queue, and responds to those that have timed out. If
+    // `releaseAll` is set, every held command is responded to. Returns the next time a held command needs attention.
+    uint64_t _processHeldCommands(bool releaseAll);
+
+    // Moves a held command back to the main queue. Called with `_heldCommandMutex` held.
+    void _unholdCommand(map<uint64_t, pair<BedrockCommand, uint64_t>>::iterator it);
+
+    // Tells the plugins that the commands with these hold IDs (which must be in `_releasedHoldIDs`) aren't held
+    // anymore, so nothing's left waiting to wake them. Called without `_heldCommandMutex` held.
+    void _releaseHolds(const list<uint64_t>& holdIDs);
+
     // Send a reply to a command that was escalated to us from a peer, rather than a locally-connected client.
     void _finishPeerCommand(BedrockCommand& command);
 
@@ -7,9 +7,10 @@ const BedrockCommand& BedrockTimeoutCommandQueue::front() const {
     }
 
     // has anything timed out?
-    if (_timeoutMap.begin()->first < STimeNow()) {
+    list<BedrockCommand>::iterator* timedOut = _timeouts.peekExpired(STimeNow());
+    if (timedOut) {
         // first item has timed out, that's the effective front.
-        return *(_timeoutMap.begin()->second);
+        return **timedOut;
     }
     return _queue.front();
 }
@@ -17,13 +18,13 @@ const BedrockCommand& BedrockTimeoutCommandQueue::front() const {
 void BedrockTimeoutCommandQueue::push(BedrockCommand&& rhs) {
     lock_guard<decltype(_queueMutex)> lock(_queueMutex);
 
-    // Add to the queue and timeout map.
+    // Add to the queue and timeout wheel.
     _queue.push_back(move(rhs));
 
     // This is past-the-end, so we decrement it to point to the last element.
     auto lastIt = _queue.end();
     lastIt--;
-    _timeoutMap.insert(make_pair(lastIt->timeout(), lastIt));
+    _timerIDs[&*lastIt] = _timeouts.insert(lastIt->timeout(), lastIt);
 
     // Write arbitrary buffer to the pipe so any subscribers will be awoken.
     // **NOTE: 1 byte so write is atomic.
@@ -35,24 +36,16 @@ BedrockCommand BedrockTimeoutCommandQueue::pop() {
     if (_queue.empty()) {
         throw out_of_range("No commands");
     }
-    if (_timeoutMap.begin()->first < STimeNow()) {
-        BedrockCommand item = move(*(_timeoutMap.begin()->second));
-        _queue.erase(_timeoutMap.begin()->second);
-        _timeoutMap.erase(_timeoutMap.begin());
-        return item;
-    }
 
-    // We need to remove the reference in the timeout map for this item as well.
-    auto firstCommandIt = _queue.begin();
-    auto itPair = _timeoutMap.equal_range(firstCommandIt->timeout());
-    for (auto it = itPair.first; it != itPair.second; it++) {
-        if (it->second == firstCommandIt) {
-            // This one points at this command, remove it.
-            _timeoutMap.erase(it);
-            break;
-        }
+    // If anything has timed out, that's what we return. Otherwise, it's the first command, and we need to cancel its
+    // timeout.
+    list<BedrockCommand>::iterator commandIt;
+    if (!_timeouts.popExpired(STimeNow(), commandIt)) {
+        commandIt = _queue.begin();
+        _timeouts.cancel(_timerIDs[&*commandIt]);
     }
-    BedrockCommand item = move(*firstCommandIt);
-    _queue.pop_front();
+    _timerIDs.erase(&*commandIt);
+    BedrockCommand item = move(*commandIt);
+    _queue.erase(commandIt);
     return item;
 }
@@ -1,4 +1,5 @@
 #include <libstuff/libstuff.h>
+#include <libstuff/STimerWheel.h>
 #include <BedrockCommand.h>
 
 class BedrockTimeoutCommandQueue : public SSynchronizedQueue<BedrockCommand> {
@@ -9,7 +10,11 @@ class BedrockTimeoutCommandQueue : public SSynchronizedQueue<BedrockCommand> {
     BedrockCommand pop();
 
   private:
-    // Map of timeouts to commands in the queue. Because the queue is a std::list, we can store iterators into it and
-    // they stay valid as we manipulate the list, avoiding walking the list to re-locate them.
-    multimap<uint64_t, list<BedrockCommand>::iterator> _timeoutMap;
+    // Timeouts of the commands in the queue. Because the queue is a std::list, we can store iterators into it and
+    // they stay valid as we manipulate the list, avoiding walking the list to re-locate them. This is mutable because
+    // `front` needs to advance it to find timed out commands.
+    mutable STimerWheel<list<BedrockCommand>::iterator> _timeouts;
+
+    // The timer ID of each command in the queue, so that we can cancel its timeout when it's popped in order.
+    unordered_map<const BedrockCommand*, uint64_t> _timerIDs;
 };
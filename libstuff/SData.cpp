@@ -121,6 +121,22 @@ string SData::serialize() const {
     return SComposeHTTP(methodLine, nameValueMap, content);
 }
 
+// --------------------------------------------------------------------------
+vector<shared_ptr<const string>> SData::serializeBuffers() const {
+    // Serializes the headers on their own, and copies the content into a buffer of its own rather than appending it to
+    // them. That's one copy of the content, where composing the whole message and queuing it on the socket took three.
+    string head;
+    string gzipContent;
+    SComposeHTTPHead(head, methodLine, nameValueMap, content, gzipContent);
+    vector<shared_ptr<const string>> buffers = {make_shared<const string>(move(head))};
+    if (!gzipContent.empty()) {
+        buffers.push_back(make_shared<const string>(move(gzipContent)));
+    } else if (!content.empty()) {
+        buffers.push_back(make_shared<const string>(content));
+    }
+    return buffers;
+}
+
 // --------------------------------------------------------------------------
 int SData::deserialize(const string& rhs) {
     // Deserializes from a string
@@ -133,6 +149,12 @@ int SData::deserialize(const char* buffer, int length) {
     return (SParseHTTP(buffer, length, methodLine, nameValueMap, content));
 }
 
+// --------------------------------------------------------------------------
+int SData::deserialize(const SFastBuffer& buffer) {
+    // Deserializes from the front of a receive buffer
+    return (SParseHTTP(buffer.c_str(), buffer.size(), methodLine, nameValueMap, content));
+}
+
 // --------------------------------------------------------------------------
 SData SData::create(const string& rhs) {
     // Initializes a new SData from a string.  If there is no content provided,
@@ -0,0 +1,245 @@
+#include "libstuff.h"
+#include <sys/epoll.h>
+
+atomic<bool> SEventLoop::usePoll(false);
+std::set<SEventLoop*> SEventLoop::_loops;
+mutex SEventLoop::_loopsMutex;
+atomic<uint64_t> SEventLoop::_nextID(1);
+
+// The most events we'll take from epoll in a single `wait`. Any more are returned by the next `wait`.
+static const int MAX_EPOLL_EVENTS = 1024;
+
+// Converts poll events to epoll events and back. Errors and hangups are always reported by epoll, so we don't ask for
+// them.
+static uint32_t SToEpollEvents(short events) {
+    uint32_t result = 0;
+    if (events & POLLIN) {
+        result |= EPOLLIN;
+    }
+    if (events & POLLPRI) {
+        result |= EPOLLPRI;
+    }
+    if (events & POLLOUT) {
+        result |= EPOLLOUT;
+    }
+    return result;
+}
+
+static short SFromEpollEvents(uint32_t events) {
+    short result = 0;
+    if (events & EPOLLIN) {
+        result |= POLLIN;
+    }
+    if (events & EPOLLPRI) {
+        result |= POLLPRI;
+    }
+    if (events & EPOLLOUT) {
+        result |= POLLOUT;
+    }
+    if (events & EPOLLERR) {
+        result |= POLLERR;
+    }
+    if (events & EPOLLHUP) {
+        result |= POLLHUP;
+    }
+    return result;
+}
+
+SEventLoop::SEventLoop() : id(_nextID++) {
+    if (!usePoll.load()) {
+        _epollFD = epoll_create1(EPOLL_CLOEXEC);
+        if (_epollFD < 0) {
+            SWARN("epoll_create1 failed with response '" << strerror(errno) << "' (#" << errno
+                  << "), falling back to poll.");
+        }
+    }
+    lock_guard<mutex> lock(_loopsMutex);
+    _loops.insert(this);
+}
+
+SEventLoop::~SEventLoop() {
+    {
+        lock_guard<mutex> lock(_loopsMutex);
+        _loops.erase(this);
+    }
+    if (_epollFD >= 0) {
+        close(_epollFD);
+    }
+}
+
+void SEventLoop::set(int fd, short events, bool edgeTriggered, void* owner, void* data) {
+    lock_guard<mutex> lock(_mutex);
+    Registration& registration = _registrations[fd];
+
+    // The first `set` for a file descriptor since the last `wait` replaces what it was waiting for, further calls add
+    // to it.
+    if (!registration.changed) {
+        registration.changed = true;
+        registration.pendingEvents = 0;
+        _changed.push_back(fd);
+    }
+    registration.pendingEvents |= events;
+    registration.edgeTriggered = edgeTriggered;
+    registration.owner = owner;
+    registration.data = data;
+}
+
+void SEventLoop::remove(int fd) {
+    lock_guard<mutex> lock(_mutex);
+    _remove(fd);
+}
+
+void SEventLoop::forget(int fd) {
+    lock_guard<mutex> loopsLock(_loopsMutex);
+    for (SEventLoop* loop : _loops) {
+        lock_guard<mutex> lock(loop->_mutex);
+        loop->_remove(fd);
+    }
+}
+
+int SEventLoop::wait(uint64_t timeoutUS) {
+    // Timeout is specified in microseconds, but epoll and poll use milliseconds, so we divide by 1000.
+    int timeoutMS = int(timeoutUS / 1000);
+    int result = 0;
+    int error = 0;
+    if (_epollFD >= 0) {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _applyChanges();
+            _ready.clear();
+            _revents.clear();
+        }
+        epoll_event events[MAX_EPOLL_EVENTS];
+        result = epoll_wait(_epollFD, events, MAX_EPOLL_EVENTS, timeoutMS);
+        error = errno;
+        lock_guard<mutex> lock(_mutex);
+        for (int i = 0; i < result; i++) {
+            _addEvent(events[i].data.fd, SFromEpollEvents(events[i].events));
+        }
+    } else {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _applyChanges();
+            _ready.clear();
+            _revents.clear();
+            if (_pollFDsDirty) {
+                _pollFDs.clear();
+                for (const auto& registration : _registrations) {
+                    if (registration.second.events) {
+                        _pollFDs.push_back({registration.first, registration.second.events, 0});
+                    }
+                }
+                _pollFDsDirty = false;
+            }
+        }
+
+        // Only `wait` changes `_pollFDs`, so we don't need to hold the lock while we're in poll.
+        result = poll(_pollFDs.data(), _pollFDs.size(), timeoutMS);
+        error = errno;
+        lock_guard<mutex> lock(_mutex);
+        for (pollfd& pfd : _pollFDs) {
+            if (pfd.revents & POLLNVAL) {
+                // Someone closed this without calling `forget`. Stop polling it, or we'll never block again.
+                SWARN("File descriptor " << pfd.fd << " was closed while registered, removing.");
+                _remove(pfd.fd);
+            } else if (pfd.revents) {
+                _addEvent(pfd.fd, pfd.revents);
+            }
+        }
+    }
+
+    if (result == -1) {
+        SWARN("Poll failed with response '" << strerror(error) << "' (#" << error << "), ignoring");
+    }
+    return result;
+}
+
+bool SEventLoop::anySet(int fd, short events) {
+    lock_guard<mutex> lock(_mutex);
+    auto it = _revents.find(fd);
+    return it != _revents.end() && (it->second & events);
+}
+
+list<void*> SEventLoop::ready(void* owner) {
+    lock_guard<mutex> lock(_mutex);
+    list<void*> result;
+    for (const Event& event : _ready) {
+        if (event.owner == owner) {
+            result.push_back(event.data);
+        }
+    }
+    return result;
+}
+
+void SEventLoop::_applyChanges() {
+    for (int fd : _changed) {
+        auto it = _registrations.find(fd);
+        if (it == _registrations.end()) {
+            // Removed since it was `set`.
+            continue;
+        }
+        Registration& registration = it->second;
+        registration.changed = false;
+
+        // Edge-triggered registrations always wait for everything, and callers handle whatever they get.
+        short events = registration.pendingEvents;
+        if (registration.edgeTriggered && _epollFD >= 0) {
+            events = SREADEVTS | SWRITEEVTS;
+        }
+        if (registration.registered && events == registration.events) {
+            continue;
+        }
+        registration.events = events;
+
+        if (_epollFD >= 0) {
+            epoll_event event{};
+            event.events = SToEpollEvents(events) | (registration.edgeTriggered ? EPOLLET : 0);
+            event.data.fd = fd;
+            int result = epoll_ctl(_epollFD, registration.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+
+            // If the file descriptor was closed and its number reused without a `forget`, the kernel's view won't
+            // match ours, so try the other operation.
+            if (result == -1 && errno == ENOENT) {
+                result = epoll_ctl(_epollFD, EPOLL_CTL_ADD, fd, &event);
+            } else if (result == -1 && errno == EEXIST) {
+                result = epoll_ctl(_epollFD, EPOLL_CTL_MOD, fd, &event);
+            }
+            if (result == -1) {
+                SWARN("Couldn't register file descriptor " << fd << " with epoll, response '" << strerror(errno)
+                      << "' (#" << errno << ").");
+                _registrations.erase(it);
+                continue;
+            }
+        } else {
+            _pollFDsDirty = true;
+        }
+        registration.registered = true;
+    }
+    _changed.clear();
+}
+
+void SEventLoop::_addEvent(int fd, short revents) {
+    auto it = _registrations.find(fd);
+    if (it == _registrations.end()) {
+        // Forgotten while we were waiting.
+        return;
+    }
+    _revents[fd] |= revents;
+    _ready.push_back({fd, revents, it->second.owner, it->second.data});
+}
+
+void SEventLoop::_remove(int fd) {
+    auto it = _registrations.find(fd);
+    if (it == _registrations.end()) {
+        return;
+    }
+    if (it->second.registered && _epollFD >= 0) {
+        // This fails harmlessly if the file descriptor was already closed, as the kernel removes it for us.
+        epoll_ctl(_epollFD, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    _registrations.erase(it);
+    _pollFDsDirty = true;
+    _revents.erase(fd);
+    _ready.erase(remove_if(_ready.begin(), _ready.end(), [fd](const Event& event) { return event.fd == fd; }),
+                 _ready.end());
+}
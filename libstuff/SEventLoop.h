@@ -0,0 +1,118 @@
+#pragma once
+// Can't include libstuff.h here because it'd be circular.
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+using namespace std;
+
+// Waits for activity on a set of file descriptors. Unlike a bare `poll`, file descriptors stay registered between
+// calls to `wait`, so only the registrations that change cost anything, and on Linux this uses epoll so that the cost
+// of `wait` depends on the number of file descriptors with activity, not the number registered.
+//
+// The expected use is the existing `prePoll`/`postPoll` pattern, with the loop kept across iterations: during
+// `prePoll`, callers `set` the events they're interested in for each file descriptor, which replaces whatever they
+// asked for in the previous iteration, and during `postPoll` they check which events occurred with `anySet`. File
+// descriptors that aren't `set` in an iteration keep their previous registration.
+//
+// File descriptors can also be registered as edge-triggered, in which case they're registered for both reading and
+// writing once, and never need to be `set` again. Callers must then read and write until they'd block, as they won't be
+// told again about data that was already available. Callers can find the file descriptors with activity by the `owner`
+// they registered them with, using `ready`, rather than checking every file descriptor they own. If the loop is using
+// poll, edge-triggered registrations are level-triggered, and callers must `set` them each iteration like any other.
+//
+// Any file descriptor that's registered in a loop must be passed to `SEventLoop::forget` before it's closed, so that a
+// later file descriptor with the same number isn't mistaken for it.
+class SEventLoop {
+  public:
+    // If set, loops created after this is set use `poll` rather than epoll. This exists for tests.
+    static atomic<bool> usePoll;
+
+    SEventLoop();
+    ~SEventLoop();
+
+    // Uniquely identifies this loop, so that callers can tell if they're being polled by a different loop than last
+    // time, even if it's at the same address. Never 0.
+    const uint64_t id;
+
+    // Explicitly delete copy constructor so it can't accidentally get called.
+    SEventLoop(const SEventLoop& other) = delete;
+
+    // Adds `events` (SREADEVTS, SWRITEEVTS) to the events we'll wait for on `fd` in the next call to `wait`. Any
+    // events `fd` was registered for before the previous `wait` are replaced. `owner` and `data` are returned by
+    // `ready`.
+    void set(int fd, short events, bool edgeTriggered = false, void* owner = nullptr, void* data = nullptr);
+
+    // Removes `fd` from this loop.
+    void remove(int fd);
+
+    // Removes `fd` from every loop. Call this before closing any file descriptor that's been registered.
+    static void forget(int fd);
+
+    // Waits up to `timeoutUS` microseconds for activity on any registered file descriptor. Returns the number of file
+    // descriptors with activity, or -1 on error.
+    int wait(uint64_t timeoutUS);
+
+    // Returns true if any of `events` occurred on `fd` in the last call to `wait`.
+    bool anySet(int fd, short events);
+
+    // Returns the `data` of every file descriptor registered with `owner` that had activity in the last `wait`.
+    list<void*> ready(void* owner);
+
+    // Returns true if edge-triggered registrations really are edge-triggered (i.e., the loop is using epoll).
+    bool edgeTriggered() const { return _epollFD >= 0; }
+
+  private:
+    struct Registration {
+        short events = 0;
+        short pendingEvents = 0;
+        bool changed = false;
+        bool edgeTriggered = false;
+        bool registered = false;
+        void* owner = nullptr;
+        void* data = nullptr;
+    };
+
+    struct Event {
+        int fd;
+        short revents;
+        void* owner;
+        void* data;
+    };
+
+    // Applies any changes made with `set` since the last `wait`. Must be called with `_mutex` held.
+    void _applyChanges();
+
+    // Records the events that occurred on a file descriptor. Must be called with `_mutex` held.
+    void _addEvent(int fd, short revents);
+
+    // Removes a file descriptor from the loop. Must be called with `_mutex` held.
+    void _remove(int fd);
+
+    // Every loop that currently exists, so `forget` can find them. This needs `std::` as `set` is also a method here.
+    static std::set<SEventLoop*> _loops;
+    static mutex _loopsMutex;
+    static atomic<uint64_t> _nextID;
+
+    // Protects everything below. This is never held while blocked in `wait`.
+    mutex _mutex;
+
+    // The epoll instance, or -1 if we're using poll.
+    int _epollFD = -1;
+
+    // Everything that's registered, and those that have been `set` since the last `wait`.
+    unordered_map<int, Registration> _registrations;
+    vector<int> _changed;
+
+    // When using poll, the array we pass to it, which is rebuilt only when a registration changes.
+    vector<pollfd> _pollFDs;
+    bool _pollFDsDirty = true;
+
+    // The results of the last `wait`.
+    vector<Event> _ready;
+    unordered_map<int, short> _revents;
+};
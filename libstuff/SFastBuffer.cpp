@@ -0,0 +1,56 @@
+#include "libstuff.h"
+
+SFastBuffer::SFastBuffer() : _data(make_shared<string>()), _front(0) { }
+
+SFastBuffer::SFastBuffer(const string& buffer) : _data(make_shared<string>(buffer)), _front(0) { }
+
+void SFastBuffer::clear() {
+    if (_shared()) {
+        _data = make_shared<string>();
+    } else {
+        _data->clear();
+    }
+    _front = 0;
+}
+
+void SFastBuffer::consumeFront(size_t bytes) {
+    SASSERT(bytes <= size());
+    _front += bytes;
+
+    // If that was everything, we can start again at the beginning without moving anything.
+    if (_front == _data->size() && !_shared()) {
+        _data->clear();
+        _front = 0;
+    }
+}
+
+void SFastBuffer::append(const char* buffer, size_t bytes) {
+    if (_shared()) {
+        // Someone has views into our storage, so leave it alone and move what's left to a new one.
+        shared_ptr<string> data = make_shared<string>();
+        data->reserve(size() + bytes);
+        data->append(c_str(), size());
+        _data = move(data);
+        _front = 0;
+    } else if (_front && _front >= size()) {
+        // We've consumed at least as much as remains, so it's worth moving what remains to the start.
+        _data->erase(0, _front);
+        _front = 0;
+    }
+    _data->append(buffer, bytes);
+}
+
+SFastBuffer& SFastBuffer::operator+=(const string& rhs) {
+    append(rhs.c_str(), rhs.size());
+    return *this;
+}
+
+SFastBuffer& SFastBuffer::operator=(const string& rhs) {
+    clear();
+    append(rhs.c_str(), rhs.size());
+    return *this;
+}
+
+ostream& operator<<(ostream& os, const SFastBuffer& buffer) {
+    return os.write(buffer.c_str(), buffer.size());
+}
@@ -0,0 +1,48 @@
+#pragma once
+// Can't include libstuff.h here because it'd be circular.
+#include <memory>
+#include <ostream>
+#include <string>
+using namespace std;
+
+// A buffer that data is appended to at the back and consumed from the front, for receiving from sockets. Consuming
+// from the front of a `string` (as `SConsumeFront` does) moves everything after it, so parsing N messages out of a
+// buffer that holds them all costs O(N^2). This just moves its front forward, and only moves the unconsumed data back
+// to the start of its storage when more is appended, once at least as much has been consumed as remains, so the total
+// cost of moving data is never more than the number of bytes consumed.
+//
+// The storage can be shared with `share`, so that views into it (see SHTTPView) stay valid after the data they refer to
+// is consumed. While the storage is shared, the buffer never changes it, and copies the unconsumed data to new storage
+// before appending anything.
+class SFastBuffer {
+  public:
+    SFastBuffer();
+    SFastBuffer(const string& buffer);
+
+    // Accessors. `c_str` points to `size` bytes followed by a null terminator, and is invalidated by any modification.
+    bool empty() const { return _front == _data->size(); }
+    size_t size() const { return _data->size() - _front; }
+    const char* c_str() const { return _data->c_str() + _front; }
+    string toString() const { return string(c_str(), size()); }
+
+    // Returns the storage `c_str` points into. The storage won't change while the returned pointer exists.
+    shared_ptr<const string> share() const { return _data; }
+
+    // Mutators
+    void clear();
+    void consumeFront(size_t bytes);
+    void append(const char* buffer, size_t bytes);
+    SFastBuffer& operator+=(const string& rhs);
+    SFastBuffer& operator=(const string& rhs);
+
+  private:
+    // Returns true if anyone else holds `_data`, in which case we can't modify it.
+    bool _shared() const { return _data.use_count() > 1; }
+
+    shared_ptr<string> _data;
+
+    // The offset of the first unconsumed byte in `_data`.
+    size_t _front;
+};
+
+ostream& operator<<(ostream& os, const SFastBuffer& buffer);
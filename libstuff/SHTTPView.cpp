@@ -0,0 +1,272 @@
+#include "libstuff.h"
+
+typedef SHTTPView::string_view string_view;
+
+// Compares two header names, ignoring case. Returns less than, equal to, or greater than 0, like `strcasecmp`.
+static int SHTTPView_compare(string_view lhs, string_view rhs) {
+    size_t length = min(lhs.size(), rhs.size());
+    for (size_t i = 0; i < length; i++) {
+        int difference = tolower((unsigned char)lhs[i]) - tolower((unsigned char)rhs[i]);
+        if (difference) {
+            return difference;
+        }
+    }
+    return lhs.size() < rhs.size() ? -1 : (lhs.size() > rhs.size() ? 1 : 0);
+}
+
+// Returns the text between `start` and `end`, without any leading or trailing spaces.
+static string_view SHTTPView_trim(const char* start, const char* end) {
+    while (start < end && *start == ' ') {
+        ++start;
+    }
+    while (end > start && *(end - 1) == ' ') {
+        --end;
+    }
+    return string_view(start, end - start);
+}
+
+// Returns a pointer past up to two end of line characters starting at `start`.
+static const char* SHTTPView_skipEOLs(const char* start, const char* inputEnd) {
+    int numEOLs = 2;
+    while (start < inputEnd && (*start == '\r' || *start == '\n') && numEOLs--) {
+        ++start;
+    }
+    return start;
+}
+
+int SHTTPView::parse(const char* buffer, size_t length) {
+    clear();
+    int result = _parse(buffer, length);
+    if (!result) {
+        clear();
+    }
+    return result;
+}
+
+int SHTTPView::parse(const SFastBuffer& buffer) {
+    int result = parse(buffer.c_str(), buffer.size());
+    if (result) {
+        _storage = buffer.share();
+    }
+    return result;
+}
+
+void SHTTPView::clear() {
+    methodLine = string_view();
+    headers.clear();
+    content = string_view();
+    _storage.reset();
+    _owned.clear();
+    _index.clear();
+}
+
+string_view SHTTPView::operator[](string_view name) const {
+    ssize_t index = _find(name);
+    return index < 0 ? string_view() : headers[index].second;
+}
+
+bool SHTTPView::isSet(string_view name) const {
+    return _find(name) >= 0;
+}
+
+ssize_t SHTTPView::_scan(string_view name) const {
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (!SHTTPView_compare(headers[i].first, name)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+ssize_t SHTTPView::_find(string_view name) const {
+    if (_index.size() != headers.size()) {
+        _index.resize(headers.size());
+        for (size_t i = 0; i < headers.size(); i++) {
+            _index[i] = i;
+        }
+        sort(_index.begin(), _index.end(), [this](size_t lhs, size_t rhs) {
+            return SHTTPView_compare(headers[lhs].first, headers[rhs].first) < 0;
+        });
+    }
+    auto it = lower_bound(_index.begin(), _index.end(), name, [this](size_t index, string_view value) {
+        return SHTTPView_compare(headers[index].first, value) < 0;
+    });
+    if (it != _index.end() && !SHTTPView_compare(headers[*it].first, name)) {
+        return *it;
+    }
+    return -1;
+}
+
+string_view SHTTPView::_own(string&& value) {
+    _owned.push_back(move(value));
+    return string_view(_owned.back());
+}
+
+int SHTTPView::_parse(const char* buffer, size_t length) {
+    // Keep parsing until we run out of input or encounter a blank line
+    const char* lineStart = buffer;
+    const char* inputEnd = buffer + length;
+    ssize_t currentHeader = -1;
+    bool isChunked = false;
+    bool lastChunkFound = false;
+    string* chunkedContent = nullptr;
+    while (lineStart < inputEnd) {
+        // Find the end of the line
+        const char* lineEnd = lineStart;
+        while ((lineEnd < inputEnd) && (*lineEnd != '\r') && (*lineEnd != '\n')) {
+            ++lineEnd;
+        }
+        if (lineEnd >= inputEnd) {
+            // Couldn't find end of line; couldn't complete parsing.
+            return 0;
+        }
+
+        // Found the end of the line; is the line blank?
+        if (lineEnd == lineStart) {
+            // Blank line -- if we have at least the method, then we're done. Otherwise, ignore.
+            if (!methodLine.empty()) {
+                // If we are done processing a chunked body, the message ends after this line.
+                if (isChunked) {
+                    SASSERTWARN(lastChunkFound);
+                    if (chunkedContent) {
+                        content = string_view(*chunkedContent);
+                    }
+                    return (int)(SHTTPView_skipEOLs(lineEnd, inputEnd) - buffer);
+                }
+
+                // If not processing a chunked body, then finish up.
+                ssize_t transferEncoding = _scan("Transfer-Encoding");
+                if (transferEncoding < 0 || SHTTPView_compare(headers[transferEncoding].second, "chunked")) {
+                    // If there is no content-length, the message is just the headers.
+                    const char* parseEnd = SHTTPView_skipEOLs(lineEnd, inputEnd);
+                    int headerLength = (int)(parseEnd - buffer);
+                    ssize_t contentLengthHeader = _scan("Content-Length");
+                    int contentLength = 0;
+                    if (contentLengthHeader >= 0) {
+                        contentLength = atoi(headers[contentLengthHeader].second.to_string().c_str());
+                    }
+                    if (contentLength <= 0) {
+                        return headerLength;
+                    }
+
+                    // There is a content length -- if we don't have enough, then cancel the parse.
+                    if ((int)(length - headerLength) < contentLength) {
+                        return 0;
+                    }
+                    content = string_view(parseEnd, contentLength);
+                    return headerLength + contentLength;
+                }
+
+                // Otherwise, we start on a chunked body.
+                isChunked = true;
+            }
+        } else {
+            // Not blank.  Is this the method line?
+            bool isHeaderOrFooter = true;
+            if (methodLine.empty()) {
+                // Everything in the line is the method
+                methodLine = SHTTPView_trim(lineStart, lineEnd);
+                isHeaderOrFooter = false;
+            }
+
+            // Is it a new chunk?
+            else if (isChunked) {
+                // Get the chunk length and ignore the optional stuff after the optional semicolon.
+                string_view chunkHeader = SHTTPView_trim(lineStart, lineEnd);
+                string_view hexChunkLength = chunkHeader.substr(0, chunkHeader.find(';'));
+
+                // If valid hex number, then we have a chunk.
+                auto isHex = [](char c) { return isxdigit((unsigned char)c); };
+                if (!hexChunkLength.empty() && hexChunkLength.size() <= 8 &&
+                    all_of(hexChunkLength.begin(), hexChunkLength.end(), isHex)) {
+                    // Get the chunk length.
+                    isHeaderOrFooter = false;
+                    int chunkLength = (int)SFromHex(hexChunkLength.to_string());
+                    if (chunkLength) {
+                        // Verify that we can get the entire chunk.
+                        const char* chunkStart = lineEnd + 2; // skipping the \r\n.
+                        const char* chunkEnd = chunkStart + chunkLength;
+                        if (chunkEnd >= inputEnd) {
+                            // Insufficient content
+                            return 0;
+                        }
+
+                        // Get the chunk and advance the pointers.
+                        if (!chunkedContent) {
+                            _owned.emplace_back();
+                            chunkedContent = &_owned.back();
+                        }
+                        chunkedContent->append(chunkStart, chunkLength);
+                        lineEnd = chunkEnd;
+                    } else {
+                        lastChunkFound = true;
+                    }
+                }
+            }
+
+            // More headers, or footers, which are treated just like headers.
+            if (isHeaderOrFooter) {
+                string_view line(lineStart, lineEnd - lineStart);
+                if (isspace(*lineStart)) {
+                    // Starts with whitespace -- if we have a header, add it to the end of its value. Otherwise, add it
+                    // to the end of the method.
+                    string_view& value = currentHeader >= 0 ? headers[currentHeader].second : methodLine;
+                    value = _own(value.to_string() + line.to_string());
+                } else {
+                    // Parse name/value pair.  Name is everything up to the ':'. A line without a name is ignored;
+                    // only lines starting with whitespace continue the header before them.
+                    const char* nameEnd = lineStart;
+                    while (nameEnd < lineEnd && *nameEnd != ':') {
+                        ++nameEnd;
+                    }
+                    string_view name = SHTTPView_trim(lineStart, nameEnd);
+                    if (!name.empty()) {
+                        // The value is everything up to the end of the line, trimming leading and trailing whitespace.
+                        string_view value;
+                        if (nameEnd < lineEnd) {
+                            value = SHTTPView_trim(nameEnd + 1, lineEnd);
+                        }
+
+                        // Store the result. If there's something already there just override, with the exception of
+                        // Set-Cookie: generate a crappy list with 0xFF separation. (See SComposeHTTP for explanation.)
+                        currentHeader = _scan(name);
+                        if (currentHeader >= 0 && !SHTTPView_compare(name, "Set-Cookie")) {
+                            string cookies = headers[currentHeader].second.to_string();
+                            cookies += S_COOKIE_SEPARATOR;
+                            cookies += value.to_string();
+                            headers[currentHeader].second = _own(move(cookies));
+                        } else {
+                            // Strip any slash-escaping.
+                            if (memchr(value.data(), '\\', value.size())) {
+                                value = _own(SUnescape(value.to_string()));
+                            }
+                            if (currentHeader >= 0) {
+                                headers[currentHeader].second = value;
+                            } else {
+                                headers.emplace_back(name, value);
+                                currentHeader = headers.size() - 1;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // Consume the end of the line -- accept \r\n, \n\r, \r, or \n.  But *not* \n\n (that's two endings)
+        lineStart = lineEnd; // Advance past the parsed line to the line ending
+        if (inputEnd - lineStart >= 2 && lineStart[0] == '\r' && lineStart[1] == '\n') {
+            lineStart += 2;
+        } else if (inputEnd - lineStart >= 2 && lineStart[0] == '\n' && lineStart[1] == '\r') {
+            lineStart += 2;
+        } else if (lineStart[0] == '\n') {
+            ++lineStart;
+        } else if (lineStart[0] == '\r') {
+            ++lineStart;
+        } else {
+            SWARN("How did we get here?");
+        }
+    }
+
+    // Reached the end of the input and haven't finished parsing the header
+    return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+// Can't include libstuff.h here because it'd be circular.
+#include <experimental/string_view>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+class SFastBuffer;
+
+// An HTTP message parsed in place. `SParseHTTP` copies the method line, every header name and value, and the content
+// into new strings, and inserts each header into a map. This records where each of them is in the buffer it was parsed
+// from instead, with the headers in a flat vector in the order they first appeared. Looking up a header scans the
+// vector until the first lookup after parsing, which builds a sorted index.
+//
+// When parsed from an SFastBuffer, the view holds a reference to the buffer's storage, so it stays valid after the
+// message has been consumed from the buffer. When parsed from a plain pointer, the caller must leave the buffer alone
+// for as long as they use the view. The few parts that have to be rewritten (escaped header values, values continued
+// onto following lines, repeated Set-Cookie headers, and chunked content) are stored in the view itself.
+class SHTTPView {
+  public:
+    typedef experimental::string_view string_view;
+    typedef pair<string_view, string_view> Header;
+
+    SHTTPView() {}
+
+    // Views can point into `_owned`, so copies would point into the original. Moving a list doesn't move its elements,
+    // so moves are fine.
+    SHTTPView(const SHTTPView& other) = delete;
+    SHTTPView& operator=(const SHTTPView& other) = delete;
+    SHTTPView(SHTTPView&& other) = default;
+    SHTTPView& operator=(SHTTPView&& other) = default;
+
+    // Parses the HTTP message at the front of a buffer. Returns the length of the message, or 0 (leaving the view
+    // empty) if the buffer doesn't yet hold a complete message.
+    int parse(const char* buffer, size_t length);
+    int parse(const SFastBuffer& buffer);
+
+    // Empties the view, and releases any storage it holds a reference to.
+    void clear();
+
+    // The parts of the message. A header that's repeated only appears once, with its last value.
+    string_view methodLine;
+    vector<Header> headers;
+    string_view content;
+
+    // Returns the value of a header, ignoring case in its name, or an empty view if it's not set.
+    string_view operator[](string_view name) const;
+    bool isSet(string_view name) const;
+
+  private:
+    // Returns the index of a header in `headers`, or -1. `_scan` always searches linearly, `_find` uses the index.
+    ssize_t _scan(string_view name) const;
+    ssize_t _find(string_view name) const;
+
+    // Does the actual parsing, returning 0 if the message is incomplete.
+    int _parse(const char* buffer, size_t length);
+
+    // Stores a string in the view, and returns a view of it.
+    string_view _own(string&& value);
+
+    // The storage of the SFastBuffer we were parsed from, if any.
+    shared_ptr<const string> _storage;
+
+    // Parts of the message that aren't in the parsed buffer.
+    list<string> _owned;
+
+    // Indexes into `headers`, sorted by name, built by the first lookup.
+    mutable vector<size_t> _index;
+};
@@ -0,0 +1,213 @@
+#include <libstuff/libstuff.h>
+#include "SQColumnarResult.h"
+
+SQColumnarResult::SQColumnarResult(const SQResult& result) : headers(result.headers) {
+    for (const auto& row : result.rows) {
+        appendRow(row);
+    }
+}
+
+SQResult SQColumnarResult::toSQResult() const {
+    SQResult result;
+    result.headers = headers;
+    result.rows.resize(_rowCount);
+    for (size_t r = 0; r < _rowCount; r++) {
+        result.rows[r].reserve(_columns.size());
+        for (size_t c = 0; c < _columns.size(); c++) {
+            result.rows[r].emplace_back(text(r, c));
+        }
+    }
+    return result;
+}
+
+int64_t SQColumnarResult::getInt64(size_t row, size_t column) const {
+    const Cell& cell = _columns[column][row];
+    switch (cell.type) {
+        case INTEGER:
+            return cell.integer;
+        case FLOAT:
+            return (int64_t)cell.real;
+        case NULL_VALUE:
+            return 0;
+        default:
+            return SToInt64(text(row, column));
+    }
+}
+
+double SQColumnarResult::getDouble(size_t row, size_t column) const {
+    const Cell& cell = _columns[column][row];
+    switch (cell.type) {
+        case INTEGER:
+            return (double)cell.integer;
+        case FLOAT:
+            return cell.real;
+        case NULL_VALUE:
+            return 0.0;
+        default:
+            return atof(text(row, column).c_str());
+    }
+}
+
+void SQColumnarResult::clear() {
+    headers.clear();
+    _columns.clear();
+    _arena.clear();
+    _rowCount = 0;
+}
+
+void SQColumnarResult::_appendCell(size_t column, Type type, const char* data, size_t length) {
+    Cell cell;
+    cell.offset = _arena.size();
+    cell.length = length;
+    cell.type = type;
+    cell.integer = 0;
+    _arena.append(data, length);
+    _columns[column].push_back(cell);
+}
+
+void SQColumnarResult::appendRow(sqlite3_stmt* statement) {
+    int columnCount = sqlite3_column_count(statement);
+    if (headers.empty()) {
+        for (int c = 0; c < columnCount; c++) {
+            const char* name = sqlite3_column_name(statement, c);
+            headers.push_back(name ? name : "");
+        }
+    }
+    _columns.resize(columnCount);
+    for (int c = 0; c < columnCount; c++) {
+        // Read the type before the text, as asking for the text converts numeric values in place.
+        Type type = NULL_VALUE;
+        int64_t integer = 0;
+        double real = 0.0;
+        switch (sqlite3_column_type(statement, c)) {
+            case SQLITE_INTEGER:
+                type = INTEGER;
+                integer = sqlite3_column_int64(statement, c);
+                break;
+            case SQLITE_FLOAT:
+                type = FLOAT;
+                real = sqlite3_column_double(statement, c);
+                break;
+            case SQLITE_TEXT:
+                type = TEXT;
+                break;
+            case SQLITE_BLOB:
+                type = BLOB;
+                break;
+        }
+        const char* value = (const char*)sqlite3_column_text(statement, c);
+        _appendCell(c, type, value ? value : "", value ? sqlite3_column_bytes(statement, c) : 0);
+        if (type == INTEGER) {
+            _columns[c].back().integer = integer;
+        } else if (type == FLOAT) {
+            _columns[c].back().real = real;
+        }
+    }
+    _rowCount++;
+}
+
+void SQColumnarResult::appendRow(const vector<string>& row) {
+    SASSERT(row.size() == headers.size());
+    _columns.resize(row.size());
+    for (size_t c = 0; c < row.size(); c++) {
+        _appendCell(c, TEXT, row[c].data(), row[c].size());
+    }
+    _rowCount++;
+}
+
+string SQColumnarResult::serializeToJSON() const {
+    // This matches SComposeJSONObject({headers, rows}) over SComposeJSONArray of each row, but without building any of
+    // the intermediate lists.
+    string output = "{\"headers\":" + SComposeJSONArray(headers) + ",\"rows\":[";
+    output.reserve(output.size() + _arena.size() + _rowCount * _columns.size() * 3);
+    for (size_t r = 0; r < _rowCount; r++) {
+        output += r ? ",[" : "[";
+        for (size_t c = 0; c < _columns.size(); c++) {
+            if (c) {
+                output += ",";
+            }
+            const Cell& cell = _columns[c][r];
+            if (cell.type == INTEGER) {
+                // SQLite's text for integers is always canonical, so SToJSON would return it unchanged.
+                output.append(_arena, cell.offset, cell.length);
+            } else {
+                output += SToJSON(text(r, c));
+            }
+        }
+        output += "]";
+    }
+    output += "]}";
+    return output;
+}
+
+string SQColumnarResult::serializeToText() const {
+    string output = SComposeList(headers, " | ") + "\n";
+    output.reserve(output.size() + _arena.size() + _rowCount * (_columns.size() * 3 + 1));
+    for (size_t r = 0; r < _rowCount; r++) {
+        for (size_t c = 0; c < _columns.size(); c++) {
+            if (c) {
+                output += " | ";
+            }
+            const Cell& cell = _columns[c][r];
+            output.append(_arena, cell.offset, cell.length);
+        }
+        output += "\n";
+    }
+    return output;
+}
+
+string SQColumnarResult::serialize(const string& format) const {
+    // Output the appropriate type
+    if (SIEquals(format, "json"))
+        return serializeToJSON();
+    else
+        return serializeToText();
+}
+
+bool SQColumnarResult::deserialize(const string& json) {
+    // Reset ourselves to start
+    clear();
+
+    // If there are any problems, clean up whatever we've parsed
+    try {
+        // Verify we have the basic components
+        STable content = SParseJSONObject(json);
+        if (!SContains(content, "headers")) {
+            STHROW("Missing 'headers'");
+        }
+        if (!SContains(content, "rows")) {
+            STHROW("Missing 'rows'");
+        }
+
+        // Add the headers
+        list<string> jsonHeaders = SParseJSONArray(content["headers"]);
+        headers.insert(headers.end(), jsonHeaders.begin(), jsonHeaders.end());
+        _columns.resize(headers.size());
+
+        // Add the rows
+        list<string> jsonRows = SParseJSONArray(content["rows"]);
+        for (string& jsonRowStr : jsonRows) {
+            // Get the row and make sure it has the right number of columns
+            list<string> jsonRow = SParseJSONArray(jsonRowStr);
+            if (jsonRow.size() != headers.size()) {
+                STHROW("Incorrect number of columns in row");
+            }
+
+            // Insert the values
+            size_t c = 0;
+            for (const string& value : jsonRow) {
+                _appendCell(c++, TEXT, value.data(), value.size());
+            }
+            _rowCount++;
+        }
+
+        // Success!
+        return true;
+    } catch (const SException& e) {
+        SDEBUG("Failed to deserialize JSON-encoded SQColumnarResult (" << e.what() << "): " << json);
+    }
+
+    // Failed, reset and report failure
+    clear();
+    return false;
+}
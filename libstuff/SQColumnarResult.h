@@ -0,0 +1,92 @@
+#pragma once
+// Can't include libstuff.h here because it'd be circular.
+#include <experimental/string_view>
+#include <string>
+#include <vector>
+using namespace std;
+
+class SQResult;
+struct sqlite3_stmt;
+
+// An alternative to SQResult that stores a query result by column, with the text of every cell packed into a single
+// byte arena. Reading N rows into an SQResult allocates a string per cell, this allocates a handful of buffers that
+// grow geometrically, regardless of the number of rows. Cells keep the type SQLite reported for them, and text is
+// exposed as views into the arena, which stay valid until the result is next modified.
+class SQColumnarResult {
+  public:
+    typedef experimental::string_view string_view;
+
+    // The storage class of a single cell, matching SQLite's fundamental datatypes.
+    enum Type : uint8_t {
+        NULL_VALUE,
+        INTEGER,
+        FLOAT,
+        TEXT,
+        BLOB,
+    };
+
+    // Attributes
+    vector<string> headers;
+
+    // Constructors. The SQResult constructor and `toSQResult` let existing code that works with SQResult interoperate
+    // with this class.
+    SQColumnarResult() {}
+    explicit SQColumnarResult(const SQResult& result);
+    SQResult toSQResult() const;
+
+    // Accessors
+    inline bool empty() const { return !_rowCount; }
+    inline size_t size() const { return _rowCount; }
+    inline size_t columnCount() const { return _columns.size(); }
+    inline Type type(size_t row, size_t column) const { return _columns[column][row].type; }
+    inline bool isNull(size_t row, size_t column) const { return type(row, column) == NULL_VALUE; }
+
+    // Returns the value of a cell as text, as `sqlite3_column_text` would (NULL is returned as empty).
+    inline string_view view(size_t row, size_t column) const {
+        const Cell& cell = _columns[column][row];
+        return string_view(_arena.data() + cell.offset, cell.length);
+    }
+    inline string text(size_t row, size_t column) const { return view(row, column).to_string(); }
+
+    // Return the value of a cell as a number. Cells that SQLite returned as text are parsed.
+    int64_t getInt64(size_t row, size_t column) const;
+    double getDouble(size_t row, size_t column) const;
+
+    // Mutators
+    void clear();
+
+    // Appends the current row of a statement that's just returned SQLITE_ROW from `sqlite3_step`. The first call also
+    // records the column names as headers.
+    void appendRow(sqlite3_stmt* statement);
+
+    // Appends a row of text values. The row must have the same number of values as there are headers.
+    void appendRow(const vector<string>& row);
+
+    // Serializers. These produce exactly the same output as the SQResult versions, but write directly from the arena.
+    string serializeToJSON() const;
+    string serializeToText() const;
+    string serialize(const string& format) const;
+
+    // Deserializers
+    bool deserialize(const string& json);
+
+  private:
+    // A single value. The text of every cell lives in `_arena`, numeric values are also kept in native form.
+    struct Cell {
+        size_t offset;
+        uint32_t length;
+        Type type;
+        union {
+            int64_t integer;
+            double real;
+        };
+    };
+
+    // Appends a cell to the given column, copying `length` bytes of `data` into the arena.
+    void _appendCell(size_t column, Type type, const char* data, size_t length);
+
+    // One vector of cells per column, each with one cell per row.
+    vector<vector<Cell>> _columns;
+    string _arena;
+    size_t _rowCount = 0;
+};
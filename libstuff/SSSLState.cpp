@@ -152,20 +152,20 @@ int SSSLSend(SSSLState* ssl, const string& buffer) {
 }
 
 // --------------------------------------------------------------------------
-bool SSSLSendConsume(SSSLState* ssl, string& sendBuffer) {
-    // Send as much as we can and return whether the socket is still alive
-    if (sendBuffer.empty()) {
-        return true;
-    }
-
-    // Nothing to send, assume we're alive
-    int numSent = SSSLSend(ssl, sendBuffer);
-    if (numSent > 0) {
-        SConsumeFront(sendBuffer, numSent);
+bool SSSLSendConsume(SSSLState* ssl, SSendBuffer& sendBuffer) {
+    // SSL sends a buffer at a time, so keep going until we've sent them all or one is only partly sent
+    while (!sendBuffer.empty()) {
+        int length = (int)sendBuffer.frontSize();
+        int numSent = SSSLSend(ssl, sendBuffer.frontData(), length);
+        if (numSent == -1) {
+            return false;
+        }
+        sendBuffer.consumeFront(numSent);
+        if (numSent < length) {
+            break;
+        }
     }
-
-    // Done!
-    return (numSent != -1);
+    return true;
 }
 
 // --------------------------------------------------------------------------
@@ -184,7 +184,7 @@ bool SSSLSendAll(SSSLState* ssl, const string& buffer) {
 }
 
 // --------------------------------------------------------------------------
-bool SSSLRecvAppend(SSSLState* ssl, string& recvBuffer) {
+bool SSSLRecvAppend(SSSLState* ssl, SFastBuffer& recvBuffer) {
     // Keep trying to receive as long as we can
     SASSERT(ssl);
     char buffer[1024 * 16];
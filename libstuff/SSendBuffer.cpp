@@ -0,0 +1,52 @@
+#include "libstuff.h"
+
+int SSendBuffer::fill(iovec* iov, int count) const {
+    int filled = 0;
+    size_t offset = _offset;
+    for (auto it = _buffers.begin(); it != _buffers.end() && filled < count; ++it) {
+        iov[filled].iov_base = const_cast<char*>((*it)->data() + offset);
+        iov[filled].iov_len = (*it)->size() - offset;
+        filled++;
+        offset = 0;
+    }
+    return filled;
+}
+
+string SSendBuffer::toString() const {
+    string result;
+    result.reserve(_size);
+    size_t offset = _offset;
+    for (const auto& buffer : _buffers) {
+        result.append(*buffer, offset, string::npos);
+        offset = 0;
+    }
+    return result;
+}
+
+void SSendBuffer::append(shared_ptr<const string> buffer) {
+    if (buffer && !buffer->empty()) {
+        _size += buffer->size();
+        _buffers.push_back(move(buffer));
+    }
+}
+
+void SSendBuffer::consumeFront(size_t bytes) {
+    SASSERT(bytes <= _size);
+    _size -= bytes;
+    while (bytes) {
+        size_t remaining = _buffers.front()->size() - _offset;
+        if (bytes < remaining) {
+            _offset += bytes;
+            return;
+        }
+        bytes -= remaining;
+        _buffers.pop_front();
+        _offset = 0;
+    }
+}
+
+void SSendBuffer::clear() {
+    _buffers.clear();
+    _offset = 0;
+    _size = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+// Can't include libstuff.h here because it'd be circular.
+#include <list>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+using namespace std;
+
+// A queue of buffers waiting to be sent on a socket. Sending a message used to mean composing it into a string,
+// appending that to the socket's send buffer, and erasing whatever was sent from the front of that, so a large response
+// was copied at least three times. This holds each buffer by reference instead, so a message's headers and content can
+// be queued as they are, and the whole queue sent with a single `sendmsg`. What's been sent from the first buffer is
+// tracked as an offset, so a partial send doesn't move anything.
+class SSendBuffer {
+  public:
+    // Accessors
+    bool empty() const { return !_size; }
+    size_t size() const { return _size; }
+
+    // Returns the unsent part of the first buffer.
+    const char* frontData() const { return _buffers.front()->data() + _offset; }
+    size_t frontSize() const { return _buffers.front()->size() - _offset; }
+
+    // Fills up to `count` iovecs with unsent data, in order, and returns how many were filled.
+    int fill(iovec* iov, int count) const;
+
+    // Returns a copy of everything that's unsent.
+    string toString() const;
+
+    // Mutators. Empty buffers aren't queued.
+    void append(shared_ptr<const string> buffer);
+    void append(const string& buffer) { append(make_shared<const string>(buffer)); }
+    void append(string&& buffer) { append(make_shared<const string>(move(buffer))); }
+    void consumeFront(size_t bytes);
+    void clear();
+
+  private:
+    list<shared_ptr<const string>> _buffers;
+
+    // How much of the first buffer has been sent, and how much is left in total.
+    size_t _offset = 0;
+    size_t _size = 0;
+};
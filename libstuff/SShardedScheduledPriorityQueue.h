@@ -0,0 +1,338 @@
+#pragma once
+#include <libstuff/libstuff.h>
+#include <libstuff/STimerWheel.h>
+
+// A drop-in replacement for SScheduledPriorityQueue (see that file for the ordering rules) that spreads its items
+// across a number of independently locked shards, so that many threads pushing and getting at once don't all contend
+// on a single mutex.
+//
+// Each push goes to the next shard in round-robin order. Each shard publishes atomic hints about its contents (its
+// highest priority, the scheduled time of the first item at that priority, and its earliest timeout), and `get` uses
+// those hints to pick which shard to lock without locking any of the others. Because the hints are read without
+// locks, ordering *across* shards is best-effort: under heavy concurrency, an item can be returned slightly ahead of
+// a higher priority item that was pushed to a different shard at nearly the same time. Within a shard, the ordering
+// is exactly that of SScheduledPriorityQueue.
+template<typename T>
+class SShardedScheduledPriorityQueue {
+  public:
+
+    // Typedefs are here for legibility's sake.
+    typedef int Priority;
+    typedef uint64_t Timeout;
+    typedef uint64_t Scheduled;
+
+    // If nothing becomes available to dequeue while waiting, a timeout_error exception is thrown.
+    class timeout_error : exception {
+      public:
+        const char* what() const noexcept {
+            return "timeout";
+        }
+    };
+
+    // By default, the start and end functions are No-ops. If shardCount is 0, one is chosen based on the number of
+    // CPUs.
+    SShardedScheduledPriorityQueue(function<void(T& item)> startFunction = [](T& item){},
+                                   function<void(T& item)> endFunction = [](T& item){},
+                                   size_t shardCount = 0);
+
+    // Remove all items from the queue.
+    void clear();
+
+    // Returns true if there are no queued commands.
+    bool empty();
+
+    // Returns the size of the queue.
+    size_t size();
+
+    // Get an item from the queue. Optionally, a timeout can be specified.
+    // If timeout is non-zero, a timeout_error exception will be thrown after waitUS microseconds, if no work was
+    // available.
+    T get(uint64_t waitUS = 0);
+
+    // Add an item to the queue. The queue takes ownership of the item and the caller's copy is invalidated.
+    void push(T&& item, Priority priority, Scheduled scheduled, Timeout timeout);
+
+  protected:
+
+    // Associate the item with it's timeout so that when we dequeue an item to return, we can also cancel it's timer
+    // in our wheel of timeouts.
+    struct ItemTimeoutPair {
+        ItemTimeoutPair(T&& _item, Timeout _timeout) : item(move(_item)), timeout(_timeout) {}
+        T item;
+        Timeout timeout;
+        uint64_t timerID = 0;
+    };
+    typedef multimap<Scheduled, ItemTimeoutPair> ScheduledQueue;
+
+    // Value of `Shard::topPriority` for an empty shard.
+    static constexpr Priority EMPTY_PRIORITY = numeric_limits<Priority>::min();
+
+    // The largest shard count we'll use.
+    static constexpr size_t MAX_SHARDS = 64;
+
+    // Each shard is a complete scheduled priority queue with its own lock.
+    struct Shard {
+        mutex queueMutex;
+
+        // The same structure as SScheduledPriorityQueue, but with timeouts kept in a timer wheel that points directly at
+        // each item, rather than in a map that has to be searched.
+        map<Priority, ScheduledQueue> queue;
+        STimerWheel<pair<Priority, typename ScheduledQueue::iterator>> timeouts;
+
+        // Hints about the contents of the shard that can be read without locking it. These are only written with
+        // `queueMutex` held, by `_updateHints`.
+        atomic<Priority> topPriority{EMPTY_PRIORITY};
+        atomic<Scheduled> topScheduled{0};
+        atomic<Timeout> nextTimeout{numeric_limits<Timeout>::max()};
+    };
+
+    // Recomputes the hints for a shard. Must be called with the shard's mutex held, after any change to it.
+    static void _updateHints(Shard& shard);
+
+    // Removes the next suitable item from a single shard, if there is one, otherwise returns null. Must be called with
+    // the shard's mutex held. Items are returned on the heap because T (i.e., BedrockCommand) isn't necessarily
+    // default-constructible.
+    unique_ptr<T> _dequeue(Shard& shard, uint64_t now);
+
+    // Tries each shard that might have a suitable item, in the order its hints suggest, and returns the first item
+    // found, or null if there's none.
+    unique_ptr<T> _tryDequeue();
+
+    // The shards. These are never added or removed after construction.
+    vector<unique_ptr<Shard>> _shards;
+
+    // The total number of items across all shards.
+    atomic<size_t> _size{0};
+
+    // The shard the next push will go to (modulo the number of shards).
+    atomic<size_t> _nextShard{0};
+
+    // These are only used by threads that found nothing to dequeue and need to sleep. `_pushCount` lets a sleeping
+    // thread know that something's been pushed since it last looked, and `_sleepers` lets `push` skip locking
+    // `_waitMutex` when nobody is waiting.
+    mutex _waitMutex;
+    condition_variable _waitCondition;
+    atomic<uint64_t> _pushCount{0};
+    atomic<int> _sleepers{0};
+
+    // Functions to call on each item when inserting or removing from the queue.
+    function<void(T&)> _startFunction;
+    function<void(T&)> _endFunction;
+};
+
+template<typename T>
+constexpr typename SShardedScheduledPriorityQueue<T>::Priority SShardedScheduledPriorityQueue<T>::EMPTY_PRIORITY;
+
+template<typename T>
+constexpr size_t SShardedScheduledPriorityQueue<T>::MAX_SHARDS;
+
+template<typename T>
+SShardedScheduledPriorityQueue<T>::SShardedScheduledPriorityQueue(function<void(T& item)> startFunction,
+                                                                  function<void(T& item)> endFunction,
+                                                                  size_t shardCount)
+  : _startFunction(startFunction), _endFunction(endFunction)
+{
+    // One shard for every 8 CPUs keeps each lock lightly contended without making `get` look at many shards.
+    if (!shardCount) {
+        shardCount = thread::hardware_concurrency() / 8;
+    }
+    shardCount = max((size_t)1, min(shardCount, MAX_SHARDS));
+    for (size_t i = 0; i < shardCount; i++) {
+        _shards.emplace_back(new Shard());
+    }
+}
+
+template<typename T>
+void SShardedScheduledPriorityQueue<T>::clear() {
+    for (auto& shard : _shards) {
+        lock_guard<decltype(shard->queueMutex)> lock(shard->queueMutex);
+        size_t count = 0;
+        for (const auto& queue : shard->queue) {
+            count += queue.second.size();
+        }
+        shard->queue.clear();
+        shard->timeouts.clear();
+        _updateHints(*shard);
+        _size -= count;
+    }
+}
+
+template<typename T>
+bool SShardedScheduledPriorityQueue<T>::empty() {
+    return _size.load() == 0;
+}
+
+template<typename T>
+size_t SShardedScheduledPriorityQueue<T>::size() {
+    return _size.load();
+}
+
+template<typename T>
+T SShardedScheduledPriorityQueue<T>::get(uint64_t waitUS) {
+    // If there's already work in the queue, just return some.
+    unique_ptr<T> item = _tryDequeue();
+    if (item) {
+        return move(*item);
+    }
+
+    // Otherwise, we'll wait for some. As with SScheduledPriorityQueue, we're only woken by new pushes, not by
+    // scheduled items coming due.
+    auto timeout = chrono::steady_clock::now() + chrono::microseconds(waitUS);
+    while (true) {
+        // Register as a sleeper *before* looking at the queue again, so that any push after this point either shows
+        // up in that look, or changes `_pushCount` and wakes us.
+        unique_lock<mutex> lock(_waitMutex);
+        _sleepers++;
+        uint64_t pushCount = _pushCount.load();
+        lock.unlock();
+        item = _tryDequeue();
+        if (item) {
+            _sleepers--;
+            return move(*item);
+        }
+
+        lock.lock();
+        auto pushed = [&]() { return _pushCount.load() != pushCount; };
+        if (waitUS) {
+            _waitCondition.wait_until(lock, timeout, pushed);
+        } else {
+            _waitCondition.wait(lock, pushed);
+        }
+        _sleepers--;
+        lock.unlock();
+
+        // If we got any work, return it.
+        item = _tryDequeue();
+        if (item) {
+            return move(*item);
+        }
+
+        // Did we go past our timeout? If so, we give up. Otherwise, someone else got the work, and we'll retry.
+        if (waitUS && chrono::steady_clock::now() > timeout) {
+            throw timeout_error();
+        }
+    }
+}
+
+template<typename T>
+void SShardedScheduledPriorityQueue<T>::push(T&& item, Priority priority, Scheduled scheduled, Timeout timeout) {
+    Shard& shard = *_shards[_nextShard.fetch_add(1, memory_order_relaxed) % _shards.size()];
+    {
+        lock_guard<decltype(shard.queueMutex)> lock(shard.queueMutex);
+        _startFunction(item);
+        auto itemIt = shard.queue[priority].emplace(scheduled, ItemTimeoutPair(move(item), timeout));
+        itemIt->second.timerID = shard.timeouts.insert(timeout, make_pair(priority, itemIt));
+        _updateHints(shard);
+        _size++;
+    }
+
+    // Only take the wait lock if someone might be sleeping on it.
+    _pushCount++;
+    if (_sleepers.load()) {
+        lock_guard<mutex> lock(_waitMutex);
+        _waitCondition.notify_one();
+    }
+}
+
+template<typename T>
+void SShardedScheduledPriorityQueue<T>::_updateHints(Shard& shard) {
+    if (shard.queue.empty()) {
+        shard.topPriority.store(EMPTY_PRIORITY);
+        shard.topScheduled.store(0);
+    } else {
+        auto top = shard.queue.rbegin();
+        shard.topPriority.store(top->first);
+        shard.topScheduled.store(top->second.begin()->first);
+    }
+    shard.nextTimeout.store(shard.timeouts.nextExpiration());
+}
+
+template<typename T>
+unique_ptr<T> SShardedScheduledPriorityQueue<T>::_tryDequeue() {
+    if (!_size.load()) {
+        return nullptr;
+    }
+
+    // Rank each shard from its hints. Timed out shards come first (earliest timeout first), then shards whose top
+    // priority item is ready (highest priority first), then any other non-empty shard, which may still have a ready
+    // item at a lower priority.
+    uint64_t now = STimeNow();
+    struct Candidate {
+        int tier;
+        int64_t key;
+        size_t index;
+    };
+    Candidate candidates[MAX_SHARDS];
+    size_t candidateCount = 0;
+
+    // Start from a different shard on each thread, so that threads with equal choices spread out.
+    static thread_local size_t offset = hash<thread::id>()(this_thread::get_id());
+    for (size_t i = 0; i < _shards.size(); i++) {
+        size_t index = (offset + i) % _shards.size();
+        Shard& shard = *_shards[index];
+        Timeout nextTimeout = shard.nextTimeout.load();
+        Priority topPriority = shard.topPriority.load();
+        if (nextTimeout <= now) {
+            candidates[candidateCount++] = {0, (int64_t)nextTimeout, index};
+        } else if (topPriority != EMPTY_PRIORITY && shard.topScheduled.load() <= now) {
+            candidates[candidateCount++] = {1, -(int64_t)topPriority, index};
+        } else if (topPriority != EMPTY_PRIORITY) {
+            candidates[candidateCount++] = {2, 0, index};
+        }
+    }
+    stable_sort(candidates, candidates + candidateCount, [](const Candidate& a, const Candidate& b) {
+        return a.tier != b.tier ? a.tier < b.tier : a.key < b.key;
+    });
+
+    for (size_t i = 0; i < candidateCount; i++) {
+        Shard& shard = *_shards[candidates[i].index];
+        lock_guard<decltype(shard.queueMutex)> lock(shard.queueMutex);
+        unique_ptr<T> item = _dequeue(shard, now);
+        if (item) {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+template<typename T>
+unique_ptr<T> SShardedScheduledPriorityQueue<T>::_dequeue(Shard& shard, uint64_t now) {
+    // If anything has timed out, pull that out of the queue, and return that first.
+    pair<Priority, typename ScheduledQueue::iterator> timedOut;
+    if (shard.timeouts.popExpired(now, timedOut)) {
+        auto priorityQueueIt = shard.queue.find(timedOut.first);
+        unique_ptr<T> item(new T(move(timedOut.second->second.item)));
+        priorityQueueIt->second.erase(timedOut.second);
+        if (priorityQueueIt->second.empty()) {
+            shard.queue.erase(priorityQueueIt);
+        }
+        _updateHints(shard);
+        _size--;
+        _endFunction(*item);
+        return item;
+    }
+
+    // Nothing has timed out, so look at each queue, in priority order, to see if any items are ready to return.
+    for (auto queueIt = shard.queue.rbegin(); queueIt != shard.queue.rend(); ++queueIt) {
+        auto itemIt = queueIt->second.begin();
+
+        // Items are in scheduled order, so if this one isn't ready, nothing at this priority is.
+        if (itemIt->first <= now) {
+            // Cancel its timeout, and remove it from the queue.
+            shard.timeouts.cancel(itemIt->second.timerID);
+            unique_ptr<T> item(new T(move(itemIt->second.item)));
+            queueIt->second.erase(itemIt);
+            if (queueIt->second.empty()) {
+                // The odd syntax in the argument converts a reverse to forward iterator.
+                shard.queue.erase(next(queueIt).base());
+            }
+            _updateHints(shard);
+            _size--;
+            _endFunction(*item);
+            return item;
+        }
+    }
+
+    // No item suitable to return.
+    return nullptr;
+}
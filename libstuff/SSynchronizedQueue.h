@@ -51,6 +51,7 @@ SSynchronizedQueue<T>::SSynchronizedQueue() {
 template<typename T>
 SSynchronizedQueue<T>::~SSynchronizedQueue() {
     if (_pipeFD[0] != -1) {
+        SEventLoop::forget(_pipeFD[0]);
         close(_pipeFD[0]);
     }
     if (_pipeFD[1] != -1) {
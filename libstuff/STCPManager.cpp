@@ -7,71 +7,119 @@ STCPManager::~STCPManager() {
 }
 
 void STCPManager::prePoll(fd_map& fdm) {
-    // Add all the sockets
-    for (Socket* socket : socketList) {
-        // Make sure it's not closed
-        if (socket->state.load() != Socket::CLOSED) {
-            // Check and see if it looks like we're still valid.
-            if (socket->s < 0) {
-                SWARN("Invalid FD number("
-                      << socket->s << "), we're probably about to corrupt stack memory. FD_SETSIZE=" << FD_SETSIZE);
+    // If this isn't the fd_map we registered our sockets with, start over.
+    if (fdm.id != _fdmID) {
+        _fdmID = fdm.id;
+        _unregisteredSockets = socketList;
+        _levelTriggeredSockets.clear();
+    }
+
+    // Register any new sockets. Plain sockets are edge-triggered, so they're registered once for everything and we
+    // never need to touch them again. SSL sockets are level-triggered, as SSL reads and writes at most one record at a
+    // time.
+    for (Socket* socket : _unregisteredSockets) {
+        if (!socket->ssl && fdm.edgeTriggered()) {
+            fdm.set(socket->s, SREADEVTS | SWRITEEVTS, true, this, socket);
+        } else {
+            _levelTriggeredSockets.insert(socket);
+        }
+    }
+    _unregisteredSockets.clear();
+
+    // Set the events for each level-triggered socket.
+    for (Socket* socket : _levelTriggeredSockets) {
+        // If it's closed, stop waiting on it.
+        if (socket->state.load() == Socket::CLOSED) {
+            fdm.remove(socket->s);
+            continue;
+        }
+
+        // Check and see if it looks like we're still valid.
+        if (socket->s < 0) {
+            SWARN("Invalid FD number("
+                  << socket->s << "), we're probably about to corrupt stack memory. FD_SETSIZE=" << FD_SETSIZE);
+        }
+        // Add this socket. First, we always want to read, and we always want to learn of exceptions.
+        short events = SREADEVTS;
+
+        // However, we only want to write in some states. No matter what, we want to send if we're not yet
+        // connected. And if we're not using SSL, then we want to send only when we have something buffered for
+        // sending. But if we *are* using SSL, it's a bit more complex. If we've completed the handshake, then we
+        // only want to send when we have data. But if we're inside the handshake, leave it up to the SSL engine
+        // to decide if it wants to send.
+        if (socket->state.load() == Socket::CONNECTING) {
+            // We haven't yet connected -- send regardless of SSL
+            events |= SWRITEEVTS;
+        } else if (!socket->ssl) {
+            // No SSL, just send if we have anything buffered
+            if (!socket->sendBufferEmpty()) {
+                events |= SWRITEEVTS;
             }
-            // Add this socket. First, we always want to read, and we always want to learn of exceptions.
-            SFDset(fdm, socket->s, SREADEVTS);
-
-            // However, we only want to write in some states. No matter what, we want to send if we're not yet
-            // connected. And if we're not using SSL, then we want to send only when we have something buffered for
-            // sending. But if we *are* using SSL, it's a bit more complex. If we've completed the handshake, then we
-            // only want to send when we have data. But if we're inside the handshake, leave it up to the SSL engine
-            // to decide if it wants to send.
-            if (socket->state.load() == Socket::CONNECTING) {
-                // We haven't yet connected -- send regardless of SSL
-                SFDset(fdm, socket->s, SWRITEEVTS);
-            } else if (!socket->ssl) {
-                // No SSL, just send if we have anything buffered
+        } else {
+            // Have we completed the handshake?
+            SASSERT(socket->ssl);
+            SSSLState* sslState = socket->ssl;
+            if (sslState->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+                // Handshake done -- send if we have anything buffered
                 if (!socket->sendBufferEmpty()) {
-                    SFDset(fdm, socket->s, SWRITEEVTS);
+                    events |= SWRITEEVTS;
                 }
             } else {
-                // Have we completed the handshake?
-                SASSERT(socket->ssl);
-                SSSLState* sslState = socket->ssl;
-                if (sslState->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
-                    // Handshake done -- send if we have anything buffered
-                    if (!socket->sendBufferEmpty()) {
-                        SFDset(fdm, socket->s, SWRITEEVTS);
-                    }
-                } else {
-                    // Handshake isn't done -- send if SSL wants to
-                    bool write;
-                    switch (sslState->ssl.state) {
-                    case MBEDTLS_SSL_HELLO_REQUEST:
-                    case MBEDTLS_SSL_CLIENT_HELLO:
-                    case MBEDTLS_SSL_CLIENT_CERTIFICATE:
-                    case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
-                    case MBEDTLS_SSL_CERTIFICATE_VERIFY:
-                    case MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC:
-                    case MBEDTLS_SSL_CLIENT_FINISHED:
-                        // In these cases, SSL is waiting to write already.
-                        // @see https://www.mail-archive.com/list@xyssl.org/msg00041.html
-                        write = true;
-                        break;
-                    default:
-                        write = false;
-                        break;
-                    }
-                    if (write) {
-                        SFDset(fdm, socket->s, SWRITEEVTS);
-                    }
+                // Handshake isn't done -- send if SSL wants to
+                bool write;
+                switch (sslState->ssl.state) {
+                case MBEDTLS_SSL_HELLO_REQUEST:
+                case MBEDTLS_SSL_CLIENT_HELLO:
+                case MBEDTLS_SSL_CLIENT_CERTIFICATE:
+                case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
+                case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+                case MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC:
+                case MBEDTLS_SSL_CLIENT_FINISHED:
+                    // In these cases, SSL is waiting to write already.
+                    // @see https://www.mail-archive.com/list@xyssl.org/msg00041.html
+                    write = true;
+                    break;
+                default:
+                    write = false;
+                    break;
+                }
+                if (write) {
+                    events |= SWRITEEVTS;
                 }
             }
         }
+        fdm.set(socket->s, events, false, this, socket);
     }
 }
 
 void STCPManager::postPoll(fd_map& fdm) {
+    // Work out which sockets to process. If we're edge-triggered, that's any with activity, and any that we always
+    // process. Otherwise, it's all of them.
+    activeSockets.clear();
+    if (fdm.edgeTriggered()) {
+        set<Socket*> seen;
+        for (void* data : fdm.ready(this)) {
+            Socket* socket = static_cast<Socket*>(data);
+            if (seen.insert(socket).second) {
+                activeSockets.push_back(socket);
+            }
+        }
+        for (Socket* socket : _levelTriggeredSockets) {
+            if (seen.insert(socket).second) {
+                activeSockets.push_back(socket);
+            }
+        }
+        for (Socket* socket : _shuttingDownSockets) {
+            if (seen.insert(socket).second) {
+                activeSockets.push_back(socket);
+            }
+        }
+    } else {
+        activeSockets = socketList;
+    }
+
     // Walk across the sockets
-    for (Socket* socket : socketList) {
+    for (Socket* socket : activeSockets) {
         // Update this socket
         switch (socket->state.load()) {
         case Socket::CONNECTING: {
@@ -196,6 +244,11 @@ void STCPManager::postPoll(fd_map& fdm) {
         default:
             SERROR("Unknown socket state");
         }
+
+        // Once it's closed, we don't need to keep checking it.
+        if (socket->state.load() == Socket::CLOSED) {
+            _shuttingDownSockets.erase(socket);
+        }
     }
 }
 
@@ -205,15 +258,35 @@ void STCPManager::shutdownSocket(Socket* socket, int how) {
     SDEBUG("Shutting down socket '" << socket->addr << "' (" << how << ")");
     ::shutdown(socket->s, how);
     socket->state.store(Socket::SHUTTINGDOWN);
+    _shuttingDownSockets.insert(socket);
 }
 
 void STCPManager::closeSocket(Socket* socket) {
     // Clean up this socket
     SASSERT(socket);
     SDEBUG("Closing socket '" << socket->addr << "'");
+    releaseSocket(socket);
+    delete socket;
+}
+
+void STCPManager::releaseSocket(Socket* socket) {
+    SASSERT(socket);
     socketList.remove(socket);
+    _unregisteredSockets.remove(socket);
+    _levelTriggeredSockets.erase(socket);
+    _shuttingDownSockets.erase(socket);
 
-    delete socket;
+    // Whoever gets it next will register it with their own fd_map.
+    SEventLoop::forget(socket->s);
+}
+
+void STCPManager::adoptSocket(Socket* socket) {
+    SASSERT(socket);
+    socketList.push_back(socket);
+    _unregisteredSockets.push_back(socket);
+    if (socket->state.load() == Socket::SHUTTINGDOWN) {
+        _shuttingDownSockets.insert(socket);
+    }
 }
 
 STCPManager::Socket::Socket(int sock, STCPManager::Socket::State state_, SX509* x509)
@@ -223,6 +296,7 @@ STCPManager::Socket::Socket(int sock, STCPManager::Socket::State state_, SX509*
 { }
 
 STCPManager::Socket::~Socket() {
+    SEventLoop::forget(s);
     ::close(s);
     if (ssl) {
         SSSLClose(ssl);
@@ -248,8 +322,10 @@ STCPManager::Socket* STCPManager::openSocket(const string& host, SX509* x509, re
     if (listMutexPtr) {
         lock_guard<recursive_mutex> lock(*listMutexPtr);
         socketList.push_back(socket);
+        _unregisteredSockets.push_back(socket);
     } else {
         socketList.push_back(socket);
+        _unregisteredSockets.push_back(socket);
     }
     return socket;
 }
@@ -286,13 +362,34 @@ bool STCPManager::Socket::send() {
 }
 
 bool STCPManager::Socket::send(const string& buffer) {
+    return _send(make_shared<const string>(buffer));
+}
+
+bool STCPManager::Socket::send(string&& buffer) {
+    return _send(make_shared<const string>(move(buffer)));
+}
+
+bool STCPManager::Socket::send(const vector<shared_ptr<const string>>& buffers) {
+    lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
+    if (state.load() < Socket::State::SHUTTINGDOWN) {
+        for (const auto& buffer : buffers) {
+            sendBuffer.append(buffer);
+        }
+    } else if (!sendBuffer.empty()) {
+        SWARN("Not appending to sendBuffer in socket state " << state.load() << ", tried to send "
+              << buffers.size() << " buffers.");
+    }
+    return send();
+}
+
+bool STCPManager::Socket::_send(shared_ptr<const string> buffer) {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
 
     // If the socket's in a valid state for sending, append to the sendBuffer, otherwise warn
     if (state.load() < Socket::State::SHUTTINGDOWN) {
-        sendBuffer += buffer;
+        sendBuffer.append(move(buffer));
     } else if (!sendBuffer.empty()) {
-        SWARN("Not appending to sendBuffer in socket state " << state.load() << ", tried to send: " << buffer);
+        SWARN("Not appending to sendBuffer in socket state " << state.load() << ", tried to send: " << *buffer);
     }
 
     // Send anything we've got.
@@ -306,12 +403,13 @@ bool STCPManager::Socket::sendBufferEmpty() {
 
 string STCPManager::Socket::sendBufferCopy() {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
-    return sendBuffer;
+    return sendBuffer.toString();
 }
 
 void STCPManager::Socket::setSendBuffer(const string& buffer) {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
-    sendBuffer = buffer;
+    sendBuffer.clear();
+    sendBuffer.append(buffer);
 }
 
 bool STCPManager::Socket::recv() {
@@ -12,7 +12,7 @@ struct STCPManager {
         // Attributes
         int s;
         sockaddr_in addr;
-        string recvBuffer;
+        SFastBuffer recvBuffer;
         atomic<State> state;
         bool connectFailure;
         uint64_t openTime;
@@ -22,6 +22,10 @@ struct STCPManager {
         void* data;
         bool send();
         bool send(const string& buffer);
+        bool send(string&& buffer);
+
+        // Queues several buffers to be sent in order, without copying them, and sends as much as we can.
+        bool send(const vector<shared_ptr<const string>>& buffers);
         bool recv();
         uint64_t id;
         string logString;
@@ -41,7 +45,10 @@ struct STCPManager {
         // This is private because it's used by our synchronized send() functions. This requires it to only
         // be accessed through the (also synchronized) wrapper functions above.
         // NOTE: Currently there's no synchronization around `recvBuffer`. It can only be accessed by one thread.
-        string sendBuffer;
+        SSendBuffer sendBuffer;
+
+        // Queues a buffer to be sent if we're in a state to send it, and then sends what we can.
+        bool _send(shared_ptr<const string> buffer);
 
         // Each socket owns it's own SX509 object to avoid thread-safety issues reading/writing the same certificate in
         // the underlying ssl code. Once assigned, the socket owns this object for it's lifetime and will delete it
@@ -55,19 +62,46 @@ struct STCPManager {
     // Cleans up outstanding sockets
     virtual ~STCPManager();
 
-    // Updates all managed sockets
+    // Updates all managed sockets. The fd_map should be kept across calls, as sockets are only registered with it once
+    // (if it changes, they're all registered again). Plain sockets are edge-triggered, so postPoll only processes the
+    // sockets that had activity (along with SSL and shutting down sockets, which are processed every time, as before),
+    // and lists them in `activeSockets`.
     void prePoll(fd_map& fdm);
     void postPoll(fd_map& fdm);
 
     // Opens outgoing socket
     Socket* openSocket(const string& host, SX509* x509 = nullptr, recursive_mutex* listMutexPtr = nullptr);
 
-    // Gracefully shuts down a socket
+    // Gracefully shuts down a socket. This must be called from the thread that polls this manager, or under the same
+    // lock as postPoll.
     void shutdownSocket(Socket* socket, int how = SHUT_RDWR);
 
     // Hard terminate a socket
     void closeSocket(Socket* socket);
 
+    // Stops managing a socket without closing it, and starts managing one released by another manager. Together, these
+    // hand a socket from one manager (and thread) to another.
+    void releaseSocket(Socket* socket);
+    void adoptSocket(Socket* socket);
+
     // Attributes
     list<Socket*> socketList;
+
+    // The sockets processed by the last call to postPoll. If the fd_map isn't edge-triggered, this is every socket.
+    list<Socket*> activeSockets;
+
+  protected:
+    // Sockets that haven't yet been registered with the fd_map.
+    list<Socket*> _unregisteredSockets;
+
+  private:
+    // The ID of the fd_map our sockets are registered with.
+    uint64_t _fdmID = 0;
+
+    // Sockets whose events we need to set in every prePoll, and process in every postPoll. These are the SSL sockets,
+    // as SSL can buffer data internally where poll can't see it, or every socket if the fd_map uses poll.
+    set<Socket*> _levelTriggeredSockets;
+
+    // Sockets that are shutting down, which are processed every postPoll until they're closed.
+    set<Socket*> _shuttingDownSockets;
 };
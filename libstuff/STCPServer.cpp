@@ -33,6 +33,7 @@ void STCPServer::closePorts(list<Port*> except) {
         while (it != portList.end()) {
             if  (find(except.begin(), except.end(), &(*it)) == except.end()) {
                 // Close this port
+                SEventLoop::forget(it->s);
                 ::close(it->s);
                 SINFO("Close ports closing " << it->host << ".");
                 it = portList.erase(it);
@@ -63,6 +64,7 @@ STCPManager::Socket* STCPServer::acceptSocket(Port*& portOut) {
             socket = new Socket(s, Socket::CONNECTED);
             socket->addr = addr;
             socketList.push_back(socket);
+            _unregisteredSockets.push_back(socket);
 
             // Try to read immediately
             S_recvappend(socket->s, socket->recvBuffer);
@@ -0,0 +1,266 @@
+#include "libstuff.h"
+
+constexpr size_t STable::LINEAR_SEARCH_MAX;
+constexpr size_t STable::FIRST_BLOCK_SIZE;
+
+// Folds the ASCII letters in 8 bytes to lower case at once, leaving every other byte alone, as `tolower` does in the C
+// locale. For each byte, the high bit of `x + (0x80 - 'A')` is set if it's at least 'A', and the high bit of
+// `x + (0x80 - 'Z' - 1)` is set if it's more than 'Z'. The high bit of each byte is cleared first so that the additions
+// can't carry into the next byte, and bytes that had it set are excluded at the end.
+static inline uint64_t SToLowerASCII8(uint64_t x) {
+    const uint64_t ones = 0x0101010101010101ull;
+    const uint64_t highBits = 0x8080808080808080ull;
+    uint64_t low = x & ~highBits;
+    uint64_t atLeastA = low + ones * (0x80 - 'A');
+    uint64_t moreThanZ = low + ones * (0x80 - 'Z' - 1);
+    uint64_t isUpper = atLeastA & ~moreThanZ & ~x & highBits;
+    return x | (isUpper >> 2);
+}
+
+// Loads up to 8 bytes, padded with zeroes.
+static inline uint64_t SLoad8(const char* data, size_t length) {
+    uint64_t result = 0;
+    memcpy(&result, data, min(length, (size_t)8));
+    return result;
+}
+
+uint32_t STable::_hash(const char* name, size_t length) {
+    uint64_t hash = length * 0x9E3779B97F4A7C15ull;
+    for (size_t offset = 0; offset < length; offset += 8) {
+        hash = (hash ^ SToLowerASCII8(SLoad8(name + offset, length - offset))) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    return (uint32_t)hash;
+}
+
+bool STable::_equals(const char* lhs, size_t lhsLength, const char* rhs, size_t rhsLength) {
+    if (lhsLength != rhsLength) {
+        return false;
+    }
+    for (size_t offset = 0; offset < lhsLength; offset += 8) {
+        if (SToLowerASCII8(SLoad8(lhs + offset, lhsLength - offset)) !=
+            SToLowerASCII8(SLoad8(rhs + offset, rhsLength - offset))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int STable::_compare(const char* lhs, size_t lhsLength, const char* rhs, size_t rhsLength) {
+    // Loads are little-endian, so we swap the bytes of words that differ to compare them in string order.
+    size_t length = min(lhsLength, rhsLength);
+    for (size_t offset = 0; offset < length; offset += 8) {
+        size_t remaining = min(length - offset, (size_t)8);
+        uint64_t lhsWord = SToLowerASCII8(SLoad8(lhs + offset, remaining));
+        uint64_t rhsWord = SToLowerASCII8(SLoad8(rhs + offset, remaining));
+        if (lhsWord != rhsWord) {
+            return __builtin_bswap64(lhsWord) < __builtin_bswap64(rhsWord) ? -1 : 1;
+        }
+    }
+    return lhsLength < rhsLength ? -1 : (lhsLength > rhsLength ? 1 : 0);
+}
+
+STable::STable(const STable& other) {
+    *this = other;
+}
+
+STable::STable(STable&& other) {
+    swap(other);
+}
+
+STable::~STable() {
+    _destroyAll();
+}
+
+STable& STable::operator=(const STable& other) {
+    if (this != &other) {
+        clear();
+        _entries.reserve(other.size());
+        _hashes.reserve(other.size());
+        for (size_t i = 0; i < other._entries.size(); i++) {
+            // The other table is already sorted, so each entry goes at the end.
+            value_type* entry = _allocate();
+            new (entry) value_type(*other._entries[i]);
+            _insertAt(_entries.size(), entry, other._hashes[i]);
+        }
+    }
+    return *this;
+}
+
+STable& STable::operator=(STable&& other) {
+    if (this != &other) {
+        clear();
+        swap(other);
+    }
+    return *this;
+}
+
+STable& STable::operator=(initializer_list<value_type> values) {
+    clear();
+    insert(values);
+    return *this;
+}
+
+STable::iterator STable::find(const string& name) {
+    ssize_t index = _find(name, _hash(name.data(), name.size()));
+    return index < 0 ? end() : iterator(_entries.data() + index);
+}
+
+STable::const_iterator STable::find(const string& name) const {
+    ssize_t index = _find(name, _hash(name.data(), name.size()));
+    return index < 0 ? end() : const_iterator(_entries.data() + index);
+}
+
+SString& STable::at(const string& name) {
+    iterator it = find(name);
+    if (it == end()) {
+        throw out_of_range("STable::at");
+    }
+    return it->second;
+}
+
+const SString& STable::at(const string& name) const {
+    const_iterator it = find(name);
+    if (it == end()) {
+        throw out_of_range("STable::at");
+    }
+    return it->second;
+}
+
+SString& STable::operator[](const string& name) {
+    uint32_t hash = _hash(name.data(), name.size());
+    ssize_t index = _find(name, hash);
+    if (index >= 0) {
+        return _entries[index]->second;
+    }
+    value_type* entry = _allocate();
+    new (entry) value_type(piecewise_construct, forward_as_tuple(name), forward_as_tuple());
+    return _insertAt(_lowerBound(name), entry, hash)->second;
+}
+
+SString& STable::operator[](string&& name) {
+    uint32_t hash = _hash(name.data(), name.size());
+    ssize_t index = _find(name, hash);
+    if (index >= 0) {
+        return _entries[index]->second;
+    }
+    size_t position = _lowerBound(name);
+    value_type* entry = _allocate();
+    new (entry) value_type(piecewise_construct, forward_as_tuple(move(name)), forward_as_tuple());
+    return _insertAt(position, entry, hash)->second;
+}
+
+size_t STable::erase(const string& name) {
+    ssize_t index = _find(name, _hash(name.data(), name.size()));
+    if (index < 0) {
+        return 0;
+    }
+    erase(const_iterator(_entries.data() + index));
+    return 1;
+}
+
+STable::iterator STable::erase(const_iterator position) {
+    size_t index = position._position - _entries.data();
+    _release(_entries[index]);
+    _entries.erase(_entries.begin() + index);
+    _hashes.erase(_hashes.begin() + index);
+    return iterator(_entries.data() + index);
+}
+
+void STable::clear() {
+    _destroyAll();
+    _entries.clear();
+    _hashes.clear();
+    _free.clear();
+
+    // Keep the largest block to fill again.
+    if (_blocks.size() > 1) {
+        _blocks.erase(_blocks.begin(), _blocks.end() - 1);
+    }
+    _lastBlockUsed = 0;
+}
+
+void STable::swap(STable& other) {
+    _blocks.swap(other._blocks);
+    std::swap(_lastBlockSize, other._lastBlockSize);
+    std::swap(_lastBlockUsed, other._lastBlockUsed);
+    _free.swap(other._free);
+    _entries.swap(other._entries);
+    _hashes.swap(other._hashes);
+}
+
+ssize_t STable::_find(const string& name, uint32_t hash) const {
+    if (_entries.size() <= LINEAR_SEARCH_MAX) {
+        for (size_t i = 0; i < _hashes.size(); i++) {
+            if (_hashes[i] == hash) {
+                const string& entryName = _entries[i]->first;
+                if (_equals(entryName.data(), entryName.size(), name.data(), name.size())) {
+                    return i;
+                }
+            }
+        }
+        return -1;
+    }
+    size_t index = _lowerBound(name);
+    if (index < _entries.size() && _hashes[index] == hash) {
+        const string& entryName = _entries[index]->first;
+        if (_equals(entryName.data(), entryName.size(), name.data(), name.size())) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+size_t STable::_lowerBound(const string& name) const {
+    size_t low = 0;
+    size_t high = _entries.size();
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const string& entryName = _entries[middle]->first;
+        if (_compare(entryName.data(), entryName.size(), name.data(), name.size()) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+STable::value_type* STable::_allocate() {
+    if (!_free.empty()) {
+        value_type* entry = _free.back();
+        _free.pop_back();
+        return entry;
+    }
+    if (_lastBlockUsed == _lastBlockSize) {
+        _lastBlockSize = _blocks.empty() ? FIRST_BLOCK_SIZE : _lastBlockSize * 2;
+        _blocks.emplace_back(new Slot[_lastBlockSize]);
+        _lastBlockUsed = 0;
+    }
+    return reinterpret_cast<value_type*>(&_blocks.back()[_lastBlockUsed++]);
+}
+
+void STable::_release(value_type* entry) {
+    entry->~value_type();
+    _free.push_back(entry);
+}
+
+STable::iterator STable::_insertAt(size_t index, value_type* entry, uint32_t hash) {
+    _entries.insert(_entries.begin() + index, entry);
+    _hashes.insert(_hashes.begin() + index, hash);
+    return iterator(_entries.data() + index);
+}
+
+void STable::_destroyAll() {
+    for (value_type* entry : _entries) {
+        entry->~value_type();
+    }
+}
+
+bool operator==(const STable& lhs, const STable& rhs) {
+    return lhs.size() == rhs.size() && equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+bool operator<(const STable& lhs, const STable& rhs) {
+    return lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+}
@@ -0,0 +1,192 @@
+#pragma once
+// Can't include libstuff.h here because it'd be circular. libstuff.h includes this once SString is defined.
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// A table of name/value pairs with case-insensitive name matching, used for headers (`SData::nameValueMap`) and JSON
+// objects. This has the interface of the `std::map<string, SString, STableComp>` it replaces, including its iteration
+// order (sorted by name, ignoring case), but rather than a tree with a node per entry, which needs O(log n) case-folded
+// string comparisons to look anything up, it keeps a flat array of entries sorted by name, along with a hash of each
+// name folded to lower case. Small tables, which is nearly all of them, are searched by scanning the hashes and only
+// comparing names whose hashes match, and larger ones by binary search. Names are folded to lower case, compared and
+// hashed 8 bytes at a time.
+//
+// Entries are allocated in blocks, and never move, so as with `std::map`, references to entries (and so the values
+// returned by `operator[]`) stay valid until that entry is erased. Unlike `std::map`, inserting or erasing an entry
+// invalidates iterators to the other entries.
+class STable {
+  public:
+    typedef string key_type;
+    typedef SString mapped_type;
+    typedef pair<const string, SString> value_type;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+    typedef STableComp key_compare;
+
+    // Iterates over the entries in order. Each position is a pointer into the array of entry pointers.
+    template <typename V>
+    class Iterator {
+      public:
+        typedef bidirectional_iterator_tag iterator_category;
+        typedef V value_type;
+        typedef ptrdiff_t difference_type;
+        typedef V* pointer;
+        typedef V& reference;
+
+        Iterator() : _position(nullptr) {}
+        explicit Iterator(STable::value_type* const* position) : _position(position) {}
+
+        // Allows iterators to be converted to const_iterators.
+        template <typename U, typename = typename enable_if<is_convertible<U*, V*>::value>::type>
+        Iterator(const Iterator<U>& other) : _position(other._position) {}
+
+        V& operator*() const { return **_position; }
+        V* operator->() const { return *_position; }
+        Iterator& operator++() { ++_position; return *this; }
+        Iterator operator++(int) { Iterator result = *this; ++_position; return result; }
+        Iterator& operator--() { --_position; return *this; }
+        Iterator operator--(int) { Iterator result = *this; --_position; return result; }
+        bool operator==(const Iterator& rhs) const { return _position == rhs._position; }
+        bool operator!=(const Iterator& rhs) const { return _position != rhs._position; }
+
+      private:
+        friend class STable;
+        template <typename U> friend class Iterator;
+        STable::value_type* const* _position;
+    };
+    typedef Iterator<value_type> iterator;
+    typedef Iterator<const value_type> const_iterator;
+
+    // Constructors
+    STable() {}
+    STable(initializer_list<value_type> values) { insert(values); }
+    template <typename InputIt>
+    STable(InputIt first, InputIt last) { insert(first, last); }
+    STable(const STable& other);
+    STable(STable&& other);
+    ~STable();
+
+    STable& operator=(const STable& other);
+    STable& operator=(STable&& other);
+    STable& operator=(initializer_list<value_type> values);
+
+    // Iterators
+    iterator begin() { return iterator(_entries.data()); }
+    iterator end() { return iterator(_entries.data() + _entries.size()); }
+    const_iterator begin() const { return const_iterator(_entries.data()); }
+    const_iterator end() const { return const_iterator(_entries.data() + _entries.size()); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    // Capacity
+    bool empty() const { return _entries.empty(); }
+    size_t size() const { return _entries.size(); }
+
+    // Lookup
+    iterator find(const string& name);
+    const_iterator find(const string& name) const;
+    size_t count(const string& name) const { return find(name) != end(); }
+    SString& at(const string& name);
+    const SString& at(const string& name) const;
+    SString& operator[](const string& name);
+    SString& operator[](string&& name);
+
+    // Modifiers. As with `std::map`, `emplace` and `insert` don't replace existing values.
+    template <typename... Args>
+    pair<iterator, bool> emplace(Args&&... args);
+    pair<iterator, bool> insert(const value_type& value) { return emplace(value); }
+    template <typename P, typename = typename enable_if<is_constructible<value_type, P&&>::value>::type>
+    pair<iterator, bool> insert(P&& value) { return emplace(forward<P>(value)); }
+    template <typename InputIt>
+    void insert(InputIt first, InputIt last);
+    void insert(initializer_list<value_type> values) { insert(values.begin(), values.end()); }
+    size_t erase(const string& name);
+    iterator erase(const_iterator position);
+    iterator erase(iterator position) { return erase(const_iterator(position)); }
+    void clear();
+    void swap(STable& other);
+
+  private:
+    // Tables up to this size are searched by scanning their hashes, larger ones by binary search.
+    static constexpr size_t LINEAR_SEARCH_MAX = 16;
+
+    // The size of the first block of entries we allocate. Each block after that is twice the size of the last.
+    static constexpr size_t FIRST_BLOCK_SIZE = 8;
+
+    typedef aligned_storage<sizeof(value_type), alignof(value_type)>::type Slot;
+
+    // Hashes a name, ignoring case.
+    static uint32_t _hash(const char* name, size_t length);
+
+    // Compares names, ignoring case, in the order used by STableComp.
+    static bool _equals(const char* lhs, size_t lhsLength, const char* rhs, size_t rhsLength);
+    static int _compare(const char* lhs, size_t lhsLength, const char* rhs, size_t rhsLength);
+
+    // Returns the index in `_entries` of the entry named `name`, or -1.
+    ssize_t _find(const string& name, uint32_t hash) const;
+
+    // Returns the index in `_entries` at which an entry named `name` belongs.
+    size_t _lowerBound(const string& name) const;
+
+    // Returns memory for a new entry, which the caller must construct, and returns memory from an entry that's been
+    // destroyed, so it can be reused.
+    value_type* _allocate();
+    void _release(value_type* entry);
+
+    // Adds an entry that's been constructed in memory from `_allocate` at the given index.
+    iterator _insertAt(size_t index, value_type* entry, uint32_t hash);
+
+    // Destroys every entry.
+    void _destroyAll();
+
+    // The blocks that entries are allocated from, how many slots the last one has, and how many of those are used.
+    vector<unique_ptr<Slot[]>> _blocks;
+    size_t _lastBlockSize = 0;
+    size_t _lastBlockUsed = 0;
+
+    // Slots in any block whose entries have been erased.
+    vector<value_type*> _free;
+
+    // The entries, sorted by name, and the hash of each one's name.
+    vector<value_type*> _entries;
+    vector<uint32_t> _hashes;
+};
+
+template <typename... Args>
+pair<STable::iterator, bool> STable::emplace(Args&&... args) {
+    // We need the name to know if it's already here, so we construct the entry first, and throw it away if so.
+    value_type* entry = _allocate();
+    try {
+        new (entry) value_type(forward<Args>(args)...);
+    } catch (...) {
+        _free.push_back(entry);
+        throw;
+    }
+    uint32_t hash = _hash(entry->first.data(), entry->first.size());
+    ssize_t existing = _find(entry->first, hash);
+    if (existing >= 0) {
+        _release(entry);
+        return make_pair(iterator(_entries.data() + existing), false);
+    }
+    return make_pair(_insertAt(_lowerBound(entry->first), entry, hash), true);
+}
+
+template <typename InputIt>
+void STable::insert(InputIt first, InputIt last) {
+    for (; first != last; ++first) {
+        emplace(*first);
+    }
+}
+
+bool operator==(const STable& lhs, const STable& rhs);
+bool operator<(const STable& lhs, const STable& rhs);
+inline bool operator!=(const STable& lhs, const STable& rhs) { return !(lhs == rhs); }
+inline void swap(STable& lhs, STable& rhs) { lhs.swap(rhs); }
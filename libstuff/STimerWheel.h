@@ -0,0 +1,359 @@
+#pragma once
+#include <libstuff/libstuff.h>
+#include <unordered_map>
+
+// A hierarchical timer wheel. This stores items against an expiration time (epoch time in microseconds, as returned by
+// STimeNow), with O(1) insertion and cancellation, and lets the caller pull out items as they expire. It replaces
+// `multimap<timeout, ...>` lookups, which cost O(log n) per operation and have to be searched with `equal_range` to
+// remove a particular item.
+//
+// Time is divided into ticks of `resolutionUS` microseconds. The wheel has LEVELS levels of SLOTS slots each. An item
+// is kept at the lowest level whose slots can tell its tick apart from the current tick, and is moved down a level
+// ("cascaded") each time the current tick reaches its slot, so each item is touched at most LEVELS times in its life.
+//
+// Items are returned in order of expiration to within `resolutionUS`. Items in the same tick are returned in no
+// particular order.
+//
+// This class is not synchronized, callers must do their own locking.
+template<typename T>
+class STimerWheel {
+  public:
+    // Identifies an item in the wheel so that it can be cancelled. IDs are never reused, and 0 is never a valid ID.
+    typedef uint64_t ID;
+
+    STimerWheel(uint64_t resolutionUS = 1000, uint64_t now = STimeNow());
+
+    // Explicitly delete copy constructor, as the slots point into `_items`.
+    STimerWheel(const STimerWheel& other) = delete;
+
+    // Adds an item to the wheel, returning its ID.
+    ID insert(uint64_t expiration, T value);
+
+    // Removes an item from the wheel. Returns false if it's not there (because it was already cancelled or popped).
+    bool cancel(ID id);
+
+    // Removes everything from the wheel.
+    void clear();
+
+    // Returns the number of items in the wheel, whether or not they've expired.
+    size_t size() const { return _items.size(); }
+    bool empty() const { return _items.empty(); }
+
+    // Returns the expiration time of the next item to expire, or `numeric_limits<uint64_t>::max()` if the wheel is
+    // empty. If items have already expired, this is the expiration time of the one `popExpired` would return.
+    uint64_t nextExpiration();
+
+    // Returns a pointer to the next item that's expired as of `now`, without removing it, or nullptr if nothing has.
+    T* peekExpired(uint64_t now);
+
+    // Removes the next item that's expired as of `now`, moving it into `value`. Returns false if nothing has expired.
+    bool popExpired(uint64_t now, T& value);
+
+  private:
+    // 6 bits per level and 11 levels covers every 64-bit tick value.
+    static constexpr int BITS_PER_LEVEL = 6;
+    static constexpr int SLOTS = 1 << BITS_PER_LEVEL;
+    static constexpr int LEVELS = 11;
+
+    // Slot index used for items on the expired list rather than in a slot.
+    static constexpr int EXPIRED = -1;
+
+    // Each item is a node in a doubly linked list, either for the slot it's in, or for the list of expired items.
+    // Nodes live in `_items`, which never moves them, so the lists can point directly at them.
+    struct Node {
+        Node(ID _id, uint64_t _expiration, T&& _value) : id(_id), expiration(_expiration), value(move(_value)) {}
+        ID id;
+        uint64_t expiration;
+        T value;
+        int slot = EXPIRED;
+        Node* prev = nullptr;
+        Node* next = nullptr;
+    };
+
+    // Puts a node in the right slot for the current tick, or on the expired list if it's expired as of `_now`.
+    void _place(Node* node);
+
+    // Unlinks a node from whichever list it's in.
+    void _unlink(Node* node);
+
+    // Moves everything in a slot to the expired list.
+    void _expireSlot(int slot);
+
+    // Moves the wheel forward to `now`, moving everything that's expired to the expired list, and cascading items
+    // down from higher levels as their slots are reached.
+    void _advance(uint64_t now);
+
+    uint64_t _tick(uint64_t time) const { return time / _resolution; }
+
+    const uint64_t _resolution;
+
+    // The time the wheel was last advanced to, and the tick it falls in.
+    uint64_t _now;
+    uint64_t _currentTick;
+
+    // All the items in the wheel, by ID.
+    unordered_map<ID, Node> _items;
+    ID _nextID = 1;
+
+    // The head of each slot's list, and the number of items at each level.
+    Node* _slots[LEVELS * SLOTS] = {};
+    size_t _levelCounts[LEVELS] = {};
+
+    // Items that have expired but not yet been popped, in (approximate) order of expiration.
+    Node* _expiredHead = nullptr;
+    Node* _expiredTail = nullptr;
+
+    // `nextExpiration` is cached, as finding it can mean scanning a level of slots.
+    uint64_t _nextExpiration = 0;
+    bool _nextExpirationValid = false;
+};
+
+template<typename T>
+constexpr int STimerWheel<T>::BITS_PER_LEVEL;
+template<typename T>
+constexpr int STimerWheel<T>::SLOTS;
+template<typename T>
+constexpr int STimerWheel<T>::LEVELS;
+template<typename T>
+constexpr int STimerWheel<T>::EXPIRED;
+
+template<typename T>
+STimerWheel<T>::STimerWheel(uint64_t resolutionUS, uint64_t now)
+  : _resolution(max(resolutionUS, (uint64_t)1)), _now(now), _currentTick(_tick(now))
+{ }
+
+template<typename T>
+typename STimerWheel<T>::ID STimerWheel<T>::insert(uint64_t expiration, T value) {
+    ID id = _nextID++;
+    Node* node = &_items.emplace(piecewise_construct, forward_as_tuple(id),
+                                 forward_as_tuple(id, expiration, move(value))).first->second;
+    _place(node);
+    if (_nextExpirationValid) {
+        _nextExpiration = min(_nextExpiration, expiration);
+    }
+    return id;
+}
+
+template<typename T>
+bool STimerWheel<T>::cancel(ID id) {
+    auto it = _items.find(id);
+    if (it == _items.end()) {
+        return false;
+    }
+    if (_nextExpirationValid && it->second.expiration == _nextExpiration) {
+        _nextExpirationValid = false;
+    }
+    _unlink(&it->second);
+    _items.erase(it);
+    return true;
+}
+
+template<typename T>
+void STimerWheel<T>::clear() {
+    _items.clear();
+    fill(begin(_slots), end(_slots), nullptr);
+    fill(begin(_levelCounts), end(_levelCounts), 0);
+    _expiredHead = nullptr;
+    _expiredTail = nullptr;
+    _nextExpirationValid = false;
+}
+
+template<typename T>
+uint64_t STimerWheel<T>::nextExpiration() {
+    if (_items.empty()) {
+        return numeric_limits<uint64_t>::max();
+    }
+
+    // Anything on the expired list is no later than anything still in a slot, so if there's anything there, we return
+    // the item that `popExpired` would return. That's checked before the cache, as the cache is the earliest item of
+    // all, and the expired list isn't strictly in order.
+    if (_expiredHead) {
+        return _expiredHead->expiration;
+    }
+    if (_nextExpirationValid) {
+        return _nextExpiration;
+    }
+
+    // Otherwise, the earliest item is in the first non-empty slot of the lowest non-empty level. Items at each level
+    // share all their higher bits with the current tick, and are ahead of it in this level's bits, so the slots are
+    // in order starting from the current tick's.
+    uint64_t result = numeric_limits<uint64_t>::max();
+    int level = 0;
+    while (!_levelCounts[level]) {
+        level++;
+    }
+    int first = (_currentTick >> (level * BITS_PER_LEVEL)) & (SLOTS - 1);
+    for (int slot = first; slot < SLOTS; slot++) {
+        Node* node = _slots[level * SLOTS + slot];
+        if (node) {
+            for (; node; node = node->next) {
+                result = min(result, node->expiration);
+            }
+            break;
+        }
+    }
+    _nextExpiration = result;
+    _nextExpirationValid = true;
+    return result;
+}
+
+template<typename T>
+T* STimerWheel<T>::peekExpired(uint64_t now) {
+    _advance(now);
+    return _expiredHead ? &_expiredHead->value : nullptr;
+}
+
+template<typename T>
+bool STimerWheel<T>::popExpired(uint64_t now, T& value) {
+    _advance(now);
+    if (!_expiredHead) {
+        return false;
+    }
+    Node* node = _expiredHead;
+    value = move(node->value);
+    if (_nextExpirationValid && node->expiration == _nextExpiration) {
+        _nextExpirationValid = false;
+    }
+    _unlink(node);
+    _items.erase(node->id);
+    return true;
+}
+
+template<typename T>
+void STimerWheel<T>::_place(Node* node) {
+    // If the item's tick has already been passed, or it's in the current tick and has expired, it goes straight on the
+    // expired list. This is checked against the current tick rather than just `_now` so that items cascaded during
+    // `_advance` get expired in tick order, rather than all at once.
+    uint64_t tick = _tick(node->expiration);
+    if (tick < _currentTick || (tick == _currentTick && node->expiration <= _now)) {
+        node->slot = EXPIRED;
+        node->next = nullptr;
+        node->prev = _expiredTail;
+        if (_expiredTail) {
+            _expiredTail->next = node;
+        } else {
+            _expiredHead = node;
+        }
+        _expiredTail = node;
+        return;
+    }
+
+    // The level is the highest group of bits in which this tick differs from the current tick.
+    uint64_t diff = tick ^ _currentTick;
+    int level = diff ? (63 - __builtin_clzll(diff)) / BITS_PER_LEVEL : 0;
+    node->slot = level * SLOTS + ((tick >> (level * BITS_PER_LEVEL)) & (SLOTS - 1));
+    node->prev = nullptr;
+    node->next = _slots[node->slot];
+    if (node->next) {
+        node->next->prev = node;
+    }
+    _slots[node->slot] = node;
+    _levelCounts[level]++;
+}
+
+template<typename T>
+void STimerWheel<T>::_unlink(Node* node) {
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else if (node->slot == EXPIRED) {
+        _expiredHead = node->next;
+    } else {
+        _slots[node->slot] = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else if (node->slot == EXPIRED) {
+        _expiredTail = node->prev;
+    }
+    if (node->slot != EXPIRED) {
+        _levelCounts[node->slot / SLOTS]--;
+    }
+    node->prev = nullptr;
+    node->next = nullptr;
+}
+
+template<typename T>
+void STimerWheel<T>::_expireSlot(int slot) {
+    while (Node* node = _slots[slot]) {
+        _unlink(node);
+        node->slot = EXPIRED;
+        node->prev = _expiredTail;
+        if (_expiredTail) {
+            _expiredTail->next = node;
+        } else {
+            _expiredHead = node;
+        }
+        _expiredTail = node;
+    }
+}
+
+template<typename T>
+void STimerWheel<T>::_advance(uint64_t now) {
+    // Time doesn't go backwards for the wheel.
+    if (now <= _now) {
+        return;
+    }
+    _now = now;
+    uint64_t target = _tick(now);
+    while (_currentTick < target) {
+        // If there's nothing in any slot, we can jump straight there.
+        int level = 0;
+        while (level < LEVELS && !_levelCounts[level]) {
+            level++;
+        }
+        if (level == LEVELS) {
+            _currentTick = target;
+            break;
+        }
+
+        uint64_t previousTick = _currentTick;
+        if (level == 0) {
+            // Every tick before the target is entirely expired. Expire those in this rotation of level 0.
+            uint64_t rotationEnd = _currentTick | (SLOTS - 1);
+            uint64_t last = min(target - 1, rotationEnd);
+            for (uint64_t tick = _currentTick; tick <= last; tick++) {
+                _expireSlot(tick & (SLOTS - 1));
+            }
+            if (target <= rotationEnd) {
+                _currentTick = target;
+                break;
+            }
+            _currentTick = rotationEnd + 1;
+        } else {
+            // Nothing below this level, so skip ahead to the start of the next slot at this level. If that's past the
+            // target, nothing at this level is due yet.
+            uint64_t boundary = (_currentTick | ((1ull << (level * BITS_PER_LEVEL)) - 1)) + 1;
+            if (boundary > target) {
+                _currentTick = target;
+                break;
+            }
+            _currentTick = boundary;
+        }
+
+        // We've crossed into a new slot at one or more higher levels. Re-place the items in those slots, starting at
+        // the highest, which moves them to lower levels (or the expired list).
+        int highest = (63 - __builtin_clzll(previousTick ^ _currentTick)) / BITS_PER_LEVEL;
+        for (int cascadeLevel = highest; cascadeLevel > 0; cascadeLevel--) {
+            int slot = cascadeLevel * SLOTS + ((_currentTick >> (cascadeLevel * BITS_PER_LEVEL)) & (SLOTS - 1));
+            Node* node = _slots[slot];
+            _slots[slot] = nullptr;
+            while (node) {
+                Node* next = node->next;
+                _levelCounts[cascadeLevel]--;
+                _place(node);
+                node = next;
+            }
+        }
+    }
+
+    // Items in the current tick may or may not have expired yet, so check them individually.
+    Node* node = _slots[_currentTick & (SLOTS - 1)];
+    while (node) {
+        Node* next = node->next;
+        if (node->expiration <= _now) {
+            _unlink(node);
+            _place(node);
+        }
+        node = next;
+    }
+}
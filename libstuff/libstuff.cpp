@@ -676,190 +676,17 @@ int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& na
     nameValueMap.clear();
     content.clear();
 
-    // Keep parsing until we run out of input or encounter a blank line
-    const char* lineStart = buffer;
-    const char* inputEnd = buffer + length;
-    string name;
-    bool isChunked = false;
-    bool lastChunkFound = false;
-    while (lineStart < inputEnd) {
-        // Find the end of the line
-        const char* lineEnd = lineStart;
-        while ((lineEnd < inputEnd) && (*lineEnd != '\r') && (*lineEnd != '\n'))
-            ++lineEnd;
-        if (lineEnd >= inputEnd) {
-            // Couldn't find end of line; couldn't complete parsing.
-            methodLine.clear();
-            nameValueMap.clear();
-            content.clear();
-            return 0;
-        }
-
-        // Found the end of the line; is the line blank?
-        if (lineEnd == lineStart) {
-            // Blank line -- if we have at least the method, then we're done.  Otherwise, ignore.
-
-            // We want to look this up without inserting it.
-            auto it = nameValueMap.find("Transfer-Encoding");
-            if (!methodLine.empty()) {
-                // If we are done processing a chunked body.
-                if (isChunked) {
-                    // Figure out the end of the message by consuming up to 2 EOL characters,
-                    // then return the total length.
-                    SASSERTWARN(lastChunkFound);
-                    const char* parseEnd = lineEnd;
-                    int numEOLs = 2;
-                    while (parseEnd < inputEnd && (*parseEnd == '\r' || *parseEnd == '\n') && numEOLs--)
-                        ++parseEnd;
-                    return (int)(parseEnd - buffer);
-                }
-
-                // If not processing a chunked body, then finish up.
-                else if (it == nameValueMap.end() || !SIEquals(it->second, "chunked")) {
-                    // We have a method -- we're done.  Figure out the end of the message
-                    // by consuming up to 2 EOL characters, then return the total length.
-                    const char* parseEnd = lineEnd;
-                    int numEOLs = 2;
-                    while (parseEnd < inputEnd && (*parseEnd == '\r' || *parseEnd == '\n') && numEOLs--)
-                        ++parseEnd;
-                    int headerLength = (int)(parseEnd - buffer);
-
-                    // If there is no content-length, just return the length of the headers
-                    int contentLength = (SContains(nameValueMap, "Content-Length")
-                                             ? atoi(nameValueMap["Content-Length"].c_str())
-                                             : 0);
-                    if (!contentLength)
-                        return headerLength;
-
-                    // There is a content length -- if we don't have enough, then cancel the parse.
-                    if ((int)(length - headerLength) < contentLength) {
-                        // Insufficient content
-                        methodLine.clear();
-                        nameValueMap.clear();
-                        content.clear();
-                        return 0;
-                    }
-
-                    // We have enough data -- copy it and return the full length
-                    content.resize(contentLength);
-                    memcpy(&content[0], parseEnd, contentLength);
-                    return (headerLength + contentLength);
-                }
-
-                // Otherwise, we start on a chunked body.
-                else
-                    isChunked = true;
-            }
-        } else {
-            // Not blank.  Is this the method line?
-            bool isHeaderOrFooter = true;
-            if (methodLine.empty()) {
-                // Everything in the line is the method
-                _SParseHTTP_GetUpToEnd(lineStart, lineEnd, methodLine);
-                isHeaderOrFooter = false;
-            }
-
-            // Is it a new chunk?
-            else if (isChunked) {
-                // Get the chunk length and ignore the optional stuff after the optional semicolon.
-                string chunkHeader;
-                _SParseHTTP_GetUpToEnd(lineStart, lineEnd, chunkHeader);
-                const string& hexChunkLength = SContains(chunkHeader, ";") ? SBefore(chunkHeader, ";") : chunkHeader;
-
-                // If valid hex number, then we have a chunk.
-                if (SREMatch("^[a-fA-F0-9]{1,8}$", hexChunkLength)) {
-                    // Get the chunk length.
-                    isHeaderOrFooter = false;
-                    int chunkLength = (int)SFromHex(hexChunkLength);
-                    if (chunkLength) {
-                        // Verify that we can get the entire chunk.
-                        const char* chunkStart = lineEnd + 2; // skipping the \r\n.
-                        const char* chunkEnd = chunkStart + chunkLength;
-                        if (chunkEnd >= inputEnd) {
-                            // Insufficient content
-                            methodLine.clear();
-                            nameValueMap.clear();
-                            content.clear();
-                            return 0;
-                        }
-
-                        // Get the chunk and advance the pointers.
-                        size_t contentLength = content.length();
-                        content.resize(contentLength + chunkLength);
-                        memcpy(&content[contentLength], chunkStart, chunkLength);
-                        lineEnd = chunkEnd;
-                    } else
-                        lastChunkFound = true;
-                }
-
-                // Else it is a footer which should be treated just like a header.  Set it again for clarity.
-                else
-                    isHeaderOrFooter = true;
-            }
-
-            // More headers.
-            if (isHeaderOrFooter) {
-                // Does it start with whitespace?  If so, just append to the last value
-                if (isspace(*lineStart)) {
-                    // Starts with whitespace -- if we have a name, add it to the end of the last
-                    // value.  Otherwise, add it to the end of the method.
-                    if (!name.empty())
-                        SAppend(nameValueMap[name], lineStart, (int)(lineEnd - lineStart));
-                    else
-                        SAppend(methodLine, lineStart, (int)(lineEnd - lineStart));
-                } else {
-                    // Parse name/value pair.  Name is everything up to the ':'
-                    const char* nameEnd = _SParseHTTP_GetUpToNext(lineStart, lineEnd, ':', name);
-                    if (!name.empty()) {
-                        // The value is everything up to the end of the line,
-                        // triming leading and trailing whitespace.
-                        const char* valueStart = nameEnd + 1;
-                        const char* valueEnd = lineEnd;
-                        while (*valueStart == ' ')
-                            ++valueStart;
-                        while (*(valueEnd - 1) == ' ')
-                            --valueEnd;
-                        int valueLength = (int)(valueEnd - valueStart);
-                        string value;
-                        if (valueLength > 0) {
-                            // Copy the value
-                            value.resize(valueLength);
-                            memcpy(&value[0], valueStart, valueLength);
-                        }
-
-                        // Store the result.  If there's something already
-                        // there just override, with the exception of
-                        // Set-Cookie: generate a crappy list with 0xFF
-                        // separation.  (See SComposeHTTP for explanation.)
-                        STable::iterator it = nameValueMap.find(name);
-                        if (it == nameValueMap.end() || !SIEquals(name, "Set-Cookie"))
-                            nameValueMap[name] = SUnescape(value); // strip any slash-escaping
-                        else
-                            nameValueMap[name] = it->second + S_COOKIE_SEPARATOR + value;
-                    }
-                }
-            }
+    // Parse in place, and copy out the parts if we got a whole message.
+    SHTTPView view;
+    int size = view.parse(buffer, length);
+    if (size) {
+        methodLine = view.methodLine.to_string();
+        for (const SHTTPView::Header& header : view.headers) {
+            nameValueMap[header.first.to_string()] = header.second.to_string();
         }
-
-        // Consume the end of the line -- accept \r\n, \n\r, \r, or \n.  But *not* \n\n (that's two endings)
-        lineStart = lineEnd; // Advance past the parsed line to the line ending
-        if (inputEnd - lineStart >= 2 && lineStart[0] == '\r' && lineStart[1] == '\n')
-            lineStart += 2;
-        else if (inputEnd - lineStart >= 2 && lineStart[0] == '\n' && lineStart[1] == '\r')
-            lineStart += 2;
-        else if (lineStart[0] == '\n')
-            ++lineStart;
-        else if (lineStart[0] == '\r')
-            ++lineStart;
-        else
-            SWARN("How did we get here?");
+        content = view.content.to_string();
     }
-
-    // Reached the end of the input and haven't finished parsing the header
-    methodLine.clear();
-    nameValueMap.clear();
-    content.clear();
-    return 0;
+    return size;
 }
 
 // --------------------------------------------------------------------------
@@ -1029,12 +856,22 @@ bool SParseURIPath(const char* buffer, int length, string& path, STable& nameVal
 
 // --------------------------------------------------------------------------
 void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content) {
+    // Compose the headers, then add the content, if any
+    string gzipContent;
+    SComposeHTTPHead(buffer, methodLine, nameValueMap, content, gzipContent);
+    buffer += gzipContent.empty() ? content : gzipContent;
+}
+
+// --------------------------------------------------------------------------
+void SComposeHTTPHead(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content,
+                      string& gzipContent) {
     bool tryGzip = false;
 
     // Just walk across and compose a valid HTTP-like message
     buffer.clear();
+    gzipContent.clear();
     buffer += methodLine + "\r\n";
-    for (pair<string, string> item : nameValueMap) {
+    for (const auto& item : nameValueMap) {
         if (SIEquals("Set-Cookie", item.first)) {
             // Parse this list and generate a separate cookie for each.
             // Technically, this shouldn't be necessary: RFC2109 section 4.2.2
@@ -1054,20 +891,18 @@ void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameVa
         }
     }
 
-    const string gzipContent = tryGzip ? SGZip(content) : "";
-    const bool gzipSuccess = !gzipContent.empty();
-    const string& finalContent = gzipSuccess ? gzipContent : content;
-
-    if (gzipSuccess) {
+    if (tryGzip) {
+        gzipContent = SGZip(content);
+    }
+    if (!gzipContent.empty()) {
         buffer += "Content-Encoding: gzip\r\n";
     }
 
     // Always add a Content-Length, even if no content, so there is no ambiguity
-    buffer += "Content-Length: " + SToStr(finalContent.size()) + "\r\n";
+    buffer += "Content-Length: " + SToStr(gzipContent.empty() ? content.size() : gzipContent.size()) + "\r\n";
 
-    // Finish the message and add the content, if any
+    // Finish the headers
     buffer += "\r\n";
-    buffer += finalContent;
 }
 
 // --------------------------------------------------------------------------
@@ -1485,7 +1320,7 @@ list<string> SParseJSONArray(const string& array) {
 }
 
 // --------------------------------------------------------------------------
-string SGZip(const string& content) {
+string SGZip(const string& content, int level) {
     z_stream stream;
 
     stream.zalloc = Z_NULL;
@@ -1503,7 +1338,7 @@ string SGZip(const string& content) {
     stream.avail_out = bufferSize;
     stream.next_out = outBuffer;
 
-    int status = deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS | GZIP_ENCODING, MAX_MEM_LEVEL,
+    int status = deflateInit2(&stream, level, Z_DEFLATED, MAX_WBITS | GZIP_ENCODING, MAX_MEM_LEVEL,
                               Z_DEFAULT_STRATEGY);
 
     if (status != Z_OK) {
@@ -1848,9 +1683,10 @@ bool SCheckNetworkErrorType(const string& logPrefix, const string& peer, int err
 }
 
 // --------------------------------------------------------------------------
-// Receives data from a socket and appends to a string.  Returns 'true' if
-// the socket is still alive when done.
-bool S_recvappend(int s, string& recvBuffer) {
+// Receives data from a socket and appends to a string or SFastBuffer.  Returns
+// 'true' if the socket is still alive when done.
+template <typename T>
+static bool S_recvappendTo(int s, T& recvBuffer) {
     SASSERT(s);
     // Figure out if this socket is blocking or non-blocking
     int flags = fcntl(s, F_GETFL);
@@ -1894,100 +1730,79 @@ bool S_recvappend(int s, string& recvBuffer) {
     return SCheckNetworkErrorType("recv", addrStr.str(), S_errno);
 }
 
-// --------------------------------------------------------------------------
-bool S_sendconsume(int s, string& sendBuffer) {
-    SASSERT(s);
-    // If empty, nothing to do
-    if (sendBuffer.empty()) {
-        return true; // Assume no error, still alive
-    }
-
-    if (SStartsWith(sendBuffer, "ESCALATE_RESPONSE")) {
-        SData tempData;
-        tempData.deserialize(sendBuffer);
-        string id = tempData["id"];
-        SINFO("Sending an ESCALATE_RESPONSE for id " << id);
-    }
-
-    // Timer for tracking how long the call to send is taking to debug slow ESCALATE_RESPONSEs
-    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+bool S_recvappend(int s, string& recvBuffer) {
+    return S_recvappendTo(s, recvBuffer);
+}
 
-    // Send as much as we can
-    ssize_t numSent = send(s, sendBuffer.c_str(), sendBuffer.size(), MSG_NOSIGNAL);
-    string errorMessage;
-    if (numSent == -1) {
-        errorMessage = " Error: "s + strerror(errno);
-    }
-    SINFO("[performance] Send() took " << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
-        << " ms and sent " << numSent << " of " << sendBuffer.size() << " bytes." << errorMessage);
+bool S_recvappend(int s, SFastBuffer& recvBuffer) {
+    return S_recvappendTo(s, recvBuffer);
+}
 
-    if (numSent > 0) {
-        SConsumeFront(sendBuffer, numSent);
-    }
+// --------------------------------------------------------------------------
+bool S_sendconsume(int s, SSendBuffer& sendBuffer) {
+    SASSERT(s);
+    // Send as many buffers as we can at a time with a single call, until they're all sent or the socket won't take any
+    // more. We have to keep going until then, as we won't be told the socket is writable again if it already is.
+    const int maxBuffers = 64;
+    iovec iov[maxBuffers];
+    while (!sendBuffer.empty()) {
+        const string escalateResponse = "ESCALATE_RESPONSE";
+        if (sendBuffer.frontSize() >= escalateResponse.size() &&
+            !memcmp(sendBuffer.frontData(), escalateResponse.data(), escalateResponse.size())) {
+            SData tempData;
+            tempData.deserialize(sendBuffer.frontData(), sendBuffer.frontSize());
+            SINFO("Sending an ESCALATE_RESPONSE for id " << tempData["id"]);
+        }
 
-    // Exit if no error
-    if (numSent >= 0) {
-        return true; // No error; still alive
-    }
+        // Timer for tracking how long the call to send is taking to debug slow ESCALATE_RESPONSEs
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = sendBuffer.fill(iov, maxBuffers);
+        size_t requested = 0;
+        for (size_t i = 0; i < message.msg_iovlen; i++) {
+            requested += iov[i].iov_len;
+        }
+        ssize_t numSent = sendmsg(s, &message, MSG_NOSIGNAL);
+        string errorMessage;
+        if (numSent == -1) {
+            errorMessage = " Error: "s + strerror(errno);
+        }
+        SINFO("[performance] Send() took " << chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+            << " ms and sent " << numSent << " of " << requested << " bytes." << errorMessage);
+
+        if (numSent == -1) {
+            // If we failed to send with over 1GB in the buffer, return false, even if the error would normally be
+            // non-fatal.
+            if (sendBuffer.size() > 1024 * 1024 * 1024) {
+                SWARN("send() failed with response '" << strerror(errno) << "' (#" << errno << "), and buffer size: "
+                      << sendBuffer.size() << ", closing.");
+                return false;
+            }
 
-    // If we failed to send with over 1GB in the buffer, return false, even if the error would normally be non-fatal.
-    if (sendBuffer.size() > 1024 * 1024 * 1024) {
-        SWARN("send() failed with response '" << strerror(errno) << "' (#" << errno << "), and buffer size: "
-              << sendBuffer.size() << ", closing.");
-        return false;
+            // Error, what kind?
+            return SCheckNetworkErrorType("send", SGetPeerName(s), S_errno);
+        }
+        sendBuffer.consumeFront(numSent);
+        if ((size_t)numSent < requested) {
+            // The socket's full, we'll be told when it's writable again.
+            break;
+        }
     }
-
-    // Error, what kind?
-    return SCheckNetworkErrorType("send", SGetPeerName(s), S_errno);
+    return true; // No error; still alive
 }
 
 void SFDset(fd_map& fdm, int socket, short evts) {
-    fd_map::iterator existing = fdm.find(socket);
-    if (existing != fdm.end()) {
-        existing->second.events = evts | existing->second.events;
-    } else {
-        fdm[socket] = (pollfd){socket, evts, 0};
-    }
+    fdm.set(socket, evts);
 }
 
 bool SFDAnySet(fd_map& fdm, int socket, short evts) {
-    if (evts == 0) {
-        return false;
-    }
-    if (fdm.find(socket) == fdm.end()) {
-        return false;
-    }
-    pollfd& fd = fdm[socket];
-    return fd.revents & evts;
+    return fdm.anySet(socket, evts);
 }
 
 // --------------------------------------------------------------------------
 int S_poll(fd_map& fdm, uint64_t timeout) {
-    // Why doesn't this function lock around our fd_map, you might ask? Because in the existing bedrock architecture,
-    // each worker thread allocates its own fd_map, and thus different threads wont compete for the same resource
-    // here. The only place they share resources is around a bedrock MessageQueue, which does its own locking. If we
-    // ever want to allow multiple threads to manipulate a shared fd_map directly, then we need locking in the related
-    // functions.
-
-    // Build a vector we can use to pass data to poll().
-    vector<pollfd> pollvec;
-    for (pair<int, pollfd> pfd : fdm) {
-        pollvec.push_back(pfd.second);
-    }
-
-    // Timeout is specified in microseconds, but poll uses milliseconds, so we divide by 1000.
-    int timeoutVal = int(timeout / 1000);
-    int returnValue = poll(&pollvec[0], fdm.size(), timeoutVal);
-
-    // And write our returned events back to our original structure.
-    for (pollfd pfd : pollvec) {
-        fdm[pfd.fd].revents = pfd.revents;
-    }
-
-    if (returnValue == -1) {
-        SWARN("Poll failed with response '" << strerror(S_errno) << "' (#" << S_errno << "), ignoring");
-    }
-    return returnValue;
+    return fdm.wait(timeout);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -2477,6 +2292,113 @@ int SQuery(sqlite3* db, const char* e, const string& sql, SQResult& result, int6
     return error;
 }
 
+// --------------------------------------------------------------------------
+// Executes a prepared SQLite statement, calling `clearResult` before each attempt and `appendRow` for each row.
+static int _SQueryPrepared(sqlite3_stmt* statement, const char* e, const vector<string>& params,
+                           const function<void()>& clearResult, const function<void()>& appendRow,
+                           int64_t warnThreshold, bool skipWarn) {
+    sqlite3* db = sqlite3_db_handle(statement);
+    const char* sql = sqlite3_sql(statement);
+
+    // A missing parameter would silently be bound as NULL, so we refuse to run the statement at all in that case.
+    if ((int)params.size() != sqlite3_bind_parameter_count(statement)) {
+        SWARN("'" << e << "', statement expects " << sqlite3_bind_parameter_count(statement) << " parameters, got "
+              << params.size() << ": " << sql);
+        return SQLITE_RANGE;
+    }
+
+    // Bind, step and collect the results, retrying on SQLITE_BUSY the same way SQuery does.
+    uint64_t startTime = STimeNow();
+    int error = 0;
+    int extErr = 0;
+    for (int tries = 0; tries < MAX_TRIES; tries++) {
+        clearResult();
+        sqlite3_reset(statement);
+        SDEBUG(sql);
+        for (size_t i = 0; i < params.size() && !error; i++) {
+            error = sqlite3_bind_text(statement, i + 1, params[i].c_str(), params[i].size(), SQLITE_TRANSIENT);
+        }
+        if (!error) {
+            while ((error = sqlite3_step(statement)) == SQLITE_ROW) {
+                appendRow();
+            }
+            if (error == SQLITE_DONE) {
+                error = SQLITE_OK;
+            }
+        }
+        extErr = sqlite3_extended_errcode(db);
+        if (error != SQLITE_BUSY || extErr == SQLITE_BUSY_SNAPSHOT) {
+            break;
+        }
+        SWARN("sqlite3_step returned SQLITE_BUSY on try #"
+              << (tries + 1) << " of " << MAX_TRIES << ". "
+              << "Extended error code: " << extErr << ". "
+              << (((tries + 1) < MAX_TRIES) ? "Sleeping 1 second and re-trying." : "No more retries."));
+
+        // Avoid the sleep after the last try.
+        if ((tries + 1) < MAX_TRIES) {
+            sleep(1);
+        }
+    }
+    uint64_t elapsed = STimeNow() - startTime;
+
+    // Warn if it took longer than the specified threshold
+    if ((int64_t)elapsed > warnThreshold)
+        SWARN("Slow query (" << elapsed / 1000 << "ms) :" << sql);
+
+    // Log this if enabled
+    if (_g_sQueryLogFP) {
+        const string& dbFilename = sqlite3_db_filename(db, "main");
+        const string& csvRow =
+            "\"" + dbFilename + "\", " + "\"" + SEscape(STrim(sql), "\"", '"') + "\", " + SToStr(elapsed) + "\n";
+        SASSERT(fwrite(csvRow.c_str(), 1, csvRow.size(), _g_sQueryLogFP) == csvRow.size());
+    }
+
+    // Only OK and commit conflicts are allowed without warning. We grab the message before the reset below.
+    if (error != SQLITE_OK && extErr != SQLITE_BUSY_SNAPSHOT) {
+        if (!skipWarn) {
+            SWARN("'" << e << "', query failed with error #" << error << " (" << sqlite3_errmsg(db) << "): " << sql);
+        }
+    }
+
+    // Release any locks held by the statement so it can sit in a cache until it's next used.
+    sqlite3_reset(statement);
+
+    if (extErr == SQLITE_BUSY_SNAPSHOT) {
+        SHMMM("[concurrent] commit conflict.");
+        return extErr;
+    }
+    return error;
+}
+
+int SQueryPrepared(sqlite3_stmt* statement, const char* e, const vector<string>& params, SQResult& result,
+                   int64_t warnThreshold, bool skipWarn) {
+    int columnCount = sqlite3_column_count(statement);
+    auto appendRow = [&]() {
+        // Like sqlite3_exec, we only record the headers once we have a row.
+        if (result.headers.empty()) {
+            for (int c = 0; c < columnCount; ++c) {
+                const char* name = sqlite3_column_name(statement, c);
+                result.headers.push_back(name ? name : "");
+            }
+        }
+        result.rows.resize(result.size() + 1);
+        vector<string>& row = result.rows.back();
+        row.reserve(columnCount);
+        for (int c = 0; c < columnCount; ++c) {
+            const char* value = (const char*)sqlite3_column_text(statement, c);
+            row.emplace_back(value ? string(value, sqlite3_column_bytes(statement, c)) : "");
+        }
+    };
+    return _SQueryPrepared(statement, e, params, [&]() { result.clear(); }, appendRow, warnThreshold, skipWarn);
+}
+
+int SQueryPrepared(sqlite3_stmt* statement, const char* e, const vector<string>& params, SQColumnarResult& result,
+                   int64_t warnThreshold, bool skipWarn) {
+    return _SQueryPrepared(statement, e, params, [&]() { result.clear(); }, [&]() { result.appendRow(statement); },
+                           warnThreshold, skipWarn);
+}
+
 // --------------------------------------------------------------------------
 // Creates a table, if not there, or verifies it's defined correctly
 bool SQVerifyTable(sqlite3* db, const string& tableName, const string& sql) {
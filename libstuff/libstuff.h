@@ -139,7 +139,13 @@ class SString : public string {
     }
 };
 
-typedef map<string, SString, STableComp> STable;
+// The table used for headers and JSON objects.
+#include "STable.h"
+
+// Send and receive buffers and in-place HTTP parsing.
+#include "SFastBuffer.h"
+#include "SHTTPView.h"
+#include "SSendBuffer.h"
 
 // An SException is an exception class that can represent an HTTP-like response, with a method line, headers, and a
 // body. The STHROW and STHROW_STACK macros will create an SException that logs it's file and line of creation, and
@@ -229,8 +235,13 @@ struct SData {
     // Serialization
     void serialize(ostringstream& out) const;
     string serialize() const;
+
+    // Serializes this as separate buffers for the method line and headers, and the content, so they can be sent (see
+    // SSendBuffer) without first being copied into one string. The content is copied once, into its own buffer.
+    vector<shared_ptr<const string>> serializeBuffers() const;
     int deserialize(const string& rhs);
     int deserialize(const char* buffer, int length);
+    int deserialize(const SFastBuffer& buffer);
 
     // Create an SData object; if no Content-Length then take everything as the content
     static SData create(const string& rhs);
@@ -553,6 +564,7 @@ int SStateNameToInt(const char* states[], const string& stateName, unsigned int
 
 // Stream management
 void SConsumeFront(string& lhs, ssize_t num);
+inline void SConsumeFront(SFastBuffer& lhs, ssize_t num) { lhs.consumeFront(num); }
 inline void SConsumeBack(string& lhs, int num) {
     if ((int)lhs.size() <= num) {
         lhs.clear();
@@ -584,6 +596,12 @@ inline bool SParseURIPath(const string& uri, string& path, STable& nameValueMap)
     return SParseURIPath(uri.c_str(), (int)uri.size(), path, nameValueMap);
 }
 void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content);
+
+// Composes the method line and headers of an HTTP message, up to and including the blank line that precedes the
+// content. If the headers ask for gzip and the content compresses, the compressed content is put in `gzipContent`, and
+// should be sent in place of `content`.
+void SComposeHTTPHead(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content,
+                      string& gzipContent);
 inline string SComposeHTTP(const string& methodLine, const STable& nameValueMap, const string& content) {
     string buffer;
     SComposeHTTP(buffer, methodLine, nameValueMap, content);
@@ -676,11 +694,15 @@ inline string SToStr(const sockaddr_in& addr) {
 }
 inline ostream& operator<<(ostream& os, const sockaddr_in& addr) { return os << SToStr(addr); }
 
-// map of FDs to pollfds
-typedef map<int, pollfd> fd_map;
+// Events to wait for on file descriptors.
 #define SREADEVTS (POLLIN | POLLPRI | POLLHUP)
 #define SWRITEEVTS (POLLOUT)
 
+// The set of file descriptors a poll loop waits on. This is an SEventLoop, which should be kept across iterations of
+// the loop, rather than created for each one, so file descriptors are only registered with it once.
+#include "SEventLoop.h"
+typedef SEventLoop fd_map;
+
 // This will add the events specified in `evts` to the events we'll listen for for this socket,
 // or, if this socket isn't in our set, it'll add it.
 void SFDset(fd_map& fdm, int socket, short evts);
@@ -694,12 +716,13 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking);
 int S_accept(int port, sockaddr_in& fromAddr, bool isBlocking);
 ssize_t S_recvfrom(int s, char* recvBuffer, int recvBufferSize, sockaddr_in& fromAddr);
 bool S_recvappend(int s, string& recvBuffer);
+bool S_recvappend(int s, SFastBuffer& recvBuffer);
 inline string S_recv(int s) {
     string buf;
     S_recvappend(s, buf);
     return buf;
 }
-bool S_sendconsume(int s, string& sendBuffer);
+bool S_sendconsume(int s, SSendBuffer& sendBuffer);
 int S_poll(fd_map& fdm, uint64_t timeout);
 
 // Network helpers
@@ -753,6 +776,7 @@ string SAESDecryptNoStrip(const string& buffer, const size_t& bufferSize, const
 // --------------------------------------------------------------------------
 #include "sqlite3.h"
 #include "SQResult.h"
+#include "SQColumnarResult.h"
 inline string SQ(const char* val) { return "'" + SEscape(val, "'", '\'') + "'"; }
 inline string SQ(const string& val) { return SQ(val.c_str()); }
 inline string SQ(int val) { return SToStr(val); }
@@ -781,6 +805,14 @@ inline int SQuery(sqlite3* db, const char* e, const string& sql, int64_t warnThr
     return SQuery(db, e, sql, ignore, warnThreshold, skipWarn);
 }
 
+// Like SQuery, but runs an already-prepared statement, binding each of `params` (as text) to its `?` placeholders in
+// order. The statement is reset when this returns, but its bindings are left in place so the caller can still call
+// `sqlite3_expanded_sql` on it. Returns an SQLite result code.
+int SQueryPrepared(sqlite3_stmt* statement, const char* e, const vector<string>& params, SQResult& result,
+                   int64_t warnThreshold = 2000 * STIME_US_PER_MS, bool skipWarn = false);
+int SQueryPrepared(sqlite3_stmt* statement, const char* e, const vector<string>& params, SQColumnarResult& result,
+                   int64_t warnThreshold = 2000 * STIME_US_PER_MS, bool skipWarn = false);
+
 bool SQVerifyTable(sqlite3* db, const string& tableName, const string& sql);
 bool SQVerifyTableExists(sqlite3* db, const string& tableName);
 
@@ -791,8 +823,8 @@ inline string SCURRENT_TIMESTAMP() { return STIMESTAMP(STimeNow()); }
 // --------------------------------------------------------------------------
 // Miscellaneous stuff
 // --------------------------------------------------------------------------
-// Compression
-string SGZip(const string& content);
+// Compression. `level` is the zlib compression level, from 1 (fastest) to 9 (smallest).
+string SGZip(const string& content, int level = 9);
 string SGUnzip(const string& content);
 
 // Command-line helpers
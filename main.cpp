@@ -188,7 +188,7 @@ int main(int argc, char* argv[]) {
         cout << "bedrock -version" << endl;
         cout << "bedrock [-clean] [-v] [-db <filename>] [-serverHost <host:port>] [-nodeHost <host:port>] [-nodeName "
                 "<name>] [-peerList <list>] [-priority <value>] [-plugins <list>] [-cacheSize <kb>] [-workerThreads <#>] "
-                "[-versionOverride <version>]"
+                "[-ioThreads <#>] [-versionOverride <version>]"
              << endl;
         cout << endl;
         cout << "Common Commands:" << endl;
@@ -212,11 +212,27 @@ int main(int argc, char* argv[]) {
         cout << "-plugins        <list>      Enable these plugins (defaults to 'db,jobs,cache,mysql')" << endl;
         cout << "-cacheSize      <kb>        number of KB to allocate for a page cache (defaults to 1GB)" << endl;
         cout << "-workerThreads  <#>         Number of worker threads to start (min 1, defaults to # of cores)" << endl;
+        cout << "-ioThreads      <#>         Number of threads to read requests from and write responses to the command "
+                "port (defaults to 0, meaning the main thread does it)"
+             << endl;
         cout << "-queryLog       <filename>  Set the query log filename (default 'queryLog.csv', SIGUSR2/SIGQUIT to "
                 "enable/disable)"
              << endl;
         cout << "-maxJournalSize <#commits>  Number of commits to retain in the historical journal (default 1000000)"
              << endl;
+        cout << "-compressReplication        Gzip large messages to peers that support it (default: false)" << endl;
+        cout << "-synchronizeBatchBytes <#>  Bytes of commits to ask for per response while synchronizing (defaults "
+                "to 0, meaning the peer decides)"
+             << endl;
+        cout << "-unbatchedReplication       Replicate each commit to followers in its own messages, rather than "
+                "batching them for peers that support it (default: false)"
+             << endl;
+        cout << "-quorumWindow   <#>         Number of QUORUM commits the leader can have awaiting follower "
+                "acknowledgement at once (defaults to 1, meaning each waits for approval before committing)"
+             << endl;
+        cout << "-jobs.archive               Periodically move finished and cancelled jobs to the jobsArchive "
+                "table with ArchiveJobs (default: false)"
+             << endl;
         cout << "-synchronous    <value>     Set the PRAGMA schema.synchronous "
                 "(defaults see https://sqlite.org/pragma.html#pragma_synchronous)"
              << endl;
@@ -316,13 +332,13 @@ int main(int argc, char* argv[]) {
         chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
         uint64_t nextActivity = STimeNow();
+        fd_map fdm;
         while (!server.shutdownComplete()) {
             if (server.shouldBackup() && server.isDetached()) {
                 BackupDB(args["-db"]);
                 server.setDetach(false);
             }
             // Wait and process
-            fd_map fdm;
             server.prePoll(fdm);
             const uint64_t now = STimeNow();
             auto timeBeforePoll = chrono::steady_clock::now();
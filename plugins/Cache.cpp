@@ -2,75 +2,316 @@
 #include "BedrockServer.h"
 
 // ==========================================================================
-BedrockPlugin_Cache::LRUMap::LRUMap() {
-    // Initialize
+BedrockPlugin_Cache::LRUMap::LRUMap() : _listening(false), _loaded(false), _appliedCommitCount(0), _tableCommitCount(0),
+                                         _size(0) {
 }
 
 // ==========================================================================
-BedrockPlugin_Cache::LRUMap::~LRUMap() {
-    // Just delete all the entries
-    while (!empty()) {
-        // Pop it off
-        popLRU();
+void BedrockPlugin_Cache::LRUMap::listen(SQLite& db) {
+    lock_guard<mutex> lock(_mutex);
+    if (!_listening) {
+        _listening = true;
+        db.addTableCommitListener("cache", [this](uint64_t commitCount) { _tableCommitted(commitCount); });
     }
 }
 
 // ==========================================================================
-bool BedrockPlugin_Cache::LRUMap::empty() {
-    // Both the map and list are the same size, so check either
-    SAUTOLOCK(_mutex);
-    return _lruList.empty();
+void BedrockPlugin_Cache::LRUMap::unload() {
+    lock_guard<mutex> lock(_mutex);
+    _loaded = false;
+    _size = 0;
+    _lruList.clear();
+    _lruMap.clear();
+}
+
+// ==========================================================================
+bool BedrockPlugin_Cache::LRUMap::load(SQLite& db) {
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_loaded) {
+            return true;
+        }
+    }
+    Changes changes;
+    read(db, changes);
+    lock_guard<mutex> lock(_mutex);
+    if (!_loaded && max(_appliedCommitCount, _tableCommitCount) <= db.getBeginCommitCount()) {
+        _replace(*changes.loaded);
+    }
+    return _loaded;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::LRUMap::read(SQLite& db, Changes& changes) {
+    SQColumnarResult result;
+    if (!db.read("SELECT name, LENGTH(value) FROM cache;", result))
+        STHROW("502 Query failed (sizing)");
+    changes.loaded.reset(new list<pair<string, int64_t>>());
+    for (size_t i = 0; i < result.size(); i++) {
+        changes.loaded->emplace_back(result.text(i, 0), result.getInt64(i, 1));
+    }
+}
+
+// ==========================================================================
+bool BedrockPlugin_Cache::LRUMap::getSize(int64_t& size) {
+    lock_guard<mutex> lock(_mutex);
+    size = _size;
+    return _loaded;
 }
 
 // ==========================================================================
 void BedrockPlugin_Cache::LRUMap::pushMRU(const string& name) {
-    // See if if it's already there
-    SAUTOLOCK(_mutex);
-    map<string, Entry*>::iterator mapIt = _lruMap.find(name);
-    if (mapIt == _lruMap.end()) {
-        // Not in the map -- add a new entry
-        Entry* entry = new Entry;
-        entry->name = name;
-
-        // Insert into the map and list, retaining iterators to both
-        entry->mapIt = _lruMap.insert(std::pair<string, Entry*>(name, entry)).first;
-        entry->listIt = _lruList.insert(_lruList.end(), entry);
+    // If it's there, just move it to the end of the list
+    lock_guard<mutex> lock(_mutex);
+    auto mapIt = _lruMap.find(name);
+    if (mapIt != _lruMap.end()) {
+        _lruList.splice(_lruList.end(), _lruList, mapIt->second.listIt);
+    }
+}
+
+// ==========================================================================
+list<string> BedrockPlugin_Cache::LRUMap::getLRU(const Changes& changes, size_t count) {
+    set<string> added;
+    for (const auto& entry : changes.added) {
+        added.insert(entry.first);
+    }
+    list<string> names;
+    auto add = [&](const string& name) {
+        if (!added.count(name) && !changes.removed.count(name)) {
+            names.push_back(name);
+        }
+        return names.size() < count;
+    };
+    if (changes.loaded) {
+        for (const auto& entry : *changes.loaded) {
+            if (!add(entry.first)) {
+                break;
+            }
+        }
     } else {
-        // Already in the map, just move to the end of the list
-        Entry* entry = mapIt->second;
-        _lruList.erase(entry->listIt);
-        entry->listIt = _lruList.insert(_lruList.end(), entry);
+        lock_guard<mutex> lock(_mutex);
+        for (const string& name : _lruList) {
+            if (!add(name)) {
+                break;
+            }
+        }
     }
+    return names;
 }
 
 // ==========================================================================
-string BedrockPlugin_Cache::LRUMap::popLRU() {
-    // Make sure we're not empty
-    SAUTOLOCK(_mutex);
-    SASSERT(!empty());
+void BedrockPlugin_Cache::LRUMap::stage(SQLite& db, Changes&& changes) {
+    auto staged = make_shared<Changes>(move(changes));
+    db.onCommit([this, &db, staged]() { _apply(db.getCommitCount(), *staged); });
+}
 
-    // Take the first item off the list
-    Entry* entry = _lruList.front();
-    _lruList.erase(entry->listIt);
-    _lruMap.erase(entry->mapIt);
-    string nameCopy = entry->name;
-    delete entry;
-    return nameCopy;
+// ==========================================================================
+void BedrockPlugin_Cache::LRUMap::_insert(const string& name, int64_t size) {
+    _erase(name);
+    Entry& entry = _lruMap[name];
+    entry.size = size;
+    entry.listIt = _lruList.insert(_lruList.end(), name);
+    _size += size;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::LRUMap::_erase(const string& name) {
+    auto mapIt = _lruMap.find(name);
+    if (mapIt != _lruMap.end()) {
+        _size -= mapIt->second.size;
+        _lruList.erase(mapIt->second.listIt);
+        _lruMap.erase(mapIt);
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::LRUMap::_replace(const list<pair<string, int64_t>>& entries) {
+    SINFO("Loaded the sizes of " << entries.size() << " cache entries.");
+    _size = 0;
+    _lruList.clear();
+    _lruMap.clear();
+    for (const auto& entry : entries) {
+        _insert(entry.first, entry.second);
+    }
+    _loaded = true;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::LRUMap::_apply(uint64_t commitCount, const Changes& changes) {
+    lock_guard<mutex> lock(_mutex);
+    _appliedCommitCount = commitCount;
+    if (changes.loaded) {
+        _replace(*changes.loaded);
+    }
+    if (!_loaded) {
+        return;
+    }
+    for (const auto& entry : changes.removed) {
+        _erase(entry.first);
+    }
+    for (const auto& entry : changes.added) {
+        _insert(entry.first, entry.second);
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::LRUMap::_tableCommitted(uint64_t commitCount) {
+    lock_guard<mutex> lock(_mutex);
+    _tableCommitCount = max(_tableCommitCount, commitCount);
+    if (_appliedCommitCount != commitCount && _loaded) {
+        // Somebody else wrote to the cache table, so we don't know how big it is any more.
+        SINFO("Cache table changed outside of WriteCache at commit " << commitCount << ", unloading cache sizes.");
+        _loaded = false;
+        _size = 0;
+        _lruList.clear();
+        _lruMap.clear();
+    }
+}
+
+// ==========================================================================
+BedrockPlugin_Cache::MemoryCache::MemoryCache(int64_t maxSize)
+    : _maxShardSize(maxSize / SHARD_COUNT), _changedCommitCount(0), _hits(0), _misses(0), _listening(false)
+{
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::MemoryCache::listen(SQLite& db) {
+    lock_guard<mutex> lock(_listenMutex);
+    if (!_listening) {
+        _listening = true;
+        db.addRowCommitListener("cache", [this](uint64_t commitCount, const set<int64_t>* rowIDs) {
+            _rowsCommitted(commitCount, rowIDs);
+        });
+
+        // Anything committed before the listener was added wasn't seen, so don't trust values read before then. A
+        // commit may have been seen since, so this only ever moves forward.
+        uint64_t commitCount = db.getCommitCount();
+        uint64_t changedCommitCount = _changedCommitCount.load();
+        while (changedCommitCount < commitCount &&
+               !_changedCommitCount.compare_exchange_weak(changedCommitCount, commitCount)) {
+        }
+    }
+}
+
+// ==========================================================================
+BedrockPlugin_Cache::MemoryCache::Shard& BedrockPlugin_Cache::MemoryCache::_shard(const string& name) {
+    return _shards[hash<string>()(name) % SHARD_COUNT];
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::MemoryCache::_erase(Shard& shard, unordered_map<string, Entry>::iterator it) {
+    shard.size -= it->first.size() + it->second.value.size();
+    shard.names.erase(it->second.rowID);
+    shard.lru.erase(it->second.lruIt);
+    shard.entries.erase(it);
+}
+
+// ==========================================================================
+bool BedrockPlugin_Cache::MemoryCache::get(const string& name, string& value) {
+    Shard& shard = _shard(name);
+    lock_guard<mutex> lock(shard.shardMutex);
+    auto it = shard.entries.find(name);
+    if (it == shard.entries.end()) {
+        _misses++;
+        return false;
+    }
+    _hits++;
+    shard.lru.splice(shard.lru.end(), shard.lru, it->second.lruIt);
+    value = it->second.value;
+    return true;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::MemoryCache::put(const string& name, int64_t rowID, const string& value,
+                                           uint64_t beginCommitCount) {
+    int64_t size = name.size() + value.size();
+    if (size > _maxShardSize) {
+        return;
+    }
+    Shard& shard = _shard(name);
+    lock_guard<mutex> lock(shard.shardMutex);
+
+    // `_rowsCommitted` updates this before taking any shard's lock, so if it hasn't changed yet, any change to this
+    // row will remove the entry after we've added it.
+    if (_changedCommitCount.load() > beginCommitCount) {
+        return;
+    }
+    auto it = shard.entries.find(name);
+    if (it != shard.entries.end()) {
+        _erase(shard, it);
+    }
+    while (shard.size + size > _maxShardSize) {
+        _erase(shard, shard.entries.find(shard.lru.front()));
+    }
+    Entry& entry = shard.entries[name];
+    entry.rowID = rowID;
+    entry.value = value;
+    entry.lruIt = shard.lru.insert(shard.lru.end(), name);
+    shard.names[rowID] = name;
+    shard.size += size;
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::MemoryCache::_rowsCommitted(uint64_t commitCount, const set<int64_t>* rowIDs) {
+    _changedCommitCount.store(commitCount);
+    for (Shard& shard : _shards) {
+        lock_guard<mutex> lock(shard.shardMutex);
+        if (!rowIDs) {
+            // We don't know which rows changed, so any of them could have.
+            shard.entries.clear();
+            shard.names.clear();
+            shard.lru.clear();
+            shard.size = 0;
+            continue;
+        }
+        for (int64_t rowID : *rowIDs) {
+            auto nameIt = shard.names.find(rowID);
+            if (nameIt != shard.names.end()) {
+                _erase(shard, shard.entries.find(nameIt->second));
+            }
+        }
+    }
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::MemoryCache::getInfo(STable& info) {
+    uint64_t hits = _hits.load();
+    uint64_t misses = _misses.load();
+    int64_t size = 0;
+    size_t entries = 0;
+    for (Shard& shard : _shards) {
+        lock_guard<mutex> lock(shard.shardMutex);
+        size += shard.size;
+        entries += shard.entries.size();
+    }
+    info["memoryCacheHits"] = to_string(hits);
+    info["memoryCacheMisses"] = to_string(misses);
+    info["memoryCacheHitRate"] = to_string(hits + misses ? (double)hits / (hits + misses) : 0.0);
+    info["memoryCacheSize"] = to_string(size);
+    info["memoryCacheMaxSize"] = to_string(_maxShardSize * SHARD_COUNT);
+    info["memoryCacheEntries"] = to_string(entries);
+}
+
+// Parses a size in bytes, optionally suffixed with KB, MB, or GB.
+static int64_t parseSize(const string& value) {
+    const string& upper = SToUpper(value);
+    int64_t size = SToInt64(upper);
+    if (SEndsWith(upper, "KB"))
+        size *= 1024;
+    if (SEndsWith(upper, "MB"))
+        size *= 1024 * 1024;
+    if (SEndsWith(upper, "GB"))
+        size *= 1024 * 1024 * 1024;
+    return size;
 }
 
 // ==========================================================================
 BedrockPlugin_Cache::BedrockPlugin_Cache(BedrockServer& s)
-    : BedrockPlugin(s), _maxCacheSize(0) // Will be set inside initialize()
+    : BedrockPlugin(s), _maxCacheSize(0), // Will be set inside initialize()
+      _memoryCache(s.args.isSet("-cache.memoryMax") ? parseSize(s.args["-cache.memoryMax"]) : DEFAULT_MEMORY_CACHE_SIZE)
 {
     // Check the configuration
-    const string& maxCache = SToUpper(server.args["-cache.max"]);
-    int64_t maxCacheSize = SToInt64(maxCache);
-    if (SEndsWith(maxCache, "KB"))
-        maxCacheSize *= 1024;
-    if (SEndsWith(maxCache, "MB"))
-        maxCacheSize *= 1024 * 1024;
-    if (SEndsWith(maxCache, "GB"))
-        maxCacheSize *= 1024 * 1024 * 1024;
+    int64_t maxCacheSize = parseSize(server.args["-cache.max"]);
     if (!maxCacheSize) {
         // Provide a default
         SINFO("No -cache.max specified, defaulting to 16GB");
@@ -104,30 +345,22 @@ void BedrockPlugin_Cache::upgradeDatabase(SQLite& db) {
         SASSERT(db.write("DROP TABLE cache;"));
     }
 
-    // Add a one row, one column table to keep track of the current size of the cache
-    SASSERT(db.verifyTable("cacheSize", "CREATE TABLE cacheSize ( size INTEGER )", ignore));
-    SQResult result;
-    SASSERT(db.read("SELECT * FROM cacheSize;", result));
-    if (result.empty()) {
-        // Insert the first (and only) row into the cache
-        SASSERT(db.write("INSERT INTO cacheSize VALUES ( 0 );"));
-    }
+    // The cache's size used to be kept in the cacheSize table by triggers, but every write updating the same row made
+    // concurrent writes conflict, so now LRUMap keeps track of it instead.
+    SASSERT(db.write("DROP TRIGGER IF EXISTS cacheOnInsert;"));
+    SASSERT(db.write("DROP TRIGGER IF EXISTS cacheOnUpdate;"));
+    SASSERT(db.write("DROP TRIGGER IF EXISTS cacheOnDelete;"));
+    SASSERT(db.write("DROP TABLE IF EXISTS cacheSize;"));
 
-    // Add the triggers to track the cache size.  (Enable recursive triggers so
-    // INSERT OR REPLACE triggers a delete when replacing.)
-    SASSERT(db.write("PRAGMA recursive_triggers = 1;"));
-    SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnInsert AFTER INSERT ON cache "
-                     "BEGIN "
-                     "UPDATE cacheSize SET size = size + LENGTH( NEW.value ); "
-                     "END;"));
-    SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnUpdate AFTER UPDATE ON cache "
-                     "BEGIN "
-                     "UPDATE cacheSize SET size = size - LENGTH( OLD.value ) + LENGTH( NEW.value ); "
-                     "END;"));
-    SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnDelete AFTER DELETE ON cache "
+    // SQLite deletes every row at once for a DELETE with no WHERE clause, without reporting the rows, unless the
+    // table has a delete trigger. LRUMap and MemoryCache need to see those rows, so we keep one that does nothing.
+    SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnDeleteAll AFTER DELETE ON cache "
                      "BEGIN "
-                     "UPDATE cacheSize SET size = size - LENGTH( OLD.value ); "
+                     "SELECT 1; "
                      "END;"));
+
+    // This node may not have seen every write to the cache while it wasn't leading.
+    _lruMap.unload();
 }
 
 // ==========================================================================
@@ -152,37 +385,259 @@ bool BedrockPlugin_Cache::peekCommand(SQLite& db, BedrockCommand& command) {
         //     - 404 - No cache found
         //
         verifyAttributeSize(request, "name", 1, MAX_SIZE_SMALL);
-        const string& name = request["name"];
+        vector<string> matchedNames;
+        vector<string> values;
+        _readCache(db, {request["name"]}, matchedNames, values);
+
+        // If we didn't get any results, respond failure
+        if (matchedNames[0].empty()) {
+            // No results
+            STHROW("404 No match found");
+        }
 
-        // Get the list
+        // Return that item
+        response["name"] = matchedNames[0];
+        response.content = move(values[0]);
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    if (SIEquals(request.getVerb(), "MultiReadCache")) {
+        // - MultiReadCache( names )
+        //
+        //     Looks up the cached values corresponding to several names at once.
+        //
+        //     Parameters:
+        //     - names - JSON array of name patterns with which to search the cache (in GLOB syntax)
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . names   - JSON array of the name matched by each pattern, in order, or "" if nothing matched
+        //         . lengths - JSON array of the length of each value (0 if nothing matched)
+        //         . values  - the raw values, one after the other (in the body of the response)
+        //
+        vector<string> matchedNames;
+        vector<string> values;
+        _readCache(db, _parseNames(request), matchedNames, values);
+        list<string> lengths;
+        size_t contentSize = 0;
+        for (const string& value : values) {
+            lengths.push_back(to_string(value.size()));
+            contentSize += value.size();
+        }
+        response["names"] = SComposeJSONArray(matchedNames);
+        response["lengths"] = SComposeJSONArray(lengths);
+        response.content.reserve(contentSize);
+        for (const string& value : values) {
+            response.content += value;
+        }
+        return true;
+    }
+
+    // ----------------------------------------------------------------------
+    if (SIEquals(request.getVerb(), "WriteCache") || SIEquals(request.getVerb(), "MultiWriteCache")) {
+        // Writes can't be peeked, but if the LRU map isn't loaded, we load it now, in this read-only transaction,
+        // rather than in the write transaction. Only leader runs writes, so only leader needs the map.
+        if (server.getState() == SQLiteNode::LEADING) {
+            _lruMap.listen(db);
+            _lruMap.load(db);
+        }
+        return false;
+    }
+
+    // Didn't recognize this command
+    return false;
+}
+
+// ==========================================================================
+STable BedrockPlugin_Cache::getInfo() {
+    STable info;
+    if (_memoryCache.enabled()) {
+        _memoryCache.getInfo(info);
+    }
+    return info;
+}
+
+// ==========================================================================
+vector<string> BedrockPlugin_Cache::_parseNames(const SData& request) {
+    list<string> names = SParseJSONArray(request["names"]);
+    if (names.empty()) {
+        STHROW("402 Missing names");
+    }
+    if (names.size() > MAX_MULTI_NAMES) {
+        STHROW("402 Too many names, " + to_string(MAX_MULTI_NAMES) + " max");
+    }
+    for (const string& name : names) {
+        if (name.empty() || name.size() > MAX_SIZE_SMALL) {
+            STHROW("402 Malformed names");
+        }
+    }
+    return vector<string>(names.begin(), names.end());
+}
+
+// ==========================================================================
+void BedrockPlugin_Cache::_readCache(SQLite& db, const vector<string>& names, vector<string>& matchedNames,
+                                     vector<string>& values) {
+    matchedNames.assign(names.size(), "");
+    values.assign(names.size(), "");
+
+    // A name with no wildcards can only match itself, so it might be in memory, and any that aren't can all be looked
+    // up with one query. Each pattern needs a query of its own, with the pattern inline rather than bound, so SQLite
+    // can plan it as a range scan over the pattern's literal prefix (a bound pattern gets re-planned on every use).
+    if (_memoryCache.enabled()) {
+        _memoryCache.listen(db);
+    }
+    map<string, list<size_t>> exactNames;
+    list<size_t> patterns;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i].find_first_of("*?[") != string::npos) {
+            patterns.push_back(i);
+        } else if (_memoryCache.enabled() && _memoryCache.get(names[i], values[i])) {
+            matchedNames[i] = names[i];
+        } else {
+            exactNames[names[i]].push_back(i);
+        }
+    }
+    auto found = [&](const vector<string>& row, const list<size_t>& indexes) {
+        SASSERT(row.size() == 3);
+        for (size_t i : indexes) {
+            matchedNames[i] = row[1];
+            values[i] = row[2];
+        }
+        if (_memoryCache.enabled()) {
+            _memoryCache.put(row[1], SToInt64(row[0]), row[2], db.getBeginCommitCount());
+        }
+    };
+    if (!exactNames.empty()) {
+        list<string> queryNames;
+        for (const auto& entry : exactNames) {
+            queryNames.push_back(entry.first);
+        }
+        SQResult result;
+        if (!db.read("SELECT rowid, name, value "
+                     "FROM cache "
+                     "WHERE name IN (" + SQList(queryNames) + ");",
+                     result)) {
+            STHROW("502 Query failed");
+        }
+        for (const auto& row : result.rows) {
+            found(row, exactNames.at(row[1]));
+        }
+    }
+    for (size_t i : patterns) {
         SQResult result;
-        if (!db.read("SELECT name, value "
+        if (!db.read("SELECT rowid, name, value "
                      "FROM cache "
-                     "WHERE name GLOB " +
-                         SQ(name) + " "
-                                    "LIMIT 1;",
+                     "WHERE name GLOB " + SQ(names[i]) + " "
+                     "LIMIT 1;",
                      result)) {
             STHROW("502 Query failed");
         }
+        if (!result.empty()) {
+            found(result[0], {i});
+        }
+    }
 
-        // If we didn't get any results, respond failure
-        if (result.empty()) {
-            // No results
-            STHROW("404 No match found");
-        } else {
-            // Return that item
-            SASSERT(result[0].size() == 2);
-            response["name"] = result[0][0];
-            response.content = result[0][1];
+    // Update the LRU Map
+    for (const string& name : matchedNames) {
+        if (!name.empty()) {
+            _lruMap.pushMRU(name);
+        }
+    }
+}
 
-            // Update the LRU Map
-            _lruMap.pushMRU(response["name"]);
-            return true;
+// ==========================================================================
+void BedrockPlugin_Cache::_writeCache(SQLite& db, const list<pair<string, string>>& entries,
+                                      const string& invalidateName) {
+    // Make sure we're not trying to cache something larger than the cache itself
+    int64_t contentSize = 0;
+    for (const auto& entry : entries) {
+        contentSize += entry.second.size();
+    }
+    if (contentSize > _maxCacheSize) {
+        // Just refuse
+        STHROW("402 Content larger than the cache itself");
+    }
+
+    // Find out how big the cache is. The LRU map is normally loaded when the command is peeked, so that reading every
+    // entry doesn't make this transaction conflict with every other write to the cache. If it couldn't be, because
+    // another write committed while peek was reading, we read the size of every entry here instead, which will also
+    // tell the LRU map when this transaction commits.
+    _lruMap.listen(db);
+    LRUMap::Changes changes;
+    int64_t cacheSize;
+    if (!_lruMap.getSize(cacheSize)) {
+        LRUMap::read(db, changes);
+        cacheSize = 0;
+        for (const auto& entry : *changes.loaded) {
+            cacheSize += entry.second;
         }
     }
 
-    // Didn't recognize this command
-    return false;
+    // Optionally invalidate other entries in the cache at the same time. Any existing entries with the names being
+    // written are deleted too, rather than replaced, so that the commit listeners see their rows change.
+    list<string> names;
+    for (const auto& entry : entries) {
+        names.push_back(entry.first);
+        changes.added.emplace_back(entry.first, entry.second.size());
+    }
+    list<string> conditions = {"name IN (" + SQList(names) + ")"};
+    if (!invalidateName.empty()) {
+        conditions.push_front("name GLOB " + SQ(invalidateName));
+    }
+    for (const string& condition : conditions) {
+        SQResult result;
+        if (!db.read("SELECT name, LENGTH(value) FROM cache WHERE " + condition + ";", result))
+            STHROW("502 Query failed (invalidating)");
+        for (const auto& row : result.rows) {
+            changes.removed[row[0]] = SToInt64(row[1]);
+            cacheSize -= SToInt64(row[1]);
+        }
+        if (!result.empty() && !db.write("DELETE FROM cache WHERE " + condition + ";"))
+            STHROW("502 Query failed (invalidating)");
+    }
+
+    // Clear out room for the new entries, starting with the least recently used (LRU) items. The LRU map may have
+    // changed since this transaction started, so we check each item is still there.
+    while (cacheSize + contentSize > _maxCacheSize) {
+        list<string> lruNames = _lruMap.getLRU(changes, EVICTION_BATCH_SIZE);
+        if (lruNames.empty()) {
+            // Another write has unloaded the map, we'll let this one go over the limit.
+            SWARN("Couldn't find anything to evict from the cache, it's " << cacheSize << " bytes.");
+            break;
+        }
+        SQResult result;
+        if (!db.read("SELECT name, LENGTH(value) FROM cache WHERE name IN (" + SQList(lruNames) + ");", result))
+            STHROW("502 Query failed (deleting)");
+        for (const string& evicted : lruNames) {
+            changes.removed[evicted] = 0;
+        }
+        list<string> evictedNames;
+        for (const auto& row : result.rows) {
+            if (cacheSize + contentSize <= _maxCacheSize) {
+                changes.removed.erase(row[0]);
+                continue;
+            }
+            changes.removed[row[0]] = SToInt64(row[1]);
+            cacheSize -= SToInt64(row[1]);
+            evictedNames.push_back(row[0]);
+        }
+        if (!evictedNames.empty() && !db.write("DELETE FROM cache WHERE name IN (" + SQList(evictedNames) + ");"))
+            STHROW("502 Query failed (deleting)");
+    }
+
+    // Insert the new entries
+    list<string> rows;
+    for (const auto& entry : entries) {
+        rows.push_back("( " + SQ(entry.first) + ", " + SQ(entry.second) + " )");
+    }
+    if (!db.write("INSERT INTO cache ( name, value ) "
+                  "VALUES " +
+                  SComposeList(rows) + ";"))
+        STHROW("502 Query failed (inserting)");
+
+    // Writing is a form of "use", so the new entries are the MRU once this commits.
+    _lruMap.stage(db, move(changes));
 }
 
 // ==========================================================================
@@ -224,47 +679,51 @@ bool BedrockPlugin_Cache::processCommand(SQLite& db, BedrockCommand& command) {
             STHROW("402 Missing value header or content body");
         }
 
-        // Make sure we're not trying to cache something larger than the cache itself
-        int64_t contentSize = valueHeader.empty() ? request.content.size() : valueHeader.size();
-        if (contentSize > _maxCacheSize) {
-            // Just refuse
-            STHROW("402 Content larger than the cache itself");
-        }
+        list<pair<string, string>> entries = {{request["name"], valueHeader.empty() ? request.content : valueHeader}};
+        _writeCache(db, entries, request["invalidateName"]);
+        return true; // Successfully processed
+    }
 
-        // Optionally invalidate other entries in the cache at the same time.
-        // Note that we will leave these items in the lruMap in memory, but
-        // that's non-harmful.
-        if (!request["invalidateName"].empty()) {
-            if (!db.write("DELETE FROM cache WHERE name GLOB " + SQ(request["invalidateName"]) + ";"))
-                STHROW("502 Query failed (invalidating)");
+    // ----------------------------------------------------------------------
+    if (SIEquals(request.getVerb(), "MultiWriteCache")) {
+        // - MultiWriteCache( names, lengths, [invalidateName] )
+        //
+        //     Records several named values into the cache in one transaction, as WriteCache does for one.
+        //
+        //     Parameters:
+        //     - names          - JSON array of names, each as for WriteCache
+        //     - lengths        - JSON array of the length of each value
+        //     - values         - The raw values, one after the other, in the content body (64MB max in total)
+        //     - invalidateName - A name pattern to erase from the cache (optional)
+        //
+        vector<string> names = _parseNames(request);
+        list<string> lengths = SParseJSONArray(request["lengths"]);
+        if (lengths.size() != names.size()) {
+            STHROW("402 Malformed lengths");
         }
-
-        // Clear out room for the new object
-        while (SToInt64(db.read("SELECT size FROM cacheSize;")) + contentSize > _maxCacheSize) {
-            // Find the least recently used (LRU) item if there is one.  (If the server was recently restarted,
-            // its LRU might not be fully populated.)
-            const string& name = (_lruMap.empty() ? db.read("SELECT name FROM cache LIMIT 1") : _lruMap.popLRU());
-            SASSERT(!name.empty());
-
-            // Delete it
-            if (!db.write("DELETE FROM cache WHERE name=" + SQ(name) + ";"))
-                STHROW("502 Query failed (deleting)");
+        if (request.content.size() > 64 * 1024 * 1024) {
+            STHROW("402 Content too large, 64MB max");
         }
-
-        // Insert the new entry
-        const string& name = request["name"];
-        const string& safeValue = SQ(valueHeader.empty() ? request.content : valueHeader);
-        if (!db.write("INSERT OR REPLACE INTO cache ( name, value ) "
-                      "VALUES( " +
-                      SQ(name) + ", " + safeValue + " );"))
-            STHROW("502 Query failed (inserting)");
-
-        // Writing is a form of "use", so this is the new MRU.  Note that we're
-        // adding it to the MRU, even before we commit.  So if this transaction
-        // gets rolled back for any reason, the MRU will have a record for a
-        // name that isn't in the database.  But that is fine.
-        _lruMap.pushMRU(name);
-        return true; // Successfully processed
+        list<pair<string, string>> entries;
+        set<string> uniqueNames;
+        size_t offset = 0;
+        auto nameIt = names.begin();
+        for (const string& length : lengths) {
+            int64_t size = SToInt64(length);
+            if (size <= 0 || length != SToStr(size) || offset + size > request.content.size()) {
+                STHROW("402 Malformed lengths");
+            }
+            if (!uniqueNames.insert(*nameIt).second) {
+                STHROW("402 Duplicate names");
+            }
+            entries.emplace_back(*nameIt++, request.content.substr(offset, size));
+            offset += size;
+        }
+        if (offset != request.content.size()) {
+            STHROW("402 Malformed lengths");
+        }
+        _writeCache(db, entries, request["invalidateName"]);
+        return true;
     }
 
     // Didn't recognize this command
@@ -1,4 +1,5 @@
 #include <libstuff/libstuff.h>
+#include <unordered_map>
 #include "../BedrockPlugin.h"
 
 // Declare the class we're going to implement below
@@ -13,40 +14,184 @@ class BedrockPlugin_Cache : public BedrockPlugin {
     virtual void upgradeDatabase(SQLite& db);
     virtual bool peekCommand(SQLite& db, BedrockCommand& command);
     virtual bool processCommand(SQLite& db, BedrockCommand& command);
+    virtual STable getInfo();
 
   private:
-    // Bedrock Cache LRU map
+    // Bedrock Cache LRU map. This has every entry in the cache table and its size, in least-recently-used order, and
+    // their total size. It's how WriteCache keeps the cache under `-cache.max` without keeping a running total in the
+    // database, which every write would have to update, so that any two concurrent writes would conflict. It's loaded
+    // from the table when a write is peeked, and then only changed when a write that's staged its changes commits. Any
+    // other write to the table unloads it, so that it's loaded again.
     class LRUMap {
       public:
-        // Constructor / Destructor
+        // The changes a transaction has made to the cache table.
+        struct Changes {
+            // Every name in the table and its size, if the transaction read them to load the map.
+            unique_ptr<list<pair<string, int64_t>>> loaded;
+
+            // The names removed, and their sizes.
+            map<string, int64_t> removed;
+
+            // The names written, and their sizes, in the order they were written.
+            list<pair<string, int64_t>> added;
+        };
+
+        // Constructor
         LRUMap();
-        ~LRUMap();
 
-        // Tests if anything is in the map
-        bool empty();
+        // Starts unloading the map whenever something other than `stage` changes the cache table. Only the first call
+        // does anything.
+        void listen(SQLite& db);
+
+        // Unloads the map.
+        void unload();
+
+        // If the map isn't loaded, loads it from a read of the cache table in the current transaction, which doesn't
+        // have to commit. That's only done if nothing has been committed to the cache table since the transaction
+        // began, as the read might not see it. Returns whether the map is loaded.
+        bool load(SQLite& db);
 
-        // Mark a name as being the most recently used (MRU)
+        // Reads every name in the cache table and its size into `changes`, so that the map is loaded if this
+        // transaction commits.
+        static void read(SQLite& db, Changes& changes);
+
+        // Gets the total size of the cache, returning false if the map isn't loaded.
+        bool getSize(int64_t& size);
+
+        // Mark a name as being the most recently used (MRU), if it's in the map
         void pushMRU(const string& name);
 
-        // Remove the name that is the least recently used (LRU)
-        string popLRU();
+        // Returns up to `count` of the least recently used (LRU) names, skipping any that `changes` has already
+        // removed or added. If `changes` loaded the map, the names it loaded are used, in the order they were read.
+        list<string> getLRU(const Changes& changes, size_t count);
+
+        // Applies `changes` to the map when the current transaction on `db` commits.
+        void stage(SQLite& db, Changes&& changes);
 
       private:
         // A single entry being tracked
         struct Entry {
-            // Attributes
-            string name;
-            list<Entry*>::iterator listIt;
-            map<string, Entry*>::iterator mapIt;
+            int64_t size;
+            list<string>::iterator listIt;
         };
 
+        // Adds or removes an entry. Called with `_mutex` held.
+        void _insert(const string& name, int64_t size);
+        void _erase(const string& name);
+
+        // Replaces every entry with `entries`, and marks the map loaded. Called with `_mutex` held.
+        void _replace(const list<pair<string, int64_t>>& entries);
+
+        // Applies a committed transaction's changes.
+        void _apply(uint64_t commitCount, const Changes& changes);
+
+        // Called for every commit that writes to the cache table.
+        void _tableCommitted(uint64_t commitCount);
+
         // Attributes
-        recursive_mutex _mutex;
-        list<Entry*> _lruList;
-        map<string, Entry*> _lruMap;
+        mutex _mutex;
+        bool _listening;
+        bool _loaded;
+        uint64_t _appliedCommitCount;
+        uint64_t _tableCommitCount;
+        int64_t _size;
+        list<string> _lruList;
+        unordered_map<string, Entry> _lruMap;
     };
 
+    // In-memory copy of recently read cache values, by exact name, so that reading them again doesn't need to query
+    // the database. It's split into shards, each with its own lock and LRU list, so that threads reading different
+    // names rarely wait for each other. An entry is dropped as soon as a transaction that changes its row commits, on
+    // any thread, including transactions replicated from other nodes.
+    class MemoryCache {
+      public:
+        // Constructor. A `maxSize` of 0 disables the cache.
+        MemoryCache(int64_t maxSize);
+
+        // Returns whether the cache is enabled.
+        bool enabled() const { return _maxShardSize > 0; }
+
+        // Starts dropping entries when their rows change in `db`. Only the first call does anything.
+        void listen(SQLite& db);
+
+        // Looks up the value for `name`, returning whether it was found.
+        bool get(const string& name, string& value);
+
+        // Adds the value of row `rowID`, read by a transaction that could see every commit up to `beginCommitCount`.
+        // It's not added if any cache row has changed since then, as it might have been read before that change.
+        void put(const string& name, int64_t rowID, const string& value, uint64_t beginCommitCount);
+
+        // Adds hit and size stats to `info`.
+        void getInfo(STable& info);
+
+      private:
+        static constexpr size_t SHARD_COUNT = 16;
+
+        // A single cached value, and where its name is in its shard's LRU list.
+        struct Entry {
+            int64_t rowID;
+            string value;
+            list<string>::iterator lruIt;
+        };
+
+        // Each name is stored in the shard picked by its hash. The names are also indexed by rowid, so that entries
+        // can be found when their rows change, and in least-recently-used order, so they can be evicted.
+        struct Shard {
+            mutex shardMutex;
+            unordered_map<string, Entry> entries;
+            unordered_map<int64_t, string> names;
+            list<string> lru;
+            int64_t size = 0;
+        };
+
+        // Returns the shard for `name`.
+        Shard& _shard(const string& name);
+
+        // Removes an entry. Called with the shard's mutex held.
+        void _erase(Shard& shard, unordered_map<string, Entry>::iterator it);
+
+        // Called for every commit that writes to the cache table.
+        void _rowsCommitted(uint64_t commitCount, const set<int64_t>* rowIDs);
+
+        const int64_t _maxShardSize;
+        Shard _shards[SHARD_COUNT];
+
+        // The last commit that changed any cache row, so that `put` can reject values that may have been read
+        // before it.
+        atomic<uint64_t> _changedCommitCount;
+
+        // Lookups that did and didn't find a value.
+        atomic<uint64_t> _hits;
+        atomic<uint64_t> _misses;
+
+        // Whether `listen` has been called.
+        mutex _listenMutex;
+        bool _listening;
+    };
+
+    // The most names MultiReadCache and MultiWriteCache accept at once.
+    static constexpr size_t MAX_MULTI_NAMES = 1000;
+
+    // How many of the least recently used entries WriteCache looks at at once when it needs to make room.
+    static constexpr size_t EVICTION_BATCH_SIZE = 100;
+
+    // How much of the cache to keep in memory, if `-cache.memoryMax` isn't set.
+    static constexpr int64_t DEFAULT_MEMORY_CACHE_SIZE = 256 * 1024 * 1024;
+
+    // Parses the JSON array of names for MultiReadCache or MultiWriteCache, checking each as ReadCache and WriteCache
+    // check their name.
+    vector<string> _parseNames(const SData& request);
+
+    // Looks up the value for each of `names`, which are GLOB patterns, setting the name each matched and its value, or
+    // leaving them empty if nothing matched.
+    void _readCache(SQLite& db, const vector<string>& names, vector<string>& matchedNames, vector<string>& values);
+
+    // Writes each of `entries`, a name and value, to the cache, after deleting anything matching `invalidateName`,
+    // and evicting enough of the least recently used entries to make room.
+    void _writeCache(SQLite& db, const list<pair<string, string>>& entries, const string& invalidateName);
+
     // Constants
     const int64_t _maxCacheSize;
     LRUMap _lruMap;
+    MemoryCache _memoryCache;
 };
@@ -77,10 +77,11 @@ bool BedrockPlugin_DB::peekCommand(SQLite& db, BedrockCommand& command) {
             return false;
         }
 
-        // Attempt the read-only query
-        SQResult result;
+        // Attempt the read-only query. Clients can send any query text they like, so we don't let it push the
+        // statements our plugins run over and over out of the statement cache.
+        SQColumnarResult result;
         int preChangeCount = db.getChangeCount();
-        if (!db.read(query, result)) {
+        if (!db.read(query, result, false)) {
             // Query failed
             SALERT("Query failed: '" << query << "'");
             response["error"] = db.getLastError();
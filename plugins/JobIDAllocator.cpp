@@ -0,0 +1,89 @@
+#include "JobIDAllocator.h"
+
+void JobIDAllocator::upgradeDatabase(SQLite& db) {
+    bool created;
+    SASSERT(db.verifyTable("jobIDBlocks", "CREATE TABLE jobIDBlocks ( nextID INTEGER NOT NULL )", created));
+    SQResult result;
+    SASSERT(db.read("SELECT COUNT(*) FROM jobIDBlocks;", result));
+    if (SToInt64(result[0][0]) == 0) {
+        // Start somewhere in the middle of the positive range, so that there's room for plenty of blocks, and so that
+        // we stay well clear of small IDs that a raw query might have inserted by hand.
+        const int64_t firstID = INT64_MAX / 4 + (int64_t)(SRandom::rand64() % (uint64_t)(INT64_MAX / 4));
+        SASSERT(db.write("INSERT INTO jobIDBlocks (nextID) VALUES (" + SQ(firstID) + ");"));
+    }
+}
+
+list<int64_t> JobIDAllocator::allocate(SQLite& db, size_t count) {
+    list<int64_t> jobIDs;
+    uint64_t generation;
+    {
+        lock_guard<mutex> lock(_mutex);
+        generation = _generation;
+        auto blockIt = _blocks.find(&db);
+        if (blockIt != _blocks.end()) {
+            _take(blockIt->second, count, jobIDs);
+            if (blockIt->second.next >= blockIt->second.end) {
+                _blocks.erase(blockIt);
+            }
+        }
+    }
+    if (jobIDs.size() == count) {
+        return jobIDs;
+    }
+
+    // Our block ran out, so reserve another one in this transaction. This is the only part of allocating IDs that
+    // touches the database. Whatever's left of it is ours once the transaction commits.
+    auto block = make_shared<Block>(_reserve(db, max((int64_t)(count - jobIDs.size()), BLOCK_SIZE)));
+    _take(*block, count - jobIDs.size(), jobIDs);
+    db.onCommit([this, &db, block, generation]() {
+        lock_guard<mutex> lock(_mutex);
+        if (generation == _generation && block->next < block->end) {
+            _blocks[&db] = move(*block);
+        }
+    });
+    return jobIDs;
+}
+
+void JobIDAllocator::reset() {
+    lock_guard<mutex> lock(_mutex);
+    _blocks.clear();
+    _generation++;
+}
+
+JobIDAllocator::Block JobIDAllocator::_reserve(SQLite& db, int64_t count) {
+    SQResult result;
+    if (!db.read("SELECT nextID FROM jobIDBlocks;", result) || result.empty()) {
+        STHROW("502 Select failed");
+    }
+    Block block;
+    block.next = SToInt64(result[0][0]);
+    if (block.next > INT64_MAX - count) {
+        STHROW("500 Job IDs exhausted");
+    }
+    block.end = block.next + count;
+    if (!db.writeIdempotent("UPDATE jobIDBlocks SET nextID = " + SQ(block.end) + ";")) {
+        STHROW("502 Update failed");
+    }
+
+    // Any IDs in this range that are already used are older, randomly chosen ones, which may since have been archived.
+    // Usually there are none, and this is a single search of each table's primary key.
+    const string range = "jobID >= " + SQ(block.next) + " AND jobID < " + SQ(block.end);
+    if (!db.read("SELECT jobID FROM jobs WHERE " + range + " UNION ALL SELECT jobID FROM jobsArchive WHERE " + range
+                 + ";", result)) {
+        STHROW("502 Select failed");
+    }
+    for (const auto& row : result.rows) {
+        block.used.insert(SToInt64(row[0]));
+    }
+    return block;
+}
+
+void JobIDAllocator::_take(Block& block, size_t count, list<int64_t>& jobIDs) {
+    while (count && block.next < block.end) {
+        if (!block.used.erase(block.next)) {
+            jobIDs.push_back(block.next);
+            count--;
+        }
+        block.next++;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+
+// Hands out job IDs without checking each one against the jobs table. IDs are allocated in blocks: a transaction that
+// needs more IDs than its database handle has left reserves the next block from the `jobIDBlocks` table, which every
+// node shares through replication. Each handle (and so each worker thread) then allocates IDs from its own block in
+// memory. If two threads reserve a block at the same time, their transactions conflict, and the block is only used by
+// the one that commits, so no two blocks can overlap, even across a change of leader.
+//
+// Jobs created before this allocator existed have random IDs, which could fall in any block. When a block is reserved,
+// we read which IDs in its range are already used, and skip them.
+class JobIDAllocator {
+  public:
+    // The number of IDs reserved at a time, unless a transaction needs more than this.
+    static const int64_t BLOCK_SIZE = 10'000;
+
+    // Creates the table we reserve blocks from, if it doesn't exist.
+    static void upgradeDatabase(SQLite& db);
+
+    // Returns `count` new job IDs, in ascending order, for jobs to be inserted in the current transaction on `db`.
+    list<int64_t> allocate(SQLite& db, size_t count);
+
+    // Forgets every block we've reserved. This must be called when this node becomes leader, as blocks we reserved
+    // before can have been lost if those transactions were never replicated, and so reserved again by another node.
+    void reset();
+
+  private:
+    // A range of IDs reserved for a single database handle, from `next` to just before `end`, except those in `used`.
+    struct Block {
+        int64_t next;
+        int64_t end;
+        set<int64_t> used;
+    };
+
+    // Reserves a block of at least `count` IDs in the current transaction on `db`.
+    static Block _reserve(SQLite& db, int64_t count);
+
+    // Moves up to `count` IDs from `block` to the end of `jobIDs`.
+    static void _take(Block& block, size_t count, list<int64_t>& jobIDs);
+
+    // The committed blocks for each database handle, and the number of resets, so a block reserved before a reset
+    // isn't kept when its transaction commits after it.
+    mutex _mutex;
+    map<SQLite*, Block> _blocks;
+    uint64_t _generation = 0;
+};
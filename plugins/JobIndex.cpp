@@ -0,0 +1,337 @@
+#include "JobIndex.h"
+
+// Whether a job is mocked. This is checked in a CASE, which SQLite only evaluates as far as it needs to, so that a job
+// with invalid JSON data doesn't fail the whole query.
+static const string MOCKED_COLUMN = "CASE WHEN JSON_VALID(data) THEN JSON_EXTRACT(data, '$.mockRequest') IS NOT NULL "
+                                    "ELSE 0 END";
+
+bool JobIndex::Key::operator<(const Key& other) const {
+    if (negativePriority != other.negativePriority) {
+        return negativePriority < other.negativePriority;
+    }
+    int comparison = nextRun.compare(other.nextRun);
+    if (comparison) {
+        return comparison < 0;
+    }
+    return jobID < other.jobID;
+}
+
+// Converts a timestamp as stored in the jobs table to microseconds.
+static uint64_t toTime(const string& timestamp) {
+    tm time = {};
+    if (!strptime(timestamp.c_str(), "%Y-%m-%d %H:%M:%S", &time)) {
+        return 0;
+    }
+    return timegm(&time) * STIME_US_PER_S;
+}
+
+bool JobIndex::Waiter::matches(const Job& job) const {
+    if ((hasPriority && job.priority != priority) || (job.mocked && !includeMocked)) {
+        return false;
+    }
+    if (names.size() > 1) {
+        return std::find(names.begin(), names.end(), job.name) != names.end();
+    }
+    return !names.empty() && !sqlite3_strglob(names.front().c_str(), job.name.c_str());
+}
+
+void JobIndex::listen(SQLite& db, WakeFunction&& wake) {
+    lock_guard<mutex> lock(_mutex);
+    if (!_listening) {
+        _listening = true;
+        _wake = move(wake);
+        db.addTableCommitListener("jobs", [this](uint64_t commitCount) { _tableCommitted(commitCount); });
+    }
+}
+
+void JobIndex::_forEachQueue(const list<string>& names, const function<void(const Queue&)>& callback) const {
+    if (names.size() > 1) {
+        for (const string& name : names) {
+            auto it = _queues.find(name);
+            if (it != _queues.end()) {
+                callback(it->second);
+            }
+        }
+    } else if (!names.empty()) {
+        // Only check each name against the pattern once, rather than once per job, and if it's not a pattern at all,
+        // just look it up.
+        const string& pattern = names.front();
+        if (pattern.find_first_of("*?[") == string::npos) {
+            auto it = _queues.find(pattern);
+            if (it != _queues.end()) {
+                callback(it->second);
+            }
+        } else {
+            for (const auto& queue : _queues) {
+                if (!sqlite3_strglob(pattern.c_str(), queue.first.c_str())) {
+                    callback(queue.second);
+                }
+            }
+        }
+    }
+}
+
+bool JobIndex::find(const list<string>& names, const int64_t* priority, bool includeMocked, const string& now,
+                    size_t limit, list<int64_t>& jobIDs) {
+    vector<Key> candidates;
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (!_valid) {
+            return false;
+        }
+        _forEachQueue(names, [&](const Queue& queue) {
+            _findInQueue(queue, priority, includeMocked, now, limit, candidates);
+        });
+    }
+
+    // We have up to `limit` candidates from each name, we want the best `limit` of all of them.
+    size_t count = min(limit, candidates.size());
+    partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+    jobIDs.clear();
+    for (size_t i = 0; i < count; i++) {
+        jobIDs.push_back(candidates[i].jobID);
+    }
+    return true;
+}
+
+bool JobIndex::wait(const list<string>& names, const int64_t* priority, bool includeMocked, uint64_t now,
+                    uint64_t holdID, uint64_t timeout, uint64_t& holdUntil) {
+    const string nowTimestamp = SComposeTime("%Y-%m-%d %H:%M:%S", now);
+    lock_guard<mutex> lock(_mutex);
+    if (!_valid) {
+        return false;
+    }
+    vector<Key> candidates;
+    string earliest;
+    _forEachQueue(names, [&](const Queue& queue) {
+        _findInQueue(queue, priority, includeMocked, nowTimestamp, 1, candidates);
+        string queueEarliest = _earliestInQueue(queue, priority, includeMocked);
+        if (!queueEarliest.empty() && (earliest.empty() || queueEarliest < earliest)) {
+            earliest = queueEarliest;
+        }
+    });
+    if (!candidates.empty()) {
+        return false;
+    }
+    holdUntil = earliest.empty() ? 0 : toTime(earliest);
+
+    // Forget anyone that's given up waiting while we're here.
+    _waiters.remove_if([now](const Waiter& waiter) { return waiter.timeout <= now; });
+    _waiters.push_back({holdID, names, priority != nullptr, priority ? *priority : 0, includeMocked, timeout});
+    return true;
+}
+
+void JobIndex::_findInQueue(const Queue& queue, const int64_t* priority, bool includeMocked, const string& now,
+                            size_t limit, vector<Key>& candidates) {
+    auto it = priority ? queue.lower_bound({-*priority, "", INT64_MIN}) : queue.begin();
+    size_t found = 0;
+    while (it != queue.end() && found < limit) {
+        if (priority && it->first.negativePriority != -*priority) {
+            break;
+        }
+        if (it->first.nextRun > now) {
+            // Nothing else at this priority is due yet, so skip to the next one.
+            if (priority) {
+                break;
+            }
+            it = queue.lower_bound({it->first.negativePriority + 1, "", INT64_MIN});
+            continue;
+        }
+        if (includeMocked || !it->second) {
+            candidates.push_back(it->first);
+            found++;
+        }
+        ++it;
+    }
+}
+
+string JobIndex::_earliestInQueue(const Queue& queue, const int64_t* priority, bool includeMocked) {
+    // Each priority's jobs are in order of nextRun, so we only need to look at the first (unmocked) job of each.
+    string earliest;
+    auto it = priority ? queue.lower_bound({-*priority, "", INT64_MIN}) : queue.begin();
+    while (it != queue.end()) {
+        if (priority && it->first.negativePriority != -*priority) {
+            break;
+        }
+        if (!includeMocked && it->second) {
+            ++it;
+            continue;
+        }
+        if (earliest.empty() || it->first.nextRun < earliest) {
+            earliest = it->first.nextRun;
+        }
+        if (priority) {
+            break;
+        }
+        it = queue.lower_bound({it->first.negativePriority + 1, "", INT64_MIN});
+    }
+    return earliest;
+}
+
+void JobIndex::scan(SQLite& db, Changes& changes) {
+    SQColumnarResult result;
+    if (!db.read("SELECT jobID, name, priority, nextRun, " + MOCKED_COLUMN + " "
+                 "FROM jobs "
+                 "WHERE state IN ('QUEUED', 'RUNQUEUED');",
+                 result)) {
+        STHROW("502 Select failed");
+    }
+    changes.allJobs.reset(new list<Job>);
+    for (size_t i = 0; i < result.size(); i++) {
+        changes.allJobs->push_back({result.getInt64(i, 0), result.text(i, 1), result.getInt64(i, 2),
+                                    result.text(i, 3), result.getInt64(i, 4) != 0});
+    }
+}
+
+bool JobIndex::rebuild(SQLite& db) {
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_valid) {
+            return true;
+        }
+    }
+    Changes changes;
+    scan(db, changes);
+    lock_guard<mutex> lock(_mutex);
+    if (!_valid && max(_appliedCommitCount, _tableCommitCount) <= db.getBeginCommitCount()) {
+        _replace(*changes.allJobs);
+    }
+    return _valid;
+}
+
+void JobIndex::stage(SQLite& db, Changes& changes) {
+    auto update = make_shared<Update>();
+    update->allJobs = move(changes.allJobs);
+
+    // Re-read everything that's changed, and sort it into jobs that can be dequeued, and jobs that can't.
+    if (!changes.jobIDs.empty() || !changes.parentJobIDs.empty()) {
+        list<string> queries;
+        const string columns = "SELECT jobID, name, priority, nextRun, state, " + MOCKED_COLUMN + " FROM jobs ";
+        if (!changes.jobIDs.empty()) {
+            queries.push_back(columns + "WHERE jobID IN (" + SQList(changes.jobIDs) + ")");
+        }
+        if (!changes.parentJobIDs.empty()) {
+            queries.push_back(columns + "WHERE parentJobID != 0 "
+                                          "AND parentJobID IN (" + SQList(changes.parentJobIDs) + ")");
+        }
+        SQResult result;
+        if (!db.read(SComposeList(queries, " UNION ALL ") + ";", result)) {
+            STHROW("502 Select failed");
+        }
+        set<int64_t> missingJobIDs = changes.jobIDs;
+        for (const auto& row : result.rows) {
+            int64_t jobID = SToInt64(row[0]);
+            missingJobIDs.erase(jobID);
+            if (row[4] == "QUEUED" || row[4] == "RUNQUEUED") {
+                update->jobs.push_back({jobID, row[1], SToInt64(row[2]), row[3], row[5] == "1"});
+            } else {
+                update->removedJobIDs.push_back(jobID);
+            }
+        }
+        update->removedJobIDs.insert(update->removedJobIDs.end(), missingJobIDs.begin(), missingJobIDs.end());
+    }
+
+    // We register this even if nothing's changed, so that committing this transaction doesn't look like somebody
+    // else has written to the jobs table.
+    db.onCommit([this, &db, update]() { _apply(db.getCommitCount(), *update); });
+}
+
+void JobIndex::_insert(const Job& job) {
+    _erase(job.jobID);
+    Key key = {-job.priority, job.nextRun, job.jobID};
+    _queues[job.name].emplace(key, job.mocked);
+    _jobs.emplace(job.jobID, make_pair(job.name, move(key)));
+}
+
+void JobIndex::_erase(int64_t jobID) {
+    auto it = _jobs.find(jobID);
+    if (it == _jobs.end()) {
+        return;
+    }
+    auto queueIt = _queues.find(it->second.first);
+    queueIt->second.erase(it->second.second);
+    if (queueIt->second.empty()) {
+        _queues.erase(queueIt);
+    }
+    _jobs.erase(it);
+}
+
+void JobIndex::_replace(const list<Job>& jobs) {
+    SINFO("Rebuilding job index with " << jobs.size() << " jobs.");
+    _queues.clear();
+    _jobs.clear();
+    for (const Job& job : jobs) {
+        _insert(job);
+    }
+    _valid = true;
+}
+
+void JobIndex::_apply(uint64_t commitCount, const Update& update) {
+    lock_guard<mutex> lock(_mutex);
+    _appliedCommitCount = commitCount;
+    if (update.allJobs) {
+        _replace(*update.allJobs);
+    }
+    if (!_valid) {
+        return;
+    }
+    uint64_t now = STimeNow();
+    for (const Job& job : update.jobs) {
+        // If this job is new to the index (or has changed), it might be what somebody's waiting for. Each job wakes
+        // the first waiter that would take it, at the time it's due.
+        auto it = _jobs.find(job.jobID);
+        bool changed = it == _jobs.end() || it->second.first != job.name ||
+                       it->second.second.negativePriority != -job.priority ||
+                       it->second.second.nextRun != job.nextRun;
+        _insert(job);
+        if (!changed) {
+            continue;
+        }
+        // We wake waiters with `_mutex` held, so that a waiter that's cancelled can't take the wakeup after it's
+        // gone. If the server says the command isn't held anymore, we try the next one.
+        for (auto waiterIt = _waiters.begin(); waiterIt != _waiters.end();) {
+            if (waiterIt->timeout <= now) {
+                waiterIt = _waiters.erase(waiterIt);
+            } else if (waiterIt->matches(job)) {
+                uint64_t due = toTime(job.nextRun);
+                bool woken = _wake(waiterIt->holdID, due > now ? due : 0, waiterIt->timeout);
+                waiterIt = _waiters.erase(waiterIt);
+                if (woken) {
+                    break;
+                }
+            } else {
+                ++waiterIt;
+            }
+        }
+    }
+    for (int64_t jobID : update.removedJobIDs) {
+        _erase(jobID);
+    }
+}
+
+void JobIndex::cancel(uint64_t holdID) {
+    lock_guard<mutex> lock(_mutex);
+    _waiters.remove_if([holdID](const Waiter& waiter) { return waiter.holdID == holdID; });
+}
+
+void JobIndex::_tableCommitted(uint64_t commitCount) {
+    list<Waiter> waiters;
+    {
+        lock_guard<mutex> lock(_mutex);
+        _tableCommitCount = max(_tableCommitCount, commitCount);
+        if (_appliedCommitCount != commitCount && _valid) {
+            // Somebody else wrote to the jobs table, we don't know what's changed. We wake everybody waiting, so they
+            // can look for themselves.
+            SINFO("Jobs table changed outside of the Jobs plugin at commit " << commitCount
+                  << ", invalidating job index.");
+            _valid = false;
+            _queues.clear();
+            _jobs.clear();
+            waiters = move(_waiters);
+            _waiters.clear();
+        }
+    }
+    for (const Waiter& waiter : waiters) {
+        _wake(waiter.holdID, 0, waiter.timeout);
+    }
+}
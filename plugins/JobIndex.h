@@ -0,0 +1,147 @@
+#pragma once
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+
+// An in-memory index of the jobs that GetJob can dequeue (those that are QUEUED or RUNQUEUED), so it can choose jobs
+// without searching the `jobs` table. Jobs are kept by name, and for each name, ordered the way GetJob wants them:
+// highest priority first, and then earliest nextRun.
+//
+// The index is only changed when transactions commit. Jobs commands record which jobs they've changed, and `stage`
+// re-reads those rows and applies them once the transaction commits. Any other commit that writes to the jobs table
+// (a raw query, or a transaction replicated from the leader) invalidates the index, and it's rebuilt from a full scan
+// by the next GetJob, whether or not it finds a job. Until then, GetJob uses the database directly.
+//
+// The index also keeps track of GetJob commands that are waiting for jobs, so that when a commit makes a job available,
+// it can wake exactly one waiter that it matches.
+class JobIndex {
+  public:
+    // Wakes the command held with the given hold ID at the given time (or now, if it's 0). The last argument is when
+    // the command times out. Returns false if the command is no longer held, so the next waiter can be tried instead.
+    typedef function<bool(uint64_t, uint64_t, uint64_t)> WakeFunction;
+
+    // The fields of a job that GetJob needs to choose it.
+    struct Job {
+        int64_t jobID;
+        string name;
+        int64_t priority;
+        string nextRun;
+        bool mocked;
+    };
+
+    // The jobs changed by a transaction.
+    struct Changes {
+        // Jobs that have been changed, and jobs whose children have been changed.
+        set<int64_t> jobIDs;
+        set<int64_t> parentJobIDs;
+
+        // Set if the transaction has scanned every dequeueable job, to rebuild the index if it commits.
+        unique_ptr<list<Job>> allJobs;
+    };
+
+    // Starts listening for commits to the jobs table on this database, using `wake` to wake waiting commands. This
+    // only needs to be called once.
+    void listen(SQLite& db, WakeFunction&& wake);
+
+    // Sets `jobIDs` to up to `limit` jobs that are due at `now`, best first, and returns true, or returns false if the
+    // index isn't valid. If `names` has more than one name, jobs must match one exactly, otherwise the only name is
+    // treated as a GLOB pattern. If `priority` isn't null, only jobs with that priority are considered, and mocked
+    // jobs are only considered if `includeMocked` is set.
+    bool find(const list<string>& names, const int64_t* priority, bool includeMocked, const string& now, size_t limit,
+              list<int64_t>& jobIDs);
+
+    // If the index is valid and has no jobs due at `now` that `find` would return, registers a waiter with the given
+    // hold ID, which is woken when a matching job is queued, and returns true. If there are matching jobs that aren't
+    // due yet, `holdUntil` is set to when the first of them is due, otherwise it's set to 0. The waiter is forgotten
+    // after `timeout`.
+    bool wait(const list<string>& names, const int64_t* priority, bool includeMocked, uint64_t now, uint64_t holdID,
+              uint64_t timeout, uint64_t& holdUntil);
+
+    // Forgets the waiter with this hold ID, if there is one. Called when its command stops being held.
+    void cancel(uint64_t holdID);
+
+    // Reads every dequeueable job into `changes`, so that the index can be rebuilt if this transaction commits.
+    static void scan(SQLite& db, Changes& changes);
+
+    // If the index isn't valid, rebuilds it from a scan of the jobs table in the current transaction, which doesn't
+    // have to commit. That's only done if nothing has been committed to the jobs table since the transaction began, as
+    // the scan might not see it. Returns whether the index is valid.
+    bool rebuild(SQLite& db);
+
+    // Reads the current state of the jobs in `changes` and arranges for the index to be updated with them when the
+    // current transaction commits.
+    void stage(SQLite& db, Changes& changes);
+
+  private:
+    // Jobs are ordered by descending priority, then nextRun, then jobID.
+    struct Key {
+        int64_t negativePriority;
+        string nextRun;
+        int64_t jobID;
+        bool operator<(const Key& other) const;
+    };
+
+    // The jobs for a single name.
+    typedef map<Key, bool> Queue;
+
+    // Adds to `candidates` up to `limit` jobs from `queue` that are due.
+    static void _findInQueue(const Queue& queue, const int64_t* priority, bool includeMocked, const string& now,
+                             size_t limit, vector<Key>& candidates);
+
+    // Calls `callback` for the queue of each name that matches `names` (see `find`). Called with `_mutex` held.
+    void _forEachQueue(const list<string>& names, const function<void(const Queue&)>& callback) const;
+
+    // Returns the earliest nextRun of the jobs in `queue`, or an empty string if there are none.
+    static string _earliestInQueue(const Queue& queue, const int64_t* priority, bool includeMocked);
+
+    // A GetJob command waiting for a job.
+    struct Waiter {
+        uint64_t holdID;
+        list<string> names;
+        bool hasPriority;
+        int64_t priority;
+        bool includeMocked;
+        uint64_t timeout;
+
+        // Whether this waiter would dequeue `job`.
+        bool matches(const Job& job) const;
+    };
+
+    // What a transaction will change in the index when it commits. If it scanned every dequeueable job, those
+    // replace the index's contents first. Then `jobs` are added or updated, and `removedJobIDs` are removed.
+    struct Update {
+        unique_ptr<list<Job>> allJobs;
+        list<Job> jobs;
+        list<int64_t> removedJobIDs;
+    };
+
+    // Adds or removes a job, or replaces every job. Called with `_mutex` held.
+    void _insert(const Job& job);
+    void _erase(int64_t jobID);
+    void _replace(const list<Job>& jobs);
+
+    // Applies a committed transaction's changes.
+    void _apply(uint64_t commitCount, const Update& update);
+
+    // Called for every commit that writes to the jobs table.
+    void _tableCommitted(uint64_t commitCount);
+
+    // Protects everything below.
+    mutex _mutex;
+
+    // Whether the index has every dequeueable job, the last commit whose changes were applied to it, and the last
+    // commit that wrote to the jobs table.
+    bool _valid = false;
+    uint64_t _appliedCommitCount = 0;
+    uint64_t _tableCommitCount = 0;
+
+    // Jobs by name, and the name and key of each job by jobID, so they can be found to remove them.
+    map<string, Queue> _queues;
+    map<int64_t, pair<string, Key>> _jobs;
+
+    // Waiters, in the order they started waiting.
+    list<Waiter> _waiters;
+
+    // Whether `listen` has been called, and how to wake waiters.
+    bool _listening = false;
+    WakeFunction _wake;
+};
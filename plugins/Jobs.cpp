@@ -17,6 +17,18 @@ const set<string, STableComp> BedrockPlugin_Jobs::supportedRequestVerbs = {
     "CreateJobs",
 };
 
+// Job priorities can be any integer that fits in 32 bits, and higher priorities are dequeued first. Returns the
+// priority in `value`, or throws if it isn't one.
+static int64_t parsePriority(const string& value) {
+    char* end = nullptr;
+    errno = 0;
+    long long priority = strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end || errno || priority < INT32_MIN || priority > INT32_MAX) {
+        STHROW("402 Invalid priority value");
+    }
+    return priority;
+}
+
 // Disable noop mode for the lifetime of this object.
 class scopedDisableNoopMode {
   public:
@@ -36,27 +48,11 @@ class scopedDisableNoopMode {
     bool _wasNoop;
 };
 
-BedrockPlugin_Jobs::BedrockPlugin_Jobs(BedrockServer& s) : BedrockPlugin(s)
-{
-}
-
-int64_t BedrockPlugin_Jobs::getNextID(SQLite& db)
+BedrockPlugin_Jobs::BedrockPlugin_Jobs(BedrockServer& s) : BedrockPlugin(s), _archiveTimer(ARCHIVE_INTERVAL)
 {
-    int64_t newID = 0;
-    while (!newID) {
-        // Make sure this fits even in a signed int64_t, and is positive.
-        newID = SRandom::rand64();
-        if (newID < 0) {
-            newID = -newID;
-        }
-        newID %= INT64_MAX;
-        string result = db.read( "SELECT jobID FROM jobs WHERE jobID = " + to_string(newID) + ";");
-        if (!result.empty()) {
-            // This one exists! Pick a new one.
-            newID = 0;
-        }
+    if (server.args.isSet("-jobs.archive")) {
+        timers.insert(&_archiveTimer);
     }
-    return newID;
 }
 
 // ==========================================================================
@@ -78,11 +74,46 @@ void BedrockPlugin_Jobs::upgradeDatabase(SQLite& db) {
                                "retryAfter  TEXT NOT NULL DEFAULT \"\")",
                            ignore));
 
+    // Finished and cancelled jobs are moved here by ArchiveJobs, and are only ever looked up by ID or parent. We create
+    // this even if archiving is off, so that jobs archived while it was on can still be found.
+    SASSERT(db.verifyTable("jobsArchive",
+                           "CREATE TABLE jobsArchive ( "
+                               "created     TIMESTAMP NOT NULL, "
+                               "jobID       INTEGER NOT NULL PRIMARY KEY, "
+                               "state       TEXT NOT NULL, "
+                               "name        TEXT NOT NULL, "
+                               "nextRun     TIMESTAMP NOT NULL, "
+                               "lastRun     TIMESTAMP, "
+                               "repeat      TEXT NOT NULL, "
+                               "data        TEXT NOT NULL, "
+                               "priority    INTEGER NOT NULL, "
+                               "parentJobID INTEGER NOT NULL, "
+                               "retryAfter  TEXT NOT NULL)",
+                           ignore));
+    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsArchiveParentJobID ON jobsArchive ( parentJobID );"));
+
     // These indexes are not used by the Bedrock::Jobs plugin, but provided for easy analysis
     // using the Bedrock::DB plugin.
     SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsName     ON jobs ( name     );"));
     SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsParentJobIDState ON jobs ( parentJobID, state ) WHERE parentJobID != 0;"));
-    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsStatePriorityNextRunName ON jobs ( state, priority, nextRun, name );"));
+    SASSERT(db.write("DROP INDEX IF EXISTS jobsStatePriorityNextRunName;"));
+
+    // GetJob reads jobs in order from this when it can't use the job index. With priority descending, each state's
+    // jobs are in the order GetJob wants them, whatever their priorities.
+    SASSERT(db.write("CREATE INDEX IF NOT EXISTS jobsStatePriorityDescNextRunName "
+                     "ON jobs ( state, priority DESC, nextRun, name );"));
+
+    // New job IDs come from blocks reserved in the database. Any blocks we reserved before we were last leader can't be
+    // trusted now.
+    JobIDAllocator::upgradeDatabase(db);
+    _idAllocator.reset();
+
+    // Keep our index of dequeueable jobs in sync with any changes made to the jobs table, starting with what's in it
+    // now.
+    _index.listen(db, [this](uint64_t holdID, uint64_t when, uint64_t timeout) {
+        return server.wakeCommand(holdID, when, timeout);
+    });
+    _index.rebuild(db);
 }
 
 // ==========================================================================
@@ -146,9 +177,30 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         }
 
         if (request.isSet("jobPriority")) {
+            parsePriority(request["jobPriority"]);
+        }
+
+        // If something other than us has written to the jobs table since the job index was last valid, rebuild it
+        // now, whether or not this command finds a job. Only leader dequeues jobs, so only leader needs the index.
+        if (server.getState() == SQLiteNode::LEADING) {
+            _index.rebuild(db);
+        }
+
+        // If we're asked to wait and there's nothing to dequeue, we hold the command until a matching job is queued,
+        // rather than have the caller poll us. If it times out first, it gets the 303 we set here.
+        if (SIEquals(request["Connection"], "wait") && server.getState() == SQLiteNode::LEADING) {
+            const list<string> nameList = SParseList(request["name"]);
             int64_t priority = request.calc64("jobPriority");
-            if (priority != 0 && priority != 500 && priority != 1000) {
-                STHROW("402 Invalid priority value");
+            bool mockRequest = request.isSet("mockRequest") || request.isSet("getMockedJobs");
+            uint64_t holdID = server.getHoldID();
+            uint64_t holdUntil = 0;
+            if (_index.wait(nameList.size() > 1 ? nameList : list<string>{request["name"]},
+                            request.isSet("jobPriority") ? &priority : nullptr, mockRequest, STimeNow(), holdID,
+                            command.timeout(), holdUntil)) {
+                command.holdID = holdID;
+                command.holdUntil = holdUntil;
+                response.methodLine = "303 Timeout";
+                return true;
             }
         }
 
@@ -178,12 +230,12 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
         //
         verifyAttributeInt64(request, "jobID", 1);
 
-        // Verify there is a job like this
+        // Verify there is a job like this, whether or not it's been archived.
         SQResult result;
-        if (!db.read("SELECT created, jobID, state, name, nextRun, lastRun, repeat, data, retryAfter, priority "
-                     "FROM jobs "
-                     "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
-                     result)) {
+        const string columns = "SELECT created, jobID, state, name, nextRun, lastRun, repeat, data, retryAfter, "
+                               "priority ";
+        if (!db.read(columns + "FROM jobs WHERE jobID=? UNION ALL " + columns + "FROM jobsArchive WHERE jobID=?;",
+                     {to_string(request.calc64("jobID")), to_string(request.calc64("jobID"))}, result)) {
             STHROW("502 Select failed");
         }
         if (result.empty()) {
@@ -230,18 +282,30 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
             }
         }
 
+        // Read all the parents at once, rather than once per job. Each maps to its state and data.
+        set<int64_t> parentJobIDs;
         for (auto& job : jsonJobs) {
-            // If no priority set, set it
-            int64_t priority = SContains(job, "jobPriority") ? SToInt(job["jobPriority"]) : JOBS_DEFAULT_PRIORITY;
-
-            // We'd initially intended for any value to be allowable here, but for
-            // performance reasons, we currently will only allow specific values to
-            // try and keep queries fast. If you pass an invalid value, we'll throw
-            // here so that the caller can know that he did something wrong rather
-            // than having his job sit unprocessed in the queue forever. Hopefully
-            // we can remove this restriction in the future.
-            if (priority != 0 && priority != 500 && priority != 1000) {
-                STHROW("402 Invalid priority value");
+            if (SContains(job, "parentJobID") && SToInt64(job["parentJobID"])) {
+                parentJobIDs.insert(SToInt64(job["parentJobID"]));
+            }
+        }
+        map<int64_t, pair<string, string>> parents;
+        if (!parentJobIDs.empty()) {
+            SINFO("parentJobID passed, checking " << parentJobIDs.size() << " existing jobs.");
+            SQResult result;
+            if (!db.read("SELECT jobID, state, data FROM jobs WHERE jobID IN (" + SQList(parentJobIDs) + ");", result)) {
+                STHROW("502 Select failed");
+            }
+            for (const auto& row : result.rows) {
+                parents[SToInt64(row[0])] = make_pair(row[1], row[2]);
+            }
+        }
+
+        for (auto& job : jsonJobs) {
+            // Make sure the priority is valid, if one is set, so the caller finds out now rather than having their job
+            // sit unprocessed in the queue forever.
+            if (SContains(job, "jobPriority")) {
+                parsePriority(job["jobPriority"]);
             }
 
             // Throw if data is not a valid JSON object, otherwise UPDATE query will fail.
@@ -258,16 +322,13 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
             // Also verify that the parent job doesn't have a retryAfter set.
             int64_t parentJobID = SContains(job, "parentJobID") ? SToInt64(job["parentJobID"]) : 0;
             if (parentJobID) {
-                SINFO("parentJobID passed, checking existing job with ID " << parentJobID);
-                SQResult result;
-                if (!db.read("SELECT state, data FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
-                    STHROW("502 Select failed");
-                }
-                if (result.empty()) {
+                auto parentIt = parents.find(parentJobID);
+                if (parentIt == parents.end()) {
                     STHROW("404 parentJobID does not exist");
                 }
-                if (!SIEquals(result[0][0], "RUNNING") && !SIEquals(result[0][0], "RUNQUEUED") && !SIEquals(result[0][0], "PAUSED")) {
-                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING or PAUSED (" << result[0][0] << ")");
+                const string& parentState = parentIt->second.first;
+                if (!SIEquals(parentState, "RUNNING") && !SIEquals(parentState, "RUNQUEUED") && !SIEquals(parentState, "PAUSED")) {
+                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING or PAUSED (" << parentState << ")");
                     STHROW("405 Can only create child job when parent is RUNNING, RUNQUEUED or PAUSED");
                 }
 
@@ -275,7 +336,7 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
                 // not. Note that this is the first place we'll look at `mockRequest` while handling this command so
                 // any change made here will happen early enough for all of our existing checks to work correctly, and
                 // everything should be good when we get to `processCommand`.
-                STable parentData = SParseJSONObject(result[0][1]);
+                STable parentData = SParseJSONObject(parentIt->second.second);
                 bool parentIsMocked = parentData.find("mockRequest") != parentData.end();
                 bool childIsMocked = command.request.isSet("mockRequest");
 
@@ -339,8 +400,12 @@ bool BedrockPlugin_Jobs::peekCommand(SQLite& db, BedrockCommand& command) {
             STHROW("502 Select failed");
         }
 
-        // Verify the job exists
+        // Verify the job exists. If it's been archived, it's already finished or cancelled, so there's nothing to do.
         if (result.empty() || result[0][0].empty()) {
+            if (!db.read("SELECT 1 FROM jobsArchive WHERE jobID=" + SQ(jobID) + ";").empty()) {
+                SINFO("CancelJob called on archived job " << jobID << ", skipping");
+                return true; // Done
+            }
             STHROW("404 No job with this jobID");
         }
 
@@ -378,6 +443,16 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
     // Disable noop update mode for jobs.
     scopedDisableNoopMode disable(db);
 
+    // If we've processed this command, update the job index with whatever it changed once it's committed.
+    JobIndex::Changes changes;
+    if (_processCommand(db, command, changes)) {
+        _index.stage(db, changes);
+        return true;
+    }
+    return false;
+}
+
+bool BedrockPlugin_Jobs::_processCommand(SQLite& db, BedrockCommand& command, JobIndex::Changes& changes) {
     // Pull out some helpful variables
     SData& request = command.request;
     SData& response = command.response;
@@ -400,7 +475,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //     - data  - A JSON object describing work to be done (optional)
         //     - firstRun - A "YYYY-MM-DD HH:MM:SS" datetime of when this job should next execute (optional)
         //     - repeat - A description of how to repeat (optional)
-        //     - jobPriority - High priorities go first (optional, default 500)
+        //     - jobPriority - High priorities go first, any 32-bit integer (optional, default 500)
         //     - unique - if true, it will check that no other job with this name already exists, if it does it will
         //                return that jobID
         //     - parentJobID - The ID of the parent job (optional)
@@ -419,7 +494,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //          - data  - A JSON object describing work to be done (optional)
         //          - firstRun - A "YYYY-MM-DD HH:MM:SS" datetime of when this job should next execute (optional)
         //          - repeat - A description of how to repeat (optional)
-        //          - jobPriority - High priorities go first (optional, default 500)
+        //          - jobPriority - High priorities go first, any 32-bit integer (optional, default 500)
         //          - unique - if true, it will check that no other job with this name already exists, if it does it will
         //                     return that jobID
         //          - parentJobID - The ID of the parent job (optional)
@@ -449,14 +524,83 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             }
         }
 
-        list<string> jobIDs;
+        // Look up everything we need to know about existing jobs up front, rather than once per job: the jobs that
+        // `unique` jobs might reuse, by name, and the parents of child jobs, by ID.
+        const bool mockRequest = command.request.isSet("mockRequest");
+        const string mockOperation = mockRequest ? "IS NOT" : "IS";
+        set<string> uniqueNames;
+        set<int64_t> parentJobIDs;
         for (auto& job : jsonJobs) {
-            // If unique flag was passed and the job exist in the DB, then we can finish the command without escalating to
-            // leader.
+            if (SContains(job, "unique") && job["unique"] == "true") {
+                uniqueNames.insert(job["name"]);
+            }
+            if (SContains(job, "parentJobID") && SToInt64(job["parentJobID"])) {
+                parentJobIDs.insert(SToInt64(job["parentJobID"]));
+            }
+        }
 
+        // Each name maps to the ID and data of the job that `unique` would find: the one with the lowest jobID.
+        map<string, pair<int64_t, string>> uniqueJobs;
+        if (!uniqueNames.empty()) {
+            SINFO("Unique flag was passed, checking existing jobs with " << uniqueNames.size() << " names, mocked? "
+                  << (mockRequest ? "true" : "false"));
+            SQResult result;
+            if (!db.read("SELECT name, jobID, data "
+                         "FROM jobs "
+                         "WHERE name IN (" + SQList(uniqueNames) + ") "
+                           "AND JSON_EXTRACT(data, '$.mockRequest') " + mockOperation + " NULL "
+                         "ORDER BY jobID DESC;",
+                         result)) {
+                STHROW("502 Select failed");
+            }
+            for (const auto& row : result.rows) {
+                uniqueJobs[row[0]] = make_pair(SToInt64(row[1]), row[2]);
+            }
+        }
+
+        // state, parentJobID, and data of each parent.
+        map<int64_t, vector<string>> parents;
+        if (!parentJobIDs.empty()) {
+            SQResult result;
+            if (!db.read("SELECT jobID, state, parentJobID, data "
+                         "FROM jobs "
+                         "WHERE jobID IN (" + SQList(parentJobIDs) + ");",
+                         result)) {
+                STHROW("502 Select failed");
+            }
+            for (const auto& row : result.rows) {
+                parents[SToInt64(row[0])] = {row[1], row[2], row[3]};
+            }
+        }
+
+        // New jobs get their IDs all at once, and are inserted together at the end.
+        list<int64_t> newJobIDs = _idAllocator.allocate(db, jsonJobs.size());
+        list<string> newJobRows;
+        const string safeCreated = SCURRENT_TIMESTAMP();
+
+        // Inserts the new jobs so far, several rows to a statement.
+        auto insertNewJobRows = [&]() {
+            const size_t rowsPerInsert = 500;
+            while (!newJobRows.empty()) {
+                list<string> rows;
+                auto end = newJobRows.begin();
+                advance(end, min(rowsPerInsert, newJobRows.size()));
+                rows.splice(rows.begin(), newJobRows, newJobRows.begin(), end);
+                if (!db.writeIdempotent("INSERT INTO jobs ( jobID, created, state, name, nextRun, repeat, data, priority, parentJobID, retryAfter ) "
+                                        "VALUES " + SComposeList(rows, ", ") + ";")) {
+                    STHROW("502 insert query failed");
+                }
+            }
+        };
+
+        // Names of unique jobs that we've updated, whose data we no longer know.
+        set<string> updatedNames;
+
+        list<string> jobIDs;
+        for (auto& job : jsonJobs) {
             // If this is a mock request, we insert that into the data.
             string originalData = job["data"];
-            if (command.request.isSet("mockRequest")) {
+            if (mockRequest) {
                 // Mocked jobs should never repeat.
                 job.erase("repeat");
 
@@ -469,44 +613,41 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                 }
             }
 
+            // If unique flag was passed and the job exists, we reuse it.
             int64_t updateJobID = 0;
             if (SContains(job, "unique") && job["unique"] == "true") {
-                SQResult result;
-                SINFO("Unique flag was passed, checking existing job with name " << job["name"] << ", mocked? "
-                      << (command.request.isSet("mockRequest") ? "true" : "false"));
-                string operation = command.request.isSet("mockRequest") ? "IS NOT" : "IS";
-                if (!db.read("SELECT jobID, data "
-                             "FROM jobs "
-                             "WHERE name=" + SQ(job["name"]) +
-                             "  AND JSON_EXTRACT(data, '$.mockRequest') " + operation + " NULL;",
-                             result)) {
-                    STHROW("502 Select failed");
+                if (updatedNames.count(job["name"])) {
+                    // We've changed this job's data already, so read it again.
+                    SQResult result;
+                    if (!db.read("SELECT jobID, data "
+                                 "FROM jobs "
+                                 "WHERE jobID = " + SQ(uniqueJobs[job["name"]].first) + ";",
+                                 result)) {
+                        STHROW("502 Select failed");
+                    }
+                    uniqueJobs[job["name"]].second = result.empty() ? "" : result[0][1];
+                    updatedNames.erase(job["name"]);
                 }
+                auto uniqueJobIt = uniqueJobs.find(job["name"]);
 
-                // If we got a result, and it's data is the same as passed, we won't change anything.
-                if (!result.empty() && ((job["data"].empty() && result[0][1] == "{}") || (!job["data"].empty() && result[0][1] == job["data"]))) {
+                // If we found one, and its data is the same as passed, we won't change anything.
+                if (uniqueJobIt != uniqueJobs.end() &&
+                    ((job["data"].empty() && uniqueJobIt->second.second == "{}") ||
+                     (!job["data"].empty() && uniqueJobIt->second.second == job["data"]))) {
                     SINFO("Job already existed with matching data, and unique flag was passed, reusing existing job "
-                          << result[0][0] << ", mocked? " << (command.request.isSet("mockRequest") ? "true" : "false"));
-
-                    // If we are calling CreateJob, return early, there are no more jobs to create.
-                    if (SIEquals(requestVerb, "CreateJob")) {
-                        content["jobID"] = result[0][0];
-                        return true;
-                    }
-
-                    // Append new jobID to list of created jobs.
-                    jobIDs.push_back(result[0][0]);
+                          << uniqueJobIt->second.first << ", mocked? " << (mockRequest ? "true" : "false"));
+                    jobIDs.push_back(SToStr(uniqueJobIt->second.first));
                     continue;
                 }
 
                 // If we found a job, but the data was different, we'll need to update it.
-                if (!result.empty()) {
-                    updateJobID = SToInt64(result[0][0]);
+                if (uniqueJobIt != uniqueJobs.end()) {
+                    updateJobID = uniqueJobIt->second.first;
                 }
             }
 
             // Record whether or not this job is scheduling itself in the future. If so, it's not suitable for
-            // immediate scheduling and won't benefit from disk-access-free assignment to waiting workers.
+            // immediate scheduling and won't wake a waiting GetJob until it's due.
             if ((!SContains(job, "repeat") || job["repeat"].empty()) && (!SContains(job, "firstRun") && job["firstRun"].empty())) {
                 SINFO("Job has no run time, can be scheduled immediately.");
             } else {
@@ -517,8 +658,8 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             const string& safeFirstRun = !SContains(job, "firstRun") || job["firstRun"].empty() ? SCURRENT_TIMESTAMP() : SQ(job["firstRun"]);
 
             // If no data was provided, use an empty object
-            const string& safeData = !SContains(job, "data") || job["data"].empty() ? SQ("{}") : SQ(job["data"]);
-            const string& safeOriginalData = originalData.empty() ? SQ("{}") : SQ(originalData);
+            const string data = !SContains(job, "data") || job["data"].empty() ? string("{}") : job["data"];
+            const string safeData = SQ(data);
 
             // If a repeat is provided, validate it
             if (SContains(job, "repeat")) {
@@ -532,41 +673,32 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             }
 
             // If no priority set, set it
-            int64_t priority = SContains(job, "jobPriority") ? SToInt(job["jobPriority"]) : (SContains(job, "priority") ? SToInt(job["priority"]) : JOBS_DEFAULT_PRIORITY);
-
-            // We'd initially intended for any value to be allowable here, but for
-            // performance reasons, we currently will only allow specific values to
-            // try and keep queries fast. If you pass an invalid value, we'll throw
-            // here so that the caller can know that he did something wrong rather
-            // than having his job sit unprocessed in the queue forever. Hopefully
-            // we can remove this restriction in the future.
-            if (priority != 0 && priority != 500 && priority != 1000) {
-                STHROW("402 Invalid priority value");
-            }
+            int64_t priority = SContains(job, "jobPriority") ? parsePriority(job["jobPriority"]) :
+                               (SContains(job, "priority") ? parsePriority(job["priority"]) : JOBS_DEFAULT_PRIORITY);
 
             // Validate that the parentJobID exists and is in the right state if one was passed.
             int64_t parentJobID = SContains(job, "parentJobID") ? SToInt64(job["parentJobID"]) : 0;
+            const vector<string>* parent = nullptr;
             if (parentJobID) {
-                SQResult result;
-                if (!db.read("SELECT state, parentJobID, data FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
-                    STHROW("502 Select failed");
-                }
-                if (result.empty()) {
+                auto parentIt = parents.find(parentJobID);
+                if (parentIt == parents.end()) {
                     STHROW("404 parentJobID does not exist");
                 }
-                if (!SIEquals(result[0][0], "RUNNING") && !SIEquals(result[0][0], "RUNQUEUED") && !SIEquals(result[0][0], "PAUSED")) {
-                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING, RUNQUEUED or PAUSED (" << result[0][0] << ")");
+                parent = &parentIt->second;
+                const string& parentState = (*parent)[0];
+                if (!SIEquals(parentState, "RUNNING") && !SIEquals(parentState, "RUNQUEUED") && !SIEquals(parentState, "PAUSED")) {
+                    SWARN("Trying to create child job with parent jobID#" << parentJobID << ", but parent isn't RUNNING, RUNQUEUED or PAUSED (" << parentState << ")");
                     STHROW("405 Can only create child job when parent is RUNNING, RUNQUEUED or PAUSED");
                 }
 
                 // Verify that the parent and child job have the same `mockRequest` setting.
-                STable parentData = SParseJSONObject(result[0][2]);
-                if (command.request.isSet("mockRequest") != (parentData.find("mockRequest") != parentData.end())) {
+                STable parentData = SParseJSONObject((*parent)[2]);
+                if (mockRequest != (parentData.find("mockRequest") != parentData.end())) {
                     STHROW("405 Parent and child jobs must have matching mockRequest setting");
                 }
 
                 // Prevent jobs from creating grandchildren
-                if (!SIEquals(result[0][1], "0")) {
+                if (!SIEquals((*parent)[1], "0")) {
                     SWARN("Trying to create grandchild job with parent jobID#" << parentJobID);
                     STHROW("405 Cannot create grandchildren");
                 }
@@ -574,6 +706,9 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
 
             // Are we creating a new job, or updating an existing job?
             if (updateJobID) {
+                // The job we're updating may be one created earlier in this request, so insert those first.
+                insertNewJobRows();
+
                 // Update the existing job.
                 if(!db.writeIdempotent("UPDATE jobs SET "
                                          "repeat   = " + SQ(SToUpper(job["repeat"])) + ", " +
@@ -583,12 +718,8 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                 {
                     STHROW("502 update query failed");
                 }
-
-                // If we are calling CreateJob, return early, there are no more jobs to create.
-                if (SIEquals(requestVerb, "CreateJob")) {
-                    content["jobID"] = SToStr(updateJobID);
-                    return true;
-                }
+                changes.jobIDs.insert(updateJobID);
+                updatedNames.insert(job["name"]);
 
                 // Append new jobID to list of created jobs.
                 jobIDs.push_back(SToStr(updateJobID));
@@ -599,39 +730,38 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                 // the child is created (indicating a child is creating a sibling) then the new child starts
                 // in the QUEUED state.
                 auto initialState = "QUEUED";
-                if (parentJobID) {
-                    auto parentState = db.read("SELECT state FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
-                    if (SIEquals(parentState, "RUNNING") || SIEquals(parentState, "RUNQUEUED")) {
-                        initialState = "PAUSED";
-                    }
+                if (parent && (SIEquals((*parent)[0], "RUNNING") || SIEquals((*parent)[0], "RUNQUEUED"))) {
+                    initialState = "PAUSED";
                 }
 
                 // If no data was provided, use an empty object
                 const string& safeRetryAfter = SContains(job, "retryAfter") && !job["retryAfter"].empty() ? SQ(job["retryAfter"]) : SQ("");
 
-                // Create this new job with a new generated ID
-                const int64_t jobIDToUse = getNextID(db);
+                // Create this new job with the next of our generated IDs.
+                const int64_t jobIDToUse = newJobIDs.front();
+                newJobIDs.pop_front();
                 SINFO("Next jobID to be used " << jobIDToUse);
-                if (!db.writeIdempotent("INSERT INTO jobs ( jobID, created, state, name, nextRun, repeat, data, priority, parentJobID, retryAfter ) "
-                         "VALUES( " +
-                            SQ(jobIDToUse) + ", " +
-                            SCURRENT_TIMESTAMP() + ", " +
-                            SQ(initialState) + ", " +
-                            SQ(job["name"]) + ", " +
-                            safeFirstRun + ", " +
-                            SQ(SToUpper(job["repeat"])) + ", " +
-                            safeData + ", " +
-                            SQ(priority) + ", " +
-                            SQ(parentJobID) + ", " +
-                            safeRetryAfter + " " +
-                         " );"))
-                {
-                    STHROW("502 insert query failed");
-                }
-
-                if (SIEquals(requestVerb, "CreateJob")) {
-                    content["jobID"] = SToStr(jobIDToUse);
-                    return true;
+                newJobRows.push_back("( " +
+                                        SQ(jobIDToUse) + ", " +
+                                        safeCreated + ", " +
+                                        SQ(initialState) + ", " +
+                                        SQ(job["name"]) + ", " +
+                                        safeFirstRun + ", " +
+                                        SQ(SToUpper(job["repeat"])) + ", " +
+                                        safeData + ", " +
+                                        SQ(priority) + ", " +
+                                        SQ(parentJobID) + ", " +
+                                        safeRetryAfter + " " +
+                                     ")");
+                changes.jobIDs.insert(jobIDToUse);
+
+                // Later unique jobs with this name would find this one if it has the lowest jobID.
+                if (uniqueNames.count(job["name"])) {
+                    auto uniqueJobIt = uniqueJobs.find(job["name"]);
+                    if (uniqueJobIt == uniqueJobs.end() || jobIDToUse < uniqueJobIt->second.first) {
+                        uniqueJobs[job["name"]] = make_pair(jobIDToUse, data);
+                        updatedNames.erase(job["name"]);
+                    }
                 }
 
                 // Append new jobID to list of created jobs.
@@ -639,90 +769,98 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             }
         }
 
-        content["jobIDs"] = SComposeJSONArray(jobIDs);
+        // Insert the rest of the new jobs.
+        insertNewJobRows();
 
-        // Release workers waiting on this state
-        // TODO: No "HeldBy" anymore. If a plugin wants to hold a command, it should own it until it's done.
-        // node->clearCommandHolds("Jobs:" + request["name"]);
+        if (SIEquals(requestVerb, "CreateJob")) {
+            content["jobID"] = jobIDs.front();
+        } else {
+            content["jobIDs"] = SComposeJSONArray(jobIDs);
+        }
 
         return true; // Successfully processed
     }
 
     // ----------------------------------------------------------------------
     else if (SIEquals(requestVerb, "GetJob") || SIEquals(requestVerb, "GetJobs")) {
-        // If we're here it's because peekCommand found some data; re-execute
-        // the query for real now.  However, this time we will order by
-        // priority.  We do this as three separate queries so we only have one
-        // unbounded column in each query.  Additionally, we wrap each inner
-        // query in a "SELECT *" such that we can have an "ORDER BY" and
-        // "LIMIT" *before* we UNION ALL them together.  Looks gnarly, but it
-        // works!
+        // Find the jobs to dequeue. Normally the job index tells us which ones, and we only need to read them. If the
+        // index isn't valid, we search the jobs table instead, and if we find anything, we also read every
+        // dequeueable job so that the index can be rebuilt when this commits.
         SQResult result;
         const list<string> nameList = SParseList(request["name"]);
-        string safeNumResults = SQ(max(request.calc("numResults"),1));
+        int64_t numResults = max(request.calc("numResults"), 1);
+        string safeNumResults = SQ(numResults);
         bool mockRequest = command.request.isSet("mockRequest") || command.request.isSet("getMockedJobs");
-        string selectQuery;
-        if (request.isSet("jobPriority")) {
-            selectQuery =
-                "SELECT jobID, name, data, parentJobID, retryAfter, created, repeat, lastRun, nextRun "
-                "FROM jobs "
-                "WHERE state IN ('QUEUED', 'RUNQUEUED') "
-                    "AND priority=" + SQ(request.calc("jobPriority")) + " "
-                    "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                    "AND +name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                    string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
-                "ORDER BY nextRun ASC LIMIT " + safeNumResults + ";";
+        uint64_t now = STimeNow();
+        int64_t priority = request.calc64("jobPriority");
+        list<int64_t> jobIDs;
+        if (_index.find(nameList.size() > 1 ? nameList : list<string>{request["name"]},
+                        request.isSet("jobPriority") ? &priority : nullptr, mockRequest,
+                        SComposeTime("%Y-%m-%d %H:%M:%S", now), numResults, jobIDs)) {
+            if (!jobIDs.empty()) {
+                SQResult unorderedResult;
+                if (!db.read("SELECT jobID, name, data, parentJobID, retryAfter, created, repeat, lastRun, nextRun "
+                             "FROM jobs "
+                             "WHERE jobID IN (" + SQList(jobIDs) + ") "
+                               "AND state IN ('QUEUED', 'RUNQUEUED') "
+                               "AND " + STIMESTAMP(now) + ">=nextRun;",
+                             unorderedResult)) {
+                    STHROW("502 Query failed");
+                }
+
+                // Keep them in the order the index returned them. If any have changed since the snapshot we're
+                // reading, we just leave them out.
+                map<string, vector<string>> rowsByJobID;
+                for (auto& row : unorderedResult.rows) {
+                    rowsByJobID.emplace(row[0], move(row));
+                }
+                for (int64_t jobID : jobIDs) {
+                    auto it = rowsByJobID.find(SToStr(jobID));
+                    if (it != rowsByJobID.end()) {
+                        result.rows.push_back(move(it->second));
+                    }
+                }
+            }
         } else {
-            selectQuery =
-                "SELECT jobID, name, data, parentJobID, retryAfter, created, repeat, lastRun, nextRun FROM ( "
+            // Without the index, we search the table. The jobsStatePriorityDescNextRunName index has each state's jobs
+            // in the order we want them, highest priority first and then earliest nextRun, whatever the priorities
+            // are, so we read each dequeueable state in that order, stopping as soon as we have enough, and merge them.
+            const string nameMatch = nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" :
+                                                           "GLOB " + SQ(request["name"]);
+            list<string> stateQueries;
+            for (const char* state : {"QUEUED", "RUNQUEUED"}) {
+                stateQueries.push_back(
                     "SELECT * FROM ("
-                        "SELECT jobID, name, data, priority, parentJobID, retryAfter, created, repeat, lastRun, nextRun "
+                        "SELECT jobID, name, data, priority, parentJobID, retryAfter, created, repeat, lastRun, "
+                               "nextRun "
                         "FROM jobs "
-                        "WHERE state IN ('QUEUED', 'RUNQUEUED') "
-                            "AND priority=1000 "
-                            "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                            "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
-                        "ORDER BY nextRun ASC LIMIT " + safeNumResults +
-                    ") "
-                "UNION ALL "
-                    "SELECT * FROM ("
-                        "SELECT jobID, name, data, priority, parentJobID, retryAfter, created, repeat, lastRun, nextRun "
-                        "FROM jobs "
-                        "WHERE state IN ('QUEUED', 'RUNQUEUED') "
-                            "AND priority=500 "
-                            "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                            "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
-                        "ORDER BY nextRun ASC LIMIT " + safeNumResults +
-                    ") "
-                "UNION ALL "
-                    "SELECT * FROM ("
-                        "SELECT jobID, name, data, priority, parentJobID, retryAfter, created, repeat, lastRun, nextRun "
-                        "FROM jobs "
-                        "WHERE state IN ('QUEUED', 'RUNQUEUED') "
-                            "AND priority=0 "
-                            "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
-                            "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
-                        "ORDER BY nextRun ASC LIMIT " + safeNumResults +
-                    ") "
+                        "WHERE state=" + SQ(state) + " " +
+                            (request.isSet("jobPriority") ? "AND priority=" + SQ(priority) + " " : "") +
+                            "AND " + STIMESTAMP(now) + ">=nextRun "
+                            "AND name " + nameMatch + " " +
+                            (!mockRequest ? "AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                        "ORDER BY priority DESC, nextRun ASC LIMIT " + safeNumResults +
+                    ")");
+            }
+            string selectQuery =
+                "SELECT jobID, name, data, parentJobID, retryAfter, created, repeat, lastRun, nextRun FROM ( " +
+                    SComposeList(stateQueries, " UNION ALL ") +
                 ") "
-                "ORDER BY priority DESC "
+                "ORDER BY priority DESC, nextRun ASC, jobID ASC "
                 "LIMIT " + safeNumResults + ";";
-        }
-        if (!db.read(selectQuery, result)) {
-            STHROW("502 Query failed");
+            if (!db.read(selectQuery, result)) {
+                STHROW("502 Query failed");
+            }
+            if (!result.empty()) {
+                JobIndex::scan(db, changes);
+            }
         }
 
         // Are there any results?
         if (result.empty()) {
-            // Ah, there were before, but aren't now -- nothing found
-            // **FIXME: If "Connection: wait" should re-apply the hold.  However, this is super edge
-            //          as we could only get here if the job somehow got consumed between the peek
-            //          and process -- which could happen during heavy load.  But it'd just return
-            //          no results (which is correct) faster than it would otherwise time out.  Either
-            //          way the worker will likely just loop, so it doesn't really matter.
+            // Nothing found. With "Connection: wait", we only get here if the jobs `peek` saw were taken by someone
+            // else before we could dequeue them, or if the index wasn't usable. We don't hold the command again from
+            // here, the caller can just ask again.
             STHROW("404 No job found");
         }
 
@@ -739,6 +877,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             // Add this object to our output
             STable job;
             SINFO("Returning jobID " << result[c][0] << " from " << requestVerb);
+            changes.jobIDs.insert(SToInt64(result[c][0]));
             job["jobID"] = result[c][0];
             job["name"] = result[c][1];
             job["data"] = result[c][2];
@@ -762,9 +901,14 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                 nonRetriableJobs.push_back(result[c][0]);
             }
 
-            // See if this job has any FINISHED/CANCELLED child jobs, indicating it is being resumed
+            // See if this job has any FINISHED/CANCELLED child jobs, indicating it is being resumed. These may have
+            // been archived.
             SQResult childJobs;
-            if (!db.read("SELECT jobID, data, state FROM jobs WHERE parentJobID != 0 AND parentJobID=" + result[c][0] + " AND state IN ('FINISHED', 'CANCELLED');", childJobs)) {
+            if (!db.read("SELECT jobID, data, state FROM jobs "
+                         "WHERE parentJobID != 0 AND parentJobID=" + result[c][0] + " AND state IN ('FINISHED', 'CANCELLED') "
+                         "UNION ALL "
+                         "SELECT jobID, data, state FROM jobsArchive WHERE parentJobID=" + result[c][0] + ";",
+                         childJobs)) {
                 STHROW("502 Failed to select finished child jobs");
             }
 
@@ -861,8 +1005,8 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         SQResult result;
         if (!db.read("SELECT jobID, nextRun, lastRun "
                      "FROM jobs "
-                     "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
-                     result)) {
+                     "WHERE jobID=?;",
+                     {to_string(request.calc64("jobID"))}, result)) {
             STHROW("502 Select failed");
         }
         if (result.empty() || !SToInt64(result[0][0])) {
@@ -885,6 +1029,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                                 SQ(request.calc64("jobID")) + ";")) {
             STHROW("502 Update failed");
         }
+        changes.jobIDs.insert(request.calc64("jobID"));
         return true; // Successfully processed
     }
 
@@ -921,170 +1066,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //     - jobID  - ID of the job to finish
         //     - data   - Data to associate with this finsihed job
         //
-        verifyAttributeInt64(request, "jobID", 1);
-        int64_t jobID = request.calc64("jobID");
-
-        // Verify there is a job like this and it's running
-        SQResult result;
-        if (!db.read("SELECT state, nextRun, lastRun, repeat, parentJobID, json_extract(data, '$.mockRequest') "
-                     "FROM jobs "
-                     "WHERE jobID=" + SQ(jobID) + ";",
-                     result)) {
-            STHROW("502 Select failed");
-        }
-        if (result.empty()) {
-            STHROW("404 No job with this jobID");
-        }
-
-        const string& state = result[0][0];
-        const string& nextRun = result[0][1];
-        const string& lastRun = result[0][2];
-        string repeat = result[0][3];
-        int64_t parentJobID = SToInt64(result[0][4]);
-        bool mockRequest = result[0][5] == "1";
-
-        // Make sure we're finishing a job that's actually running
-        if (state != "RUNNING" && state != "RUNQUEUED" && !mockRequest) {
-            SINFO("Trying to finish job#" << jobID << ", but isn't RUNNING or RUNQUEUED (" << state << ")");
-            STHROW("405 Can only retry/finish RUNNING and RUNQUEUED jobs");
-        }
-
-        // If we have a parent, make sure it is PAUSED.  This is to just
-        // double-check that child jobs aren't somehow running in parallel to
-        // the parent.
-        if (parentJobID) {
-            auto parentState = db.read("SELECT state FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
-            if (!SIEquals(parentState, "PAUSED")) {
-                SINFO("Trying to finish/retry job#" << jobID << ", but parent isn't PAUSED (" << parentState << ")");
-                STHROW("405 Can only retry/finish child job when parent is PAUSED");
-            }
-        }
-
-        // Delete any FINISHED/CANCELLED child jobs, but leave any PAUSED children alone (as those will signal that
-        // we just want to re-PAUSE this job so those new children can run)
-        if (!db.writeIdempotent("DELETE FROM jobs WHERE parentJobID != 0 AND parentJobID=" + SQ(jobID) + " AND state IN ('FINISHED', 'CANCELLED');")) {
-            STHROW("502 Failed deleting finished/cancelled child jobs");
-        }
-
-        // If we've been asked to update the data, let's do that
-        auto data = request["data"];
-        if (!data.empty()) {
-            // See if the new data says it's mocked.
-            STable newData = SParseJSONObject(data);
-            bool newMocked = newData.find("mockRequest") != newData.end();
-
-            // If both sets of data don't match each other, this is an error, we don't know who to trust.
-            // We don't worry about the state of the request header for mockRequest here, as we expect that the Bedrock
-            // client won't always set it when finishing or retrying a job. We'll just use what's in the data.
-            if (mockRequest != newMocked) {
-                SWARN("Not updating mockRequest field of job data.");
-                STHROW("500 Mock Mismatch");
-            }
-
-            // If the Job data indicates that this job should be deleted, clear the repeat value so that we delete this job further down.
-            if (SContains(newData, "delete") && newData["delete"] == "true") {
-                SINFO("Job was marked for deletion in the data object, clearing repeat value.");
-                repeat = "";
-            }
-
-            // Update the data to the new value.
-            if (!db.writeIdempotent("UPDATE jobs SET data=" + SQ(data) + " WHERE jobID=" + SQ(jobID) + ";")) {
-                STHROW("502 Failed to update job data");
-            }
-        }
-
-        // If we are finishing a job that has child jobs, set its state to paused.
-        if (SIEquals(requestVerb, "FinishJob") && _hasPendingChildJobs(db, jobID)) {
-            // Update the parent job to PAUSED. Also update its nextRun: in case it has a retryAfter, GetJobs set the nextRun too far in the future (to account for retryAfter), so set it to what it should
-            // be now that it is waiting on its children to complete.
-            SINFO("Job has child jobs, PAUSING parent, QUEUING children");
-            if (!db.writeIdempotent("UPDATE jobs SET state='PAUSED', nextRun=" + SQ(lastRun) + " WHERE jobID=" + SQ(jobID) + ";")) {
-                STHROW("502 Parent update failed");
-            }
-
-            // Also un-pause any child jobs such that they can run
-            if (!db.writeIdempotent("UPDATE jobs SET state='QUEUED' "
-                          "WHERE state='PAUSED' "
-                            "AND parentJobID != 0 AND parentJobID=" + SQ(jobID) + ";")) {
-                STHROW("502 Child update failed");
-            }
-
-            // All done processing this command
-            return true;
-        }
-
-        // If this is RetryJob and we want to update the name, let's do that
-        const string& name = request["name"];
-        if (!name.empty() && SIEquals(requestVerb, "RetryJob")) {
-            if (!db.writeIdempotent("UPDATE jobs SET name=" + SQ(name) + " WHERE jobID=" + SQ(jobID) + ";")) {
-                STHROW("502 Failed to update job name");
-            }
-        }
-
-        string safeNewNextRun = "";
-        // If this is set to repeat, get the nextRun value
-        if (!repeat.empty()) {
-            safeNewNextRun = _constructNextRunDATETIME(nextRun, lastRun, repeat);
-        } else if (SIEquals(requestVerb, "RetryJob")) {
-            const string& newNextRun = request["nextRun"];
-
-            if (newNextRun.empty()) {
-                SINFO("nextRun isn't set, using delay");
-                int64_t delay = request.calc64("delay");
-                if (delay < 0) {
-                    STHROW("402 Must specify a non-negative delay when retrying");
-                }
-                repeat = "FINISHED, +" + SToStr(delay) + " SECONDS";
-                safeNewNextRun = _constructNextRunDATETIME(nextRun, lastRun, repeat);
-                if (safeNewNextRun.empty()) {
-                    STHROW("402 Malformed delay");
-                }
-            } else {
-                safeNewNextRun = SQ(newNextRun);
-            }
-        }
-
-        // The job is set to be rescheduled.
-        if (!safeNewNextRun.empty()) {
-            // The "nextRun" at this point is still
-            // storing the last time this job was *scheduled* to be run;
-            // lastRun contains when it was *actually* run.
-            SINFO("Rescheduling job#" << jobID << ": " << safeNewNextRun);
-
-            // Update this job
-            if (!db.writeIdempotent("UPDATE jobs SET nextRun=" + safeNewNextRun + ", state='QUEUED' WHERE jobID=" + SQ(jobID) + ";")) {
-                STHROW("502 Update failed");
-            }
-        } else {
-            // We are done with this job.  What do we do with it?
-            SASSERT(!SIEquals(requestVerb, "RetryJob"));
-            if (parentJobID) {
-                // This is a child job.  Mark it as finished.
-                if (!db.writeIdempotent("UPDATE jobs SET state='FINISHED' WHERE jobID=" + SQ(jobID) + ";")) {
-                    STHROW("502 Failed to mark job as FINISHED");
-                }
-
-                // Resume the parent if this is the last pending child
-                if (!_hasPendingChildJobs(db, parentJobID)) {
-                    SINFO("Job has parentJobID: " + SToStr(parentJobID) +
-                          " and no other pending children, resuming parent job");
-                    if (!db.writeIdempotent("UPDATE jobs SET state='QUEUED' where jobID=" + SQ(parentJobID) + ";")) {
-                        STHROW("502 Update failed");
-                    }
-                }
-            } else {
-                // This is a standalone (not a child) job; delete it.
-                if (!db.writeIdempotent("DELETE FROM jobs WHERE jobID=" + SQ(jobID) + ";")) {
-                    STHROW("502 Delete failed");
-                }
-
-                // At this point, all child jobs should already be deleted, but
-                // let's double check.
-                if (!db.read("SELECT 1 FROM jobs WHERE parentJobID != 0 AND parentJobID=" + SQ(jobID) + " LIMIT 1;").empty()) {
-                    STHROW("405 Failed to delete a job with outstanding children");
-                }
-            }
-        }
+        _finishJob(db, request, SIEquals(requestVerb, "RetryJob"), changes);
 
         // Successfully processed
         return true;
@@ -1114,6 +1096,8 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             STHROW("502 Select failed");
         }
         const string& safeParentJobID = SQ(result[0][0]);
+        changes.jobIDs.insert(jobID);
+        changes.jobIDs.insert(SToInt64(result[0][0]));
         if (!db.read("SELECT count(1) "
                      "FROM jobs "
                      "WHERE parentJobID != 0 AND parentJobID=" + safeParentJobID + " AND "
@@ -1143,43 +1127,61 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         //     - jobID - ID of the job to fail
         //     - data  - Data to associate with this failed job
         //
-        verifyAttributeInt64(request, "jobID", 1);
+        _failJob(db, request, changes);
 
-        // Verify there is a job like this and it's running
-        SQResult result;
-        if (!db.read("SELECT state, nextRun, lastRun, repeat "
-                     "FROM jobs "
-                     "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
-                     result)) {
-            STHROW("502 Select failed");
-        }
-        if (result.empty()) {
-            STHROW("404 No job with this jobID");
-        }
-        const string& state = result[0][0];
+        // Successfully processed
+        return true;
+    }
 
-        // Make sure we're failing a job that's actually running or running with a retryAfter
-        if (state != "RUNNING" && state != "RUNQUEUED") {
-            SINFO("Trying to fail job#" << request["jobID"] << ", but isn't RUNNING or RUNQUEUED (" << state << ")");
-            STHROW("405 Can only fail RUNNING or RUNQUEUED jobs");
-        }
+    // ----------------------------------------------------------------------
 
-        // Are we updating the data too?
-        list<string> updateList;
-        if (request.isSet("data")) {
-            // Update the data too
-            updateList.push_back("data=" + SQ(request["data"]));
+    else if (SIEquals(requestVerb, "FinishJobs") || SIEquals(requestVerb, "RetryJobs") ||
+             SIEquals(requestVerb, "FailJobs")) {
+        // - FinishJobs( jobs )
+        // - RetryJobs( jobs )
+        // - FailJobs( jobs )
+        //
+        //     Finishes, retries, or fails several jobs in a single transaction.
+        //
+        //     Parameters:
+        //     - jobs - JSON array of objects, each with the parameters that FinishJob, RetryJob, or FailJob takes
+        //              for a single job
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . results - JSON array with an object for each job, in the same order, with its jobID and result:
+        //                     "200 OK", or the error that FinishJob, RetryJob, or FailJob would have returned. Jobs
+        //                     with an error are left unchanged.
+        //
+        list<string> jsonJobs = SParseJSONArray(request["jobs"]);
+        if (jsonJobs.empty()) {
+            STHROW("401 Invalid JSON");
         }
 
-        // Not repeating; just finish
-        updateList.push_back("state='FAILED'");
-
-        // Update this job
-        if (!db.writeIdempotent("UPDATE jobs SET " + SComposeList(updateList) + "WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
-            STHROW("502 Fail failed");
+        list<string> results;
+        for (const string& jsonJob : jsonJobs) {
+            SData jobRequest;
+            jobRequest.nameValueMap = SParseJSONObject(jsonJob);
+            STable jobResult;
+            jobResult["jobID"] = jobRequest["jobID"];
+            jobResult["result"] = "200 OK";
+            try {
+                if (SIEquals(requestVerb, "FailJobs")) {
+                    _failJob(db, jobRequest, changes);
+                } else {
+                    _finishJob(db, jobRequest, SIEquals(requestVerb, "RetryJobs"), changes);
+                }
+            } catch (const SException& e) {
+                // Jobs are checked before they're changed, so when one is rejected we can move on to the next.
+                // Failing to read or write the database, though, means the whole transaction is in doubt.
+                if (SStartsWith(e.method, "502")) {
+                    throw;
+                }
+                jobResult["result"] = e.method;
+            }
+            results.push_back(SComposeJSONObject(jobResult));
         }
-
-        // Successfully processed
+        content["results"] = SComposeJSONArray(results);
         return true;
     }
 
@@ -1199,12 +1201,19 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
         SQResult result;
         if (!db.read("SELECT state "
                      "FROM jobs "
-                     "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
-                     result)) {
+                     "WHERE jobID=?;",
+                     {to_string(request.calc64("jobID"))}, result)) {
             STHROW("502 Select failed");
         }
         if (result.empty()) {
-            STHROW("404 No job with this jobID");
+            // Archived jobs are all finished or cancelled, so they can always be deleted.
+            if (db.read("SELECT 1 FROM jobsArchive WHERE jobID=" + SQ(request.calc64("jobID")) + ";").empty()) {
+                STHROW("404 No job with this jobID");
+            }
+            if (!db.writeIdempotent("DELETE FROM jobsArchive WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
+                STHROW("502 Delete failed");
+            }
+            return true;
         }
         if (result[0][0] == "RUNNING") {
             STHROW("405 Can't delete a RUNNING job");
@@ -1219,6 +1228,7 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
                       SQ(request.calc64("jobID")) + ";")) {
             STHROW("502 Delete failed");
         }
+        changes.jobIDs.insert(request.calc64("jobID"));
 
         // Successfully processed
         return true;
@@ -1236,8 +1246,42 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
             if (!db.writeIdempotent(updateQuery)) {
                 STHROW("502 RequeueJobs update failed");
             }
+            changes.jobIDs.insert(jobIDs.begin(), jobIDs.end());
+        }
+
+        return true;
+    }
+
+    // Archive a batch of finished and cancelled jobs. This is queued by `timerFired`.
+    else if (SIEquals(requestVerb, "ArchiveJobs")) {
+        // We choose the jobs here, rather than in the query that moves them, so that followers move exactly the same
+        // ones.
+        SQResult result;
+        if (!db.read("SELECT jobID "
+                     "FROM jobs "
+                     "WHERE state IN ('FINISHED', 'CANCELLED') "
+                     "LIMIT " + SQ(ARCHIVE_BATCH_SIZE) + ";",
+                     result)) {
+            STHROW("502 Select failed");
+        }
+        if (!result.empty()) {
+            list<string> jobIDs;
+            for (const auto& row : result.rows) {
+                jobIDs.push_back(row[0]);
+            }
+            const string columns = "created, jobID, state, name, nextRun, lastRun, repeat, data, priority, parentJobID, "
+                                   "retryAfter";
+            if (!db.writeIdempotent("INSERT INTO jobsArchive ( " + columns + " ) "
+                                    "SELECT " + columns + " FROM jobs WHERE jobID IN (" + SQList(jobIDs) + ");") ||
+                !db.writeIdempotent("DELETE FROM jobs WHERE jobID IN (" + SQList(jobIDs) + ");")) {
+                STHROW("502 Archive failed");
+            }
+            SINFO("Archiving " << jobIDs.size() << " jobs.");
         }
 
+        // If there are likely more jobs to archive, come back for them soon.
+        const bool backlog = result.size() == ARCHIVE_BATCH_SIZE;
+        _archiveTimer.alarmDuration.store(backlog ? ARCHIVE_BACKLOG_INTERVAL : ARCHIVE_INTERVAL);
         return true;
     }
 
@@ -1245,6 +1289,244 @@ bool BedrockPlugin_Jobs::processCommand(SQLite& db, BedrockCommand& command) {
     return false;
 }
 
+void BedrockPlugin_Jobs::timerFired(SStopwatch* timer) {
+    // Only the leader archives jobs, and its followers get the same changes when the archive commands are replicated.
+    if (timer == &_archiveTimer && server.getState() == SQLiteNode::LEADING) {
+        SQLiteCommand command(SData("ArchiveJobs"));
+        command.initiatingClientID = -1;
+        server.acceptCommand(move(command));
+    }
+}
+
+void BedrockPlugin_Jobs::_finishJob(SQLite& db, const SData& request, bool retry, JobIndex::Changes& changes) {
+    verifyAttributeInt64(request, "jobID", 1);
+    int64_t jobID = request.calc64("jobID");
+
+    // Verify there is a job like this and it's running
+    SQResult result;
+    if (!db.read("SELECT state, nextRun, lastRun, repeat, parentJobID, json_extract(data, '$.mockRequest') "
+                 "FROM jobs "
+                 "WHERE jobID=?;",
+                 {to_string(jobID)}, result)) {
+        STHROW("502 Select failed");
+    }
+    if (result.empty()) {
+        STHROW("404 No job with this jobID");
+    }
+
+    const string& state = result[0][0];
+    const string& nextRun = result[0][1];
+    const string& lastRun = result[0][2];
+    string repeat = result[0][3];
+    int64_t parentJobID = SToInt64(result[0][4]);
+    bool mockRequest = result[0][5] == "1";
+
+    // Make sure we're finishing a job that's actually running
+    if (state != "RUNNING" && state != "RUNQUEUED" && !mockRequest) {
+        SINFO("Trying to finish job#" << jobID << ", but isn't RUNNING or RUNQUEUED (" << state << ")");
+        STHROW("405 Can only retry/finish RUNNING and RUNQUEUED jobs");
+    }
+
+    // If we have a parent, make sure it is PAUSED.  This is to just
+    // double-check that child jobs aren't somehow running in parallel to
+    // the parent.
+    if (parentJobID) {
+        auto parentState = db.read("SELECT state FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
+        if (!SIEquals(parentState, "PAUSED")) {
+            SINFO("Trying to finish/retry job#" << jobID << ", but parent isn't PAUSED (" << parentState << ")");
+            STHROW("405 Can only retry/finish child job when parent is PAUSED");
+        }
+    }
+
+    // If we've been asked to update the data, check it first.
+    const string& data = request["data"];
+    if (!data.empty()) {
+        // See if the new data says it's mocked.
+        STable newData = SParseJSONObject(data);
+        bool newMocked = newData.find("mockRequest") != newData.end();
+
+        // If both sets of data don't match each other, this is an error, we don't know who to trust.
+        // We don't worry about the state of the request header for mockRequest here, as we expect that the Bedrock
+        // client won't always set it when finishing or retrying a job. We'll just use what's in the data.
+        if (mockRequest != newMocked) {
+            SWARN("Not updating mockRequest field of job data.");
+            STHROW("500 Mock Mismatch");
+        }
+
+        // If the Job data indicates that this job should be deleted, clear the repeat value so that we delete this job further down.
+        if (SContains(newData, "delete") && newData["delete"] == "true") {
+            SINFO("Job was marked for deletion in the data object, clearing repeat value.");
+            repeat = "";
+        }
+    }
+
+    // If we are finishing a job that has child jobs, we'll set its state to paused. Otherwise, work out when it should
+    // next run, if ever.
+    const bool pause = !retry && _hasPendingChildJobs(db, jobID);
+    string safeNewNextRun = "";
+    if (!pause) {
+        // If this is set to repeat, get the nextRun value
+        if (!repeat.empty()) {
+            safeNewNextRun = _constructNextRunDATETIME(nextRun, lastRun, repeat);
+        } else if (retry) {
+            const string& newNextRun = request["nextRun"];
+
+            if (newNextRun.empty()) {
+                SINFO("nextRun isn't set, using delay");
+                int64_t delay = request.calc64("delay");
+                if (delay < 0) {
+                    STHROW("402 Must specify a non-negative delay when retrying");
+                }
+                repeat = "FINISHED, +" + SToStr(delay) + " SECONDS";
+                safeNewNextRun = _constructNextRunDATETIME(nextRun, lastRun, repeat);
+                if (safeNewNextRun.empty()) {
+                    STHROW("402 Malformed delay");
+                }
+            } else {
+                safeNewNextRun = SQ(newNextRun);
+            }
+        }
+
+        // If this is a standalone job that we're about to delete, it can't have any children left other than the
+        // finished and cancelled ones we delete with it.
+        if (safeNewNextRun.empty() && !parentJobID &&
+            !db.read("SELECT 1 FROM jobs "
+                     "WHERE parentJobID != 0 AND parentJobID=" + SQ(jobID) + " "
+                       "AND state NOT IN ('FINISHED', 'CANCELLED') "
+                     "LIMIT 1;").empty()) {
+            STHROW("405 Failed to delete a job with outstanding children");
+        }
+    }
+
+    // Everything that can reject this job has been checked above, before we write anything, so that FinishJobs and
+    // RetryJobs can carry on with their other jobs if this one is rejected.
+
+    // This can change the job, its parent, and its children.
+    changes.jobIDs.insert(jobID);
+    if (parentJobID) {
+        changes.jobIDs.insert(parentJobID);
+    }
+    changes.parentJobIDs.insert(jobID);
+
+    // Delete any FINISHED/CANCELLED child jobs, but leave any PAUSED children alone (as those will signal that
+    // we just want to re-PAUSE this job so those new children can run)
+    if (!db.writeIdempotent("DELETE FROM jobs "
+                            "WHERE parentJobID != 0 AND parentJobID=" + SQ(jobID) + " "
+                              "AND state IN ('FINISHED', 'CANCELLED');") ||
+        !db.writeIdempotent("DELETE FROM jobsArchive WHERE parentJobID=" + SQ(jobID) + ";")) {
+        STHROW("502 Failed deleting finished/cancelled child jobs");
+    }
+
+    // Update the data to the new value.
+    if (!data.empty()) {
+        if (!db.writeIdempotent("UPDATE jobs SET data=" + SQ(data) + " WHERE jobID=" + SQ(jobID) + ";")) {
+            STHROW("502 Failed to update job data");
+        }
+    }
+
+    if (pause) {
+        // Update the parent job to PAUSED. Also update its nextRun: in case it has a retryAfter, GetJobs set the nextRun too far in the future (to account for retryAfter), so set it to what it should
+        // be now that it is waiting on its children to complete.
+        SINFO("Job has child jobs, PAUSING parent, QUEUING children");
+        if (!db.writeIdempotent("UPDATE jobs SET state='PAUSED', nextRun=" + SQ(lastRun) + " WHERE jobID=" + SQ(jobID) + ";")) {
+            STHROW("502 Parent update failed");
+        }
+
+        // Also un-pause any child jobs such that they can run
+        if (!db.writeIdempotent("UPDATE jobs SET state='QUEUED' "
+                      "WHERE state='PAUSED' "
+                        "AND parentJobID != 0 AND parentJobID=" + SQ(jobID) + ";")) {
+            STHROW("502 Child update failed");
+        }
+
+        // All done processing this job
+        return;
+    }
+
+    // If this is RetryJob and we want to update the name, let's do that
+    const string& name = request["name"];
+    if (!name.empty() && retry) {
+        if (!db.writeIdempotent("UPDATE jobs SET name=" + SQ(name) + " WHERE jobID=" + SQ(jobID) + ";")) {
+            STHROW("502 Failed to update job name");
+        }
+    }
+
+    // The job is set to be rescheduled.
+    if (!safeNewNextRun.empty()) {
+        // The "nextRun" at this point is still
+        // storing the last time this job was *scheduled* to be run;
+        // lastRun contains when it was *actually* run.
+        SINFO("Rescheduling job#" << jobID << ": " << safeNewNextRun);
+
+        // Update this job
+        if (!db.writeIdempotent("UPDATE jobs SET nextRun=" + safeNewNextRun + ", state='QUEUED' WHERE jobID=" + SQ(jobID) + ";")) {
+            STHROW("502 Update failed");
+        }
+    } else {
+        // We are done with this job.  What do we do with it?
+        SASSERT(!retry);
+        if (parentJobID) {
+            // This is a child job.  Mark it as finished.
+            if (!db.writeIdempotent("UPDATE jobs SET state='FINISHED' WHERE jobID=" + SQ(jobID) + ";")) {
+                STHROW("502 Failed to mark job as FINISHED");
+            }
+
+            // Resume the parent if this is the last pending child
+            if (!_hasPendingChildJobs(db, parentJobID)) {
+                SINFO("Job has parentJobID: " + SToStr(parentJobID) +
+                      " and no other pending children, resuming parent job");
+                if (!db.writeIdempotent("UPDATE jobs SET state='QUEUED' where jobID=" + SQ(parentJobID) + ";")) {
+                    STHROW("502 Update failed");
+                }
+            }
+        } else {
+            // This is a standalone (not a child) job; delete it. We've already made sure it has no children left.
+            if (!db.writeIdempotent("DELETE FROM jobs WHERE jobID=" + SQ(jobID) + ";")) {
+                STHROW("502 Delete failed");
+            }
+        }
+    }
+}
+
+void BedrockPlugin_Jobs::_failJob(SQLite& db, const SData& request, JobIndex::Changes& changes) {
+    verifyAttributeInt64(request, "jobID", 1);
+
+    // Verify there is a job like this and it's running
+    SQResult result;
+    if (!db.read("SELECT state, nextRun, lastRun, repeat "
+                 "FROM jobs "
+                 "WHERE jobID=?;",
+                 {to_string(request.calc64("jobID"))}, result)) {
+        STHROW("502 Select failed");
+    }
+    if (result.empty()) {
+        STHROW("404 No job with this jobID");
+    }
+    const string& state = result[0][0];
+
+    // Make sure we're failing a job that's actually running or running with a retryAfter
+    if (state != "RUNNING" && state != "RUNQUEUED") {
+        SINFO("Trying to fail job#" << request["jobID"] << ", but isn't RUNNING or RUNQUEUED (" << state << ")");
+        STHROW("405 Can only fail RUNNING or RUNQUEUED jobs");
+    }
+
+    // Are we updating the data too?
+    list<string> updateList;
+    if (request.isSet("data")) {
+        // Update the data too
+        updateList.push_back("data=" + SQ(request["data"]));
+    }
+
+    // Not repeating; just finish
+    updateList.push_back("state='FAILED'");
+
+    // Update this job
+    if (!db.writeIdempotent("UPDATE jobs SET " + SComposeList(updateList) + "WHERE jobID=" + SQ(request.calc64("jobID")) + ";")) {
+        STHROW("502 Fail failed");
+    }
+    changes.jobIDs.insert(request.calc64("jobID"));
+}
+
 // Under this line we don't know the "node", so remove from the log prefix
 #undef SLOGPREFIX
 #define SLOGPREFIX "{" << getName() << "} "
@@ -1341,6 +1623,11 @@ bool BedrockPlugin_Jobs::_isValidSQLiteDateModifier(const string& modifier) {
     return true;
 }
 
+void BedrockPlugin_Jobs::holdReleased(uint64_t holdID) {
+    // If a held GetJob was released for any reason other than a job waking it, it's still waiting in the index.
+    _index.cancel(holdID);
+}
+
 void BedrockPlugin_Jobs::handleFailedReply(const BedrockCommand& command) {
     if (SIEquals(command.request.methodLine, "GetJob") || SIEquals(command.request.methodLine, "GetJobs")) {
 
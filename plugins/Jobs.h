@@ -1,5 +1,7 @@
 #include <libstuff/libstuff.h>
 #include "../BedrockPlugin.h"
+#include "JobIDAllocator.h"
+#include "JobIndex.h"
 
 // Declare the class we're going to implement below
 class BedrockPlugin_Jobs : public BedrockPlugin {
@@ -19,9 +21,37 @@ class BedrockPlugin_Jobs : public BedrockPlugin {
     virtual bool peekCommand(SQLite& db, BedrockCommand& command);
     virtual bool processCommand(SQLite& db, BedrockCommand& command);
     virtual void handleFailedReply(const BedrockCommand& command);
+    virtual void holdReleased(uint64_t holdID);
+
+    // If `-jobs.archive` is set, the leader periodically queues an `ArchiveJobs` command, which moves a batch of
+    // FINISHED and CANCELLED jobs from `jobs` to `jobsArchive`, so they don't slow down queries on the jobs that are
+    // still live. Archived jobs can still be seen with QueryJob, and by their parents.
+    virtual void timerFired(SStopwatch* timer);
 
   private:
-    static int64_t getNextID(SQLite& db);
+    // Each `ArchiveJobs` command moves at most this many jobs, so that its commit doesn't take long.
+    static constexpr int64_t ARCHIVE_BATCH_SIZE = 1000;
+
+    // How often we archive jobs, normally, and while there are more jobs to archive than fit in one batch.
+    static constexpr uint64_t ARCHIVE_INTERVAL = STIME_US_PER_S;
+    static constexpr uint64_t ARCHIVE_BACKLOG_INTERVAL = STIME_US_PER_MS * 10;
+    SStopwatch _archiveTimer;
+
+    // Does the work of `processCommand`, recording the jobs it changes in `changes`.
+    bool _processCommand(SQLite& db, BedrockCommand& command, JobIndex::Changes& changes);
+
+    // Finishes the job in `request`, which has FinishJob's parameters, or retries it if `retry` is set, in which case
+    // it has RetryJob's. If the job is rejected, this throws before writing anything, unless the database fails.
+    void _finishJob(SQLite& db, const SData& request, bool retry, JobIndex::Changes& changes);
+
+    // Fails the job in `request`, which has FailJob's parameters, with the same guarantee as `_finishJob`.
+    void _failJob(SQLite& db, const SData& request, JobIndex::Changes& changes);
+
+    // Allocates the IDs of new jobs.
+    JobIDAllocator _idAllocator;
+
+    // The jobs that GetJob can dequeue.
+    JobIndex _index;
 
     // Helper functions
     string _constructNextRunDATETIME(const string& lastScheduled, const string& lastRun, const string& repeat);
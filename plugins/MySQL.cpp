@@ -19,9 +19,9 @@ string MySQLPacket::serialize() {
     return header + payload;
 }
 
-int MySQLPacket::deserialize(const string& packet) {
+int MySQLPacket::deserialize(const char* packet, size_t size) {
     // Does it have a header?
-    if (packet.size() < 4) {
+    if (size < 4) {
         return 0;
     }
 
@@ -30,12 +30,12 @@ int MySQLPacket::deserialize(const string& packet) {
     sequenceID = (uint8_t)packet[3];
 
     // Do we have enough data for the full payload?
-    if (packet.size() < (4 + payloadLength)) {
+    if (size < (4 + payloadLength)) {
         return 0;
     }
 
     // Have the full payload, parse it out
-    payload = packet.substr(4, payloadLength);
+    payload = string(packet + 4, payloadLength);
 
     // Indicate that we've consumed this full packet
     return 4 + payloadLength;
@@ -121,6 +121,10 @@ string MySQLPacket::serializeHandshake() {
 }
 
 string MySQLPacket::serializeQueryResponse(int sequenceID, const SQResult& result) {
+    return serializeQueryResponse(sequenceID, SQColumnarResult(result));
+}
+
+string MySQLPacket::serializeQueryResponse(int sequenceID, const SQColumnarResult& result) {
     // Add the response
     string sendBuffer;
 
@@ -176,12 +180,14 @@ string MySQLPacket::serializeQueryResponse(int sequenceID, const SQResult& resul
     sendBuffer += eofPacket.serialize();
 
     // Add all the rows
-    for (const auto& row : result.rows) {
-        // Now the row
+    for (size_t r = 0; r < result.size(); r++) {
+        // Now the row, with each cell written straight from the result.
         MySQLPacket rowPacket;
         rowPacket.sequenceID = ++sequenceID;
-        for (const auto& cell : row) {
-            rowPacket.payload += lenEncStr(cell);
+        for (size_t c = 0; c < result.columnCount(); c++) {
+            SQColumnarResult::string_view cell = result.view(r, c);
+            rowPacket.payload += lenEncInt(cell.size());
+            rowPacket.payload.append(cell.data(), cell.size());
         }
         SAppend(rowPacket.payload, "\xFE", 1); // EOF
         sendBuffer += rowPacket.serialize();
@@ -236,7 +242,7 @@ void BedrockPlugin_MySQL::onPortRecv(STCPManager::Socket* s, SData& request) {
     // Get any new MySQL requests
     int packetSize = 0;
     MySQLPacket packet;
-    while ((packetSize = packet.deserialize(s->recvBuffer))) {
+    while ((packetSize = packet.deserialize(s->recvBuffer.c_str(), s->recvBuffer.size()))) {
         // Got a packet, process it
         SDEBUG("Received command #" << (int)packet.sequenceID << ": '" << SToHex(packet.serialize()) << "'");
         SConsumeFront(s->recvBuffer, packetSize);
@@ -345,7 +351,7 @@ void BedrockPlugin_MySQL::onPortRequestComplete(const BedrockCommand& command, S
             s->send(MySQLPacket::serializeOK(command.request.calc("sequenceID")));
         } else {
             // Convert the JSON response from Bedrock::DB into MySQL protocol
-            SQResult result;
+            SQColumnarResult result;
             SASSERT(command.response.content.empty() || result.deserialize(command.response.content));
             s->send(MySQLPacket::serializeQueryResponse(command.request.calc("sequenceID"), result));
         }
@@ -28,9 +28,10 @@ struct MySQLPacket {
      * Parse a MySQL packet from the wire
      *
      * @param packet Binary data received from the MySQL client
+     * @param size   Number of bytes of data
      * @return       Number of bytes deserialized, or 0 on failure
      */
-    int deserialize(const string& packet);
+    int deserialize(const char* packet, size_t size);
 
     /**
      * Creates a MySQL length-encoded integer
@@ -65,6 +66,7 @@ struct MySQLPacket {
      * @return           A series of MySQL packets ready to be sent to the client
      */
     static string serializeQueryResponse(int sequenceID, const SQResult& result);
+    static string serializeQueryResponse(int sequenceID, const SQColumnarResult& result);
 
     /**
      * Creatse a standard OK packet
@@ -18,6 +18,10 @@ atomic<int> SQLite::fullCheckpointPageMin(25000); // Approx 100mb (pages are ass
 // Tracing can only be enabled or disabled globally, not per object.
 atomic<bool> SQLite::enableTrace(false);
 
+atomic<int> SQLite::maxCachedStatements(200);
+atomic<uint64_t> SQLite::statementCacheHits(0);
+atomic<uint64_t> SQLite::statementCacheMisses(0);
+
 SQLite::SQLite(const string& filename, int cacheSize, bool enableFullCheckpoints, int maxJournalSize, int journalTable,
                int maxRequiredJournalTableID, const string& synchronous, int64_t mmapSizeGB) :
     whitelist(nullptr),
@@ -31,6 +35,8 @@ SQLite::SQLite(const string& filename, int cacheSize, bool enableFullCheckpoints
     _rollbackElapsed(0),
     _enableRewrite(false),
     _currentlyRunningRewritten(false),
+    _lastTableRows(nullptr),
+    _beginCommitCount(0),
     _timeoutLimit(0),
     _autoRolledBack(false),
     _noopUpdateMode(false),
@@ -207,6 +213,9 @@ SQLite::SQLite(const string& filename, int cacheSize, bool enableFullCheckpoints
     // Register the authorizer callback which allows callers to whitelist particular data in the DB.
     sqlite3_set_authorizer(_db, _sqliteAuthorizerCallback, this);
 
+    // Register the update callback so we know which tables each transaction writes.
+    sqlite3_update_hook(_db, _sqliteUpdateCallback, this);
+
     // I tested and found that we could set about 10,000,000 and the number of steps to run and get a callback once a
     // second. This is set to be a bit more granular than that, which is probably adequate.
     sqlite3_progress_handler(_db, 1'000'000, _progressHandlerCallback, this);
@@ -383,9 +392,10 @@ SQLite::~SQLite() {
         SINFO("Rollback in destructor complete.");
     }
 
-    // Finally, Close the DB.
+    // Finally, Close the DB. sqlite3_close will fail if there are any un-finalized statements.
     DBINFO("Closing database '" << _filename << ".");
     SASSERTWARN(_uncommittedQuery.empty());
+    _clearStatementCache();
     SASSERT(!sqlite3_close(_db));
     DBINFO("Database closed.");
 }
@@ -404,8 +414,10 @@ bool SQLite::beginTransaction(bool useCache, const string& transactionName) {
     }
     _sharedData->blockNewTransactionsCV.notify_one();
     SDEBUG("Beginning transaction");
+    _beginCommitCount = _sharedData->_commitCount.load();
     uint64_t before = STimeNow();
     _insideTransaction = !SQuery(_db, "starting db transaction", "BEGIN TRANSACTION");
+    _clearCommitCallbacks();
     _queryCache.clear();
     _transactionName = transactionName;
     _useCache = useCache;
@@ -430,8 +442,10 @@ bool SQLite::beginConcurrentTransaction(bool useCache, const string& transaction
     }
     _sharedData->blockNewTransactionsCV.notify_one();
     SDEBUG("[concurrent] Beginning transaction");
+    _beginCommitCount = _sharedData->_commitCount.load();
     uint64_t before = STimeNow();
     _insideTransaction = !SQuery(_db, "starting db transaction", "BEGIN CONCURRENT");
+    _clearCommitCallbacks();
     _queryCache.clear();
     _transactionName = transactionName;
     _useCache = useCache;
@@ -547,6 +561,136 @@ bool SQLite::read(const string& query, SQResult& result) {
     return queryResult;
 }
 
+bool SQLite::read(const string& query, const vector<string>& params, SQResult& result) {
+    uint64_t before = STimeNow();
+    _queryCount++;
+
+    // The results of a parameterized query are cached by the query text plus each of its (length-prefixed)
+    // parameters, so that different parameters can't produce the same key.
+    string cacheKey;
+    if (_useCache) {
+        cacheKey = query;
+        for (const string& param : params) {
+            cacheKey += "\n" + to_string(param.size()) + ":" + param;
+        }
+        auto foundQuery = _queryCache.find(cacheKey);
+        if (foundQuery != _queryCache.end()) {
+            result = foundQuery->second;
+            _cacheHits++;
+            return true;
+        }
+    }
+    bool cached = false;
+    int error = 0;
+    sqlite3_stmt* statement = _getStatement(query, cached, error);
+    if (error == SQLITE_MISUSE) {
+        SWARN("Refusing to run empty or multi-statement parameterized query: " << query);
+    }
+    bool queryResult = statement && !SQueryPrepared(statement, "read only query", params, result);
+    if (statement && !cached) {
+        sqlite3_finalize(statement);
+    }
+    if (_useCache && _isDeterministicQuery && queryResult) {
+        _queryCache.emplace(make_pair(cacheKey, result));
+    }
+    _checkTiming("timeout in SQLite::read"s);
+    _readElapsed += STimeNow() - before;
+    return queryResult;
+}
+
+bool SQLite::read(const string& query, SQColumnarResult& result, bool cacheStatement) {
+    uint64_t before = STimeNow();
+    _queryCount++;
+    bool cached = false;
+    int error = 0;
+    bool queryResult = false;
+    sqlite3_stmt* statement = _getStatement(query, cached, error, cacheStatement);
+    if (statement) {
+        queryResult = !SQueryPrepared(statement, "read only query", {}, result);
+        if (!cached) {
+            sqlite3_finalize(statement);
+        }
+    } else if (error == SQLITE_MISUSE) {
+        // This query has multiple statements, which a prepared statement can't run. Fall back to sqlite3_exec.
+        SQResult rowResult;
+        queryResult = !SQuery(_db, "read only query", query, rowResult);
+        result = SQColumnarResult(rowResult);
+    }
+    _checkTiming("timeout in SQLite::read"s);
+    _readElapsed += STimeNow() - before;
+    return queryResult;
+}
+
+sqlite3_stmt* SQLite::_getStatement(const string& query, bool& cached, int& error, bool cacheStatement) {
+    error = SQLITE_OK;
+
+    // The authorizer only runs when a statement is compiled, so if it has per-query work to do, we can't re-use
+    // statements.
+    cached = cacheStatement && !whitelist && !_enableRewrite;
+    if (cached) {
+        auto it = _statementLookup.find(query);
+        if (it != _statementLookup.end()) {
+            // Move this statement to the front of the list, as it's now the most recently used.
+            _statementList.splice(_statementList.begin(), _statementList, it->second);
+            _isDeterministicQuery = it->second->second.isDeterministic;
+            statementCacheHits++;
+            return it->second->second.statement;
+        }
+        statementCacheMisses++;
+    }
+
+    // Compile the query. The authorizer will clear _isDeterministicQuery if it finds anything non-deterministic.
+    _isDeterministicQuery = true;
+    sqlite3_stmt* statement = nullptr;
+    const char* tail = nullptr;
+    error = sqlite3_prepare_v3(_db, query.c_str(), query.size() + 1, cached ? SQLITE_PREPARE_PERSISTENT : 0,
+                               &statement, &tail);
+    if (error) {
+        // If a rewrite was requested, this is expected, and the caller will run the re-written query instead.
+        if (error != SQLITE_AUTH || !_enableRewrite) {
+            SWARN("Couldn't prepare query, error #" << error << " (" << sqlite3_errmsg(_db) << "): " << query);
+        }
+        sqlite3_finalize(statement);
+        return nullptr;
+    }
+
+    // We only support a single statement here, as anything following the first would be silently ignored. We leave it
+    // to the caller to decide whether that's worth a warning.
+    if (!statement || !SStrip(tail, " \t\r\n;", false).empty()) {
+        sqlite3_finalize(statement);
+        error = SQLITE_MISUSE;
+        return nullptr;
+    }
+
+    if (cached) {
+        _statementList.emplace_front(query, CachedStatement{statement, _isDeterministicQuery});
+        _statementLookup[query] = _statementList.begin();
+
+        // Evict the least recently used statements if we're over our limit.
+        while (_statementList.size() > (size_t)max(maxCachedStatements.load(), 1)) {
+            sqlite3_finalize(_statementList.back().second.statement);
+            _statementLookup.erase(_statementList.back().first);
+            _statementList.pop_back();
+        }
+    }
+    return statement;
+}
+
+void SQLite::_clearStatementCache() {
+    for (auto& entry : _statementList) {
+        sqlite3_finalize(entry.second.statement);
+    }
+    _statementList.clear();
+    _statementLookup.clear();
+}
+
+uint64_t SQLite::_getSchemaVersion() {
+    SQResult results;
+    SASSERT(!SQuery(_db, "looking up schema version", "PRAGMA schema_version;", results));
+    SASSERT(!results.empty() && !results[0].empty());
+    return SToUInt64(results[0][0]);
+}
+
 void SQLite::_checkTiming(const string& error) {
     if (_timeoutLimit) {
         uint64_t now = STimeNow();
@@ -582,10 +726,22 @@ bool SQLite::write(const string& query) {
     return _writeIdempotent(query);
 }
 
+bool SQLite::write(const string& query, const vector<string>& params) {
+    if (_noopUpdateMode) {
+        SALERT("Non-idempotent write in _noopUpdateMode. Query: " << query);
+        return true;
+    }
+    return _writeIdempotent(query, params);
+}
+
 bool SQLite::writeIdempotent(const string& query) {
     return _writeIdempotent(query);
 }
 
+bool SQLite::writeIdempotent(const string& query, const vector<string>& params) {
+    return _writeIdempotent(query, params);
+}
+
 bool SQLite::writeUnmodified(const string& query) {
     return _writeIdempotent(query, true);
 }
@@ -598,10 +754,7 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
     SASSERTWARN(SToUpper(query).find("CURRENT_TIMESTAMP") == string::npos); // Else will be replayed wrong
 
     // First, check our current state
-    SQResult results;
-    SASSERT(!SQuery(_db, "looking up schema version", "PRAGMA schema_version;", results));
-    SASSERT(!results.empty() && !results[0].empty());
-    uint64_t schemaBefore = SToUInt64(results[0][0]);
+    uint64_t schemaBefore = _getSchemaVersion();
     uint64_t changesBefore = sqlite3_total_changes(_db);
 
     // Try to execute the query
@@ -630,11 +783,14 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
     }
 
     // See if the query changed anything
-    SASSERT(!SQuery(_db, "looking up schema version", "PRAGMA schema_version;", results));
-    SASSERT(!results.empty() && !results[0].empty());
-    uint64_t schemaAfter = SToUInt64(results[0][0]);
+    uint64_t schemaAfter = _getSchemaVersion();
     uint64_t changesAfter = sqlite3_total_changes(_db);
 
+    // Cached statements were compiled against the old schema, so we throw them all away.
+    if (schemaAfter != schemaBefore) {
+        _clearStatementCache();
+    }
+
     // If something changed, or we're always keeping queries, then save this.
     if (alwaysKeepQueries || (schemaAfter > schemaBefore) || (changesAfter > changesBefore)) {
         _uncommittedQuery += usedRewrittenQuery ? _rewrittenQuery : query;
@@ -642,6 +798,79 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
     return true;
 }
 
+bool SQLite::_writeIdempotent(const string& query, const vector<string>& params) {
+    SASSERT(_insideTransaction);
+    _queryCache.clear();
+    _queryCount++;
+    SASSERT(SEndsWith(query, ";"));                                         // Must finish everything with semicolon
+    SASSERTWARN(SToUpper(query).find("CURRENT_TIMESTAMP") == string::npos); // Else will be replayed wrong
+
+    // First, check our current state
+    uint64_t schemaBefore = _getSchemaVersion();
+    uint64_t changesBefore = sqlite3_total_changes(_db);
+
+    // Try to execute the query. If the rewrite handler denied it while compiling, we run the re-written query in its
+    // place, exactly as the non-parameterized `write` does.
+    uint64_t before = STimeNow();
+    bool result = false;
+    string expandedQuery;
+    bool cached = false;
+    int error = 0;
+    sqlite3_stmt* statement = _getStatement(query, cached, error);
+    if (error == SQLITE_MISUSE) {
+        SWARN("Refusing to run empty or multi-statement parameterized query: " << query);
+    }
+    if (statement) {
+        SQResult ignore;
+        result = !SQueryPrepared(statement, "read/write transaction", params, ignore);
+
+        // Peers replay the journal as plain SQL, so that's what we record, with the parameters substituted inline.
+        // If SQLite can't expand it (it's out of memory, or the result would be too long), we record it as it was
+        // written. That's only the same thing if it has no parameters, so otherwise we fail the write.
+        if (result) {
+            char* expanded = sqlite3_expanded_sql(statement);
+            if (expanded) {
+                expandedQuery = STrim(expanded);
+                sqlite3_free(expanded);
+            } else if (params.empty()) {
+                SWARN("Couldn't expand query, recording it as written: " << query);
+                expandedQuery = STrim(query);
+            } else {
+                SWARN("Couldn't expand parameters of query, failing it: " << query);
+                result = false;
+            }
+            if (!SEndsWith(expandedQuery, ";")) {
+                expandedQuery += ";";
+            }
+        }
+        if (!cached) {
+            sqlite3_finalize(statement);
+        }
+    } else if (error == SQLITE_AUTH && _enableRewrite) {
+        _currentlyRunningRewritten = true;
+        SASSERT(SEndsWith(_rewrittenQuery, ";"));
+        result = !SQuery(_db, "read/write transaction", _rewrittenQuery);
+        expandedQuery = _rewrittenQuery;
+        _currentlyRunningRewritten = false;
+    }
+    _checkTiming("timeout in SQLite::write"s);
+    _writeElapsed += STimeNow() - before;
+    if (!result) {
+        return false;
+    }
+
+    // See if the query changed anything
+    uint64_t schemaAfter = _getSchemaVersion();
+    uint64_t changesAfter = sqlite3_total_changes(_db);
+    if (schemaAfter != schemaBefore) {
+        _clearStatementCache();
+    }
+    if ((schemaAfter > schemaBefore) || (changesAfter > changesBefore)) {
+        _uncommittedQuery += expandedQuery;
+    }
+    return true;
+}
+
 bool SQLite::prepare() {
     SASSERT(_insideTransaction);
 
@@ -750,6 +979,7 @@ int SQLite::commit() {
             _sharedData->currentTransactionCount--;
         }
         _sharedData->blockNewTransactionsCV.notify_one();
+        _runCommitCallbacks();
         g_commitLock.unlock();
         _queryCache.clear();
         if (_useCache) {
@@ -767,6 +997,79 @@ int SQLite::commit() {
     return result;
 }
 
+void SQLite::onCommit(function<void()>&& callback) {
+    SASSERT(_insideTransaction);
+    _commitCallbacks.push_back(move(callback));
+}
+
+void SQLite::addTableCommitListener(const string& table, function<void(uint64_t)>&& listener) {
+    SQLITE_COMMIT_AUTOLOCK;
+    _sharedData->_tableCommitListeners[table].push_back(move(listener));
+}
+
+void SQLite::addRowCommitListener(const string& table, function<void(uint64_t, const set<int64_t>*)>&& listener) {
+    SQLITE_COMMIT_AUTOLOCK;
+    _sharedData->_rowCommitListeners[table].push_back(move(listener));
+    auto tables = make_shared<set<string>>();
+    for (const auto& entry : _sharedData->_rowCommitListeners) {
+        tables->insert(entry.first);
+    }
+    atomic_store(&_sharedData->_rowListenedTables, shared_ptr<const set<string>>(move(tables)));
+}
+
+void SQLite::_sqliteUpdateCallback(void* data, int operation, const char* database, const char* table,
+                                   sqlite3_int64 rowID) {
+    SQLite* sqlite = static_cast<SQLite*>(data);
+    if (sqlite->_lastTableWritten != table) {
+        sqlite->_lastTableWritten = table;
+        sqlite->_tablesWritten.insert(sqlite->_lastTableWritten);
+        sqlite->_lastTableRows = nullptr;
+        if (sqlite->_rowListenedTables && sqlite->_rowListenedTables->count(sqlite->_lastTableWritten)) {
+            sqlite->_lastTableRows = &sqlite->_rowsWritten[sqlite->_lastTableWritten];
+        }
+    }
+    if (sqlite->_lastTableRows) {
+        sqlite->_lastTableRows->insert(rowID);
+    }
+}
+
+void SQLite::_runCommitCallbacks() {
+    // We're still holding the commit lock, so this is the count for the transaction we just committed.
+    uint64_t commitCount = _sharedData->_commitCount.load();
+    list<function<void()>> callbacks = move(_commitCallbacks);
+    set<string> tables = move(_tablesWritten);
+    map<string, set<int64_t>> rows = move(_rowsWritten);
+    _clearCommitCallbacks();
+    for (auto& callback : callbacks) {
+        callback();
+    }
+    for (const string& table : tables) {
+        auto it = _sharedData->_tableCommitListeners.find(table);
+        if (it != _sharedData->_tableCommitListeners.end()) {
+            for (auto& listener : it->second) {
+                listener(commitCount);
+            }
+        }
+        auto rowIt = _sharedData->_rowCommitListeners.find(table);
+        if (rowIt != _sharedData->_rowCommitListeners.end()) {
+            auto tableRows = rows.find(table);
+            const set<int64_t>* rowIDs = tableRows == rows.end() ? nullptr : &tableRows->second;
+            for (auto& listener : rowIt->second) {
+                listener(commitCount, rowIDs);
+            }
+        }
+    }
+}
+
+void SQLite::_clearCommitCallbacks() {
+    _commitCallbacks.clear();
+    _tablesWritten.clear();
+    _lastTableWritten.clear();
+    _rowsWritten.clear();
+    _lastTableRows = nullptr;
+    _rowListenedTables = atomic_load(&_sharedData->_rowListenedTables);
+}
+
 map<uint64_t, pair<string,string>> SQLite::getCommittedTransactions() {
     SQLITE_COMMIT_AUTOLOCK;
 
@@ -814,6 +1117,7 @@ void SQLite::rollback() {
             SINFO("Rollback successful.");
         }
         _uncommittedQuery.clear();
+        _clearCommitCallbacks();
 
         // Only unlock the mutex if we've previously locked it. We can call `rollback` to cancel a transaction without
         // ever having called `prepare`, which would have locked our mutex.
@@ -887,6 +1191,130 @@ bool SQLite::getCommits(uint64_t fromIndex, uint64_t toIndex, SQResult& result)
     return !SQuery(_db, "getting commits", query, result);
 }
 
+uint64_t SQLite::getJournalStart() {
+    // Each table has every one of its commits after its oldest, so the journal is complete after the newest of those.
+    string query = _getJournalQuery({"SELECT MIN(id) AS minIDs FROM"}, true);
+    query = "SELECT MAX(minIDs) FROM (" + query + ")";
+    SQResult result;
+    SASSERT(!SQuery(_db, "getting journal start", query, result));
+    if (result.empty()) {
+        return 0;
+    }
+    return SToUInt64(result[0][0]);
+}
+
+bool SQLite::createSnapshot(const string& filename, uint64_t& commitCount, string& hash) {
+    SASSERT(!_insideTransaction);
+    SFileDelete(filename);
+
+    // Everything from here on reads from the same read transaction, so the commit count and hash we look up describe
+    // exactly the pages that the backup copies, no matter what other threads commit in the meantime.
+    SASSERT(!SQuery(_db, "beginning snapshot", "BEGIN TRANSACTION"));
+    commitCount = _getCommitCount();
+    string ignore;
+    getCommit(commitCount, ignore, hash);
+
+    // Copy every page of the database into the new file in a single step.
+    uint64_t before = STimeNow();
+    sqlite3* snapshot = nullptr;
+    const int SNAPSHOT_OPEN_FLAGS = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+    int result = sqlite3_open_v2(filename.c_str(), &snapshot, SNAPSHOT_OPEN_FLAGS, NULL);
+    if (result == SQLITE_OK) {
+        sqlite3_backup* backup = sqlite3_backup_init(snapshot, "main", _db, "main");
+        if (backup) {
+            result = sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        } else {
+            result = sqlite3_errcode(snapshot);
+        }
+    }
+    sqlite3_close(snapshot);
+    SQuery(_db, "ending snapshot", "ROLLBACK");
+
+    if (result != SQLITE_DONE) {
+        SWARN("Failed to create snapshot '" << filename << "': " << sqlite3_errstr(result));
+        SFileDelete(filename);
+        return false;
+    }
+    SINFO("Created snapshot '" << filename << "' of " << SFileSize(filename) << " bytes at commit #" << commitCount
+          << " (" << hash << ") in " << (STimeNow() - before) / 1000 << "ms.");
+    return true;
+}
+
+bool SQLite::restoreSnapshot(const string& filename) {
+    SASSERT(!_insideTransaction);
+
+    // Don't let anyone else commit while we replace the database underneath them.
+    SQLITE_COMMIT_AUTOLOCK;
+    uint64_t before = STimeNow();
+    sqlite3* snapshot = nullptr;
+    int result = sqlite3_open_v2(filename.c_str(), &snapshot, SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, NULL);
+    if (result == SQLITE_OK) {
+        sqlite3_backup* backup = sqlite3_backup_init(_db, "main", snapshot, "main");
+        if (backup) {
+            result = sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        } else {
+            result = sqlite3_errcode(_db);
+        }
+    }
+    sqlite3_close(snapshot);
+
+    // The snapshot was copied from a database in WAL mode, so opening it may have created these as well.
+    SFileDelete(filename + "-wal");
+    SFileDelete(filename + "-shm");
+    if (result != SQLITE_DONE) {
+        SWARN("Failed to restore snapshot '" << filename << "': " << sqlite3_errstr(result));
+        return false;
+    }
+
+    // The snapshot has the journal tables of the node that created it, which may not match ours. Recreate any of ours
+    // that it's missing, and move the rows of any extra ones into our own journal, so that they're still counted.
+    SASSERT(!SQuery(_db, "beginning journal table repair", "BEGIN TRANSACTION"));
+    for (const string& name : _sharedData->_journalNames) {
+        SQVerifyTable(_db, name, "CREATE TABLE " + name + " ( id INTEGER PRIMARY KEY, query TEXT, hash TEXT )");
+    }
+    SQResult tables;
+    SASSERT(!SQuery(_db, "listing journal tables",
+                    "SELECT name FROM sqlite_master WHERE type = 'table' AND name GLOB 'journal[0-9]*';", tables));
+    for (const auto& row : tables.rows) {
+        const string& name = row[0];
+        if (find(_sharedData->_journalNames.begin(), _sharedData->_journalNames.end(), name)
+            == _sharedData->_journalNames.end()) {
+            SINFO("Moving snapshot journal table " << name << " into " << _journalName << ".");
+            SASSERT(!SQuery(_db, "merging journal table",
+                            "INSERT INTO " + _journalName + " SELECT id, query, hash FROM " + name + ";"));
+            SASSERT(!SQuery(_db, "dropping journal table", "DROP TABLE " + name + ";"));
+        }
+    }
+    SASSERT(!SQuery(_db, "committing journal table repair", "COMMIT"));
+
+    // Finally, load our new state, exactly as we do at startup.
+    uint64_t commitCount = _getCommitCount();
+    string lastCommittedHash, ignore;
+    getCommit(commitCount, ignore, lastCommittedHash);
+    _sharedData->_commitCount.store(commitCount);
+    _sharedData->_lastCommittedHash.store(lastCommittedHash);
+    SQResult journalSize;
+    SASSERT(!SQuery(_db, "getting journal size", "SELECT MAX(id) - MIN(id) FROM " + _journalName, journalSize));
+    _journalSize = SToUInt64(journalSize[0][0]);
+
+    // The backup doesn't go through our update hook, and may have changed any row of any table.
+    for (auto& entry : _sharedData->_tableCommitListeners) {
+        for (auto& listener : entry.second) {
+            listener(commitCount);
+        }
+    }
+    for (auto& entry : _sharedData->_rowCommitListeners) {
+        for (auto& listener : entry.second) {
+            listener(commitCount, nullptr);
+        }
+    }
+    SINFO("Restored snapshot '" << filename << "' at commit #" << commitCount << " (" << lastCommittedHash << ") in "
+          << (STimeNow() - before) / 1000 << "ms.");
+    return true;
+}
+
 int64_t SQLite::getLastInsertRowID() {
     // Make sure it *does* happen after an INSERT, but not with a IGNORE
     SASSERTWARN(SContains(_uncommittedQuery, "INSERT") || SContains(_uncommittedQuery, "REPLACE"));
@@ -51,6 +51,17 @@ class SQLite {
     // Performs a read-only query (eg, SELECT) that returns a single value.
     string read(const string& query);
 
+    // Like `read` above, but `query` may contain `?` placeholders which are bound, in order, to the values in `params`.
+    // The query is compiled once and the resulting statement is kept in a per-object cache, so repeated calls with the
+    // same query text skip parsing and planning. `query` must be a single statement.
+    bool read(const string& query, const vector<string>& params, SQResult& result);
+
+    // Performs a read-only query into a columnar result. This is preferable to the SQResult version for large results.
+    // These results aren't stored in the per-transaction query cache. Unless `cacheStatement` is false, as it should be
+    // for query text that's unlikely to be seen again, the compiled statement is kept like those of the parameterized
+    // `read`.
+    bool read(const string& query, SQColumnarResult& result, bool cacheStatement = true);
+
     // Begins a new transaction. Returns true on success. Can optionally be instructed to use the query cache, if so
     // the transaction can be named so that log lines about cache success can be associated to the transaction.
     bool beginTransaction(bool useCache = false, const string& transactionName = "");
@@ -78,10 +89,15 @@ class SQLite {
     // If we're in noop-update mode, this call alerts and performs no write, but returns as if it had completed.
     bool write(const string& query);
 
+    // Like `write` above, but with `?` placeholders bound to `params`, using the same statement cache as the
+    // parameterized `read`. The query is replicated with the bound values expanded inline.
+    bool write(const string& query, const vector<string>& params);
+
     // This is the same as `write` except it runs successfully without any warnings or errors in noop-update mode.
     // It's intended to be used for `mockRequest` enabled commands, such that we only run a version of them that's
     // known to be repeatable. What counts as repeatable is up to the individual command.
     bool writeIdempotent(const string& query);
+    bool writeIdempotent(const string& query, const vector<string>& params);
 
     // This runs a query completely unchanged, always adding it to the uncommitted query, such that it will be recorded
     // in the journal even if it had no effect on the database. This lets replicated or synchronized queries be added
@@ -125,6 +141,27 @@ class SQLite {
     // Cancels the current transaction and rolls it back
     void rollback();
 
+    // Registers a function to run once the current transaction commits, or to be discarded if it's rolled back. These
+    // run in commit order, with the commit lock still held, so they must be quick and must not use the database.
+    void onCommit(function<void()>&& callback);
+
+    // Registers a function to run whenever a transaction that wrote rows to `table` commits, on any handle to this
+    // database, including transactions replicated from peers. It's passed the commit count of that transaction, and
+    // runs after the transaction's own `onCommit` functions, with the same restrictions. Rows removed by SQLite's
+    // truncate optimization (a `DELETE` with no `WHERE` clause) aren't seen.
+    void addTableCommitListener(const string& table, function<void(uint64_t)>&& listener);
+
+    // Like `addTableCommitListener`, but the listener is also passed the rowids of the rows the transaction inserted,
+    // updated, or deleted in `table`. These are null if they weren't recorded, because the transaction began before
+    // the listener was added, in which case any row may have changed. SQLite doesn't report rows deleted by `REPLACE`
+    // conflict resolution either, so a table listened to this way should be overwritten with an explicit `DELETE`
+    // rather than `INSERT OR REPLACE`.
+    void addRowCommitListener(const string& table, function<void(uint64_t, const set<int64_t>*)>&& listener);
+
+    // Returns the commit count as of just before the current transaction began. Every commit up to this one is
+    // visible to the transaction, and later ones may or may not be.
+    uint64_t getBeginCommitCount() { return _beginCommitCount; }
+
     // Returns the total number of changes on this database
     int getChangeCount() { return sqlite3_total_changes(_db); }
 
@@ -165,6 +202,21 @@ class SQLite {
     // Looks up a range of commits
     bool getCommits(uint64_t fromIndex, uint64_t toIndex, SQResult& result);
 
+    // Returns the ID of the oldest commit from which every later commit is still in the journal, or 0 if the journal
+    // is empty. Each journal table is trimmed to `maxJournalSize` separately, so some older commits may still be there
+    // as well, but not all of them, so a range of commits starting before this can't be looked up with `getCommits`.
+    uint64_t getJournalStart();
+
+    // Writes a consistent copy of the entire database to `filename`, and sets `commitCount` and `hash` to the commit
+    // that the copy is at. Must be called outside of a transaction. Returns false on failure.
+    bool createSnapshot(const string& filename, uint64_t& commitCount, string& hash);
+
+    // Overwrites the entire database with a copy written by `createSnapshot`, and reloads the commit count and hash
+    // from it. Any journal tables the copy has that we don't use are merged into our own, and every commit listener is
+    // called, as any table may have changed. Must be called outside of a transaction, while nothing else is writing to
+    // the database. Returns false on failure.
+    bool restoreSnapshot(const string& filename);
+
     // Start a timing operation, that will time out after the given number of microseconds.
     void startTiming(uint64_t timeLimitUS);
 
@@ -193,6 +245,13 @@ class SQLite {
     // Enable/disable SQL statement tracing.
     static atomic<bool> enableTrace;
 
+    // The number of prepared statements each SQLite object will keep in its statement cache.
+    static atomic<int> maxCachedStatements;
+
+    // Hit and miss counters for the prepared statement cache, summed across all SQLite objects.
+    static atomic<uint64_t> statementCacheHits;
+    static atomic<uint64_t> statementCacheMisses;
+
   private:
 
     // This structure contains all of the data that's shared between a set of SQLite objects that share the same
@@ -282,6 +341,16 @@ class SQLite {
 
         // Used as a flag to prevent starting multiple checkpoint threads simultaneously.
         atomic<int> _checkpointThreadBusy;
+
+        // Functions to call when a transaction that wrote to a table commits, by table name. Protected by
+        // `_commitLock`.
+        map<string, list<function<void(uint64_t)>>> _tableCommitListeners;
+
+        // Functions to call with the rows written when a transaction that wrote to a table commits, by table name.
+        // Protected by `_commitLock`. The names of their tables are also kept where a handle can read them without
+        // the lock when it begins a transaction. That set is replaced, rather than modified, when a listener is added.
+        map<string, list<function<void(uint64_t, const set<int64_t>*)>>> _rowCommitListeners;
+        shared_ptr<const set<string>> _rowListenedTables;
     };
 
     // We have designed this so that multiple threads can write to multiple journals simultaneously, but we want
@@ -337,6 +406,10 @@ class SQLite {
     uint64_t _getCommitCount();
 
     bool _writeIdempotent(const string& query, bool alwaysKeepQueries = false);
+    bool _writeIdempotent(const string& query, const vector<string>& params);
+
+    // Returns the current schema version of the database.
+    uint64_t _getSchemaVersion();
 
     // Constructs a UNION query from a list of 'query parts' over each of our journal tables.
     // Fore each table, queryParts will be joined with that table's name as a separator. I.e., if you have a tables
@@ -382,6 +455,31 @@ class SQLite {
     // Handles running checkpointing operations.
     static int _sqliteWALCallback(void* data, sqlite3* db, const char* dbName, int pageCount);
 
+    // Records the tables and rows written by the current transaction, for the commit listeners.
+    static void _sqliteUpdateCallback(void* data, int operation, const char* database, const char* table,
+                                      sqlite3_int64 rowID);
+
+    // Functions to call when the current transaction commits, and the tables it's written to. The last table written
+    // is kept separately, as most transactions write many rows to the same table in a row.
+    list<function<void()>> _commitCallbacks;
+    set<string> _tablesWritten;
+    string _lastTableWritten;
+
+    // The tables that had row listeners when the current transaction began, and the rowids it's written to each of
+    // them. `_lastTableRows` points to the rowids for `_lastTableWritten`, if it's one of those tables.
+    shared_ptr<const set<string>> _rowListenedTables;
+    map<string, set<int64_t>> _rowsWritten;
+    set<int64_t>* _lastTableRows;
+
+    // The commit count just before the current transaction began, for `getBeginCommitCount`.
+    uint64_t _beginCommitCount;
+
+    // Runs the commit callbacks and table listeners for the transaction that just committed, and resets them.
+    void _runCommitCallbacks();
+
+    // Discards the commit callbacks and tables written for the current transaction.
+    void _clearCommitCallbacks();
+
     // Callback function for progress tracking.
     static int _progressHandlerCallback(void* arg);
     uint64_t _timeoutLimit;
@@ -426,4 +524,26 @@ class SQLite {
 
     // Will be set to false while running a non-deterministic query to prevent it's result being cached.
     bool _isDeterministicQuery;
+
+    // This section implements the prepared statement cache used by the parameterized versions of `read` and `write`.
+
+    // A compiled statement, along with whether the authorizer found it to be deterministic when it was compiled (the
+    // authorizer doesn't run again when the statement is re-used).
+    struct CachedStatement {
+        sqlite3_stmt* statement;
+        bool isDeterministic;
+    };
+
+    // Statements ordered from most to least recently used, and a lookup by query text into that list.
+    list<pair<string, CachedStatement>> _statementList;
+    map<string, list<pair<string, CachedStatement>>::iterator> _statementLookup;
+
+    // Returns a compiled statement for `query`, either from the cache or newly compiled, or nullptr on failure, with
+    // the sqlite error code in `error`. If `cached` is false, the statement is not in the cache (because the caller
+    // asked for it not to be, or the authorizer needs to see each query when a whitelist or re-writing is enabled) and
+    // the caller must finalize it.
+    sqlite3_stmt* _getStatement(const string& query, bool& cached, int& error, bool cacheStatement = true);
+
+    // Finalizes and removes every statement in the cache. Called whenever the schema changes, and on destruction.
+    void _clearStatementCache();
 };
@@ -1,9 +1,12 @@
 #include <libstuff/libstuff.h>
 #include "SQLiteCommand.h"
 
+constexpr uint64_t SQLiteCommand::UNORDERED_CLIENT_SEQUENCE;
+
 SQLiteCommand::SQLiteCommand(SData&& _request) : 
     initiatingPeerID(0),
     initiatingClientID(0),
+    initiatingClientSequence(0),
     request(move(_request)),
     writeConsistency(SQLiteNode::ASYNC),
     complete(false),
@@ -37,6 +40,7 @@ SQLiteCommand::SQLiteCommand(SData&& _request) :
 SQLiteCommand::SQLiteCommand() :
     initiatingPeerID(0),
     initiatingClientID(0),
+    initiatingClientSequence(0),
     writeConsistency(SQLiteNode::ASYNC),
     complete(false),
     escalationTimeUS(0),
@@ -19,6 +19,13 @@ class SQLiteCommand {
     // can't respond to.
     int64_t initiatingClientID;
 
+    // When `initiatingClientID` is set, the position of this command's request among those read from the client's
+    // socket, so responses can be sent in the order the requests were received. Sequence numbers start at 1. A value of
+    // zero means the client isn't waiting for a response (for instance, the command was scheduled for the future), and
+    // UNORDERED_CLIENT_SEQUENCE means the response can be sent as soon as it's ready.
+    uint64_t initiatingClientSequence;
+    static constexpr uint64_t UNORDERED_CLIENT_SEQUENCE = numeric_limits<uint64_t>::max();
+
     // Each command is given a unique id that can be serialized and passed back and forth across nodes. Its id must be
     // uniquely identifiable for cases where, for instance, two peers escalate commands to the leader, and leader will
     // need to  respond to them.
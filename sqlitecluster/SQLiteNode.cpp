@@ -27,17 +27,33 @@
 // Initializations for static vars.
 const uint64_t SQLiteNode::SQL_NODE_DEFAULT_RECV_TIMEOUT = STIME_US_PER_M * 5;
 const uint64_t SQLiteNode::SQL_NODE_SYNCHRONIZING_RECV_TIMEOUT = STIME_US_PER_S * 30;
+const size_t SQLiteNode::MAX_TRANSACTION_BATCH_COUNT = 100;
+const size_t SQLiteNode::MAX_TRANSACTION_BATCH_BYTES = 1024 * 1024;
+const size_t SQLiteNode::MIN_COMPRESSION_SIZE = 1024;
+const int SQLiteNode::COMPRESSION_LEVEL = 1;
+const size_t SQLiteNode::SNAPSHOT_CHUNK_SIZE = 4 * 1024 * 1024;
+const uint64_t SQLiteNode::SYNCHRONIZE_DEFAULT_BYTES = 4 * 1024 * 1024;
+const uint64_t SQLiteNode::SYNCHRONIZE_MAX_BYTES = 64 * 1024 * 1024;
+const uint64_t SQLiteNode::SYNCHRONIZE_TIME_BUDGET_US = STIME_US_PER_MS * 250;
+const uint64_t SQLiteNode::SYNCHRONIZE_MAX_PAGE_COMMITS = 1000;
 atomic<bool> SQLiteNode::unsentTransactions(false);
 uint64_t SQLiteNode::_lastSentTransactionID = 0;
+mutex SQLiteNode::_outgoingSnapshotMutex;
+uint64_t SQLiteNode::_outgoingSnapshotCommitCount = 0;
+string SQLiteNode::_outgoingSnapshotHash;
 
 const string SQLiteNode::consistencyLevelNames[] = {"ASYNC",
                                                     "ONE",
                                                     "QUORUM"};
 
 SQLiteNode::SQLiteNode(SQLiteServer& server, SQLite& db, const string& name, const string& host,
-                       const string& peerList, int priority, uint64_t firstTimeout, const string& version)
+                       const string& peerList, int priority, uint64_t firstTimeout, const string& version,
+                       bool compressReplication, uint64_t synchronizeBatchBytes, bool batchTransactions)
     : STCPNode(name, host, max(SQL_NODE_DEFAULT_RECV_TIMEOUT, SQL_NODE_SYNCHRONIZING_RECV_TIMEOUT)),
-      _db(db), _commitState(CommitState::UNINITIALIZED), _server(server), _stateChangeCount(0),
+      _db(db), _commitState(CommitState::UNINITIALIZED), _commitPipelined(false), _quorumCommitCount(0),
+      _server(server), _stateChangeCount(0), _compressReplication(compressReplication),
+      _synchronizeBatchBytes(synchronizeBatchBytes), _batchTransactions(batchTransactions),
+      _incomingSnapshotCommitCount(0),
       _lastNetStatTime(chrono::steady_clock::now())
     {
     SASSERT(priority >= 0);
@@ -80,7 +96,7 @@ SQLiteNode::~SQLiteNode() {
     SASSERTWARN(!commitInProgress());
 }
 
-void SQLiteNode::startCommit(ConsistencyLevel consistency)
+void SQLiteNode::startCommit(ConsistencyLevel consistency, bool pipelined)
 {
     // Verify we're not already committing something, and then record that we have begun. This doesn't actually *do*
     // anything, but `update()` will pick up the state in its next invocation and start the actual commit.
@@ -89,6 +105,7 @@ void SQLiteNode::startCommit(ConsistencyLevel consistency)
             _commitState == CommitState::FAILED);
     _commitState = CommitState::WAITING;
     _commitConsistency = consistency;
+    _commitPipelined = pipelined;
 }
 
 void SQLiteNode::sendResponse(const SQLiteCommand& command)
@@ -206,6 +223,21 @@ void SQLiteNode::_sendOutstandingTransactions() {
     }
     auto transactions = _db.getCommittedTransactions();
     string sendTime = to_string(STimeNow());
+
+    // Peers that advertised `BatchTransactions` at LOGIN get everything that's been committed since the last time we
+    // were called grouped into as few COMMIT_TRANSACTIONS messages as the batch limits allow, rather than a
+    // BEGIN_TRANSACTION/COMMIT_TRANSACTION pair for each transaction.
+    SData batch("COMMIT_TRANSACTIONS");
+    size_t batchCount = 0;
+    auto sendBatch = [&]() {
+        if (batchCount) {
+            batch["NumCommits"] = to_string(batchCount);
+            batch["leaderSendTime"] = sendTime;
+            _sendToSubscribedPeers(batch, true);
+            batch.content.clear();
+            batchCount = 0;
+        }
+    };
     for (auto& i : transactions) {
         uint64_t id = i.first;
         if (id <= _lastSentTransactionID) {
@@ -223,7 +255,7 @@ void SQLiteNode::_sendOutstandingTransactions() {
         transaction["masterSendTime"] = transaction["leaderSendTime"];
         transaction["ID"] = "ASYNC_" + to_string(id);
         transaction.content = query;
-        _sendToAllPeers(transaction, true); // subscribed only
+        _sendToSubscribedPeers(transaction, false);
         for (auto peer : peerList) {
             // Clear the response flag from the last transaction
             (*peer)["TransactionResponse"].clear();
@@ -232,9 +264,21 @@ void SQLiteNode::_sendOutstandingTransactions() {
         commit["ID"] = transaction["ID"];
         commit["CommitCount"] = transaction["NewCount"];
         commit["Hash"] = hash;
-        _sendToAllPeers(commit, true); // subscribed only
+        _sendToSubscribedPeers(commit, false);
+
+        // Each transaction in a batch carries its own count and hash, so followers can verify them one at a time.
+        SData batchedTransaction("TRANSACTION");
+        batchedTransaction["NewCount"] = transaction["NewCount"];
+        batchedTransaction["NewHash"] = hash;
+        batchedTransaction["ID"] = transaction["ID"];
+        batchedTransaction.content = query;
+        batch.content += batchedTransaction.serialize();
+        if (++batchCount >= MAX_TRANSACTION_BATCH_COUNT || batch.content.size() >= MAX_TRANSACTION_BATCH_BYTES) {
+            sendBatch();
+        }
         _lastSentTransactionID = id;
     }
+    sendBatch();
     unsentTransactions.store(false);
 }
 
@@ -404,6 +448,22 @@ bool SQLiteNode::update() {
             return true; // Re-update
         }
 
+        // If we've diverged from the current leader, we can't catch up one commit at a time, so we ask it for a
+        // snapshot of its database to replace ours with.
+        for (auto peer : peerList) {
+            if (peer->test("LoggedIn") && peer->state == LEADING && _divergedFrom(peer)) {
+                PWARN("Our database has diverged from the leader's (we have " << _db.getCommitCount() << "/"
+                      << _db.getCommittedHash() << ", it has " << (*peer)["CommitCount"] << "/" << (*peer)["Hash"]
+                      << "), synchronizing from a snapshot.");
+                _syncPeer = peer;
+                SData request = _newSynchronizeRequest();
+                request["Diverged"] = "true";
+                _sendToPeer(_syncPeer, request);
+                _changeState(SYNCHRONIZING);
+                return true; // Re-update
+            }
+        }
+
         // How does our state compare with the freshest peer?
         SASSERT(freshestPeer);
         uint64_t freshestPeerCommitCount = freshestPeer->calcU64("CommitCount");
@@ -427,7 +487,7 @@ bool SQLiteNode::update() {
         SASSERTWARN(!_syncPeer);
         _updateSyncPeer();
         if (_syncPeer) {
-            _sendToPeer(_syncPeer, SData("SYNCHRONIZE"));
+            _sendToPeer(_syncPeer, _newSynchronizeRequest());
         } else {
             SWARN("Updated to NULL _syncPeer when about to send SYNCHRONIZE. Going to WAITING.");
             _changeState(WAITING);
@@ -547,6 +607,13 @@ bool SQLiteNode::update() {
         SASSERT(highestPriorityPeer);
         SASSERT(freshestPeer);
 
+        // If we've diverged from the current leader, we need to go back to SEARCHING to replace our database with its.
+        if (currentLeader && currentLeader->state == LEADING && _divergedFrom(currentLeader)) {
+            SHMMM("Diverged from leader '" << currentLeader->name << "' while waiting; re-SEARCHING.");
+            _changeState(SEARCHING);
+            return true; // Re-update
+        }
+
         // If there is already a leader that is higher priority than us,
         // subscribe -- even if we're not in sync with it.  (It'll bring
         // us back up to speed while subscribing.)
@@ -733,8 +800,9 @@ bool SQLiteNode::update() {
             bool majorityApproved = (numFullApproved * 2 >= numFullPeers);
 
             // Figure out if we have enough consistency
+            // A pipelined commit doesn't wait for approvals at all, it's confirmed by acknowledgements afterwards.
             bool consistentEnough = false;
-            switch (_commitConsistency) {
+            switch (_commitPipelined ? ASYNC : _commitConsistency) {
                 case ASYNC:
                     // Always consistent enough if we don't care!
                     consistentEnough = true;
@@ -826,8 +894,17 @@ bool SQLiteNode::update() {
                           << " transaction. Sending COMMIT_TRANSACTION to peers.");
                     SData commit("COMMIT_TRANSACTION");
                     commit.set("ID", _lastSentTransactionID + 1);
+                    if (_commitPipelined) {
+                        commit["Acknowledge"] = "true";
+                    }
                     _sendToAllPeers(commit, true); // true: Only to subscribed peers.
 
+                    // Everything up to and including this commit has been approved by a majority, because followers
+                    // apply transactions in order.
+                    if (majorityApproved) {
+                        _quorumCommitCount = max(_quorumCommitCount, _db.getCommitCount());
+                    }
+
                     // clear the unsent transactions, we've sent them all (including this one);
                     _db.getCommittedTransactions();
 
@@ -858,7 +935,12 @@ bool SQLiteNode::update() {
             // Lock the database. We'll unlock it when we complete in a future update cycle.
             SQLite::g_commitLock.lock();
             _commitState = CommitState::COMMITTING;
-            SINFO("[performance] Beginning " << consistencyLevelNames[_commitConsistency] << " commit.");
+            if (_commitPipelined && !_peersAcknowledgeTransactions()) {
+                SINFO("Not all peers can acknowledge transactions, not pipelining this commit.");
+                _commitPipelined = false;
+            }
+            SINFO("[performance] Beginning " << consistencyLevelNames[_commitConsistency]
+                  << (_commitPipelined ? " pipelined" : "") << " commit.");
 
             // Now that we've grabbed the commit lock, we can safely clear out any outstanding transactions, no new
             // ones can be added until we release the lock.
@@ -885,7 +967,7 @@ bool SQLiteNode::update() {
 
             // TODO: Remove when we've switched to 'leader'
             transaction.set("masterSendTime", transaction["leaderSendTime"]);
-            if (_commitConsistency == ASYNC) {
+            if (_commitConsistency == ASYNC || _commitPipelined) {
                 transaction["ID"] = "ASYNC_" + to_string(_lastSentTransactionID + 1);
             } else {
                 transaction.set("ID", _lastSentTransactionID + 1);
@@ -1049,6 +1131,31 @@ bool SQLiteNode::update() {
 void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
     SASSERT(peer);
     SASSERTWARN(!message.empty());
+
+    // If the peer compressed this message, decompress it and handle that instead.
+    if (message.isSet("Compression")) {
+        if (!SIEquals(message["Compression"], "gzip")) {
+            STHROW("unsupported Compression");
+        }
+        uint64_t start = STimeNow();
+        SData decompressed = message;
+        decompressed.erase("Compression");
+        decompressed.content = SGUnzip(message.content);
+        if (decompressed.content.empty()) {
+            STHROW("failed to decompress");
+        }
+        {
+            lock_guard<decltype(_compressionStatsMutex)> lock(_compressionStatsMutex);
+            CompressionStats& stats = _compressionStats[peer->id];
+            stats.messagesDecompressed++;
+            stats.bytesBeforeDecompression += message.content.size();
+            stats.bytesAfterDecompression += decompressed.content.size();
+            stats.decompressionTimeUS += STimeNow() - start;
+        }
+        _onMESSAGE(peer, decompressed);
+        return;
+    }
+
     // Every message broadcasts the current state of the node
     if (!message.isSet("CommitCount")) {
         STHROW("missing CommitCount");
@@ -1089,6 +1196,10 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
         peer->set("Priority", message["Priority"]);
         peer->set("LoggedIn", "true");
         peer->set("Version",  message["Version"]);
+        peer->set("BatchTransactions", message["BatchTransactions"]);
+        peer->set("AcknowledgeTransactions", message["AcknowledgeTransactions"]);
+        peer->set("AcceptCompression", message["AcceptCompression"]);
+        peer->set("AcceptSnapshots", message["AcceptSnapshots"]);
         peer->state = stateFromName(message["State"]);
 
         // Let the server know that a peer has logged in.
@@ -1293,8 +1404,10 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
     } else if (SIEquals(message.methodLine, "SYNCHRONIZE")) {
         // If we're FOLLOWING, we'll let worker threads handle SYNCHRONIZATION messages. We don't on leader, because if
         // there's a backlog of commands, these can get stale, and by the time they reach the follower, it's already
-        // behind, thus never catching up.
-        if (_state == FOLLOWING) {
+        // behind, thus never catching up. Snapshots are the exception: they're always sent from worker threads, as
+        // creating one can take a long time, and a snapshot can't get stale, as the peer follows it with a normal
+        // synchronization from whatever commit it's at.
+        if (_state == FOLLOWING || _peerNeedsSnapshot(peer, message)) {
             // Attach all of the state required to populate a SYNCHRONIZE_RESPONSE to this message. All of this is
             // processed asynchronously, but that is fine, the final `SUBSCRIBE` message and its response will be
             // processed synchronously.
@@ -1303,6 +1416,10 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
             request["peerHash"] = (*peer)["Hash"];
             request["peerID"] = to_string(getIDByPeer(peer));
             request["targetCommit"] = to_string(unsentTransactions.load() ? _lastSentTransactionID : _db.getCommitCount());
+            request["AcceptSnapshots"] = (*peer)["AcceptSnapshots"];
+            if (_shouldCompress(peer)) {
+                request["compressResponse"] = "true";
+            }
 
             // The following properties are only used to expand out our log macros.
             request["name"] = name;
@@ -1316,7 +1433,7 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
             // Otherwise we handle them immediately, as the server doesn't deliver commands to workers until we've
             // stood up.
             SData response("SYNCHRONIZE_RESPONSE");
-            _queueSynchronize(peer, response, false);
+            _queueSynchronize(peer, response, false, message.nameValueMap);
             _sendToPeer(peer, response);
         }
     } else if (SIEquals(message.methodLine, "SYNCHRONIZE_RESPONSE")) {
@@ -1333,10 +1450,42 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
         }
         PINFO("Beginning synchronization");
         try {
-            // Received this synchronization response; are we done?
-            _recvSynchronize(peer, message);
+            // Received this synchronization response; are we done? If it's part of a snapshot, we're not done until
+            // we have all of it.
+            bool snapshotIncomplete = false;
+            bool prefetched = false;
+            if (message.isSet("SnapshotCommitCount")) {
+                snapshotIncomplete = !_recvSnapshot(peer, message);
+            } else {
+                // Keep track of how we're being synchronized, for `Status`.
+                (*peer)["SynchronizeResponses"] = to_string(peer->calcU64("SynchronizeResponses") + 1);
+                (*peer)["SynchronizeLargestResponse"] = to_string(max(peer->calcU64("SynchronizeLargestResponse"),
+                                                                      (uint64_t)message.content.size()));
+
+                // If there'll be more to go after this batch, ask for the next one before we commit this one, so our
+                // peer can look it up and send it while we do. Peers that support this tell us which commit their
+                // response ends at.
+                uint64_t lastCommitIndex = message.calcU64("LastCommitIndex");
+                if (lastCommitIndex && lastCommitIndex < _syncPeer->calcU64("CommitCount")) {
+                    SData request = _newSynchronizeRequest();
+                    request["FromCommit"] = to_string(lastCommitIndex);
+                    request["FromHash"] = message["LastCommitHash"];
+                    _sendToPeer(_syncPeer, request);
+                    (*peer)["SynchronizePrefetches"] = to_string(peer->calcU64("SynchronizePrefetches") + 1);
+                    prefetched = true;
+                }
+                _recvSynchronize(peer, message);
+            }
             uint64_t peerCommitCount = _syncPeer->calcU64("CommitCount");
-            if (_db.getCommitCount() == peerCommitCount) {
+            if (snapshotIncomplete) {
+                // Ask the same peer for the next chunk, as no other peer has this snapshot.
+                SData request("SYNCHRONIZE");
+                request["SnapshotCommitCount"] = to_string(_incomingSnapshotCommitCount);
+                request["SnapshotOffset"] = to_string(SFileSize(_db.getFilename() + ".snapshot.partial"));
+                _sendToPeer(_syncPeer, request);
+                _stateTimeout = STimeNow() + SQL_NODE_SYNCHRONIZING_RECV_TIMEOUT
+                                + SRandom::rand64() % STIME_US_PER_S * 5;
+            } else if (_db.getCommitCount() == peerCommitCount) {
                 // All done
                 SINFO("Synchronization complete, at commitCount #" << _db.getCommitCount() << " ("
                       << _db.getCommittedHash() << "), WAITING");
@@ -1354,12 +1503,16 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
                 SINFO("Synchronization underway, at commitCount #"
                       << _db.getCommitCount() << " (" << _db.getCommittedHash() << "), "
                       << peerCommitCount - _db.getCommitCount() << " to go.");
-                _updateSyncPeer();
-                if (_syncPeer) {
-                    _sendToPeer(_syncPeer, SData("SYNCHRONIZE"));
-                } else {
-                    SWARN("No usable _syncPeer but syncing not finished. Going to SEARCHING.");
-                    _changeState(SEARCHING);
+
+                // If we've already asked for the next batch, it's on its way from this peer, so we stick with it.
+                if (!prefetched) {
+                    _updateSyncPeer();
+                    if (_syncPeer) {
+                        _sendToPeer(_syncPeer, _newSynchronizeRequest());
+                    } else {
+                        SWARN("No usable _syncPeer but syncing not finished. Going to SEARCHING.");
+                        _changeState(SEARCHING);
+                    }
                 }
 
                 // Also, extend our timeout so long as we're still alive
@@ -1581,6 +1734,17 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
                   << message.calc("NewCount") << " (" << message["NewHash"] << ", " << message["ID"] << ") but '"
                   << e.what() << "', ignoring.");
         }
+    } else if (SIEquals(message.methodLine, "ACKNOWLEDGE_TRANSACTION")) {
+        // ACKNOWLEDGE_TRANSACTION: Sent to the leader by a follower when it commits a pipelined transaction. The
+        // CommitCount it carries has already been recorded for the peer above, which is all we need to see whether
+        // that commit, and everything before it, has now reached a majority.
+        if (_state != LEADING && _state != STANDINGDOWN) {
+            PINFO("Received ACKNOWLEDGE_TRANSACTION for #" << message["CommitCount"] << " but not leading, ignoring.");
+        } else if (peer->params["Permafollower"] == "true") {
+            STHROW("permafollowers shouldn't acknowledge");
+        } else {
+            _updateQuorumCommitCount();
+        }
     } else if (SIEquals(message.methodLine, "COMMIT_TRANSACTION")) {
         // COMMIT_TRANSACTION: Sent to all subscribed followers by the leader when it determines that the current
         // outstanding transaction should be committed to the database. This completes a given distributed transaction.
@@ -1604,6 +1768,12 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
         // Clear the list of committed transactions. We're following, so we don't need to send these.
         _db.getCommittedTransactions();
 
+        // If the leader pipelined this commit, it's waiting to hear that we've committed it. Our new CommitCount is
+        // attached to every message we send, so the acknowledgement itself needs nothing else.
+        if (_priority && message["Acknowledge"] == "true") {
+            _sendToPeer(_leadPeer, SData("ACKNOWLEDGE_TRANSACTION"));
+        }
+
         // Log timing info.
         // TODO: This is obsolete and replaced by timing info in BedrockCommand. This should be removed.
         uint64_t beginElapsed, readElapsed, writeElapsed, prepareElapsed, commitElapsed, rollbackElapsed;
@@ -1623,6 +1793,81 @@ void SQLiteNode::_onMESSAGE(Peer* peer, const SData& message) {
             SINFO("Leader has committed in response to our command " << message["ID"]);
             commandIt->second.transaction = message;
         }
+    } else if (SIEquals(message.methodLine, "COMMIT_TRANSACTIONS")) {
+        // COMMIT_TRANSACTIONS: Sent to subscribed followers that advertised `BatchTransactions` at LOGIN in place of a
+        // BEGIN_TRANSACTION/COMMIT_TRANSACTION pair for each transaction that the leader has already committed outside
+        // of a quorum round. Each transaction in the batch is applied in order, and its hash is verified before it's
+        // committed, exactly as if it had arrived on its own.
+        if (!message.isSet("NumCommits")) {
+            STHROW("missing NumCommits");
+        }
+        if (_state != FOLLOWING) {
+            STHROW("not following");
+        }
+        if (!_db.getUncommittedHash().empty()) {
+            STHROW("already in a transaction");
+        }
+        uint64_t leaderSentTimestamp = message.calcU64("leaderSendTime");
+        uint64_t followerDequeueTimestamp = STimeNow();
+        int commitsRemaining = message.calc("NumCommits");
+        SData transaction;
+        const char* content = message.content.c_str();
+        int transactionSize = 0;
+        int remaining = (int)message.content.size();
+        while ((transactionSize = transaction.deserialize(content, remaining))) {
+            content += transactionSize;
+            remaining -= transactionSize;
+            if (!SIEquals(transaction.methodLine, "TRANSACTION")) {
+                STHROW("expecting TRANSACTION");
+            }
+            if (!transaction.isSet("NewCount")) {
+                STHROW("missing NewCount");
+            }
+            if (!transaction.isSet("NewHash")) {
+                STHROW("missing NewHash");
+            }
+            if (_db.getCommitCount() + 1 != transaction.calcU64("NewCount")) {
+                STHROW("commit count mismatch. Expected: " + transaction["NewCount"] + ", but would actually be: "
+                       + to_string(_db.getCommitCount() + 1));
+            }
+            _db.waitForCheckpoint();
+            if (!_db.beginTransaction()) {
+                STHROW("failed to begin transaction");
+            }
+            try {
+                // Inside transaction; get ready to back out on error
+                if (!_db.writeUnmodified(transaction.content)) {
+                    STHROW("failed to write transaction");
+                }
+                if (!_db.prepare()) {
+                    STHROW("failed to prepare transaction");
+                }
+                if (_db.getUncommittedHash() != transaction["NewHash"]) {
+                    PWARN("New hash mismatch in batch: commitCount=#" << _db.getCommitCount() << "', committedHash='"
+                          << _db.getCommittedHash() << "', uncommittedHash='" << _db.getUncommittedHash()
+                          << "', messageHash='" << transaction["NewHash"] << "', uncommittedQuery='"
+                          << _db.getUncommittedQuery() << "'");
+                    STHROW("new hash mismatch");
+                }
+            } catch (const SException& e) {
+                _db.rollback();
+                throw e;
+            }
+            SDEBUG("Committing current transaction because COMMIT_TRANSACTIONS: " << _db.getUncommittedQuery());
+            _db.commit();
+            --commitsRemaining;
+        }
+
+        // Clear the list of committed transactions. We're following, so we don't need to send these.
+        _db.getCommittedTransactions();
+        if (commitsRemaining) {
+            STHROW("commits remaining at end");
+        }
+        uint64_t transitTimeUS = followerDequeueTimestamp - leaderSentTimestamp;
+        uint64_t applyTimeUS = STimeNow() - followerDequeueTimestamp;
+        PINFO("Replicated batch of " << message["NumCommits"] << " transactions through #" << _db.getCommitCount()
+              << ", sent by leader at " << leaderSentTimestamp << ", transit/dequeue time: "
+              << (float)transitTimeUS / 1000.0 << "ms, applied in: " << (float)applyTimeUS / 1000.0 << "ms.");
     } else if (SIEquals(message.methodLine, "ROLLBACK_TRANSACTION")) {
         // ROLLBACK_TRANSACTION: Sent to all subscribed followers by the leader when it determines that the current
         // outstanding transaction should be rolled back. This completes a given distributed transaction.
@@ -1783,6 +2028,12 @@ void SQLiteNode::_onConnect(Peer* peer) {
     login["Priority"] = to_string(_priority);
     login["State"] = stateName(_state);
     login["Version"] = _version;
+    if (_batchTransactions) {
+        login["BatchTransactions"] = "true";
+    }
+    login["AcknowledgeTransactions"] = "true";
+    login["AcceptCompression"] = "gzip";
+    login["AcceptSnapshots"] = "true";
     _sendToPeer(peer, login);
 }
 
@@ -1902,10 +2153,27 @@ void SQLiteNode::_sendToPeer(Peer* peer, const SData& message) {
     SData messageCopy = message;
     messageCopy["CommitCount"] = to_string(_db.getCommitCount());
     messageCopy["Hash"] = _db.getCommittedHash();
+    if (_shouldCompress(peer)) {
+        _compressForPeer(peer, messageCopy);
+    }
     peer->s->send(messageCopy.serialize());
 }
 
 void SQLiteNode::_sendToAllPeers(const SData& message, bool subscribedOnly) {
+    // Send either to everybody, or just subscribed peers.
+    _sendToPeers(message, [subscribedOnly](Peer* peer) {
+        return !subscribedOnly || SIEquals((*peer)["Subscribed"], "true");
+    });
+}
+
+void SQLiteNode::_sendToSubscribedPeers(const SData& message, bool batchTransactions) {
+    _sendToPeers(message, [this, batchTransactions](Peer* peer) {
+        return SIEquals((*peer)["Subscribed"], "true") &&
+               (_batchTransactions && SIEquals((*peer)["BatchTransactions"], "true")) == batchTransactions;
+    });
+}
+
+void SQLiteNode::_sendToPeers(const SData& message, function<bool(Peer*)> shouldSend) {
     // Piggyback on whatever we're sending to add the CommitCount/Hash, but only serialize once before broadcasting.
     SData messageCopy = message;
     if (!messageCopy.isSet("CommitCount")) {
@@ -1916,14 +2184,126 @@ void SQLiteNode::_sendToAllPeers(const SData& message, bool subscribedOnly) {
     }
     const string& serializedMessage = messageCopy.serialize();
 
+    // Likewise, we compress at most once, the first time we find a peer that wants it.
+    bool triedCompression = false;
+    uint64_t compressionTimeUS = 0;
+    size_t compressedSize = 0;
+    string compressedMessage;
+
     // Loop across all connected peers and send the message
     for (auto peer : peerList) {
-        // Send either to everybody, or just subscribed peers.
-        if (peer->s && (!subscribedOnly || SIEquals((*peer)["Subscribed"], "true"))) {
-            // Send it now, without waiting for the outer event loop
-            peer->s->send(serializedMessage);
+        if (!peer->s || !shouldSend(peer)) {
+            continue;
+        }
+        if (_shouldCompress(peer)) {
+            if (!triedCompression) {
+                triedCompression = true;
+                SData compressed = messageCopy;
+                if (_compress(compressed, compressionTimeUS)) {
+                    compressedSize = compressed.content.size();
+                    compressedMessage = compressed.serialize();
+                }
+            }
+            if (!compressedMessage.empty()) {
+                _recordCompression(peer, messageCopy.content.size(), compressedSize, compressionTimeUS);
+
+                // Send it now, without waiting for the outer event loop
+                peer->s->send(compressedMessage);
+                continue;
+            }
+        }
+
+        // Send it now, without waiting for the outer event loop
+        peer->s->send(serializedMessage);
+    }
+}
+
+bool SQLiteNode::_shouldCompress(Peer* peer) {
+    return _compressReplication && SIEquals((*peer)["AcceptCompression"], "gzip");
+}
+
+bool SQLiteNode::_compress(SData& message, uint64_t& timeUS) {
+    if (message.content.size() < MIN_COMPRESSION_SIZE) {
+        return false;
+    }
+    uint64_t start = STimeNow();
+    string compressed = SGZip(message.content, COMPRESSION_LEVEL);
+    timeUS = STimeNow() - start;
+
+    // If compression failed, or didn't save anything, we'll just send the original.
+    if (compressed.empty() || compressed.size() >= message.content.size()) {
+        return false;
+    }
+    message.content = move(compressed);
+    message["Compression"] = "gzip";
+    return true;
+}
+
+void SQLiteNode::_compressForPeer(Peer* peer, SData& message) {
+    size_t uncompressedSize = message.content.size();
+    uint64_t timeUS = 0;
+    if (_compress(message, timeUS)) {
+        _recordCompression(peer, uncompressedSize, message.content.size(), timeUS);
+    }
+}
+
+void SQLiteNode::_recordCompression(Peer* peer, size_t uncompressedSize, size_t compressedSize, uint64_t timeUS) {
+    lock_guard<decltype(_compressionStatsMutex)> lock(_compressionStatsMutex);
+    CompressionStats& stats = _compressionStats[peer->id];
+    stats.messagesCompressed++;
+    stats.bytesBeforeCompression += uncompressedSize;
+    stats.bytesAfterCompression += compressedSize;
+    stats.compressionTimeUS += timeUS;
+}
+
+STable SQLiteNode::getCompressionInfo(Peer* peer) {
+    lock_guard<decltype(_compressionStatsMutex)> lock(_compressionStatsMutex);
+    STable info;
+    auto it = _compressionStats.find(peer->id);
+    if (it != _compressionStats.end()) {
+        const CompressionStats& stats = it->second;
+        info["MessagesCompressed"] = to_string(stats.messagesCompressed);
+        info["BytesBeforeCompression"] = to_string(stats.bytesBeforeCompression);
+        info["BytesAfterCompression"] = to_string(stats.bytesAfterCompression);
+        info["CompressionRatio"] = to_string(stats.bytesAfterCompression ?
+                                             (double)stats.bytesBeforeCompression / stats.bytesAfterCompression : 0.0);
+        info["CompressionTimeMS"] = to_string(stats.compressionTimeUS / 1000);
+        info["MessagesDecompressed"] = to_string(stats.messagesDecompressed);
+        info["BytesBeforeDecompression"] = to_string(stats.bytesBeforeDecompression);
+        info["BytesAfterDecompression"] = to_string(stats.bytesAfterDecompression);
+        info["DecompressionTimeMS"] = to_string(stats.decompressionTimeUS / 1000);
+    }
+    return info;
+}
+
+void SQLiteNode::_updateQuorumCommitCount() {
+    // Collect the commit count of each full peer, counting peers that aren't subscribed as having nothing.
+    vector<uint64_t> commitCounts;
+    for (auto peer : peerList) {
+        if (peer->params["Permafollower"] != "true") {
+            bool subscribed = SIEquals((*peer)["Subscribed"], "true");
+            commitCounts.push_back(subscribed ? min(peer->calcU64("CommitCount"), _db.getCommitCount()) : 0);
         }
     }
+
+    // Like approvals, a majority means at least half of the full peers, as we count ourselves as well.
+    size_t required = (commitCounts.size() + 1) / 2;
+    if (!required) {
+        _quorumCommitCount = _db.getCommitCount();
+        return;
+    }
+    sort(commitCounts.begin(), commitCounts.end(), greater<uint64_t>());
+    _quorumCommitCount = max(_quorumCommitCount, commitCounts[required - 1]);
+}
+
+bool SQLiteNode::_peersAcknowledgeTransactions() {
+    for (auto peer : peerList) {
+        if (peer->params["Permafollower"] != "true" && SIEquals((*peer)["LoggedIn"], "true") &&
+            !SIEquals((*peer)["AcknowledgeTransactions"], "true")) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void SQLiteNode::broadcast(const SData& message, Peer* peer) {
@@ -1994,6 +2374,9 @@ void SQLiteNode::_changeState(SQLiteNode::State newState) {
                 // Clear these.
                 _db.getCommittedTransactions();
             }
+
+            // Nothing we commit from here on has been acknowledged yet.
+            _quorumCommitCount = _db.getCommitCount();
         } else if (newState == STANDINGDOWN) {
             // start the timeout countdown.
             _standDownTimeOut.alarmDuration = STIME_US_PER_S * 30; // 30s timeout before we give up
@@ -2026,8 +2409,21 @@ void SQLiteNode::_changeState(SQLiteNode::State newState) {
     }
 }
 
-void SQLiteNode::_queueSynchronize(Peer* peer, SData& response, bool sendAll) {
-    _queueSynchronizeStateless(peer->nameValueMap, name, peer->name, _state, (unsentTransactions.load() ? _lastSentTransactionID : _db.getCommitCount()), _db, response, sendAll);
+void SQLiteNode::_queueSynchronize(Peer* peer, SData& response, bool sendAll, const STable& request) {
+    STable params = peer->nameValueMap;
+    for (const auto& header : request) {
+        params[header.first] = header.second;
+    }
+    uint64_t targetCommit = unsentTransactions.load() ? _lastSentTransactionID : _db.getCommitCount();
+    _queueSynchronizeStateless(params, name, peer->name, _state, targetCommit, _db, response, sendAll);
+}
+
+SData SQLiteNode::_newSynchronizeRequest() {
+    SData request("SYNCHRONIZE");
+    if (_synchronizeBatchBytes) {
+        request["MaxBytes"] = to_string(_synchronizeBatchBytes);
+    }
+    return request;
 }
 
 void SQLiteNode::_queueSynchronizeStateless(const STable& params, const string& name, const string& peerName, State _state, uint64_t targetCommit, SQLite& db, SData& response, bool sendAll) {
@@ -2036,13 +2432,40 @@ void SQLiteNode::_queueSynchronizeStateless(const STable& params, const string&
     auto peer = &peerBase;
     peerBase.name = peerName;
 
-    // Peer is requesting synchronization.  First, does it have any data?
+    // A peer that's already receiving a snapshot from us just wants the next part of it.
+    if (params.find("SnapshotCommitCount") != params.end()) {
+        _queueSnapshot(params, name, peerName, _state, db, response);
+        return;
+    }
+
+    // Peer is requesting synchronization.  First, does it have any data? If it's asking for the batch after one it
+    // hasn't finished committing yet, we synchronize it from the end of that batch instead.
+    const bool prefetch = params.find("FromCommit") != params.end();
+    const string countName = prefetch ? "FromCommit" : "CommitCount";
+    const string hashName = prefetch ? "FromHash" : "Hash";
     uint64_t peerCommitCount = 0;
-    if(params.find("CommitCount") != params.end()) {
-        peerCommitCount = SToUInt64(params.at("CommitCount"));
+    if(params.find(countName) != params.end()) {
+        peerCommitCount = SToUInt64(params.at(countName));
+    }
+
+    // A peer that's diverged from us can't be synchronized one commit at a time, so if it can take one, we send it a
+    // copy of our whole database instead.
+    auto acceptSnapshots = params.find("AcceptSnapshots");
+    const bool canSnapshot = !sendAll && acceptSnapshots != params.end() && SIEquals(acceptSnapshots->second, "true");
+    if (canSnapshot && params.find("Diverged") != params.end()) {
+        PINFO("Peer at commit #" << peerCommitCount << " has diverged from us, sending snapshot.");
+        _queueSnapshot(params, name, peerName, _state, db, response);
+        return;
     }
     if (peerCommitCount > db.getCommitCount())
         STHROW("you have more data than me");
+
+    // Likewise if we've already deleted commits that it needs from our journal.
+    if (canSnapshot && _journalMissingCommits(db, peerCommitCount, targetCommit)) {
+        PINFO("Peer at commit #" << peerCommitCount << " needs commits no longer in our journal, sending snapshot.");
+        _queueSnapshot(params, name, peerName, _state, db, response);
+        return;
+    }
     if (peerCommitCount) {
         // It has some data -- do we agree on what we share?
         string myHash, ignore;
@@ -2051,12 +2474,17 @@ void SQLiteNode::_queueSynchronizeStateless(const STable& params, const string&
             STHROW("error getting hash");
         }
         string compareHash;
-        if (params.find("Hash") != params.end()) {
-            compareHash = params.at("Hash");
+        if (params.find(hashName) != params.end()) {
+            compareHash = params.at(hashName);
         }
         if (myHash != compareHash) {
             SWARN("Hash mismatch. Peer at commit:" << peerCommitCount << " with hash " << compareHash
                   << ", but we have hash: " << myHash << " for that commit.");
+            if (canSnapshot) {
+                PINFO("Peer has diverged from us, sending snapshot.");
+                _queueSnapshot(params, name, peerName, _state, db, response);
+                return;
+            }
             STHROW("hash mismatch");
         }
         PINFO("Latest commit hash matches our records, beginning synchronization.");
@@ -2065,36 +2493,65 @@ void SQLiteNode::_queueSynchronizeStateless(const STable& params, const string&
     }
 
     // We agree on what we share, do we need to give it more?
-    SQResult result;
-    if (peerCommitCount == targetCommit) {
+    if (peerCommitCount >= targetCommit) {
         // Already synchronized; nothing to send
         PINFO("Peer is already synchronized");
         response["NumCommits"] = "0";
-    } else {
-        // Figure out how much to send it
-        uint64_t fromIndex = peerCommitCount + 1;
-        uint64_t toIndex = targetCommit;
-        if (!sendAll)
-            toIndex = min(toIndex, fromIndex + 100); // 100 transactions at a time
+        return;
+    }
+
+    // Figure out how much to send it. Unless we're sending everything, we fill up to the size the peer asked for,
+    // within our own limit, and stop early if looking up commits is taking too long. We always send at least one.
+    uint64_t maxBytes = SYNCHRONIZE_DEFAULT_BYTES;
+    if (params.find("MaxBytes") != params.end() && SToUInt64(params.at("MaxBytes"))) {
+        maxBytes = min(SToUInt64(params.at("MaxBytes")), SYNCHRONIZE_MAX_BYTES);
+    }
+    const uint64_t start = STimeNow();
+    uint64_t fromIndex = peerCommitCount + 1;
+    uint64_t lastIndex = peerCommitCount;
+    string lastHash;
+    bool full = false;
+    while (!full && fromIndex <= targetCommit) {
+        // Until we know how big the commits are, look up as many as we used to send at once. After that, look up
+        // about as many as we expect to fit in what's left.
+        uint64_t pageCommits = 100;
+        if (sendAll) {
+            pageCommits = SYNCHRONIZE_MAX_PAGE_COMMITS;
+        } else if (lastIndex > peerCommitCount) {
+            uint64_t averageBytes = max(response.content.size() / (lastIndex - peerCommitCount), (size_t)1);
+            pageCommits = (maxBytes - min((uint64_t)response.content.size(), maxBytes)) / averageBytes;
+            pageCommits = max(min(pageCommits, SYNCHRONIZE_MAX_PAGE_COMMITS), (uint64_t)1);
+        }
+        uint64_t toIndex = min(targetCommit, fromIndex + pageCommits - 1);
+        SQResult result;
         if (!db.getCommits(fromIndex, toIndex, result))
             STHROW("error getting commits");
         if ((uint64_t)result.size() != toIndex - fromIndex + 1)
             STHROW("mismatched commit count");
 
-        // Wrap everything into one huge message
-        PINFO("Synchronizing commits from " << peerCommitCount + 1 << "-" << targetCommit);
-        response["NumCommits"] = SToStr(result.size());
-        for (size_t c = 0; c < result.size(); ++c) {
+        // Wrap everything into one message
+        for (size_t c = 0; c < result.size() && !full; ++c) {
             // Queue the result
             SASSERT(result[c].size() == 2);
             SData commit("COMMIT");
-            commit["CommitIndex"] = SToStr(peerCommitCount + c + 1);
-            commit["Hash"] = result[c][0];
+            lastIndex = fromIndex + c;
+            lastHash = result[c][0];
+            commit["CommitIndex"] = SToStr(lastIndex);
+            commit["Hash"] = lastHash;
             commit.content = result[c][1];
             response.content += commit.serialize();
+            full = !sendAll &&
+                   (response.content.size() >= maxBytes || STimeNow() - start >= SYNCHRONIZE_TIME_BUDGET_US);
         }
-        SASSERTWARN(response.content.size() < 10 * 1024 * 1024); // Let's watch if it gets over 10MB
+        fromIndex = toIndex + 1;
     }
+    PINFO("Synchronizing commits from " << peerCommitCount + 1 << "-" << lastIndex << " of " << targetCommit << " ("
+          << response.content.size() << " bytes in " << (STimeNow() - start) / 1000 << "ms).");
+    response["NumCommits"] = SToStr(lastIndex - peerCommitCount);
+
+    // Tell the peer where this batch ends, so it can ask for the next one before it's done committing this one.
+    response["LastCommitIndex"] = SToStr(lastIndex);
+    response["LastCommitHash"] = lastHash;
 }
 
 void SQLiteNode::_recvSynchronize(Peer* peer, const SData& message) {
@@ -2154,6 +2611,141 @@ void SQLiteNode::_recvSynchronize(Peer* peer, const SData& message) {
         STHROW("commits remaining at end");
 }
 
+bool SQLiteNode::_journalMissingCommits(SQLite& db, uint64_t peerCommitCount, uint64_t targetCommit) {
+    // We need the peer's own latest commit to compare hashes with, and everything after it.
+    return peerCommitCount < targetCommit && db.getJournalStart() > max(peerCommitCount, (uint64_t)1);
+}
+
+bool SQLiteNode::_peerNeedsSnapshot(Peer* peer, const SData& message) {
+    if (!SIEquals((*peer)["AcceptSnapshots"], "true")) {
+        return false;
+    }
+    uint64_t peerCommitCount = message.isSet("FromCommit") ? message.calcU64("FromCommit")
+                                                           : peer->calcU64("CommitCount");
+    if (message.isSet("SnapshotCommitCount") || message.isSet("Diverged") ||
+        _journalMissingCommits(_db, peerCommitCount, _db.getCommitCount())) {
+        return true;
+    }
+
+    // So does a peer whose latest commit doesn't match ours.
+    const string& peerHash = message.isSet("FromCommit") ? message["FromHash"] : (*peer)["Hash"];
+    string hash, ignore;
+    return peerCommitCount && peerCommitCount <= _db.getCommitCount() &&
+           _db.getCommit(peerCommitCount, ignore, hash) && hash != peerHash;
+}
+
+bool SQLiteNode::_divergedFrom(Peer* leader) {
+    // If it's ahead of us, it'll find out when we ask it to synchronize us.
+    uint64_t leaderCommitCount = leader->calcU64("CommitCount");
+    if (!leaderCommitCount || leaderCommitCount > _db.getCommitCount()) {
+        return false;
+    }
+    string hash, ignore;
+    return _db.getCommit(leaderCommitCount, ignore, hash) && hash != (*leader)["Hash"];
+}
+
+void SQLiteNode::_queueSnapshot(const STable& params, const string& name, const string& peerName, State _state,
+                                SQLite& db, SData& response) {
+    // This is a hack to make the PXXXX macros works, since they expect `peer->name` to be defined.
+    struct {string name;} peerBase;
+    auto peer = &peerBase;
+    peerBase.name = peerName;
+
+    // Only one thread at a time can create the snapshot or read from it.
+    lock_guard<mutex> lock(_outgoingSnapshotMutex);
+    const string filename = db.getFilename() + ".snapshot";
+    uint64_t offset = 0;
+    auto snapshotCommitCount = params.find("SnapshotCommitCount");
+    if (snapshotCommitCount != params.end()) {
+        // The peer is partway through a snapshot. If we've replaced it since, it needs to start over.
+        if (SToUInt64(snapshotCommitCount->second) != _outgoingSnapshotCommitCount) {
+            STHROW("snapshot no longer available");
+        }
+        auto snapshotOffset = params.find("SnapshotOffset");
+        offset = snapshotOffset == params.end() ? 0 : SToUInt64(snapshotOffset->second);
+    } else if (_outgoingSnapshotCommitCount && SFileExists(filename) &&
+               db.getJournalStart() <= _outgoingSnapshotCommitCount) {
+        // The snapshot we already have will do, as the peer can still synchronize from it using our journal.
+        PINFO("Reusing snapshot at commit #" << _outgoingSnapshotCommitCount << ".");
+    } else if (!db.createSnapshot(filename, _outgoingSnapshotCommitCount, _outgoingSnapshotHash)) {
+        _outgoingSnapshotCommitCount = 0;
+        STHROW("failed to create snapshot");
+    }
+
+    // Read the requested chunk.
+    uint64_t size = SFileSize(filename);
+    if (offset >= size) {
+        STHROW("invalid snapshot offset");
+    }
+    response.content.resize(min((uint64_t)SNAPSHOT_CHUNK_SIZE, size - offset));
+    FILE* fp = fopen(filename.c_str(), "rb");
+    bool success = fp && !fseek(fp, offset, SEEK_SET) &&
+                   fread(&response.content[0], 1, response.content.size(), fp) == response.content.size();
+    if (fp) {
+        fclose(fp);
+    }
+    if (!success) {
+        STHROW("failed to read snapshot");
+    }
+    PINFO("Sending snapshot bytes " << offset << "-" << offset + response.content.size() << " of " << size
+          << " at commit #" << _outgoingSnapshotCommitCount << ".");
+    response["NumCommits"] = "0";
+    response["SnapshotCommitCount"] = to_string(_outgoingSnapshotCommitCount);
+    response["SnapshotHash"] = _outgoingSnapshotHash;
+    response["SnapshotOffset"] = to_string(offset);
+    response["SnapshotSize"] = to_string(size);
+}
+
+bool SQLiteNode::_recvSnapshot(Peer* peer, const SData& message) {
+    // A new snapshot always starts at the beginning, and each chunk must follow on from the last.
+    const string filename = _db.getFilename() + ".snapshot.partial";
+    uint64_t offset = message.calcU64("SnapshotOffset");
+    if (!offset) {
+        _incomingSnapshotCommitCount = message.calcU64("SnapshotCommitCount");
+        _incomingSnapshotHash = message["SnapshotHash"];
+        SFileDelete(filename);
+        PINFO("Receiving " << message["SnapshotSize"] << " byte snapshot at commit #" << _incomingSnapshotCommitCount
+              << " (" << _incomingSnapshotHash << ").");
+    } else if (message.calcU64("SnapshotCommitCount") != _incomingSnapshotCommitCount ||
+               offset != SFileSize(filename)) {
+        STHROW("snapshot chunk out of order");
+    }
+
+    // Append this chunk.
+    FILE* fp = fopen(filename.c_str(), "ab");
+    if (!fp) {
+        STHROW("failed to open snapshot");
+    }
+    size_t numWritten = fwrite(message.content.c_str(), 1, message.content.size(), fp);
+    fclose(fp);
+    if (numWritten != message.content.size()) {
+        STHROW("failed to write snapshot");
+    }
+
+    // Is there more to come?
+    uint64_t size = SFileSize(filename);
+    uint64_t snapshotSize = message.calcU64("SnapshotSize");
+    if (size < snapshotSize) {
+        return false;
+    }
+    if (size > snapshotSize) {
+        STHROW("snapshot too large");
+    }
+
+    // We have the whole thing. Replace our database with it, and make sure we ended up where we were told we would.
+    if (!_db.restoreSnapshot(filename)) {
+        STHROW("failed to restore snapshot");
+    }
+    SFileDelete(filename);
+    if (_db.getCommitCount() != _incomingSnapshotCommitCount || _db.getCommittedHash() != _incomingSnapshotHash) {
+        PWARN("Restored snapshot at commit #" << _db.getCommitCount() << " (" << _db.getCommittedHash()
+              << "), expected #" << _incomingSnapshotCommitCount << " (" << _incomingSnapshotHash << ").");
+        STHROW("snapshot hash mismatch");
+    }
+    PINFO("Restored snapshot at commit #" << _db.getCommitCount() << ".");
+    return true;
+}
+
 void SQLiteNode::_updateSyncPeer()
 {
     Peer* newSyncPeer = nullptr;
@@ -2277,9 +2869,12 @@ bool SQLiteNode::peekPeerCommand(SQLiteNode* node, SQLite& db, SQLiteCommand& co
                                        command.response,
                                        false);
 
-            // The following two lines are copied from `_sendToPeer`.
+            // The following lines are copied from `_sendToPeer`.
             command.response["CommitCount"] = to_string(db.getCommitCount());
             command.response["Hash"] = db.getCommittedHash();
+            if (command.request.test("compressResponse")) {
+                node->_compressForPeer(peer, command.response);
+            }
             peer->sendMessage(command.response);
             return true;
         }
@@ -35,7 +35,8 @@ class SQLiteNode : public STCPNode {
 
     // Constructor/Destructor
     SQLiteNode(SQLiteServer& server, SQLite& db, const string& name, const string& host, const string& peerList,
-               int priority, uint64_t firstTimeout, const string& version);
+               int priority, uint64_t firstTimeout, const string& version, bool compressReplication = false,
+               uint64_t synchronizeBatchBytes = 0, bool batchTransactions = true);
     ~SQLiteNode();
 
     // Simple Getters. See property definitions for details.
@@ -68,7 +69,15 @@ class SQLiteNode : public STCPNode {
 
     // Begins the process of committing a transaction on this SQLiteNode's database. When this returns,
     // commitInProgress() will return true until the commit completes.
-    void startCommit(ConsistencyLevel consistency);
+    // If `pipelined` is set, the transaction is committed without waiting for followers to approve it, and followers
+    // are asked to acknowledge it once they've committed it, so the caller can start its next commit while this one
+    // is still in flight. The transaction has reached `consistency` once `getQuorumCommitCount()` reaches its commit
+    // count. If any logged in full peer can't acknowledge transactions, this is ignored.
+    void startCommit(ConsistencyLevel consistency, bool pipelined = false);
+
+    // Returns the highest commit count that a majority of full peers are known to have committed. Only meaningful
+    // while LEADING or STANDINGDOWN.
+    uint64_t getQuorumCommitCount() { return _quorumCommitCount; }
 
     // If we have a command that can't be handled on a follower, we can escalate it to the leader node. The SQLiteNode
     // takes ownership of the command until it receives a response from the follower. When the command completes, it will
@@ -102,6 +111,10 @@ class SQLiteNode : public STCPNode {
     // This will broadcast a message to all peers, or a specific peer.
     void broadcast(const SData& message, Peer* peer = nullptr);
 
+    // Returns the compression totals for messages exchanged with the given peer, for `Status`. Empty if nothing
+    // compressed has been sent to or received from it.
+    STable getCompressionInfo(Peer* peer);
+
   private:
     // STCPNode API: Peer handling framework functions
     void _onConnect(Peer* peer);
@@ -142,6 +155,19 @@ class SQLiteNode : public STCPNode {
     // The write consistency requested for the current in-progress commit.
     ConsistencyLevel _commitConsistency;
 
+    // Whether the current in-progress commit was started with `pipelined` set.
+    bool _commitPipelined;
+
+    // See `getQuorumCommitCount`. This only ever increases while we're leading, so acknowledgements received before
+    // followers unsubscribe at the end of a stand down still count.
+    uint64_t _quorumCommitCount;
+
+    // Recalculates `_quorumCommitCount` from the commit counts that our subscribed full peers have sent us.
+    void _updateQuorumCommitCount();
+
+    // Returns true if every logged in full peer advertised `AcknowledgeTransactions` at LOGIN.
+    bool _peersAcknowledgeTransactions();
+
     // Stopwatch to track if we're going to give up on gracefully shutting down and force it.
     SStopwatch _gracefulShutdownTimeout;
 
@@ -164,14 +190,80 @@ class SQLiteNode : public STCPNode {
     // Helper methods
     void _sendToPeer(Peer* peer, const SData& message);
     void _sendToAllPeers(const SData& message, bool subscribedOnly = false);
+
+    // Sends to the subscribed peers we replicate to with COMMIT_TRANSACTIONS if `batchTransactions` is set, or to the
+    // rest of them if not. We batch for peers that advertised `BatchTransactions` at LOGIN, unless batching is off.
+    void _sendToSubscribedPeers(const SData& message, bool batchTransactions);
+
+    // Sends to every connected peer for which `shouldSend` returns true. Used by the two functions above.
+    void _sendToPeers(const SData& message, function<bool(Peer*)> shouldSend);
+
+    // Returns true if we compress messages that we send to this peer: compression must be enabled for this node, and
+    // the peer must have advertised `AcceptCompression: gzip` at LOGIN.
+    bool _shouldCompress(Peer* peer);
+
+    // Replaces the content of `message` with its gzipped equivalent, and marks it with a `Compression` header, if it's
+    // at least `MIN_COMPRESSION_SIZE` bytes and compressing it makes it smaller. Returns whether it did, and sets
+    // `timeUS` to the time spent trying.
+    static bool _compress(SData& message, uint64_t& timeUS);
+
+    // Compresses `message` as above, and records the result against `peer`. Safe to call from any thread.
+    void _compressForPeer(Peer* peer, SData& message);
+    void _recordCompression(Peer* peer, size_t uncompressedSize, size_t compressedSize, uint64_t timeUS);
+
+    // Smaller messages than this aren't worth compressing.
+    static const size_t MIN_COMPRESSION_SIZE;
+
+    // The gzip level we compress with. Messages are often compressed with the commit lock held, so we favor speed.
+    static const int COMPRESSION_LEVEL;
+
+    // The most bytes of a snapshot that we send in a single SYNCHRONIZE_RESPONSE.
+    static const size_t SNAPSHOT_CHUNK_SIZE;
+
+    // Limits for a single SYNCHRONIZE_RESPONSE, as described for `_queueSynchronizeStateless`. We look commits up in
+    // pages of at most `SYNCHRONIZE_MAX_PAGE_COMMITS`, sized by the commits we've seen so far to fill what's left of
+    // the batch, so that a few huge commits don't all get loaded at once.
+    static const uint64_t SYNCHRONIZE_DEFAULT_BYTES;
+    static const uint64_t SYNCHRONIZE_MAX_BYTES;
+    static const uint64_t SYNCHRONIZE_TIME_BUDGET_US;
+    static const uint64_t SYNCHRONIZE_MAX_PAGE_COMMITS;
+
+    // Returns a new SYNCHRONIZE request, asking for `_synchronizeBatchBytes` per response, if set.
+    SData _newSynchronizeRequest();
     void _changeState(State newState);
 
-    // Queue a SYNCHRONIZE message based on the current state of the node.
-    void _queueSynchronize(Peer* peer, SData& response, bool sendAll);
+    // Queue a SYNCHRONIZE message based on the current state of the node. Any headers in `request` (such as
+    // `FromCommit`) override what we know about the peer.
+    void _queueSynchronize(Peer* peer, SData& response, bool sendAll, const STable& request = STable());
 
-    // Queue a SYNCHRONIZE message based on pre-computed state of the node. This version is thread-safe.
+    // Queue a SYNCHRONIZE message based on pre-computed state of the node. This version is thread-safe. The peer is
+    // synchronized from `FromCommit` and `FromHash` in `params` if they're set, or `CommitCount` and `Hash` otherwise,
+    // so that it can ask for its next batch before it's finished committing the last one. Unless `sendAll` is set, we
+    // stop adding commits once we've got `MaxBytes` (capped at `SYNCHRONIZE_MAX_BYTES`) of them, or we've spent
+    // `SYNCHRONIZE_TIME_BUDGET_US` looking them up.
     static void _queueSynchronizeStateless(const STable& params, const string& name, const string& peerName, State _state, uint64_t targetCommit, SQLite& db, SData& response, bool sendAll);
     void _recvSynchronize(Peer* peer, const SData& message);
+
+    // Returns true if commits that a peer at `peerCommitCount` needs to reach `targetCommit` have already been deleted
+    // from our journal, so it can only catch up from a snapshot.
+    static bool _journalMissingCommits(SQLite& db, uint64_t peerCommitCount, uint64_t targetCommit);
+
+    // Returns true if this SYNCHRONIZE message from `peer` will be answered with part of a snapshot.
+    bool _peerNeedsSnapshot(Peer* peer, const SData& message);
+
+    // Returns true if we have a different commit than `leader` at its latest commit. That can only be one we made as
+    // leader that never reached the rest of the cluster before it carried on without it (e.g., a pipelined QUORUM
+    // commit when we crashed), so we have to discard it to follow `leader`.
+    bool _divergedFrom(Peer* leader);
+
+    // Fills in `response` with the chunk of our snapshot that the peer asked for with `SnapshotCommitCount` and
+    // `SnapshotOffset`, or with the first chunk of a snapshot if it didn't, creating one if needed. Thread-safe.
+    static void _queueSnapshot(const STable& params, const string& name, const string& peerName, State _state,
+                               SQLite& db, SData& response);
+
+    // Saves a chunk of a snapshot we're receiving from `peer`. Once it has all of them, restores the snapshot to our
+    // database and returns true.
+    bool _recvSnapshot(Peer* peer, const SData& message);
     void _reconnectPeer(Peer* peer);
     void _reconnectAll();
     bool _isQueuedCommandMapEmpty();
@@ -185,6 +277,12 @@ class SQLiteNode : public STCPNode {
     // Replicates any transactions that have been made on our database by other threads to peers.
     void _sendOutstandingTransactions();
 
+    // The most transactions, and the most bytes of queries, that `_sendOutstandingTransactions` will group into a
+    // single COMMIT_TRANSACTIONS message. Whatever's been committed since the last call is sent in as many batches as
+    // these limits require.
+    static const size_t MAX_TRANSACTION_BATCH_COUNT;
+    static const size_t MAX_TRANSACTION_BATCH_BYTES;
+
     // The server object to which we'll pass incoming escalated commands.
     SQLiteServer& _server;
 
@@ -193,6 +291,42 @@ class SQLiteNode : public STCPNode {
     // and not stale reponses to old changes.
     int _stateChangeCount;
 
+    // Whether we compress large messages for peers that accept it. Supplied by constructor.
+    bool _compressReplication;
+
+    // The size of SYNCHRONIZE_RESPONSE we ask peers for, or 0 to leave it up to them. Supplied by constructor.
+    uint64_t _synchronizeBatchBytes;
+
+    // Whether we replicate with COMMIT_TRANSACTIONS to and from peers that support it. Supplied by constructor.
+    bool _batchTransactions;
+
+    // Compression totals for each peer, by peer ID. Only messages that were actually compressed are counted, as the
+    // rest are sent as they are. Worker threads compress SYNCHRONIZE_RESPONSE messages as well as the sync thread
+    // compressing everything else, so these are guarded by `_compressionStatsMutex`.
+    struct CompressionStats {
+        uint64_t messagesCompressed = 0;
+        uint64_t bytesBeforeCompression = 0;
+        uint64_t bytesAfterCompression = 0;
+        uint64_t compressionTimeUS = 0;
+        uint64_t messagesDecompressed = 0;
+        uint64_t bytesBeforeDecompression = 0;
+        uint64_t bytesAfterDecompression = 0;
+        uint64_t decompressionTimeUS = 0;
+    };
+    map<uint64_t, CompressionStats> _compressionStats;
+    mutex _compressionStatsMutex;
+
+    // The commit count and hash of the snapshot we're currently sending to peers that need one. Like
+    // `_lastSentTransactionID`, these are global, as snapshots are sent from worker threads as well as the sync thread.
+    // Guarded by `_outgoingSnapshotMutex`.
+    static mutex _outgoingSnapshotMutex;
+    static uint64_t _outgoingSnapshotCommitCount;
+    static string _outgoingSnapshotHash;
+
+    // The commit count and hash of the snapshot we're currently receiving, if any.
+    uint64_t _incomingSnapshotCommitCount;
+    string _incomingSnapshotHash;
+
     // Last time we recorded network stats.
     chrono::steady_clock::time_point _lastNetStatTime;
 };
@@ -31,8 +31,8 @@ class ClusterTester {
     // Same as above but don't wait for the command port to be ready.
     string startNodeDontWait(size_t index);
 
-    // Stops a given node.
-    void stopNode(size_t index);
+    // Stops a given node, by sending it the given signal.
+    void stopNode(size_t index, int signal = SIGINT);
 
   private:
 
@@ -204,9 +204,9 @@ T& ClusterTester<T>::getTester(size_t index)
 }
 
 template <typename T>
-void ClusterTester<T>::stopNode(size_t index)
+void ClusterTester<T>::stopNode(size_t index, int signal)
 {
-    next(_cluster.begin(), index)->stopServer();
+    next(_cluster.begin(), index)->stopServer(signal);
 }
 
 template <typename T>
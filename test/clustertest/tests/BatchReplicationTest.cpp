@@ -0,0 +1,62 @@
+#include "../BedrockClusterTester.h"
+
+struct BatchReplicationTest : tpunit::TestFixture {
+    BatchReplicationTest()
+        : tpunit::TestFixture("BatchReplication",
+                              BEFORE_CLASS(BatchReplicationTest::setup),
+                              AFTER_CLASS(BatchReplicationTest::teardown),
+                              TEST(BatchReplicationTest::mixedPeers)
+                             ) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER);
+
+        // Restart one follower without batching, so it logs in like a node from before COMMIT_TRANSACTIONS existed.
+        tester->stopNode(2);
+        tester->getTester(2).setArg("-unbatchedReplication", "");
+        tester->startNode(2);
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    // Returns the hash that `node` has recorded for the given commit, whichever journal it's in.
+    string getCommitHash(BedrockTester& node, uint64_t commitCount) {
+        SQResult journals;
+        node.readDB("SELECT name FROM sqlite_master WHERE type = 'table' AND name LIKE 'journal%';", journals);
+        list<string> queries;
+        for (size_t i = 0; i < journals.size(); i++) {
+            queries.push_back("SELECT hash FROM " + journals[i][0] + " WHERE id = " + to_string(commitCount));
+        }
+        return node.readDB(SComposeList(queries, " UNION ") + ";");
+    }
+
+    void mixedPeers() {
+        ASSERT_TRUE(tester->getTester(0).waitForStates({"LEADING", "MASTERING"}));
+        ASSERT_TRUE(tester->getTester(1).waitForStates({"FOLLOWING", "SLAVING"}));
+        ASSERT_TRUE(tester->getTester(2).waitForStates({"FOLLOWING", "SLAVING"}));
+
+        // Only the follower that's batching says so.
+        ASSERT_EQUAL(tester->getTester(0).getPeerInfo("cluster_node_1")["BatchTransactions"], "true");
+        ASSERT_EQUAL(tester->getTester(0).getPeerInfo("cluster_node_2")["BatchTransactions"], "");
+
+        // Commit on several connections at once, so that the leader has more than one commit to send at a time.
+        ASSERT_TRUE(tester->getTester(0).insertRows(10'000, 1000));
+        ASSERT_TRUE(tester->getTester(1).waitForRows(10'000, 1000));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(10'000, 1000));
+
+        // Both followers end up with the same commits as leader, whichever way they got them.
+        uint64_t commitCount = SToUInt64(tester->getTester(0).executeWaitVerifyContentTable(SData("Status"))
+                                         ["CommitCount"]);
+        string hash = getCommitHash(tester->getTester(0), commitCount);
+        ASSERT_FALSE(hash.empty());
+        for (size_t i : {1, 2}) {
+            STable status = tester->getTester(i).executeWaitVerifyContentTable(SData("Status"));
+            ASSERT_EQUAL(SToUInt64(status["CommitCount"]), commitCount);
+            ASSERT_EQUAL(getCommitHash(tester->getTester(i), commitCount), hash);
+        }
+    }
+} __BatchReplicationTest;
@@ -0,0 +1,51 @@
+#include "../BedrockClusterTester.h"
+
+struct CompressionTest : tpunit::TestFixture {
+    CompressionTest()
+        : tpunit::TestFixture("Compression",
+                              BEFORE_CLASS(CompressionTest::setup),
+                              AFTER_CLASS(CompressionTest::teardown),
+                              TEST(CompressionTest::replicate),
+                              TEST(CompressionTest::synchronize)
+                             ) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0, {{"-compressReplication", ""}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    void replicate() {
+        ASSERT_TRUE(tester->getTester(0).waitForStates({"LEADING", "MASTERING"}));
+        ASSERT_TRUE(tester->getTester(0).insertRows(10'000, 50, 4096));
+        ASSERT_TRUE(tester->getTester(1).waitForRows(10'000, 50));
+
+        // Leader compressed what it sent, and the follower decompressed what it received.
+        STable leaderInfo = tester->getTester(0).getPeerInfo("cluster_node_1");
+        ASSERT_GREATER_THAN(SToUInt64(leaderInfo["BytesAfterCompression"]), 0);
+        ASSERT_GREATER_THAN(stod(leaderInfo["CompressionRatio"]), 1.0);
+        STable followerInfo = tester->getTester(1).getPeerInfo("cluster_node_0");
+        ASSERT_GREATER_THAN(SToUInt64(followerInfo["BytesBeforeDecompression"]), 0);
+    }
+
+    void synchronize() {
+        // Stop a follower, and make some commits for it to miss.
+        tester->stopNode(2);
+        ASSERT_TRUE(tester->getTester(0).insertRows(20'000, 50, 4096));
+
+        // When it comes back, it catches up from compressed SYNCHRONIZE_RESPONSEs.
+        tester->startNode(2);
+        ASSERT_TRUE(tester->getTester(2).waitForStates({"FOLLOWING", "SLAVING"}));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(20'000, 50));
+        uint64_t compressedBytesReceived = 0;
+        for (const char* peerName : {"cluster_node_0", "cluster_node_1"}) {
+            STable peerInfo = tester->getTester(2).getPeerInfo(peerName);
+            compressedBytesReceived += SToUInt64(peerInfo["BytesBeforeDecompression"]);
+        }
+        ASSERT_GREATER_THAN(compressedBytesReceived, 0);
+    }
+} __CompressionTest;
@@ -27,6 +27,7 @@ struct JobIDTest : tpunit::TestFixture {
         SData createCmd("CreateJob");
         createCmd["name"] = "TestJob";
         STable response = leader.executeWaitVerifyContentTable(createCmd);
+        set<string> jobIDs = {response["jobID"]};
 
         // Restart follower. This is a regression test, before we only re-initialized the lastID if it was !=0 which made
         // these tests pass (because the first ID is 0) but fail in the real life. So here we make sure that when a follower
@@ -57,6 +58,7 @@ struct JobIDTest : tpunit::TestFixture {
 
         // Create a job in the follower
         response = follower.executeWaitVerifyContentTable(createCmd, "200");
+        jobIDs.insert(response["jobID"]);
 
         // Restart leader
         tester->startNode(0);
@@ -78,12 +80,17 @@ struct JobIDTest : tpunit::TestFixture {
 
         // Create a new job in leader.
         response = leader.executeWaitVerifyContentTable(createCmd);
+        jobIDs.insert(response["jobID"]);
+
+        // Each leader allocated its IDs from a different block, so they should all be different.
+        ASSERT_EQUAL(jobIDs.size(), 3);
 
         // Get the 3 jobs to leave the db clean
         SData getCmd("GetJobs");
         getCmd["name"] = "*";
         getCmd["numResults"] = 3;
-        follower.executeWaitVerifyContentTable(getCmd, "200");
+        response = follower.executeWaitVerifyContentTable(getCmd, "200");
+        ASSERT_EQUAL(SParseJSONArray(response["jobs"]).size(), 3);
     }
 
 } __JobIDTest;
@@ -0,0 +1,156 @@
+#include "../BedrockClusterTester.h"
+
+struct PipelinedQuorumTest : tpunit::TestFixture {
+    PipelinedQuorumTest()
+        : tpunit::TestFixture("PipelinedQuorum",
+                              BEFORE_CLASS(PipelinedQuorumTest::setup),
+                              AFTER_CLASS(PipelinedQuorumTest::teardown),
+                              TEST(PipelinedQuorumTest::pipelined),
+                              TEST(PipelinedQuorumTest::followerFailover),
+                              TEST(PipelinedQuorumTest::leaderFailover),
+                              TEST(PipelinedQuorumTest::leaderCrash)
+                             ) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0, {{"-quorumWindow", "8"}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    // Returns `count` QUORUM commands, each inserting its own row into `test`, starting with ID `firstID`.
+    vector<SData> createInserts(int firstID, int count) {
+        vector<SData> requests(count);
+        for (int i = 0; i < count; i++) {
+            requests[i].methodLine = "Query";
+            requests[i]["writeConsistency"] = "QUORUM";
+            requests[i]["query"] = "INSERT INTO test VALUES(" + to_string(firstID + i) + ", 'pipelined');";
+        }
+        return requests;
+    }
+
+    // Returns the IDs in [firstID, firstID + count) that exist in the given node's `test` table.
+    set<int> getIDs(BedrockTester& node, int firstID, int count) {
+        SData query("Query");
+        query["query"] = "SELECT id FROM test WHERE id >= " + to_string(firstID) + " AND id < "
+                         + to_string(firstID + count) + ";";
+        list<string> lines = SParseList(node.executeWaitVerifyContent(query), '\n');
+        lines.pop_front();
+        set<int> ids;
+        for (const string& line : lines) {
+            ids.insert(SToInt(line));
+        }
+        return ids;
+    }
+
+    void pipelined() {
+        ASSERT_TRUE(tester->getTester(0).waitForStates({"LEADING", "MASTERING"}));
+
+        // Send enough QUORUM commands at once to keep the window full.
+        const int firstID = 100'000;
+        const int count = 500;
+        vector<SData> results = tester->getTester(0).executeWaitMultipleData(createInserts(firstID, count), 20);
+        ASSERT_EQUAL(results.size(), count);
+        for (auto& result : results) {
+            ASSERT_TRUE(SStartsWith(result.methodLine, "200"));
+        }
+
+        // Every follower has every row.
+        ASSERT_EQUAL(getIDs(tester->getTester(0), firstID, count).size(), count);
+        ASSERT_TRUE(tester->getTester(1).waitForRows(firstID, count));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(firstID, count));
+    }
+
+    // Losing one follower mid-window still leaves a quorum, so every command should still succeed.
+    void followerFailover() {
+        const int firstID = 200'000;
+        const int count = 1000;
+        vector<SData> results;
+        thread sender([&]() {
+            results = tester->getTester(0).executeWaitMultipleData(createInserts(firstID, count), 20);
+        });
+        usleep(200'000);
+        tester->stopNode(2);
+        sender.join();
+
+        ASSERT_EQUAL(results.size(), count);
+        for (auto& result : results) {
+            ASSERT_TRUE(SStartsWith(result.methodLine, "200"));
+        }
+        ASSERT_EQUAL(getIDs(tester->getTester(0), firstID, count).size(), count);
+        ASSERT_TRUE(tester->getTester(1).waitForRows(firstID, count));
+
+        // When the follower comes back, it catches up on everything it missed.
+        tester->startNode(2);
+        ASSERT_TRUE(tester->getTester(2).waitForStates({"FOLLOWING", "SLAVING"}));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(firstID, count));
+    }
+
+    // When the leader shuts down mid-window, every command it reported as successful must have reached the new leader.
+    void leaderFailover() {
+        const int firstID = 300'000;
+        const int count = 1000;
+        vector<SData> results;
+        thread sender([&]() {
+            results = tester->getTester(0).executeWaitMultipleData(createInserts(firstID, count), 20, false, true);
+        });
+        usleep(200'000);
+        tester->stopNode(0);
+        sender.join();
+        ASSERT_TRUE(tester->getTester(1).waitForStates({"LEADING", "MASTERING"}));
+
+        set<int> acknowledgedIDs;
+        for (size_t i = 0; i < results.size(); i++) {
+            if (SStartsWith(results[i].methodLine, "200")) {
+                acknowledgedIDs.insert(firstID + (int)i);
+            }
+        }
+        ASSERT_TRUE(acknowledgedIDs.size());
+        set<int> newLeaderIDs = getIDs(tester->getTester(1), firstID, count);
+        ASSERT_TRUE(includes(newLeaderIDs.begin(), newLeaderIDs.end(), acknowledgedIDs.begin(), acknowledgedIDs.end()));
+
+        // And the old leader can rejoin and take back over.
+        tester->startNode(0);
+        ASSERT_TRUE(tester->getTester(0).waitForStates({"LEADING", "MASTERING"}));
+    }
+
+    // A leader that's killed doesn't get to drain its window, so it can come back with commits that nobody else has.
+    void leaderCrash() {
+        const int firstID = 400'000;
+        const int count = 1000;
+        vector<SData> results;
+        thread sender([&]() {
+            results = tester->getTester(0).executeWaitMultipleData(createInserts(firstID, count), 20, false, true);
+        });
+        usleep(200'000);
+        tester->stopNode(0, SIGKILL);
+        sender.join();
+        ASSERT_TRUE(tester->getTester(1).waitForStates({"LEADING", "MASTERING"}));
+
+        // Every command it reported as successful still reached the new leader.
+        set<int> acknowledgedIDs;
+        for (size_t i = 0; i < results.size(); i++) {
+            if (SStartsWith(results[i].methodLine, "200")) {
+                acknowledgedIDs.insert(firstID + (int)i);
+            }
+        }
+        ASSERT_TRUE(acknowledgedIDs.size());
+        set<int> newLeaderIDs = getIDs(tester->getTester(1), firstID, count);
+        ASSERT_TRUE(includes(newLeaderIDs.begin(), newLeaderIDs.end(), acknowledgedIDs.begin(), acknowledgedIDs.end()));
+
+        // The new leader commits over whatever the old one had in flight.
+        for (auto& result : tester->getTester(1).executeWaitMultipleData(createInserts(firstID + count, 20))) {
+            ASSERT_TRUE(SStartsWith(result.methodLine, "200"));
+        }
+        newLeaderIDs = getIDs(tester->getTester(1), firstID, count + 20);
+
+        // The old leader still rejoins, discarding its own commits for the cluster's, and takes back over.
+        tester->startNode(0);
+        ASSERT_TRUE(tester->getTester(0).waitForStates({"LEADING", "MASTERING"}));
+        ASSERT_EQUAL(getIDs(tester->getTester(0), firstID, count + 20), newLeaderIDs);
+        ASSERT_TRUE(tester->getTester(2).waitForRows(newLeaderIDs));
+    }
+} __PipelinedQuorumTest;
@@ -0,0 +1,42 @@
+#include "../BedrockClusterTester.h"
+
+struct SnapshotTest : tpunit::TestFixture {
+    SnapshotTest()
+        : tpunit::TestFixture("Snapshot",
+                              BEFORE_CLASS(SnapshotTest::setup),
+                              AFTER_CLASS(SnapshotTest::teardown),
+                              TEST(SnapshotTest::catchUp)
+                             ) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0, {{"-maxJournalSize", "100"}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    void catchUp() {
+        ASSERT_TRUE(tester->getTester(0).waitForStates({"LEADING", "MASTERING"}));
+        ASSERT_TRUE(tester->getTester(2).waitForStates({"FOLLOWING", "SLAVING"}));
+        STable status = SParseJSONObject(tester->getTester(2).executeWaitVerifyContent(SData("Status")));
+        uint64_t commitCount = SToUInt64(status["CommitCount"]);
+
+        // Stop a follower, and make enough commits while it's down that the ones it needs are trimmed from the
+        // journals of the other nodes.
+        tester->stopNode(2);
+        ASSERT_TRUE(tester->getTester(0).insertRows(10'000, 500));
+        ASSERT_GREATER_THAN(SToUInt64(tester->getTester(1).readDB("SELECT MIN(id) FROM journal;")), commitCount);
+
+        // When it comes back, it can only catch up from a snapshot.
+        tester->startNode(2);
+        ASSERT_TRUE(tester->getTester(2).waitForStates({"FOLLOWING", "SLAVING"}));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(10'000, 500));
+
+        // And it carries on replicating normally afterwards.
+        ASSERT_TRUE(tester->getTester(0).insertRows(20'000, 10));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(20'000, 10));
+    }
+} __SnapshotTest;
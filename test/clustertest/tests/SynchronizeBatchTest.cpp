@@ -0,0 +1,56 @@
+#include "../BedrockClusterTester.h"
+
+struct SynchronizeBatchTest : tpunit::TestFixture {
+    SynchronizeBatchTest()
+        : tpunit::TestFixture("SynchronizeBatch",
+                              BEFORE_CLASS(SynchronizeBatchTest::setup),
+                              AFTER_CLASS(SynchronizeBatchTest::teardown),
+                              TEST(SynchronizeBatchTest::smallBatches)
+                             ) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        // Small enough that catching up takes many batches.
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0, {{"-synchronizeBatchBytes", "4096"}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    void smallBatches() {
+        ASSERT_TRUE(tester->getTester(0).waitForStates({"LEADING", "MASTERING"}));
+
+        // Stop a follower, and make some commits for it to miss, some of them bigger than a whole batch.
+        tester->stopNode(2);
+        ASSERT_TRUE(tester->getTester(0).insertRows(10'000, 200, 100));
+        ASSERT_TRUE(tester->getTester(0).insertRows(20'000, 5, 10'000));
+        ASSERT_TRUE(tester->getTester(0).insertRows(30'000, 200, 100));
+
+        // When it comes back, it catches up one batch at a time, and ends up with everything.
+        tester->startNode(2);
+        ASSERT_TRUE(tester->getTester(2).waitForStates({"FOLLOWING", "SLAVING"}));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(10'000, 200));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(20'000, 5));
+        ASSERT_TRUE(tester->getTester(2).waitForRows(30'000, 200));
+        ASSERT_EQUAL(tester->getTester(2).readDB("SELECT COUNT(*) FROM test;"),
+                     tester->getTester(0).readDB("SELECT COUNT(*) FROM test;"));
+
+        // The ~90KB it missed would fit in a single default-sized batch, so it must have come in many small ones, none
+        // more than one commit past the 4KB we asked for. And it should have asked for most of them before it had
+        // finished committing the one before.
+        uint64_t responses = 0;
+        uint64_t prefetches = 0;
+        uint64_t largestResponse = 0;
+        for (const char* peerName : {"cluster_node_0", "cluster_node_1"}) {
+            STable peerInfo = tester->getTester(2).getPeerInfo(peerName);
+            responses += SToUInt64(peerInfo["SynchronizeResponses"]);
+            prefetches += SToUInt64(peerInfo["SynchronizePrefetches"]);
+            largestResponse = max(largestResponse, SToUInt64(peerInfo["SynchronizeLargestResponse"]));
+        }
+        ASSERT_GREATER_THAN(responses, 10);
+        ASSERT_LESS_THAN(largestResponse, 4096 + 12'000);
+        ASSERT_GREATER_THAN(prefetches, responses / 2);
+    }
+} __SynchronizeBatchTest;
@@ -162,6 +162,10 @@ BedrockTester::~BedrockTester() {
     }
 }
 
+void BedrockTester::setArg(const string& name, const string& value) {
+    _args[name] = value;
+}
+
 string BedrockTester::startServer(bool dontWait) {
     string serverName = getServerName();
     int childPID = fork();
@@ -378,8 +382,9 @@ vector<SData> BedrockTester::executeWaitMultipleData(vector<SData> requests, int
                     }
 
                     // Send until there's nothing left in the buffer.
-                    string sendBuffer = myRequest.serialize();
-                    while (sendBuffer.size()) {
+                    SSendBuffer sendBuffer;
+                    sendBuffer.append(myRequest.serialize());
+                    while (!sendBuffer.empty()) {
                         bool result = S_sendconsume(socket, sendBuffer);
                         if (!result) {
                             cout << "Failed to send! Probably disconnected. Should we reconnect?" << endl;
@@ -555,6 +560,60 @@ bool BedrockTester::waitForStates(set<string> states, uint64_t timeoutUS)
     return false;
 }
 
+bool BedrockTester::insertRows(int firstID, int count, size_t valueSize) {
+    vector<SData> requests(count);
+    for (int i = 0; i < count; i++) {
+        requests[i].methodLine = "Query";
+        requests[i]["writeConsistency"] = "ASYNC";
+        requests[i]["query"] = "INSERT INTO test VALUES(" + to_string(firstID + i) + ", '" + string(valueSize, 'x')
+                               + "');";
+    }
+    for (auto& result : executeWaitMultipleData(requests)) {
+        if (!SStartsWith(result.methodLine, "200")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BedrockTester::waitForRows(int firstID, int count, uint64_t timeoutUS) {
+    return _waitForRowCount("id >= " + to_string(firstID) + " AND id < " + to_string(firstID + count), count,
+                            timeoutUS);
+}
+
+bool BedrockTester::waitForRows(const set<int>& ids, uint64_t timeoutUS) {
+    return _waitForRowCount("id IN (" + SQList(ids) + ")", ids.size(), timeoutUS);
+}
+
+bool BedrockTester::_waitForRowCount(const string& where, size_t count, uint64_t timeoutUS) {
+    SData query("Query");
+    query["query"] = "SELECT COUNT(*) FROM test WHERE " + where + ";";
+    uint64_t start = STimeNow();
+    while (STimeNow() < start + timeoutUS) {
+        try {
+            list<string> lines = SParseList(executeWaitVerifyContent(query), '\n');
+            if (lines.size() == 2 && SToUInt64(lines.back()) == count) {
+                return true;
+            }
+        } catch (...) {
+            // Doesn't do anything, we'll fall through to the sleep and try again.
+        }
+        usleep(100'000);
+    }
+    return false;
+}
+
+STable BedrockTester::getPeerInfo(const string& peerName) {
+    STable json = SParseJSONObject(executeWaitVerifyContent(SData("Status")));
+    for (const string& peer : SParseJSONArray(json["peerList"])) {
+        STable peerInfo = SParseJSONObject(peer);
+        if (peerInfo["name"] == peerName) {
+            return peerInfo;
+        }
+    }
+    return STable();
+}
+
 int BedrockTester::waitForPort(int port) {
     int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     int i = 1;
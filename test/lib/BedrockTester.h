@@ -86,6 +86,10 @@ class BedrockTester {
                   bool ownPorts = true);
     ~BedrockTester();
 
+    // Sets an argument to start the server with, taking effect the next time it's started. An empty value passes just
+    // the name.
+    void setArg(const string& name, const string& value);
+
     // Start and stop the bedrock server. If `dontWait` is specified, return as soon as the control port, rather that
     // the cmmand port, is ready.
     string startServer(bool dontWait = false);
@@ -123,11 +127,29 @@ class BedrockTester {
     // Like `waitForState` but wait for any of a set of states.
     bool waitForStates(set<string> states, uint64_t timeoutUS = 60'000'000);
 
+    // Inserts `count` rows into `test`, each in its own ASYNC commit, with IDs starting at `firstID` and values of
+    // `valueSize` bytes. Returns whether every insert succeeded.
+    bool insertRows(int firstID, int count, size_t valueSize = 16);
+
+    // Waits up to timeoutUS for all `count` rows starting at `firstID` to be in `test`, returning true as soon as they
+    // are, or false if the timeout is hit.
+    bool waitForRows(int firstID, int count, uint64_t timeoutUS = 10'000'000);
+
+    // Like `waitForRows` but waits for each row with an ID in `ids`, which don't have to be contiguous.
+    bool waitForRows(const set<int>& ids, uint64_t timeoutUS = 10'000'000);
+
+    // Returns the `Status` peer info this node has for the peer with the given name, or an empty table if it has no
+    // such peer.
+    STable getPeerInfo(const string& peerName);
+
     // Waits for a particular port to be free to bind to. This is useful when we've killed a server, because sometimes
     // it takes the OS a few seconds to make the port available again.
     static int waitForPort(int port);
 
   protected:
+    // Waits up to timeoutUS for `count` rows in `test` to match `where`, returning whether they do.
+    bool _waitForRowCount(const string& where, size_t count, uint64_t timeoutUS);
+
     // Args passed on creation, which will be used to start the server if the `start` flag is set, or if `startServer`
     // is called later on with an empty args list.
     map<string, string> _args;
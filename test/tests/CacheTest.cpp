@@ -0,0 +1,147 @@
+#include <test/lib/BedrockTester.h>
+
+struct CacheTest : tpunit::TestFixture {
+    CacheTest()
+        : tpunit::TestFixture("Cache",
+                              BEFORE_CLASS(CacheTest::setupClass),
+                              TEST(CacheTest::readFromMemory),
+                              TEST(CacheTest::overwrite),
+                              TEST(CacheTest::invalidateName),
+                              TEST(CacheTest::queryWrite),
+                              TEST(CacheTest::multiWrite),
+                              TEST(CacheTest::multiRead),
+                              TEST(CacheTest::evictLeastRecentlyUsed),
+                              AFTER_CLASS(CacheTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() {
+        tester = new BedrockTester(_threadID,
+                                   {{"-plugins", "Cache,DB"}, {"-cache.max", "100"}, {"-cache.memoryMax", "1MB"}}, {});
+    }
+
+    void tearDownClass() { delete tester; }
+
+    void writeCache(const string& name, const string& value, const string& invalidateName = "") {
+        SData command("WriteCache");
+        command["name"] = name;
+        command["value"] = value;
+        if (!invalidateName.empty()) {
+            command["invalidateName"] = invalidateName;
+        }
+        tester->executeWaitVerifyContent(command);
+    }
+
+    string readCache(const string& name, const string& expectedResult = "200") {
+        SData command("ReadCache");
+        command["name"] = name;
+        return tester->executeWaitVerifyContent(command, expectedResult);
+    }
+
+    // Returns the Cache plugin's info from Status.
+    STable getInfo() {
+        STable status = tester->executeWaitVerifyContentTable(SData("Status"));
+        for (const string& plugin : SParseJSONArray(status["plugins"])) {
+            STable info = SParseJSONObject(plugin);
+            if (info["name"] == "Cache") {
+                return info;
+            }
+        }
+        return STable();
+    }
+
+    void readFromMemory() {
+        writeCache("memory", "value");
+        uint64_t hits = SToUInt64(getInfo()["memoryCacheHits"]);
+
+        // The first read loads the value into memory, and the second finds it there.
+        ASSERT_EQUAL(readCache("memory"), "value");
+        ASSERT_EQUAL(readCache("memory"), "value");
+        STable info = getInfo();
+        ASSERT_EQUAL(SToUInt64(info["memoryCacheHits"]), hits + 1);
+        ASSERT_GREATER_THAN_EQUAL(SToInt64(info["memoryCacheEntries"]), 1);
+        ASSERT_EQUAL(info["memoryCacheMaxSize"], to_string(1024 * 1024));
+    }
+
+    void overwrite() {
+        writeCache("overwrite", "1");
+        ASSERT_EQUAL(readCache("overwrite"), "1");
+        writeCache("overwrite", "2");
+        ASSERT_EQUAL(readCache("overwrite"), "2");
+        ASSERT_EQUAL(readCache("overwrite"), "2");
+    }
+
+    void invalidateName() {
+        writeCache("version_1", "1");
+        ASSERT_EQUAL(readCache("version_1"), "1");
+        writeCache("version_2", "2", "version_*");
+        readCache("version_1", "404 No match found");
+        ASSERT_EQUAL(readCache("version_*"), "2");
+    }
+
+    // Rows changed by other commands are dropped from memory too.
+    void queryWrite() {
+        writeCache("query", "before");
+        ASSERT_EQUAL(readCache("query"), "before");
+        SData command("Query");
+        command["query"] = "UPDATE cache SET value = 'after' WHERE name = 'query';";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(readCache("query"), "after");
+    }
+
+    void multiWrite() {
+        writeCache("multi_old", "old");
+        SData command("MultiWriteCache");
+        command["names"] = SComposeJSONArray(list<string>{"multi_a", "multi_b"});
+        command["lengths"] = "[3, 5]";
+        command["invalidateName"] = "multi_*";
+        command.content = "abcdefgh";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(readCache("multi_a"), "abc");
+        ASSERT_EQUAL(readCache("multi_b"), "defgh");
+        readCache("multi_old", "404 No match found");
+
+        // The lengths have to add up to the content.
+        command["lengths"] = "[3, 4]";
+        tester->executeWaitVerifyContent(command, "402 Malformed lengths");
+        command["lengths"] = "[3]";
+        tester->executeWaitVerifyContent(command, "402 Malformed lengths");
+
+        // And each name can only be written once.
+        command["names"] = SComposeJSONArray(list<string>{"multi_a", "multi_a"});
+        command["lengths"] = "[3, 5]";
+        tester->executeWaitVerifyContent(command, "402 Duplicate names");
+    }
+
+    void multiRead() {
+        SData command("MultiReadCache");
+        command["names"] = SComposeJSONArray(list<string>{"multi_b", "missing", "multi_a*", "multi_b"});
+        SData response = tester->executeWaitMultipleData({command})[0];
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+
+        // Each name gets a result, in order, with the values one after the other.
+        list<string> names = SParseJSONArray(response["names"]);
+        ASSERT_EQUAL(SComposeList(names), "multi_b, , multi_a, multi_b");
+        list<string> lengths = SParseJSONArray(response["lengths"]);
+        ASSERT_EQUAL(SComposeList(lengths), "5, 0, 3, 5");
+        ASSERT_EQUAL(response.content, "defghabcdefgh");
+
+        command["names"] = "[]";
+        tester->executeWaitVerifyContent(command, "402 Missing names");
+    }
+
+    void evictLeastRecentlyUsed() {
+        // Each of these is 40 bytes, so there's only room for two of them.
+        const string value(40, 'x');
+        writeCache("evict_a", value);
+        writeCache("evict_b", value);
+
+        // Reading `evict_a` makes `evict_b` the least recently used, as well as everything the other tests wrote.
+        readCache("evict_a");
+        writeCache("evict_c", value);
+        readCache("evict_b", "404 No match found");
+        ASSERT_EQUAL(readCache("evict_a"), value);
+        ASSERT_EQUAL(readCache("evict_c"), value);
+        ASSERT_EQUAL(tester->readDB("SELECT SUM(LENGTH(value)) FROM cache;"), "80");
+    }
+} __CacheTest;
@@ -0,0 +1,45 @@
+#include <test/lib/BedrockTester.h>
+
+struct IOThreadsTest : tpunit::TestFixture {
+    IOThreadsTest()
+        : tpunit::TestFixture("IOThreads",
+                              BEFORE_CLASS(IOThreadsTest::setup),
+                              TEST(IOThreadsTest::manyConnections),
+                              TEST(IOThreadsTest::sequentialRequests),
+                              AFTER_CLASS(IOThreadsTest::tearDown)) { }
+
+    BedrockTester* tester;
+
+    void setup() { tester = new BedrockTester(_threadID, {{"-ioThreads", "3"}}); }
+
+    void tearDown() { delete tester; }
+
+    void manyConnections() {
+        // Spread requests across enough connections that every reactor gets some.
+        vector<SData> requests;
+        for (int i = 0; i < 100; i++) {
+            SData query("Query");
+            query["query"] = "SELECT " + to_string(i) + ";";
+            requests.push_back(query);
+        }
+        auto results = tester->executeWaitMultipleData(requests, 10);
+        ASSERT_EQUAL(results.size(), requests.size());
+        for (size_t i = 0; i < results.size(); i++) {
+            ASSERT_TRUE(SStartsWith(results[i].methodLine, "200"));
+            ASSERT_EQUAL(SToInt(results[i].content), (int)i);
+        }
+    }
+
+    void sequentialRequests() {
+        // Status commands are handled directly by the reactor that reads them, and Connection: close shuts the socket
+        // down from whichever thread replies.
+        for (int i = 0; i < 10; i++) {
+            SData status("Status");
+            if (i % 2) {
+                status["Connection"] = "close";
+            }
+            tester->executeWaitVerifyContent(status);
+        }
+    }
+
+} __IOThreadsTest;
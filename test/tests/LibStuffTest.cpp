@@ -1,4 +1,6 @@
 #include <libstuff/libstuff.h>
+#include <libstuff/SShardedScheduledPriorityQueue.h>
+#include <libstuff/STimerWheel.h>
 #include <test/lib/BedrockTester.h>
 
 struct LibStuff : tpunit::TestFixture {
@@ -24,7 +26,13 @@ struct LibStuff : tpunit::TestFixture {
                                     TEST(LibStuff::testRandom),
                                     TEST(LibStuff::testHexConversion),
                                     TEST(LibStuff::testBase32Conversion),
-                                    TEST(LibStuff::testContains))
+                                    TEST(LibStuff::testContains),
+                                    TEST(LibStuff::testShardedScheduledPriorityQueue),
+                                    TEST(LibStuff::testTimerWheel),
+                                    TEST(LibStuff::testEventLoop),
+                                    TEST(LibStuff::testFastBuffer),
+                                    TEST(LibStuff::testHTTPView),
+                                    TEST(LibStuff::testSendBuffer))
     { }
 
     void testEncryptDecrpyt() {
@@ -396,6 +404,37 @@ struct LibStuff : tpunit::TestFixture {
         ASSERT_EQUAL(test["i"], "string");
         ASSERT_EQUAL(test["j"], "true");
         ASSERT_EQUAL(test["k"], "false");
+
+        // Names are case-insensitive, and iterated in order ignoring case, including once the table is large enough to
+        // be binary searched.
+        STable headers;
+        headers["Content-Length"] = 10;
+        headers["content-length"] = 20;
+        headers["ZEBRA"] = "z";
+        headers["apple"] = "a";
+        headers["Mango"] = "m";
+        ASSERT_EQUAL(headers.size(), 4);
+        ASSERT_EQUAL(headers.begin()->first, "apple");
+        ASSERT_EQUAL(headers.find("CONTENT-LENGTH")->second, "20");
+        ASSERT_EQUAL(headers.find("Content-Length")->first, "Content-Length");
+        ASSERT_TRUE(headers.find("missing") == headers.end());
+        SString& mango = headers["mango"];
+        for (int i = 0; i < 100; i++) {
+            headers["header" + to_string(i)] = i;
+        }
+        ASSERT_EQUAL(&mango, &headers["MANGO"]);
+        ASSERT_EQUAL(headers["HEADER42"], "42");
+        ASSERT_EQUAL(headers.erase("Header42"), 1);
+        ASSERT_EQUAL(headers.count("header42"), 0);
+        string previous;
+        for (const auto& entry : headers) {
+            ASSERT_TRUE(previous.empty() || STableComp()(previous, entry.first));
+            previous = entry.first;
+        }
+        STable copy = headers;
+        ASSERT_TRUE(copy == headers);
+        copy["apple"] = "b";
+        ASSERT_TRUE(copy != headers);
     }
 
     void testFileIO() {
@@ -588,4 +627,323 @@ struct LibStuff : tpunit::TestFixture {
         ASSERT_TRUE(SContains(string("asdf"), "a"));
         ASSERT_TRUE(SContains(string("asdf"), string("asd")));
     }
+
+    void testShardedScheduledPriorityQueue() {
+        // With a single shard, ordering is exactly that of SScheduledPriorityQueue.
+        uint64_t now = STimeNow();
+        uint64_t never = now + 3600 * 1000000ull;
+        SShardedScheduledPriorityQueue<string> queue([](string&){}, [](string&){}, 1);
+        queue.push("low", 250, now, never);
+        queue.push("high-later", 750, now - 10, never);
+        queue.push("high", 750, now - 20, never);
+        queue.push("future", 1000, now + 3600 * 1000000ull, never);
+        queue.push("timedOut", 0, now + 3600 * 1000000ull, now - 1);
+        ASSERT_EQUAL(queue.size(), 5);
+        ASSERT_EQUAL(queue.get(), "timedOut");
+        ASSERT_EQUAL(queue.get(), "high");
+        ASSERT_EQUAL(queue.get(), "high-later");
+        ASSERT_EQUAL(queue.get(), "low");
+        ASSERT_EQUAL(queue.size(), 1);
+
+        // The only thing left is scheduled in the future, so waiting for it times out.
+        bool threw = false;
+        try {
+            queue.get(1000);
+        } catch (const SShardedScheduledPriorityQueue<string>::timeout_error& e) {
+            threw = true;
+        }
+        ASSERT_TRUE(threw);
+        queue.clear();
+        ASSERT_TRUE(queue.empty());
+
+        // With several shards and several threads, everything pushed comes out exactly once.
+        SShardedScheduledPriorityQueue<string> shardedQueue([](string&){}, [](string&){}, 4);
+        const int threadCount = 4;
+        const int perThread = 1000;
+        atomic<int> received(0);
+        mutex seenMutex;
+        set<string> seen;
+        list<thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&, t]() {
+                for (int i = 0; i < perThread; i++) {
+                    shardedQueue.push(to_string(t) + ":" + to_string(i), i % 3, 0, never);
+                }
+            });
+            threads.emplace_back([&]() {
+                while (received.load() < threadCount * perThread) {
+                    try {
+                        string item = shardedQueue.get(10000);
+                        received++;
+                        lock_guard<mutex> lock(seenMutex);
+                        seen.insert(item);
+                    } catch (const SShardedScheduledPriorityQueue<string>::timeout_error& e) {
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        ASSERT_EQUAL(seen.size(), threadCount * perThread);
+        ASSERT_TRUE(shardedQueue.empty());
+    }
+
+    void testTimerWheel() {
+        // Use a fixed start time and 1ms resolution.
+        uint64_t start = 1'000'000'000'000'000;
+        STimerWheel<string> wheel(1000, start);
+        wheel.insert(start + 5'000, "5ms");
+        uint64_t cancelled = wheel.insert(start + 2'000, "cancelled");
+        wheel.insert(start + 2'000, "2ms");
+        wheel.insert(start + 3'600'000'000, "1h");
+        wheel.insert(start + 90'000, "90ms");
+        wheel.insert(start - 1, "past");
+        ASSERT_EQUAL(wheel.size(), 6);
+        ASSERT_TRUE(wheel.cancel(cancelled));
+        ASSERT_FALSE(wheel.cancel(cancelled));
+
+        // Anything already expired comes out straight away.
+        string value;
+        ASSERT_EQUAL(wheel.nextExpiration(), start - 1);
+        ASSERT_TRUE(wheel.popExpired(start, value));
+        ASSERT_EQUAL(value, "past");
+        ASSERT_FALSE(wheel.popExpired(start, value));
+        ASSERT_EQUAL(wheel.nextExpiration(), start + 2'000);
+
+        // Items expire at exactly their expiration time, not just at the end of their tick.
+        ASSERT_FALSE(wheel.popExpired(start + 1'999, value));
+        ASSERT_TRUE(wheel.popExpired(start + 2'000, value));
+        ASSERT_EQUAL(value, "2ms");
+
+        // Jumping a long way ahead returns everything in order.
+        ASSERT_NOT_EQUAL(wheel.peekExpired(start + 100'000), nullptr);
+        ASSERT_EQUAL(*wheel.peekExpired(start + 100'000), "5ms");
+        ASSERT_TRUE(wheel.popExpired(start + 100'000, value));
+        ASSERT_EQUAL(value, "5ms");
+        ASSERT_TRUE(wheel.popExpired(start + 100'000, value));
+        ASSERT_EQUAL(value, "90ms");
+        ASSERT_FALSE(wheel.popExpired(start + 100'000, value));
+        ASSERT_EQUAL(wheel.nextExpiration(), start + 3'600'000'000);
+        ASSERT_TRUE(wheel.popExpired(start + 7'200'000'000, value));
+        ASSERT_EQUAL(value, "1h");
+        ASSERT_TRUE(wheel.empty());
+
+        // Lots of random timeouts, checked against a multimap.
+        multimap<uint64_t, uint64_t> expected;
+        mt19937_64 generator(1);
+        uint64_t now = start;
+        for (int i = 0; i < 10000; i++) {
+            uint64_t expiration = now + generator() % 10'000'000;
+            wheel.insert(expiration, to_string(expiration));
+            expected.emplace(expiration, 0);
+        }
+        while (!expected.empty()) {
+            now += generator() % 100'000;
+            while (wheel.popExpired(now, value)) {
+                uint64_t expiration = SToUInt64(value);
+                ASSERT_LESS_THAN_EQUAL(expiration, now);
+                auto it = expected.find(expiration);
+                ASSERT_TRUE(it != expected.end());
+                expected.erase(it);
+            }
+            ASSERT_TRUE(expected.empty() || expected.begin()->first > now);
+            ASSERT_EQUAL(wheel.size(), expected.size());
+        }
+
+        // Something inserted after an item has expired goes after it on the expired list, even if it expires earlier,
+        // and `nextExpiration` still tells us about the one `popExpired` returns first.
+        wheel.insert(now + 500, "first");
+        ASSERT_EQUAL(wheel.nextExpiration(), now + 500);
+        ASSERT_NOT_EQUAL(wheel.peekExpired(now + 1'000), nullptr);
+        wheel.insert(now - 100, "second");
+        ASSERT_EQUAL(wheel.nextExpiration(), now + 500);
+        ASSERT_TRUE(wheel.popExpired(now + 1'000, value));
+        ASSERT_EQUAL(value, "first");
+        ASSERT_EQUAL(wheel.nextExpiration(), now - 100);
+        ASSERT_TRUE(wheel.popExpired(now + 1'000, value));
+        ASSERT_EQUAL(value, "second");
+        ASSERT_TRUE(wheel.empty());
+    }
+
+    void testEventLoop() {
+        // Check both the epoll and poll implementations.
+        for (bool usePoll : {false, true}) {
+            SEventLoop::usePoll = usePoll;
+            fd_map fdm;
+            SEventLoop::usePoll = false;
+            ASSERT_EQUAL(fdm.edgeTriggered(), !usePoll);
+            int fds[2];
+            ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds), 0);
+
+            // Nothing to read yet, so we time out.
+            fdm.set(fds[0], SREADEVTS);
+            ASSERT_EQUAL(fdm.wait(1000), 0);
+            ASSERT_FALSE(fdm.anySet(fds[0], SREADEVTS));
+
+            // Registrations persist between iterations, so we see this without setting it again, and it's reported
+            // until it's read.
+            ASSERT_EQUAL(write(fds[1], "x", 1), 1);
+            ASSERT_EQUAL(fdm.wait(1000), 1);
+            ASSERT_TRUE(fdm.anySet(fds[0], SREADEVTS));
+            ASSERT_EQUAL(fdm.wait(1000), 1);
+            char c;
+            ASSERT_EQUAL(read(fds[0], &c, 1), 1);
+            ASSERT_EQUAL(fdm.wait(1000), 0);
+
+            // Setting a file descriptor again replaces what it was waiting for.
+            fdm.set(fds[0], SWRITEEVTS);
+            ASSERT_EQUAL(fdm.wait(1000), 1);
+            ASSERT_TRUE(fdm.anySet(fds[0], SWRITEEVTS));
+            ASSERT_FALSE(fdm.anySet(fds[0], POLLIN));
+            fdm.set(fds[0], SREADEVTS);
+
+            // Edge-triggered file descriptors are reported to their owner once for each change.
+            if (fdm.edgeTriggered()) {
+                int owner = 0;
+                fdm.set(fds[1], 0, true, &owner, &fds[1]);
+                ASSERT_EQUAL(write(fds[0], "y", 1), 1);
+                fdm.wait(1000);
+                list<void*> ready = fdm.ready(&owner);
+                ASSERT_EQUAL(ready.size(), 1);
+                ASSERT_EQUAL(ready.front(), &fds[1]);
+                ASSERT_TRUE(fdm.anySet(fds[1], POLLIN));
+                fdm.wait(1000);
+                ASSERT_TRUE(fdm.ready(&owner).empty());
+                ASSERT_TRUE(fdm.ready(nullptr).empty());
+            }
+
+            // Once forgotten, closed file descriptors aren't waited on.
+            SEventLoop::forget(fds[0]);
+            SEventLoop::forget(fds[1]);
+            close(fds[0]);
+            close(fds[1]);
+            ASSERT_EQUAL(fdm.wait(1000), 0);
+        }
+    }
+
+    void testFastBuffer() {
+        // Consuming from the front and appending at the back should behave just like a string.
+        SFastBuffer buffer;
+        string expected;
+        for (int i = 0; i < 1000; i++) {
+            buffer += "0123456789";
+            expected += "0123456789";
+            buffer.consumeFront(7);
+            SConsumeFront(expected, 7);
+            ASSERT_EQUAL(buffer.size(), expected.size());
+            ASSERT_EQUAL(buffer.toString(), expected);
+        }
+        buffer.consumeFront(buffer.size());
+        ASSERT_TRUE(buffer.empty());
+
+        // Storage that's been shared isn't modified.
+        buffer = "abc";
+        shared_ptr<const string> storage = buffer.share();
+        buffer.consumeFront(1);
+        buffer += "def";
+        ASSERT_EQUAL(*storage, "abc");
+        ASSERT_EQUAL(buffer.toString(), "bcdef");
+    }
+
+    void testHTTPView() {
+        // Parse several messages out of one buffer, keeping the views after they're consumed.
+        SFastBuffer buffer;
+        for (int i = 0; i < 3; i++) {
+            buffer += "Query\r\n"
+                      "query: SELECT " + to_string(i) + ";\r\n"
+                      "Content-Length: 3\r\n"
+                      "Escaped: a\\nb\r\n"
+                      " continued\r\n"
+                      "\r\n"
+                      "abc";
+        }
+        buffer += "Incomplete\r\n";
+        vector<SHTTPView> views;
+        while (true) {
+            SHTTPView view;
+            int size = view.parse(buffer);
+            if (!size) {
+                break;
+            }
+            SConsumeFront(buffer, size);
+            views.push_back(move(view));
+        }
+        buffer += "\r\n";
+        ASSERT_EQUAL(views.size(), 3);
+        for (size_t i = 0; i < views.size(); i++) {
+            ASSERT_EQUAL(views[i].methodLine, "Query");
+            ASSERT_EQUAL(views[i]["QUERY"], "SELECT " + to_string(i) + ";");
+            ASSERT_EQUAL(views[i]["escaped"], "a\nb continued");
+            ASSERT_EQUAL(views[i].content, "abc");
+            ASSERT_TRUE(views[i].isSet("content-length"));
+            ASSERT_FALSE(views[i].isSet("missing"));
+        }
+        SHTTPView last;
+        ASSERT_EQUAL(last.parse(buffer), (int)buffer.size());
+        ASSERT_EQUAL(last.methodLine, "Incomplete");
+
+        // Repeated headers keep the last value, except Set-Cookie, and chunked content is joined.
+        string message = "Response\r\n"
+                         "Set-Cookie: a\r\n"
+                         "Header: 1\r\n"
+                         "set-cookie: b\r\n"
+                         "header: 2\r\n"
+                         "Transfer-Encoding: chunked\r\n"
+                         "\r\n"
+                         "3\r\n"
+                         "xyz\r\n"
+                         "0\r\n"
+                         "\r\n";
+        SHTTPView view;
+        ASSERT_EQUAL(view.parse(message.c_str(), message.size()), (int)message.size());
+        ASSERT_EQUAL(view.headers.size(), 3);
+        ASSERT_EQUAL(view["Set-Cookie"], string("a") + S_COOKIE_SEPARATOR + "b");
+        ASSERT_EQUAL(view["Header"], "2");
+        ASSERT_EQUAL(view.content, "xyz");
+
+        // A line with no name doesn't change the header before it.
+        message = "Request\r\n"
+                  "Header: 1\r\n"
+                  ": 2\r\n"
+                  "Other: 3\r\n"
+                  "\r\n";
+        SHTTPView unnamed;
+        ASSERT_EQUAL(unnamed.parse(message.c_str(), message.size()), (int)message.size());
+        ASSERT_EQUAL(unnamed.headers.size(), 2);
+        ASSERT_EQUAL(unnamed["Header"], "1");
+        ASSERT_EQUAL(unnamed["Other"], "3");
+    }
+
+    void testSendBuffer() {
+        // Buffers are queued without copying, and sending part of them only moves the offset into the first.
+        SData response("200 OK");
+        response["name"] = "value";
+        response.content = "some content";
+        SSendBuffer buffer;
+        auto buffers = response.serializeBuffers();
+        ASSERT_EQUAL(buffers.size(), 2);
+        for (const auto& part : buffers) {
+            buffer.append(part);
+        }
+        buffer.append(string());
+        buffer.append(string("tail"));
+        string expected = response.serialize() + "tail";
+        ASSERT_EQUAL(buffer.toString(), expected);
+        ASSERT_EQUAL(buffer.size(), expected.size());
+
+        iovec iov[2];
+        ASSERT_EQUAL(buffer.fill(iov, 2), 2);
+        ASSERT_EQUAL(iov[0].iov_base, (void*)buffers[0]->data());
+
+        buffer.consumeFront(buffers[0]->size() + 5);
+        SConsumeFront(expected, buffers[0]->size() + 5);
+        ASSERT_EQUAL(string(buffer.frontData(), buffer.frontSize()), "content");
+        ASSERT_EQUAL(buffer.toString(), expected);
+        ASSERT_EQUAL(buffer.fill(iov, 2), 2);
+        ASSERT_EQUAL(string((char*)iov[1].iov_base, iov[1].iov_len), "tail");
+
+        buffer.consumeFront(buffer.size());
+        ASSERT_TRUE(buffer.empty());
+    }
 } __LibStuff;
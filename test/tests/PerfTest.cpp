@@ -0,0 +1,280 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SScheduledPriorityQueue.h>
+#include <libstuff/SShardedScheduledPriorityQueue.h>
+#include <libstuff/STimerWheel.h>
+#include <plugins/JobIndex.h>
+#include <test/lib/BedrockTester.h>
+
+// Microbenchmarks. These are excluded from normal test runs, pass `-perf` to run them.
+struct PerfTest : tpunit::TestFixture {
+    PerfTest() : tpunit::TestFixture("Perf",
+                                     TEST(PerfTest::testScheduledPriorityQueue),
+                                     TEST(PerfTest::testTimerWheel),
+                                     TEST(PerfTest::testSData),
+                                     TEST(PerfTest::testJobPriorities)) { }
+
+    // Runs `threadCount` producers and `threadCount` consumers against a queue, each producer pushing `perThread`
+    // items, and returns how long it took for every item to be consumed, in microseconds.
+    template<typename Q>
+    uint64_t runQueue(Q& queue, int threadCount, int perThread) {
+        atomic<int> received(0);
+        uint64_t start = STimeNow();
+        list<thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < perThread; i++) {
+                    queue.push(int(i), i % 5, 0, STimeNow() + 3600 * 1000000ull);
+                }
+            });
+            threads.emplace_back([&]() {
+                while (received.load() < threadCount * perThread) {
+                    try {
+                        queue.get(1000);
+                        received++;
+                    } catch (const typename Q::timeout_error& e) {
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        return STimeNow() - start;
+    }
+
+    void testScheduledPriorityQueue() {
+        const int perThread = 10000;
+        for (int threadCount : {1, 4, 16}) {
+            SScheduledPriorityQueue<int> single;
+            SShardedScheduledPriorityQueue<int> sharded;
+            uint64_t singleUS = runQueue(single, threadCount, perThread);
+            uint64_t shardedUS = runQueue(sharded, threadCount, perThread);
+            cout << "Queue with " << threadCount << " producers/consumers, " << threadCount * perThread
+                 << " items: single lock " << singleUS / 1000 << "ms, sharded " << shardedUS / 1000 << "ms." << endl;
+        }
+    }
+
+    void testTimerWheel() {
+        // Queue up lots of timeouts, and then cancel them all, in the same order as a busy server would: each with a
+        // timeout some way in the future, and cancelled in roughly the order they were added.
+        const int count = 500000;
+        uint64_t now = STimeNow();
+        vector<uint64_t> timeouts;
+        for (int i = 0; i < count; i++) {
+            timeouts.push_back(now + 60'000'000 + SRandom::rand64() % 240'000'000);
+        }
+
+        uint64_t start = STimeNow();
+        multimap<uint64_t, int> timeoutMap;
+        for (int i = 0; i < count; i++) {
+            timeoutMap.emplace(timeouts[i], i);
+        }
+        for (int i = 0; i < count; i++) {
+            // The existing code has to search for the entry with `equal_range`.
+            auto range = timeoutMap.equal_range(timeouts[i]);
+            for (auto it = range.first; it != range.second; it++) {
+                if (it->second == i) {
+                    timeoutMap.erase(it);
+                    break;
+                }
+            }
+        }
+        uint64_t mapUS = STimeNow() - start;
+
+        start = STimeNow();
+        STimerWheel<int> wheel;
+        vector<STimerWheel<int>::ID> ids;
+        for (int i = 0; i < count; i++) {
+            ids.push_back(wheel.insert(timeouts[i], i));
+        }
+        for (int i = 0; i < count; i++) {
+            wheel.cancel(ids[i]);
+        }
+        uint64_t wheelUS = STimeNow() - start;
+        cout << count << " timeouts inserted and cancelled: multimap " << mapUS / 1000 << "ms, timer wheel "
+             << wheelUS / 1000 << "ms." << endl;
+        ASSERT_TRUE(timeoutMap.empty());
+        ASSERT_TRUE(wheel.empty());
+    }
+
+    // Fills a table from a parsed request as `SParseHTTP` does, looks up the headers a command typically reads, and
+    // iterates over it as `SComposeHTTP` does. Returns a checksum so none of it can be optimized away.
+    template<typename T>
+    size_t useTable(const SHTTPView& view, const vector<string>& lookups) {
+        T table;
+        for (const SHTTPView::Header& header : view.headers) {
+            table[header.first.to_string()] = header.second.to_string();
+        }
+        size_t result = 0;
+        for (const string& name : lookups) {
+            auto it = table.find(name);
+            if (it != table.end()) {
+                result += it->second.size();
+            }
+        }
+        for (const auto& entry : table) {
+            result += entry.first.size() + entry.second.size();
+        }
+        return result;
+    }
+
+    void testSData() {
+        // A request with a typical number of headers.
+        SData request("GetJobs");
+        request["Connection"] = "wait";
+        request["Content-Length"] = "0";
+        request["authToken"] = "A1B2C3D4E5F6A1B2C3D4E5F6A1B2C3D4E5F6";
+        request["jobName"] = "www-prod/*";
+        request["numResults"] = "10";
+        request["priority"] = "500";
+        request["requestID"] = "abc123";
+        request["logParam"] = "true";
+        request["lastIP"] = "10.0.0.1";
+        request["timeout"] = "60000";
+        request["writeConsistency"] = "ASYNC";
+        request["idempotent"] = "true";
+        const string serialized = request.serialize();
+        const vector<string> lookups = {"requestID", "connection", "jobName", "numResults", "priority", "timeout",
+                                        "mockRequest", "upstreamTimeout", "writeConsistency", "Content-Length"};
+        const int count = 200000;
+
+        uint64_t start = STimeNow();
+        size_t bytes = 0;
+        for (int i = 0; i < count; i++) {
+            SData data;
+            data.deserialize(serialized);
+            bytes += data.serialize().size();
+        }
+        uint64_t sdataUS = STimeNow() - start;
+        ASSERT_EQUAL(bytes, serialized.size() * count);
+        cout << count << " requests deserialized and serialized in " << sdataUS / 1000 << "ms ("
+             << count * 1000000ull / max(sdataUS, (uint64_t)1) << "/s)." << endl;
+
+        // Compare the same header work against the `std::map` that STable replaced.
+        SHTTPView view;
+        view.parse(serialized.c_str(), serialized.size());
+        start = STimeNow();
+        size_t mapResult = 0;
+        for (int i = 0; i < count; i++) {
+            mapResult += useTable<map<string, SString, STableComp>>(view, lookups);
+        }
+        uint64_t mapUS = STimeNow() - start;
+        start = STimeNow();
+        size_t tableResult = 0;
+        for (int i = 0; i < count; i++) {
+            tableResult += useTable<STable>(view, lookups);
+        }
+        uint64_t tableUS = STimeNow() - start;
+        ASSERT_EQUAL(mapResult, tableResult);
+        cout << count << " header tables filled, searched and iterated: std::map " << mapUS / 1000 << "ms, STable "
+             << tableUS / 1000 << "ms." << endl;
+    }
+
+    // Reads the best due job `count` times with `query`, returning how long that took in microseconds, and the jobID
+    // it found.
+    uint64_t timeJobQuery(SQLite& db, const string& query, int count, string& jobID) {
+        uint64_t start = STimeNow();
+        SQResult result;
+        for (int i = 0; i < count; i++) {
+            db.read(query, result);
+        }
+        jobID = result.empty() ? "" : result[0][0];
+        return STimeNow() - start;
+    }
+
+    void testJobPriorities() {
+        // Jobs are spread over several names, a quarter of them are running, and half of the rest aren't due yet. We
+        // compare three priorities (where we can also run the query GetJob used to use, with one subquery per
+        // priority) with a thousand of them.
+        const int jobCount = 200000;
+        const int count = 2000;
+        const string now = SComposeTime("%Y-%m-%d %H:%M:%S", STimeNow());
+        for (int priorities : {3, 1000}) {
+            char filename[] = "br_perf_jobsXXXXXX";
+            close(mkstemp(filename));
+            {
+                SQLite db(filename, 1000000, false, 5000, -1, -1);
+                db.beginTransaction();
+                ASSERT_TRUE(db.write("CREATE TABLE jobs (created TIMESTAMP NOT NULL, "
+                                     "jobID INTEGER NOT NULL PRIMARY KEY, state TEXT NOT NULL, name TEXT NOT NULL, "
+                                     "nextRun TIMESTAMP NOT NULL, "
+                                     "lastRun TIMESTAMP, repeat TEXT NOT NULL, data TEXT NOT NULL, "
+                                     "priority INTEGER NOT NULL DEFAULT 500, parentJobID INTEGER NOT NULL DEFAULT 0, "
+                                     "retryAfter TEXT NOT NULL DEFAULT \"\");"));
+                ASSERT_TRUE(db.write("CREATE INDEX jobsStatePriorityDescNextRunName "
+                                     "ON jobs (state, priority DESC, nextRun, name);"));
+                ASSERT_TRUE(db.write("INSERT INTO jobs (created, jobID, state, name, nextRun, repeat, data, priority) "
+                                     "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " +
+                                         to_string(jobCount) + ") "
+                                     "SELECT " + SQ(now) + ", i, CASE WHEN i % 4 = 0 THEN 'RUNNING' ELSE 'QUEUED' END, "
+                                         "'job' || (i % 10), "
+                                         "CASE WHEN i % 2 THEN DATETIME('2000-01-01', '+' || i || ' seconds') "
+                                             "ELSE '2100-01-01 00:00:00' END, "
+                                         "'', '{}', " +
+                                         (priorities == 3 ? string("(i % 3) * 500") : "(i % 1000) * 7 - 3000") + " "
+                                     "FROM n;"));
+                ASSERT_TRUE(db.prepare());
+                ASSERT_FALSE(db.commit());
+
+                // The query GetJob uses when it can't use the job index.
+                list<string> stateQueries;
+                for (const char* state : {"QUEUED", "RUNQUEUED"}) {
+                    stateQueries.push_back("SELECT * FROM (SELECT jobID, priority, nextRun FROM jobs "
+                                           "WHERE state=" + SQ(state) + " AND " + SQ(now) + ">=nextRun "
+                                           "AND name GLOB 'job*' AND JSON_EXTRACT(data, '$.mockRequest') IS NULL "
+                                           "ORDER BY priority DESC, nextRun ASC LIMIT 1)");
+                }
+                const string query = "SELECT jobID FROM (" + SComposeList(stateQueries, " UNION ALL ") + ") "
+                                     "ORDER BY priority DESC, nextRun ASC, jobID ASC LIMIT 1;";
+                string jobID;
+                uint64_t queryUS = timeJobQuery(db, query, count, jobID);
+                ASSERT_FALSE(jobID.empty());
+                cout << count << " GetJob queries, " << jobCount << " jobs, " << priorities << " priorities: "
+                     << queryUS / 1000 << "ms";
+                uint64_t oldQueryUS = 0;
+                if (priorities == 3) {
+                    list<string> priorityQueries;
+                    for (const char* priority : {"1000", "500", "0"}) {
+                        priorityQueries.push_back("SELECT * FROM (SELECT jobID, priority FROM jobs "
+                                                  "WHERE state IN ('QUEUED', 'RUNQUEUED') AND priority=" +
+                                                      string(priority) + " AND " + SQ(now) + ">=nextRun "
+                                                  "AND name GLOB 'job*' "
+                                                  "AND JSON_EXTRACT(data, '$.mockRequest') IS NULL "
+                                                  "ORDER BY nextRun ASC LIMIT 1)");
+                    }
+                    const string oldQuery = "SELECT jobID FROM (" + SComposeList(priorityQueries, " UNION ALL ") +
+                                            ") ORDER BY priority DESC LIMIT 1;";
+                    string oldJobID;
+                    oldQueryUS = timeJobQuery(db, oldQuery, count, oldJobID);
+                    ASSERT_EQUAL(oldJobID, jobID);
+                    cout << " (one subquery per priority: " << oldQueryUS / 1000 << "ms)";
+                }
+
+                // And the job index, which is what GetJob normally uses.
+                JobIndex index;
+                JobIndex::Changes changes;
+                db.beginTransaction();
+                JobIndex::scan(db, changes);
+                index.stage(db, changes);
+                ASSERT_TRUE(db.prepare());
+                ASSERT_FALSE(db.commit());
+                list<int64_t> jobIDs;
+                uint64_t start = STimeNow();
+                for (int i = 0; i < count; i++) {
+                    index.find({"job*"}, nullptr, false, now, 1, jobIDs);
+                }
+                uint64_t indexUS = STimeNow() - start;
+                ASSERT_EQUAL(jobIDs.size(), 1);
+                ASSERT_EQUAL(SToStr(jobIDs.front()), jobID);
+                cout << ", job index " << indexUS / 1000 << "ms." << endl;
+
+                // The index should never be slower than either query it replaces.
+                ASSERT_LESS_THAN_EQUAL(indexUS, queryUS);
+                if (priorities == 3) {
+                    ASSERT_LESS_THAN_EQUAL(indexUS, oldQueryUS);
+                }
+            }
+            unlink(filename);
+        }
+    }
+} __PerfTest;
@@ -0,0 +1,98 @@
+#include <test/lib/BedrockTester.h>
+
+struct PipeliningTest : tpunit::TestFixture {
+    PipeliningTest()
+        : tpunit::TestFixture("Pipelining",
+                              BEFORE_CLASS(PipeliningTest::setup),
+                              TEST(PipeliningTest::inOrder),
+                              TEST(PipeliningTest::outOfOrder),
+                              AFTER_CLASS(PipeliningTest::tearDown)) { }
+
+    BedrockTester* tester;
+
+    // A query that takes long enough that the queries sent after it finish first.
+    const string slowQuery = "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 2000000) "
+                             "SELECT COUNT(*) FROM c;";
+
+    void setup() { tester = new BedrockTester(_threadID); }
+
+    void tearDown() { delete tester; }
+
+    // Sends all of `requests` in a single write on one connection, and reads the first `count` responses into
+    // `responses`.
+    void sendPipelined(const vector<SData>& requests, size_t count, vector<SData>& responses) {
+        int socket = S_socket(tester->getServerAddr(), true, false, true);
+        ASSERT_TRUE(socket != -1);
+        SSendBuffer sendBuffer;
+        string requestBuffer;
+        for (const SData& request : requests) {
+            requestBuffer += request.serialize();
+        }
+        sendBuffer.append(move(requestBuffer));
+        while (!sendBuffer.empty()) {
+            ASSERT_TRUE(S_sendconsume(socket, sendBuffer));
+        }
+
+        string recvBuffer;
+        uint64_t start = STimeNow();
+        while (responses.size() < count) {
+            SData response;
+            int size = response.deserialize(recvBuffer);
+            if (size) {
+                recvBuffer = recvBuffer.substr(size);
+                responses.push_back(response);
+                continue;
+            }
+            ASSERT_TRUE(STimeNow() < start + 60'000'000);
+            pollfd readSock = {socket, POLLIN, 0};
+            poll(&readSock, 1, 1000);
+            if (readSock.revents & POLLIN) {
+                ASSERT_TRUE(S_recvappend(socket, recvBuffer));
+            }
+        }
+        ::shutdown(socket, SHUT_RDWR);
+        ::close(socket);
+    }
+
+    void inOrder() {
+        // The slow query's response has to come back first, even though the rest finish before it.
+        vector<SData> requests;
+        SData slow("Query");
+        slow["query"] = slowQuery;
+        requests.push_back(slow);
+        for (int i = 0; i < 10; i++) {
+            SData query("Query");
+            query["query"] = "SELECT " + to_string(i) + ";";
+            requests.push_back(query);
+        }
+        vector<SData> responses;
+        sendPipelined(requests, requests.size(), responses);
+        ASSERT_EQUAL(responses.size(), requests.size());
+        ASSERT_TRUE(SStartsWith(responses[0].methodLine, "200"));
+        ASSERT_TRUE(SContains(responses[0].content, "2000000"));
+        for (int i = 0; i < 10; i++) {
+            ASSERT_TRUE(SStartsWith(responses[i + 1].methodLine, "200"));
+            ASSERT_EQUAL(SToInt(responses[i + 1].content), i);
+        }
+    }
+
+    void outOfOrder() {
+        // With `outOfOrderResponse`, the fast query comes back first, and `requestID` says which request it answers.
+        SData slow("Query");
+        slow["query"] = slowQuery;
+        slow["outOfOrderResponse"] = "true";
+        slow["requestID"] = "slow";
+        SData fast("Query");
+        fast["query"] = "SELECT 1;";
+        fast["outOfOrderResponse"] = "true";
+        fast["requestID"] = "fast";
+        vector<SData> responses;
+        sendPipelined({slow, fast}, 2, responses);
+        ASSERT_EQUAL(responses.size(), 2);
+        ASSERT_EQUAL(responses[0]["requestID"], "fast");
+        ASSERT_EQUAL(SToInt(responses[0].content), 1);
+        ASSERT_EQUAL(responses[1]["requestID"], "slow");
+        ASSERT_TRUE(SContains(responses[1].content, "2000000"));
+    }
+
+} __PipeliningTest;
@@ -13,6 +13,14 @@ class SQLiteNodeTester {
     static void updateSyncPeer(SQLiteNode& node) {
         node._updateSyncPeer();
     }
+
+    static void setState(SQLiteNode& node, SQLiteNode::State state) {
+        node._state = state;
+    }
+
+    static void onMESSAGE(SQLiteNode& node, SQLiteNode::Peer* peer, const SData& message) {
+        node._onMESSAGE(peer, message);
+    }
 };
 
 class TestServer : public SQLiteServer {
@@ -28,13 +36,18 @@ class TestServer : public SQLiteServer {
 struct SQLiteNodeTest : tpunit::TestFixture {
     SQLiteNodeTest() : tpunit::TestFixture("SQLiteNode",
                                            AFTER_CLASS(SQLiteNodeTest::teardown),
-                                           TEST(SQLiteNodeTest::testFindSyncPeer)) { }
+                                           TEST(SQLiteNodeTest::testFindSyncPeer),
+                                           TEST(SQLiteNodeTest::testCommitTransactions)) { }
 
-    // Filename for temp DB.
+    // Filenames for temp DBs.
     char filename[17] = "br_sync_dbXXXXXX";
+    char followerFilename[17] = "br_foll_dbXXXXXX";
+    char leaderFilename[17] = "br_lead_dbXXXXXX";
 
     void teardown() {
         unlink(filename);
+        unlink(followerFilename);
+        unlink(leaderFilename);
     }
 
     void testFindSyncPeer() {
@@ -120,4 +133,85 @@ struct SQLiteNodeTest : tpunit::TestFixture {
         ASSERT_EQUAL(SQLiteNodeTester::getSyncPeer(testNode), fastest);
     }
 
+
+    // Commits `query` to `db`, and adds the TRANSACTION entry that leader would put in a COMMIT_TRANSACTIONS batch for
+    // it to `transactions`.
+    void commitOnLeader(SQLite& db, const string& query, vector<SData>& transactions) {
+        SData transaction("TRANSACTION");
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_TRUE(db.writeUnmodified(query));
+        ASSERT_TRUE(db.prepare());
+        transaction["NewCount"] = to_string(db.getCommitCount() + 1);
+        transaction["NewHash"] = db.getUncommittedHash();
+        transaction["ID"] = "ASYNC_" + transaction["NewCount"];
+        transaction.content = query;
+        ASSERT_EQUAL(db.commit(), SQLITE_OK);
+        transactions.push_back(transaction);
+    }
+
+    // Returns a COMMIT_TRANSACTIONS message from leader, claiming to hold `numCommits` of `transactions`.
+    SData commitTransactions(SQLite& leaderDB, const vector<SData>& transactions, size_t numCommits) {
+        SData message("COMMIT_TRANSACTIONS");
+        message["CommitCount"] = to_string(leaderDB.getCommitCount());
+        message["Hash"] = leaderDB.getCommittedHash();
+        message["leaderSendTime"] = to_string(STimeNow());
+        message["NumCommits"] = to_string(numCommits);
+        for (const SData& transaction : transactions) {
+            message.content += transaction.serialize();
+        }
+        return message;
+    }
+
+    void testCommitTransactions() {
+        // A follower, and a separate database to make leader's commits in.
+        close(mkstemp(followerFilename));
+        close(mkstemp(leaderFilename));
+        SQLite db(followerFilename, 1000000, 100, 5000, -1, -1);
+        SQLite leaderDB(leaderFilename, 1000000, 100, 5000, -1, -1);
+        TestServer server("");
+        SQLiteNode testNode(server, db, "test", "localhost:19998", "", 1, 1000000000, "1.0");
+        testNode.addPeer("leader", "leader.fake:15555", STable());
+        SQLiteNode::Peer* leader = testNode.peerList.front();
+        SQLiteNodeTester::setState(testNode, SQLiteNode::FOLLOWING);
+
+        // A whole batch is applied, with each transaction checked along the way.
+        vector<SData> transactions;
+        commitOnLeader(leaderDB, "CREATE TABLE batch (id INTEGER PRIMARY KEY);", transactions);
+        for (int i = 1; i <= 3; i++) {
+            commitOnLeader(leaderDB, "INSERT INTO batch VALUES(" + to_string(i) + ");", transactions);
+        }
+        SQLiteNodeTester::onMESSAGE(testNode, leader, commitTransactions(leaderDB, transactions, 4));
+        ASSERT_EQUAL(db.getCommitCount(), leaderDB.getCommitCount());
+        ASSERT_EQUAL(db.getCommittedHash(), leaderDB.getCommittedHash());
+        ASSERT_EQUAL(db.read("SELECT COUNT(*) FROM batch;"), "3");
+
+        // If the second transaction's hash doesn't match ours, the first one is kept, the second is rolled back, and
+        // the rest aren't looked at.
+        transactions.clear();
+        for (int i = 4; i <= 6; i++) {
+            commitOnLeader(leaderDB, "INSERT INTO batch VALUES(" + to_string(i) + ");", transactions);
+        }
+        uint64_t commitCount = db.getCommitCount();
+        vector<SData> mismatched = transactions;
+        mismatched[1]["NewHash"] = string(40, '0');
+        ASSERT_THROW(SQLiteNodeTester::onMESSAGE(testNode, leader, commitTransactions(leaderDB, mismatched, 3)),
+                     SException);
+        ASSERT_EQUAL(db.getCommitCount(), commitCount + 1);
+        ASSERT_TRUE(db.getUncommittedHash().empty());
+        ASSERT_EQUAL(db.read("SELECT MAX(id) FROM batch;"), "4");
+
+        // A batch holding fewer transactions than its NumCommits is rejected, though the ones it has are applied, as
+        // each of them was checked.
+        ASSERT_THROW(SQLiteNodeTester::onMESSAGE(testNode, leader,
+                                                 commitTransactions(leaderDB, {transactions[1]}, 2)),
+                     SException);
+        ASSERT_EQUAL(db.getCommitCount(), commitCount + 2);
+        ASSERT_EQUAL(db.read("SELECT MAX(id) FROM batch;"), "5");
+
+        // And the rest of it can still be applied afterwards.
+        SQLiteNodeTester::onMESSAGE(testNode, leader, commitTransactions(leaderDB, {transactions[2]}, 1));
+        ASSERT_EQUAL(db.getCommitCount(), leaderDB.getCommitCount());
+        ASSERT_EQUAL(db.getCommittedHash(), leaderDB.getCommittedHash());
+    }
+
 } __SQLiteNodeTest;
@@ -0,0 +1,146 @@
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+#include <test/lib/BedrockTester.h>
+
+struct SQLiteTest : tpunit::TestFixture {
+    SQLiteTest() : tpunit::TestFixture("SQLite",
+                                       BEFORE_CLASS(SQLiteTest::setup),
+                                       AFTER_CLASS(SQLiteTest::teardown),
+                                       TEST(SQLiteTest::testPreparedReadWrite),
+                                       TEST(SQLiteTest::testPreparedStatementCache),
+                                       TEST(SQLiteTest::testPreparedParameterMismatch),
+                                       TEST(SQLiteTest::testColumnarResult),
+                                       TEST(SQLiteTest::testRowCommitListener)) { }
+
+    // Filename for temp DB.
+    char filename[17] = "br_sqlt_dbXXXXXX";
+    SQLite* db = nullptr;
+
+    void setup() {
+        int fd = mkstemp(filename);
+        close(fd);
+        db = new SQLite(filename, 1000000, false, 5000, -1, -1);
+        db->beginTransaction();
+        ASSERT_TRUE(db->write("CREATE TABLE things (id INTEGER PRIMARY KEY, name TEXT);"));
+        ASSERT_TRUE(db->prepare());
+        ASSERT_FALSE(db->commit());
+    }
+
+    void teardown() {
+        delete db;
+        unlink(filename);
+    }
+
+    void testPreparedReadWrite() {
+        db->beginTransaction();
+        ASSERT_TRUE(db->write("INSERT INTO things VALUES (?, ?);", {"1", "it's quoted"}));
+
+        // The journaled query has the parameters expanded inline, so peers can replay it as-is.
+        ASSERT_EQUAL(db->getUncommittedQuery(), "INSERT INTO things VALUES ('1', 'it''s quoted');");
+        ASSERT_TRUE(db->prepare());
+        ASSERT_FALSE(db->commit());
+
+        // Integer columns still match text parameters.
+        SQResult result;
+        ASSERT_TRUE(db->read("SELECT id, name FROM things WHERE id=?;", {"1"}, result));
+        ASSERT_EQUAL(result.size(), 1);
+        ASSERT_EQUAL(result.headers[1], "name");
+        ASSERT_EQUAL(result[0][0], "1");
+        ASSERT_EQUAL(result[0][1], "it's quoted");
+
+        ASSERT_TRUE(db->read("SELECT id, name FROM things WHERE id=?;", {"2"}, result));
+        ASSERT_TRUE(result.empty());
+    }
+
+    void testPreparedStatementCache() {
+        SQResult result;
+        uint64_t hitsBefore = SQLite::statementCacheHits.load();
+        for (int i = 0; i < 5; i++) {
+            ASSERT_TRUE(db->read("SELECT name FROM things WHERE name=? LIMIT 1;", {"it's quoted"}, result));
+            ASSERT_EQUAL(result.size(), 1);
+        }
+        ASSERT_GREATER_THAN_EQUAL(SQLite::statementCacheHits.load() - hitsBefore, 4);
+
+        // Changing the schema drops the cache, and statements still work against the new schema.
+        db->beginTransaction();
+        ASSERT_TRUE(db->write("ALTER TABLE things ADD COLUMN extra TEXT;"));
+        ASSERT_TRUE(db->prepare());
+        ASSERT_FALSE(db->commit());
+        uint64_t missesBefore = SQLite::statementCacheMisses.load();
+        ASSERT_TRUE(db->read("SELECT name FROM things WHERE name=? LIMIT 1;", {"it's quoted"}, result));
+        ASSERT_EQUAL(result.size(), 1);
+        ASSERT_EQUAL(SQLite::statementCacheMisses.load() - missesBefore, 1);
+    }
+
+    void testPreparedParameterMismatch() {
+        SQResult result;
+        ASSERT_FALSE(db->read("SELECT name FROM things WHERE id=? AND name=?;", {"1"}, result));
+        ASSERT_FALSE(db->read("SELECT 1; SELECT 2;", {}, result));
+    }
+
+    void testColumnarResult() {
+        const string query = "SELECT 1 AS i, 2.5 AS f, NULL AS n, 'a \"b\" | c' AS t, '[1,2]' AS j, x'6869' AS b;";
+        SQResult rows;
+        SQColumnarResult columns;
+        ASSERT_TRUE(db->read(query, rows));
+        ASSERT_TRUE(db->read(query, columns));
+
+        // Both representations serialize identically.
+        ASSERT_EQUAL(columns.serializeToJSON(), rows.serializeToJSON());
+        ASSERT_EQUAL(columns.serializeToText(), rows.serializeToText());
+
+        // Cells keep their types.
+        ASSERT_EQUAL(columns.size(), 1);
+        ASSERT_EQUAL(columns.columnCount(), 6);
+        ASSERT_EQUAL(columns.type(0, 0), SQColumnarResult::INTEGER);
+        ASSERT_EQUAL(columns.getInt64(0, 0), 1);
+        ASSERT_EQUAL(columns.type(0, 1), SQColumnarResult::FLOAT);
+        ASSERT_EQUAL(columns.getDouble(0, 1), 2.5);
+        ASSERT_TRUE(columns.isNull(0, 2));
+        ASSERT_EQUAL(columns.text(0, 3), "a \"b\" | c");
+        ASSERT_EQUAL(columns.type(0, 5), SQColumnarResult::BLOB);
+        ASSERT_EQUAL(columns.text(0, 5), "hi");
+
+        // And round-trip through JSON and the SQResult adapter.
+        SQColumnarResult deserialized;
+        ASSERT_TRUE(deserialized.deserialize(columns.serializeToJSON()));
+        ASSERT_EQUAL(deserialized.toSQResult().serializeToJSON(), rows.serializeToJSON());
+        ASSERT_EQUAL(SQColumnarResult(rows).serializeToText(), rows.serializeToText());
+    }
+
+    // What the row commit listener was last called with. These are members, as the listener outlives the test.
+    uint64_t committedCount = 0;
+    set<int64_t> committedRows;
+    bool rowsKnown = false;
+
+    void testRowCommitListener() {
+        db->addRowCommitListener("things", [this](uint64_t commitCount, const set<int64_t>* rowIDs) {
+            committedCount = commitCount;
+            rowsKnown = rowIDs;
+            if (rowIDs) {
+                committedRows = *rowIDs;
+            }
+        });
+
+        db->beginTransaction();
+        ASSERT_EQUAL(db->getBeginCommitCount(), db->getCommitCount());
+        ASSERT_TRUE(db->write("INSERT INTO things (id, name) VALUES (10, 'ten');"));
+        ASSERT_TRUE(db->write("UPDATE things SET name = 'one' WHERE id = 1;"));
+        ASSERT_TRUE(db->prepare());
+
+        // Nothing is reported until the transaction commits.
+        ASSERT_EQUAL(committedCount, 0);
+        ASSERT_FALSE(db->commit());
+        ASSERT_EQUAL(committedCount, db->getCommitCount());
+        ASSERT_TRUE(rowsKnown);
+        ASSERT_EQUAL(committedRows, set<int64_t>({1, 10}));
+
+        // Rolled back transactions aren't reported.
+        uint64_t lastCount = committedCount;
+        db->beginTransaction();
+        ASSERT_TRUE(db->write("DELETE FROM things WHERE id = 10;"));
+        db->rollback();
+        ASSERT_EQUAL(committedCount, lastCount);
+    }
+
+} __SQLiteTest;
@@ -0,0 +1,144 @@
+#include <test/lib/BedrockTester.h>
+
+struct ArchiveJobsTest : tpunit::TestFixture {
+    ArchiveJobsTest()
+        : tpunit::TestFixture("ArchiveJobs",
+                              BEFORE_CLASS(ArchiveJobsTest::setupClass),
+                              TEST(ArchiveJobsTest::archiveFinishedChildren),
+                              TEST(ArchiveJobsTest::deleteArchivedJob),
+                              AFTER(ArchiveJobsTest::tearDown),
+                              AFTER_CLASS(ArchiveJobsTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester(_threadID, {{"-plugins", "Jobs,DB"}, {"-jobs.archive", ""}}, {});}
+
+    // Reset the jobs tables
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM jobs WHERE jobID > 0; DELETE FROM jobsArchive WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    // Waits for up to 10 seconds for there to be `count` archived jobs, and returns whether there are.
+    bool waitForArchive(int count) {
+        for (int i = 0; i < 100; i++) {
+            if (SToInt(tester->readDB("SELECT COUNT(*) FROM jobsArchive;")) == count) {
+                return true;
+            }
+            usleep(100'000);
+        }
+        return false;
+    }
+
+    // Creates a parent with one finished and one cancelled child, and returns the IDs of all three.
+    void createFinishedFamily(string& parentID, string& finishedChildID, string& cancelledChildID) {
+        SData command("CreateJob");
+        command["name"] = "parent";
+        parentID = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "parent";
+        tester->executeWaitVerifyContent(command);
+
+        command.clear();
+        command.methodLine = "CreateJob";
+        command["name"] = "child_finished";
+        command["data"] = "{\"foo\":\"bar\"}";
+        command["parentJobID"] = parentID;
+        finishedChildID = tester->executeWaitVerifyContentTable(command)["jobID"];
+        command["name"] = "child_cancelled";
+        command["data"] = "{\"baz\":\"foo\"}";
+        cancelledChildID = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        // Finishing the parent pauses it and queues its children.
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = parentID;
+        tester->executeWaitVerifyContent(command);
+
+        command.clear();
+        command.methodLine = "CancelJob";
+        command["jobID"] = cancelledChildID;
+        tester->executeWaitVerifyContent(command);
+
+        // The parent may have other children from mock requests, delete them.
+        command.clear();
+        command.methodLine = "Query";
+        command["Query"] = "DELETE FROM jobs "
+                           "WHERE parentJobID = " + parentID + " AND JSON_EXTRACT(data, '$.mockRequest') IS NOT NULL;";
+        tester->executeWaitVerifyContent(command);
+
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "child_finished";
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = finishedChildID;
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void archiveFinishedChildren() {
+        string parentID, finishedChildID, cancelledChildID;
+        createFinishedFamily(parentID, finishedChildID, cancelledChildID);
+
+        // Both children get moved out of the jobs table.
+        ASSERT_TRUE(waitForArchive(2));
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE parentJobID = " + parentID + ";"), "0");
+
+        // They can still be queried.
+        SData command("QueryJob");
+        command["jobID"] = finishedChildID;
+        STable response = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(response["state"], "FINISHED");
+        ASSERT_EQUAL(response["name"], "child_finished");
+        ASSERT_EQUAL(response["data"], "{\"foo\":\"bar\"}");
+
+        // Cancelling a job that's already been archived does nothing.
+        command.clear();
+        command.methodLine = "CancelJob";
+        command["jobID"] = cancelledChildID;
+        tester->executeWaitVerifyContent(command);
+
+        // The parent still gets its children's results.
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "parent";
+        response = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(response["jobID"], parentID);
+        list<string> finishedChildJobs = SParseJSONArray(response["finishedChildJobs"]);
+        ASSERT_EQUAL(finishedChildJobs.size(), 1);
+        ASSERT_EQUAL(SParseJSONObject(finishedChildJobs.front())["jobID"], finishedChildID);
+        list<string> cancelledChildJobs = SParseJSONArray(response["cancelledChildJobs"]);
+        ASSERT_EQUAL(cancelledChildJobs.size(), 1);
+        ASSERT_EQUAL(SParseJSONObject(cancelledChildJobs.front())["jobID"], cancelledChildID);
+
+        // And when the parent finishes, its archived children are deleted along with it.
+        command.clear();
+        command.methodLine = "FinishJob";
+        command["jobID"] = parentID;
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobsArchive;"), "0");
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs WHERE jobID = " + parentID + ";"), "0");
+    }
+
+    void deleteArchivedJob() {
+        string parentID, finishedChildID, cancelledChildID;
+        createFinishedFamily(parentID, finishedChildID, cancelledChildID);
+        ASSERT_TRUE(waitForArchive(2));
+
+        SData command("DeleteJob");
+        command["jobID"] = finishedChildID;
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(tester->readDB("SELECT jobID FROM jobsArchive;"), cancelledChildID);
+
+        command.clear();
+        command.methodLine = "QueryJob";
+        command["jobID"] = finishedChildID;
+        tester->executeWaitVerifyContent(command, "404 No job with this jobID");
+    }
+} __ArchiveJobsTest;
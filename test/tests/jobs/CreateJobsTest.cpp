@@ -9,6 +9,9 @@ struct CreateJobsTest : tpunit::TestFixture {
                               TEST(CreateJobsTest::createWithInvalidJson),
                               TEST(CreateJobsTest::createWithParentIDNotRunning),
                               TEST(CreateJobsTest::createWithParentMocked),
+                              TEST(CreateJobsTest::createMany),
+                              TEST(CreateJobsTest::createUnique),
+                              TEST(CreateJobsTest::createUniqueChangedInSameCommand),
                               AFTER(CreateJobsTest::tearDown),
                               AFTER_CLASS(CreateJobsTest::tearDownClass)) { }
 
@@ -193,4 +196,102 @@ struct CreateJobsTest : tpunit::TestFixture {
 
         ASSERT_EQUAL(result.rows.size(), 0);
     }
+
+    // Enough jobs to need several inserts.
+    void createMany() {
+        vector<string> jobs;
+        for (int i = 0; i < 1234; i++) {
+            STable job;
+            job["name"] = "createMany" + to_string(i % 7);
+            job["jobPriority"] = to_string(i);
+            jobs.push_back(SComposeJSONObject(job));
+        }
+        SData command("CreateJobs");
+        command["jobs"] = SComposeJSONArray(jobs);
+        list<string> jobIDList = SParseJSONArray(tester->executeWaitVerifyContentTable(command)["jobIDs"]);
+        ASSERT_EQUAL(jobIDList.size(), jobs.size());
+        ASSERT_EQUAL(set<string>(jobIDList.begin(), jobIDList.end()).size(), jobs.size());
+
+        // Each job got its own row, in the order they were passed.
+        SQResult result;
+        tester->readDB("SELECT jobID, priority FROM jobs WHERE name GLOB 'createMany*';", result);
+        ASSERT_EQUAL(result.size(), jobs.size());
+        map<string, string> priorities;
+        for (const auto& row : result.rows) {
+            priorities[row[0]] = row[1];
+        }
+        int i = 0;
+        for (const string& jobID : jobIDList) {
+            ASSERT_EQUAL(priorities[jobID], to_string(i++));
+        }
+    }
+
+    // Unique jobs reuse jobs that already exist, including those created earlier in the same command.
+    void createUnique() {
+        SData command("CreateJob");
+        command["name"] = "existing";
+        command["data"] = "{\"a\":1}";
+        string existingID = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        vector<pair<string, string>> namesAndData = {
+            {"existing", "{\"a\":1}"},
+            {"new", "{}"},
+            {"new", ""},
+            {"existing", "{\"b\":2}"},
+        };
+        vector<string> jobs;
+        for (const auto& nameAndData : namesAndData) {
+            STable job;
+            job["name"] = nameAndData.first;
+            job["unique"] = "true";
+            if (!nameAndData.second.empty()) {
+                job["data"] = nameAndData.second;
+            }
+            jobs.push_back(SComposeJSONObject(job));
+        }
+        command.clear();
+        command.methodLine = "CreateJobs";
+        command["jobs"] = SComposeJSONArray(jobs);
+        vector<string> jobIDs;
+        for (const string& jobID : SParseJSONArray(tester->executeWaitVerifyContentTable(command)["jobIDs"])) {
+            jobIDs.push_back(jobID);
+        }
+        ASSERT_EQUAL(jobIDs.size(), 4);
+        ASSERT_EQUAL(jobIDs[0], existingID);
+        ASSERT_NOT_EQUAL(jobIDs[1], existingID);
+        ASSERT_EQUAL(jobIDs[2], jobIDs[1]);
+        ASSERT_EQUAL(jobIDs[3], existingID);
+
+        // The last one updated the existing job's data.
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM jobs;"), "2");
+        ASSERT_EQUAL(tester->readDB("SELECT data FROM jobs WHERE jobID = " + existingID + ";"), "{\"a\":1,\"b\":2}");
+    }
+
+    // A unique job created earlier in the same command can be changed by a later one with different data.
+    void createUniqueChangedInSameCommand() {
+        vector<string> jobs;
+        for (const auto& dataAndPriority : vector<pair<string, string>>{{"{\"a\":1}", "500"},
+                                                                        {"{\"b\":2}", "1000"},
+                                                                        {"{\"a\":1,\"b\":2}", "1000"}}) {
+            STable job;
+            job["name"] = "sameCommand";
+            job["unique"] = "true";
+            job["data"] = dataAndPriority.first;
+            job["jobPriority"] = dataAndPriority.second;
+            jobs.push_back(SComposeJSONObject(job));
+        }
+        SData command("CreateJobs");
+        command["jobs"] = SComposeJSONArray(jobs);
+        list<string> jobIDs = SParseJSONArray(tester->executeWaitVerifyContentTable(command)["jobIDs"]);
+        ASSERT_EQUAL(jobIDs.size(), 3);
+        ASSERT_EQUAL(set<string>(jobIDs.begin(), jobIDs.end()).size(), 1);
+
+        // The second job's changes were made to the first, and the third found them there, so changed nothing.
+        SQResult result;
+        tester->readDB("SELECT jobID, data, priority FROM jobs WHERE name = 'sameCommand';", result);
+        ASSERT_EQUAL(result.size(), 1);
+        ASSERT_EQUAL(result[0][0], jobIDs.front());
+        ASSERT_EQUAL(result[0][1], "{\"a\":1,\"b\":2}");
+        ASSERT_EQUAL(result[0][2], "1000");
+    }
 } __CreateJobsTest;
@@ -0,0 +1,180 @@
+#include <test/lib/BedrockTester.h>
+#include <test/tests/jobs/JobTestHelper.h>
+
+struct FinishJobsTest : tpunit::TestFixture {
+    FinishJobsTest()
+        : tpunit::TestFixture("FinishJobs",
+                              BEFORE_CLASS(FinishJobsTest::setupClass),
+                              TEST(FinishJobsTest::finishMany),
+                              TEST(FinishJobsTest::retryMany),
+                              TEST(FinishJobsTest::failMany),
+                              TEST(FinishJobsTest::finishSiblings),
+                              AFTER(FinishJobsTest::tearDown),
+                              AFTER_CLASS(FinishJobsTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    void setupClass() { tester = new BedrockTester(_threadID, {{"-plugins", "Jobs,DB"}}, {});}
+
+    // Reset the jobs table
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM jobs WHERE jobID > 0;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    // Creates a job with the given name and repeat, and returns its ID.
+    string createJob(const string& name, const string& repeat = "") {
+        SData command("CreateJob");
+        command["name"] = name;
+        if (!repeat.empty()) {
+            command["repeat"] = repeat;
+        }
+        return tester->executeWaitVerifyContentTable(command)["jobID"];
+    }
+
+    // Dequeues `count` jobs with the given name.
+    void getJobs(const string& name, size_t count) {
+        SData command("GetJobs");
+        command["name"] = name;
+        command["numResults"] = to_string(count);
+        STable response = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(SParseJSONArray(response["jobs"]).size(), count);
+    }
+
+    // Sends `verb` with one job object per entry in `jobs`, and returns the result for each job, in order.
+    vector<string> sendBatch(const string& verb, const list<map<string, string>>& jobs) {
+        list<string> jsonJobs;
+        for (const auto& job : jobs) {
+            STable jobObject;
+            for (const auto& field : job) {
+                jobObject[field.first] = field.second;
+            }
+            jsonJobs.push_back(SComposeJSONObject(jobObject));
+        }
+        SData command(verb);
+        command["jobs"] = SComposeJSONArray(jsonJobs);
+        STable response = tester->executeWaitVerifyContentTable(command);
+        vector<string> results;
+        for (const string& result : SParseJSONArray(response["results"])) {
+            results.push_back(SParseJSONObject(result)["result"]);
+        }
+        return results;
+    }
+
+    void finishMany() {
+        string jobID1 = createJob("job");
+        string jobID2 = createJob("job");
+        string repeatingJobID = createJob("job", "STARTED, +1 HOUR");
+        getJobs("job", 3);
+
+        // Jobs that don't exist are reported, but don't stop the others from finishing.
+        vector<string> results = sendBatch("FinishJobs", {{{"jobID", jobID1}}, {{"jobID", "1"}},
+                                                          {{"jobID", jobID2}}, {{"jobID", repeatingJobID}}});
+        ASSERT_EQUAL(results.size(), 4);
+        ASSERT_EQUAL(results[0], "200 OK");
+        ASSERT_EQUAL(results[1], "404 No job with this jobID");
+        ASSERT_EQUAL(results[2], "200 OK");
+        ASSERT_EQUAL(results[3], "200 OK");
+
+        // The plain jobs are deleted, and the repeating one is rescheduled.
+        SQResult result;
+        tester->readDB("SELECT jobID, state, lastRun, nextRun FROM jobs;", result);
+        ASSERT_EQUAL(result.size(), 1);
+        ASSERT_EQUAL(result[0][0], repeatingJobID);
+        ASSERT_EQUAL(result[0][1], "QUEUED");
+        time_t lastRunTime = JobTestHelper::getTimestampForDateTimeString(result[0][2]);
+        time_t nextRunTime = JobTestHelper::getTimestampForDateTimeString(result[0][3]);
+        ASSERT_EQUAL(difftime(nextRunTime, lastRunTime), 3600);
+    }
+
+    void retryMany() {
+        string runningJobID = createJob("job");
+        getJobs("job", 1);
+        string queuedJobID = createJob("job");
+
+        // The job that isn't running is rejected, and its data isn't changed.
+        vector<string> results = sendBatch("RetryJobs", {
+            {{"jobID", runningJobID}, {"delay", "5"}, {"data", "{\"retried\":true}"}, {"name", "newName"}},
+            {{"jobID", queuedJobID}, {"delay", "5"}, {"data", "{\"retried\":true}"}},
+        });
+        ASSERT_EQUAL(results.size(), 2);
+        ASSERT_EQUAL(results[0], "200 OK");
+        ASSERT_EQUAL(results[1], "405 Can only retry/finish RUNNING and RUNQUEUED jobs");
+
+        SQResult result;
+        tester->readDB("SELECT state, name, data, lastRun, nextRun FROM jobs WHERE jobID = " + runningJobID + ";",
+                       result);
+        ASSERT_EQUAL(result[0][0], "QUEUED");
+        ASSERT_EQUAL(result[0][1], "newName");
+        ASSERT_EQUAL(result[0][2], "{\"retried\":true}");
+        time_t lastRunTime = JobTestHelper::getTimestampForDateTimeString(result[0][3]);
+        time_t nextRunTime = JobTestHelper::getTimestampForDateTimeString(result[0][4]);
+        ASSERT_GREATER_THAN_EQUAL(difftime(nextRunTime, lastRunTime), 5);
+
+        tester->readDB("SELECT state, data FROM jobs WHERE jobID = " + queuedJobID + ";", result);
+        ASSERT_EQUAL(result[0][0], "QUEUED");
+        ASSERT_EQUAL(result[0][1], "{}");
+    }
+
+    void failMany() {
+        string jobID1 = createJob("job");
+        string jobID2 = createJob("job");
+        getJobs("job", 2);
+
+        vector<string> results = sendBatch("FailJobs", {{{"jobID", jobID1}, {"data", "{\"error\":1}"}},
+                                                        {{"jobID", jobID2}}});
+        ASSERT_EQUAL(results.size(), 2);
+        ASSERT_EQUAL(results[0], "200 OK");
+        ASSERT_EQUAL(results[1], "200 OK");
+
+        SQResult result;
+        tester->readDB("SELECT jobID, state, data FROM jobs ORDER BY jobID = " + jobID1 + " DESC;", result);
+        ASSERT_EQUAL(result.size(), 2);
+        ASSERT_EQUAL(result[0][1], "FAILED");
+        ASSERT_EQUAL(result[0][2], "{\"error\":1}");
+        ASSERT_EQUAL(result[1][1], "FAILED");
+        ASSERT_EQUAL(result[1][2], "{}");
+
+        // Failing them again is rejected.
+        results = sendBatch("FailJobs", {{{"jobID", jobID1}}});
+        ASSERT_EQUAL(results[0], "405 Can only fail RUNNING or RUNQUEUED jobs");
+    }
+
+    // Finishing all of a parent's children in one batch resumes the parent.
+    void finishSiblings() {
+        string parentID = createJob("parent");
+        getJobs("parent", 1);
+        SData command("CreateJob");
+        command["name"] = "child";
+        command["parentJobID"] = parentID;
+        string childID1 = tester->executeWaitVerifyContentTable(command)["jobID"];
+        string childID2 = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        // Finishing the parent pauses it and queues its children.
+        vector<string> results = sendBatch("FinishJobs", {{{"jobID", parentID}}});
+        ASSERT_EQUAL(results[0], "200 OK");
+        ASSERT_EQUAL(tester->readDB("SELECT state FROM jobs WHERE jobID = " + parentID + ";"), "PAUSED");
+
+        // The parent may have other children from mock requests, delete them.
+        command.clear();
+        command.methodLine = "Query";
+        command["Query"] = "DELETE FROM jobs "
+                           "WHERE parentJobID = " + parentID + " AND JSON_EXTRACT(data, '$.mockRequest') IS NOT NULL;";
+        tester->executeWaitVerifyContent(command);
+
+        getJobs("child", 2);
+        results = sendBatch("FinishJobs", {{{"jobID", childID1}}, {{"jobID", childID2}}});
+        ASSERT_EQUAL(results[0], "200 OK");
+        ASSERT_EQUAL(results[1], "200 OK");
+
+        SQResult result;
+        tester->readDB("SELECT state FROM jobs WHERE parentJobID = " + parentID + ";", result);
+        ASSERT_EQUAL(result.size(), 2);
+        ASSERT_EQUAL(result[0][0], "FINISHED");
+        ASSERT_EQUAL(result[1][0], "FINISHED");
+        ASSERT_EQUAL(tester->readDB("SELECT state FROM jobs WHERE jobID = " + parentID + ";"), "QUEUED");
+    }
+} __FinishJobsTest;
@@ -35,7 +35,12 @@ struct GetJobTest : tpunit::TestFixture {
                               TEST(GetJobTest::testMultipleNames),
                               TEST(GetJobTest::testPriorityParameter),
                               TEST(GetJobTest::testInvalidJobPriority),
+                              TEST(GetJobTest::testArbitraryPriorities),
                               TEST(GetJobTest::testRetryableParentJobs),
+                              TEST(GetJobTest::testJobsChangedByQuery),
+                              TEST(GetJobTest::testGlobOrder),
+                              TEST(GetJobTest::testWaitWokenByCreate),
+                              TEST(GetJobTest::testWaitTimesOut),
                               AFTER(GetJobTest::tearDown),
                               AFTER_CLASS(GetJobTest::tearDownClass)) { }
 
@@ -697,8 +702,54 @@ struct GetJobTest : tpunit::TestFixture {
         SData command("GetJobs");
         command["name"] = "*";
         command["numResults"] = "1";
-        command["jobPriority"] = "111";
+        command["jobPriority"] = "high";
         tester->executeWaitVerifyContent(command, "402 Invalid priority value");
+        command["jobPriority"] = "4294967296";
+        tester->executeWaitVerifyContent(command, "402 Invalid priority value");
+
+        // CreateJob
+        command.clear();
+        command.methodLine = "CreateJob";
+        command["name"] = "job";
+        command["jobPriority"] = "1.5";
+        tester->executeWaitVerifyContent(command, "402 Invalid priority value");
+    }
+
+    // Any integer is a valid priority, and jobs come out highest priority first, whether they're chosen from the
+    // database or the job index.
+    void testArbitraryPriorities() {
+        vector<string> priorities = {"7", "-3", "2000", "501", "8"};
+        vector<string> jobIDs;
+        for (const string& priority : priorities) {
+            SData command("CreateJob");
+            command["name"] = "arbitrary";
+            command["jobPriority"] = priority;
+            jobIDs.push_back(tester->executeWaitVerifyContentTable(command)["jobID"]);
+        }
+
+        // The first one comes from the database, which rebuilds the job index for the rest.
+        vector<size_t> expectedOrder = {2, 3, 4, 0, 1};
+        for (size_t i : expectedOrder) {
+            SData command("GetJob");
+            command["name"] = "arbitrary";
+            ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], jobIDs[i]);
+        }
+
+        // And we can ask for a particular one.
+        SData command("CreateJob");
+        command["name"] = "arbitrary";
+        command["jobPriority"] = "-12345";
+        string jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+        command["jobPriority"] = "12345";
+        tester->executeWaitVerifyContent(command);
+        command.clear();
+        command.methodLine = "GetJobs";
+        command["name"] = "arbitrary";
+        command["numResults"] = "10";
+        command["jobPriority"] = "-12345";
+        list<string> jobs = SParseJSONArray(tester->executeWaitVerifyContentTable(command)["jobs"]);
+        ASSERT_EQUAL(jobs.size(), 1);
+        ASSERT_EQUAL(SParseJSONObject(jobs.front())["jobID"], jobID);
     }
 
     void testRetryableParentJobs() {
@@ -799,5 +850,108 @@ struct GetJobTest : tpunit::TestFixture {
         ASSERT_EQUAL(stoi(parentCount), 0);
     }
 
-} __GetJobTest;
+    // Jobs changed directly in the database, rather than by Jobs commands, should still be found.
+    void testJobsChangedByQuery() {
+        // Create and dequeue a job, so it's RUNNING.
+        SData command("CreateJob");
+        command["name"] = "queried";
+        string jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "queried";
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], jobID);
+        tester->executeWaitVerifyContent(command, "404");
+
+        // Queue it again with a query, and we should get it again.
+        SData query("Query");
+        query["query"] = "UPDATE jobs SET state = 'QUEUED' WHERE jobID = " + jobID + ";";
+        tester->executeWaitVerifyContent(query);
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], jobID);
+
+        // Insert one with a query, and we should get that too.
+        query["query"] = "INSERT INTO jobs (jobID, created, state, name, nextRun, repeat, data) "
+                         "VALUES (1234, " + SCURRENT_TIMESTAMP() + ", 'QUEUED', 'queried', " + SCURRENT_TIMESTAMP() +
+                         ", '', '{}');";
+        tester->executeWaitVerifyContent(query);
+        ASSERT_EQUAL(tester->executeWaitVerifyContentTable(command)["jobID"], "1234");
+    }
+
+    // Dequeues a job, so that the job index is built, and later commands can use it.
+    void warmUpIndex() {
+        SData command("CreateJob");
+        command["name"] = "warmup";
+        tester->executeWaitVerifyContent(command);
+        command.methodLine = "GetJob";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    // Jobs from several names matching a pattern come out by priority, then nextRun, whatever their names.
+    void testGlobOrder() {
+        // Dequeue a job first, so that the rest are chosen from the job index rather than the database.
+        warmUpIndex();
+
+        vector<tuple<string, string, string>> jobs = {
+            {"glob_a", "500", "2000-01-01 00:00:02"},
+            {"glob_b", "1000", "2000-01-01 00:00:03"},
+            {"glob_c", "500", "2000-01-01 00:00:01"},
+            {"glob_a", "0", "2000-01-01 00:00:00"},
+            {"glob_b", "1000", "2100-01-01 00:00:00"},
+            {"other", "1000", "2000-01-01 00:00:00"},
+        };
+        vector<string> jobIDs;
+        for (const auto& job : jobs) {
+            SData command("CreateJob");
+            command["name"] = get<0>(job);
+            command["jobPriority"] = get<1>(job);
+            command["firstRun"] = get<2>(job);
+            jobIDs.push_back(tester->executeWaitVerifyContentTable(command)["jobID"]);
+        }
+
+        // The future job and the one that doesn't match are left out.
+        SData command("GetJobs");
+        command["name"] = "glob_*";
+        command["numResults"] = "10";
+        list<string> results = SParseJSONArray(tester->executeWaitVerifyContentTable(command)["jobs"]);
+        vector<string> resultIDs;
+        for (const string& job : results) {
+            resultIDs.push_back(SParseJSONObject(job)["jobID"]);
+        }
+        ASSERT_EQUAL(resultIDs.size(), 4);
+        ASSERT_EQUAL(resultIDs[0], jobIDs[1]);
+        ASSERT_EQUAL(resultIDs[1], jobIDs[2]);
+        ASSERT_EQUAL(resultIDs[2], jobIDs[0]);
+        ASSERT_EQUAL(resultIDs[3], jobIDs[3]);
+    }
+
+    // A GetJob that's waiting for a job gets it as soon as it's created.
+    void testWaitWokenByCreate() {
+        warmUpIndex();
+        string jobID;
+        thread waiter([&]() {
+            SData command("GetJob");
+            command["name"] = "waited";
+            command["Connection"] = "wait";
+            jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+        });
+
+        // Give it a moment to start waiting, then create the job it's waiting for.
+        sleep(1);
+        SData command("CreateJob");
+        command["name"] = "waited";
+        string createdJobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+        waiter.join();
+        ASSERT_EQUAL(jobID, createdJobID);
+    }
 
+    // A GetJob that's waiting gets a 303 if nothing shows up before its timeout.
+    void testWaitTimesOut() {
+        warmUpIndex();
+        SData command("GetJob");
+        command["name"] = "neverCreated";
+        command["Connection"] = "wait";
+        command["timeout"] = "2000";
+        uint64_t start = STimeNow();
+        tester->executeWaitVerifyContent(command, "303 Timeout");
+        ASSERT_GREATER_THAN(STimeNow() - start, STIME_US_PER_S);
+    }
+} __GetJobTest;